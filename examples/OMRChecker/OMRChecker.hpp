@@ -34,12 +34,23 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Frontend/BruteClangDeclFingerprint.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTTypeTraits.h"
 #include "clang/AST/Attr.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #ifdef LLVM34
@@ -52,9 +63,15 @@
 #include <queue>
 #include <map>
 #include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
 #include <algorithm>
 #include <assert.h>
+#include <errno.h>
 #include <iostream>
+#include <unistd.h>
 
 using namespace llvm;
 using namespace clang;
@@ -108,8 +125,10 @@ using namespace clang;
  *
  * # Design
  *
- * The checker operates in three phases. Each phase is a complete traversal of
- * the AST.
+ * The checker operates in three phases. A single traversal of the AST first
+ * collects every CXXRecordDecl and every method definition outside of system
+ * headers into a worklist; the phases then run over the worklist rather than
+ * traversing the whole translation unit again.
  *
  * ## Phase 1: Extensibility Discovery
  *
@@ -133,6 +152,25 @@ using namespace clang;
  * ## Phase 3: Expression Checking.
  *
  * The third phase checks for implicit this or casts to the wrong types, issuing diagnostics.
+ * Only the bodies of methods of extensible classes are walked, and only those
+ * in project headers and the main file.
+ *
+ * Phases 1 and 2 only ever relate classes connected through their bases, so
+ * they run on each such class hierarchy on its own. When
+ * OMR_CHECK_HIERARCHY_CACHE names a file, the verdicts of phase 2 on each
+ * hierarchy, and the diagnostics issued for it, are kept there by a key
+ * covering every class in the hierarchy; a hierarchy seen by an earlier
+ * translation unit, through the same headers, has them loaded instead of
+ * analyzed again.
+ *
+ * When OMR_CHECK_TIMES names a file, a line giving the wall time of each
+ * phase is appended to it for every translation unit. The benchmark in
+ * benchmark/ reads it.
+ *
+ * Under BruteClang's -brute-dedup-decls, a method is walked once for all the
+ * variants of a file that parse it the same and build the same relations
+ * for its class and the bases of its class; the other variants are handed
+ * the diagnostics it raised.
  *
  * # Known Weaknesses:
  *
@@ -151,12 +189,72 @@ namespace OMRChecker {
 
    static CXXThisExpr* getThisExpr(Expr*);
 
+   /**
+    * OMR_CHECK_TRACE is read once; trace arguments are only evaluated, and
+    * their strings only built, when it is set.
+    */
+   static bool traceEnabled() {
+      static const bool enabled = getenv("OMR_CHECK_TRACE") != NULL;
+      return enabled;
+   }
+
 #define trace(x) \
-   if (getenv("OMR_CHECK_TRACE")) {\
+   if (traceEnabled()) {\
       llvm::errs() << __FUNCTION__ << ":" << __LINE__ << ":  "; \
       llvm::errs() << x << "\n"; \
    }
 
+/**
+ * Declaration collector.
+ *
+ * Traverses the translation unit once, gathering the CXXRecordDecls the
+ * record-level phases analyze and the method definitions the expression-level
+ * phase may walk. Function bodies in system headers are skipped entirely, as
+ * nothing in them can be part of an extensible class.
+ */
+class OMRDeclCollector : public RecursiveASTVisitor<OMRDeclCollector> {
+public:
+   explicit OMRDeclCollector(ASTContext *Context) : SM(Context->getSourceManager()) { }
+
+   bool TraverseDecl(Decl *decl) {
+      if (decl && isa<FunctionDecl>(decl) && isInSystemHeader(decl))
+         return true;
+      return RecursiveASTVisitor<OMRDeclCollector>::TraverseDecl(decl);
+   }
+
+   bool VisitCXXRecordDecl(CXXRecordDecl *decl) {
+      Records.push_back(decl);
+      return true;
+   }
+
+   /**
+    * Methods of local classes are walked with the body they are declared in,
+    * so they are not collected on their own.
+    */
+   bool VisitCXXMethodDecl(CXXMethodDecl *decl) {
+      if (decl->doesThisDeclarationHaveABody() && !decl->getParent()->isLocalClass())
+         Methods.push_back(decl);
+      return true;
+   }
+
+   bool isInSystemHeader(const Decl *decl) {
+      return SM.isInSystemHeader(SM.getExpansionLoc(decl->getLocation()));
+   }
+
+   /**
+    * Every CXXRecordDecl in the translation unit, in traversal order.
+    */
+   std::vector<CXXRecordDecl*> Records;
+
+   /**
+    * Method definitions outside of system headers, in traversal order.
+    */
+   std::vector<CXXMethodDecl*> Methods;
+
+private:
+   SourceManager &SM;
+};
+
 /**
  * Extensible Class discovery visitor.
  *
@@ -184,8 +282,10 @@ public:
     * Determines if a decl, or any decl with the same canonical is extensible
     */
    bool isExtensible(const CXXRecordDecl * declIn) {
+      if (!declIn) return false;
+
       //Check canonical map.
-      std::map<const CXXRecordDecl*, bool>::iterator itr = ExtensibleMap.find(declIn->getCanonicalDecl());
+      llvm::DenseMap<const CXXRecordDecl*, bool>::iterator itr = ExtensibleMap.find(declIn->getCanonicalDecl());
       if (itr != ExtensibleMap.end()) { return itr->second; }
 
       // Check annotations.
@@ -196,34 +296,70 @@ private:
    /**
     * Check a CXXRecordDecl for the extensible attribute
     *
-    * Checks all declarations in the the decl chain.
+    * Checks all declarations in the the decl chain, starting from the most
+    * recent one, so the answer is the same for every redeclaration.
     *
-    * The canonical decl is marked in an extensible map.
+    * The canonical decl is marked in an extensible map either way.
     */
    bool isExtensibleDecl(const CXXRecordDecl *declIn) {
-      const CXXRecordDecl* decl = declIn;
+      const CXXRecordDecl* decl = declIn->getMostRecentDecl();
+      bool extensible = false;
 
-      while (decl) {
+      while (decl && !extensible) {
          for (Decl::attr_iterator A = decl->attr_begin(), E = decl->attr_end(); A != E; ++A) {
             if (isa<AnnotateAttr>(*A)) {
                AnnotateAttr *annotation = dyn_cast<AnnotateAttr>(*A);
                if (annotation->getAnnotation() == "OMR_Extensible") {
-                  ExtensibleMap[decl->getCanonicalDecl()] = true;
-                  return true;
+                  extensible = true;
+                  break;
                }
             }
          }
          decl = decl->getPreviousDecl();
       }
-      return false;
+      ExtensibleMap[declIn->getCanonicalDecl()] = extensible;
+      return extensible;
    }
 
 
    /**
-    *  A map indicating the canoncial decl is extensible.
+    *  A map indicating whether the canoncial decl is extensible.
+    */
+   llvm::DenseMap<const CXXRecordDecl*, bool> ExtensibleMap;
+
+};
+
+/**
+ * Hierarchy error reporter.
+ *
+ * Reports the errors the record-level phases find at the class they are
+ * about. While recording, what is reported is also kept, to be written to
+ * the hierarchy cache with the verdicts of the hierarchy.
+ */
+class HierarchyReporter {
+public:
+   typedef std::vector<std::pair<const CXXRecordDecl*, std::string> > Errors;
+
+   explicit HierarchyReporter(ASTContext *Context) : Context(Context), recording(NULL) { }
+
+   void report(const CXXRecordDecl *decl, const std::string &diagnostic) {
+      DiagnosticsEngine &diagEngine = Context->getDiagnostics();
+      unsigned diagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Error, "%0");
+      diagEngine.Report(decl->getLocation(), diagID) << diagnostic;
+      if (recording)
+         recording->push_back(std::make_pair(decl, diagnostic));
+   }
+
+   /**
+    * Keep what is reported in errors, until called again with NULL.
     */
-   std::map<const CXXRecordDecl*, bool> ExtensibleMap;
+   void record(Errors *errors) {
+      recording = errors;
+   }
 
+private:
+   ASTContext *Context;
+   Errors *recording;
 };
 
 /**
@@ -249,10 +385,11 @@ private:
  */
 class ExtensibleClassCheckingVisitor : public RecursiveASTVisitor<ExtensibleClassCheckingVisitor> {
 public:
-   explicit ExtensibleClassCheckingVisitor(ASTContext *Context, ExtensibleClassDiscoveryVisitor &extensible) :
+   explicit ExtensibleClassCheckingVisitor(ASTContext *Context, ExtensibleClassDiscoveryVisitor &extensible, HierarchyReporter &reporter) :
       currentPass(1),
       passNumber(),
       Extensible(extensible),
+      Reporter(reporter),
       Context(Context)
    { }
 
@@ -304,9 +441,7 @@ private:
          } else {
             if (pass != passNumber[decl]) {
                std::string diagnostic("Extensible classes heirarchy was incorrect, multiple extensible classes deriving from non-extensible class.");
-               DiagnosticsEngine &diagEngine = Context->getDiagnostics();
-               unsigned diagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Error, "%0");
-               diagEngine.Report(decl->getLocation(), diagID) << diagnostic;
+               Reporter.report(decl, diagnostic);
                return false;
             }
          }
@@ -326,9 +461,7 @@ private:
                   return false;
             } else {
                std::string diagnostic("Extensible classes heirarchy was incorrect, multiple extensible class chains in heirarchy.");
-               DiagnosticsEngine &diagEngine = Context->getDiagnostics();
-               unsigned diagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Error, "%0");
-               diagEngine.Report(decl->getLocation(), diagID) << diagnostic;
+               Reporter.report(decl, diagnostic);
                return false;
             }
          }
@@ -344,13 +477,18 @@ private:
    /**
     * Every visited class is passged with the pass number
     */
-   std::map<const CXXRecordDecl*,int> passNumber;
+   llvm::DenseMap<const CXXRecordDecl*,int> passNumber;
 
    /**
     * This visitor has determined the map of extensible classes
     */
    ExtensibleClassDiscoveryVisitor &Extensible;
 
+   /**
+    * Where errors in the hierarchy are reported
+    */
+   HierarchyReporter &Reporter;
+
    /**
     * Context, required for diagnostics
     */
@@ -364,8 +502,9 @@ private:
  */
 class OMRClassCheckingVisitor : public RecursiveASTVisitor<OMRClassCheckingVisitor> {
 public:
-   explicit OMRClassCheckingVisitor(ASTContext *Context, ExtensibleClassDiscoveryVisitor &extensible) :
+   explicit OMRClassCheckingVisitor(ASTContext *Context, ExtensibleClassDiscoveryVisitor &extensible, HierarchyReporter &reporter) :
       Extensible(extensible),
+      Reporter(reporter),
       Context(Context)
    { }
 
@@ -385,7 +524,7 @@ public:
 
    void printRelations() {
       llvm::errs() << "Most Derived Type Map: \n";
-      for (std::map<const CXXRecordDecl*, const CXXRecordDecl*>::iterator I = MostDerivedType.begin(), E= MostDerivedType.end(); I != E; ++I) {
+      for (llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator I = MostDerivedType.begin(), E= MostDerivedType.end(); I != E; ++I) {
          llvm::errs() << "\t\t" << I->first->getQualifiedNameAsString() << " -> " << I->second->getQualifiedNameAsString();
          auto* concrete = getAssociatedConcreteType(I->first);
          llvm::errs() << " => " << (concrete ? concrete->getQualifiedNameAsString() : "<no concrete found>" );
@@ -398,7 +537,7 @@ public:
     * Returns the most derived type for a decl.
     */
    const CXXRecordDecl *mostDerivedType(const CXXRecordDecl *decl) {
-      std::map<const CXXRecordDecl*, const CXXRecordDecl*>::iterator itr = MostDerivedType.find(decl->getCanonicalDecl());
+      llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator itr = MostDerivedType.find(decl->getCanonicalDecl());
       if (itr != MostDerivedType.end()) { return itr->second; }
       return NULL;
    }
@@ -407,6 +546,37 @@ public:
       return MostDerivedType.empty();
    }
 
+   /**
+    * Describe the relations the expressions of a method of decl are checked
+    * against: decl and each of its bases, with its extensibility, most
+    * derived type and concrete type, by name.
+    */
+   std::string describeRelations(const CXXRecordDecl *decl) {
+      std::string description;
+      llvm::SmallPtrSet<const CXXRecordDecl*, 8> seen;
+      llvm::SmallVector<const CXXRecordDecl*, 8> worklist(1, decl->getCanonicalDecl());
+      while (!worklist.empty()) {
+         const CXXRecordDecl *type = worklist.pop_back_val();
+         if (!seen.insert(type).second)
+            continue;
+         llvm::MapVector<CXXRecordDecl*, bool>::iterator I = Types.find(const_cast<CXXRecordDecl*>(type));
+         if (I == Types.end())
+            continue;
+         const CXXRecordDecl *derived = mostDerivedType(type);
+         const CXXRecordDecl *concrete = getAssociatedConcreteType(type);
+         description += type->getQualifiedNameAsString();
+         description += I->second ? " extensible -> " : " -> ";
+         description += derived ? derived->getQualifiedNameAsString() : "";
+         description += " => ";
+         description += concrete ? concrete->getQualifiedNameAsString() : "";
+         description += "\n";
+         for (CXXRecordDecl::base_class_const_iterator BI = type->bases_begin(), BE = type->bases_end(); BI != BE; ++BI)
+            if (const CXXRecordDecl *base_class = BI->getType()->getAsCXXRecordDecl())
+               worklist.push_back(base_class->getCanonicalDecl());
+      }
+      return description;
+   }
+
    /**
     * Once the recursive visitor has completed, this routine analyzes the
     * MostDerivedTypeMap to find errors in the structure of the OMR classes
@@ -414,54 +584,56 @@ public:
    void VerifyTypeStructure() {
       trace("Starting Structure Verification");
 
-      for (std::map<CXXRecordDecl*, bool>::iterator I = Types.begin(), E=Types.end(); I != E; ++I) {
-         CXXRecordDecl * Type        = I->first;
-         bool extensible             = I->second;
-         trace(Type << " " << extensible << " " << getAssociatedConcreteType(Type));
-         if (extensible && !getAssociatedConcreteType(Type)) {
-            trace("xxxx Issue diagnostic because there's no associated concrete type");
-            continue;
-         }
-         if (extensible) {  //Extnsible type .
-            trace("xxxx Verifying " << Type->getQualifiedNameAsString() << " has no non-extensible base classes." );
-            for (CXXRecordDecl::base_class_iterator BI = Type->bases_begin(), BE = Type->bases_end(); BI != BE; ++BI) {
-               CXXRecordDecl * base_class = BI->getType()->getAsCXXRecordDecl();
-               if (base_class
-                   && !isExtensible(base_class) // Ensure extensible parent.
-                   && !isOMRRootType(Type)) {   // OMR Root type can have non-extensible parents.
-                  //Base is not extensible, but an extensible type reaches it, with no concrete class in the middle.
-                  //Issue diagnostic.
-                  std::string diagnostic("OMR_EXTENSIBLE Type ");
-                  diagnostic += Type->getQualifiedNameAsString();
-                  diagnostic += " derives from ";
-                  diagnostic += base_class->getQualifiedNameAsString();
-                  diagnostic += " that is not marked as OMR_EXTENSIBLE.\n";
+      for (llvm::MapVector<CXXRecordDecl*, bool>::iterator I = Types.begin(), E=Types.end(); I != E; ++I)
+         verifyType(I->first);
+   }
 
-                  DiagnosticsEngine &diagEngine = Context->getDiagnostics();
-                  unsigned diagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Error, "%0");
-                  diagEngine.Report(base_class->getLocation(), diagID) << diagnostic;
-               }
+   /**
+    * Verify the structure of one canonical type, which must have been
+    * visited as a complete definition.
+    */
+   void verifyType(CXXRecordDecl *Type) {
+      bool extensible = Types.lookup(Type);
+      trace(Type << " " << extensible << " " << getAssociatedConcreteType(Type));
+      if (extensible && !getAssociatedConcreteType(Type)) {
+         trace("xxxx Issue diagnostic because there's no associated concrete type");
+         return;
+      }
+      if (extensible) {  //Extnsible type .
+         trace("xxxx Verifying " << Type->getQualifiedNameAsString() << " has no non-extensible base classes." );
+         for (CXXRecordDecl::base_class_iterator BI = Type->bases_begin(), BE = Type->bases_end(); BI != BE; ++BI) {
+            CXXRecordDecl * base_class = BI->getType()->getAsCXXRecordDecl();
+            if (base_class
+                && !isExtensible(base_class) // Ensure extensible parent.
+                && !isOMRRootType(Type)) {   // OMR Root type can have non-extensible parents.
+               //Base is not extensible, but an extensible type reaches it, with no concrete class in the middle.
+               //Issue diagnostic.
+               std::string diagnostic("OMR_EXTENSIBLE Type ");
+               diagnostic += Type->getQualifiedNameAsString();
+               diagnostic += " derives from ";
+               diagnostic += base_class->getQualifiedNameAsString();
+               diagnostic += " that is not marked as OMR_EXTENSIBLE.\n";
+
+               Reporter.report(base_class, diagnostic);
             }
-         } else {
-            trace("xxxx Verifying " << Type->getQualifiedNameAsString() << " has no non-extensible base classes." );
-            for (CXXRecordDecl::base_class_iterator BI = Type->bases_begin(), BE = Type->bases_end(); BI != BE; ++BI) {
-               CXXRecordDecl * base_class = BI->getType()->getAsCXXRecordDecl();
-               if (base_class && isExtensible(base_class) && !isOMRConcreteType(base_class)) {
-                  //Base is not extensible, but an extensible type reaches it, with no concrete class in the middle.
-                  //Issue diagnostic.
-                  std::string diagnostic("Type ");
-                  diagnostic += Type->getQualifiedNameAsString();
-                  diagnostic += " derives from ";
-                  diagnostic += base_class->getQualifiedNameAsString();
-                  diagnostic += " that is  marked as OMR_EXTENSIBLE.\n";
-
-                  DiagnosticsEngine &diagEngine = Context->getDiagnostics();
-                  unsigned diagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Error, "%0");
-                  diagEngine.Report(Type->getLocation(), diagID) << diagnostic;
-               }
+         }
+      } else {
+         trace("xxxx Verifying " << Type->getQualifiedNameAsString() << " has no non-extensible base classes." );
+         for (CXXRecordDecl::base_class_iterator BI = Type->bases_begin(), BE = Type->bases_end(); BI != BE; ++BI) {
+            CXXRecordDecl * base_class = BI->getType()->getAsCXXRecordDecl();
+            if (base_class && isExtensible(base_class) && !isOMRConcreteType(base_class)) {
+               //Base is not extensible, but an extensible type reaches it, with no concrete class in the middle.
+               //Issue diagnostic.
+               std::string diagnostic("Type ");
+               diagnostic += Type->getQualifiedNameAsString();
+               diagnostic += " derives from ";
+               diagnostic += base_class->getQualifiedNameAsString();
+               diagnostic += " that is  marked as OMR_EXTENSIBLE.\n";
+
+               Reporter.report(Type, diagnostic);
             }
          }
-      } //each most derived type
+      }
    }
 
    /**
@@ -496,10 +668,48 @@ public:
     * Return the concrete type in the same extensible class string as me, or
     * NULL if it can't be found.
     *
-    * This query only really makes sense for an extensible class.
+    * This query only really makes sense for an extensible class. Answers are
+    * cached until the most derived type map changes.
     */
    const CXXRecordDecl* getAssociatedConcreteType(const CXXRecordDecl* decl) {
+      llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator itr = ConcreteType.find(decl->getCanonicalDecl());
+      if (itr != ConcreteType.end()) { return itr->second; }
 
+      const CXXRecordDecl* concrete = findAssociatedConcreteType(decl);
+      ConcreteType[decl->getCanonicalDecl()] = concrete;
+      return concrete;
+   }
+
+   bool isExtensible(const CXXRecordDecl* decl) {
+      return Extensible.isExtensible(decl);
+   }
+
+   /**
+    * Whether a complete definition of decl was visited.
+    */
+   bool isKnownType(const CXXRecordDecl* decl) {
+      return Types.count(const_cast<CXXRecordDecl*>(decl->getCanonicalDecl()));
+   }
+
+   /**
+    * Restore what an earlier analysis of its hierarchy found for a canonical
+    * type, in place of visiting it.
+    */
+   void restoreType(CXXRecordDecl* decl, bool extensible) {
+      Types[decl] = extensible;
+   }
+
+   void restoreMostDerivedType(const CXXRecordDecl* decl, const CXXRecordDecl* mostDerived) {
+      setMostDerivedType(decl, mostDerived);
+   }
+
+   void restoreConcreteType(const CXXRecordDecl* decl, const CXXRecordDecl* concrete) {
+      ConcreteType[decl] = concrete;
+   }
+
+private:
+
+   const CXXRecordDecl* findAssociatedConcreteType(const CXXRecordDecl* decl) {
       // a concrete type is always part of its own extensible class string.
       if (isOMRConcreteType(decl))
          return decl;
@@ -531,54 +741,48 @@ public:
       return NULL;
    }
 
-   bool isExtensible(const CXXRecordDecl* decl) {
-      return Extensible.isExtensible(decl);
-   }
-
-
-private:
-
    /**
     * Return true iff the inhertiance from MostDerivedType to Type is not
     * broken by a concrete class.
     *
-    *
-    * \FIXME: This could be tighter integrated with getAssociatedConcreteType, reducing complexity.
+    * Answers are memoized by canonical decl pair, so each pair is searched
+    * once however many paths of the hierarchy lead to it.
     */
    bool inSameClassString(const CXXRecordDecl * queryType, const CXXRecordDecl * derivedType, int level = 0) {
-      std::string query_name   = queryType->getQualifiedNameAsString();
-      std::string derived_name = derivedType->getQualifiedNameAsString();
+      queryType   = queryType->getCanonicalDecl();
+      derivedType = derivedType->getCanonicalDecl();
 
-      std::string prefix("");
-      for (int i = 0; i < level; i++) prefix += "\t";
-      trace(prefix << "checking " << derived_name << " reaches  " << query_name);
+      trace(std::string(level, '\t') << "checking " << derivedType->getQualifiedNameAsString() << " reaches  " << queryType->getQualifiedNameAsString());
 
       // If the two decls are the same, then in the same string.
-      if (queryType->getCanonicalDecl() == derivedType->getCanonicalDecl())
+      if (queryType == derivedType)
         return true;
 
+      std::pair<const CXXRecordDecl*, const CXXRecordDecl*> key(queryType, derivedType);
+      llvm::DenseMap<std::pair<const CXXRecordDecl*, const CXXRecordDecl*>, bool>::iterator itr = SameClassString.find(key);
+      if (itr != SameClassString.end()) { return itr->second; }
+
+      // Assume unreachable while searching, which also stops cycles.
+      SameClassString[key] = false;
 
       //Keep searching upwards through all bases.
       // If any base is in the same class string as the query type, then
       // we are as well. This is a reachability problem.
-      trace(prefix << query_name << "\t[ - ]  C = " << derivedType->getQualifiedNameAsString() );
-      for (auto BI = derivedType->bases_begin(), BE = derivedType->bases_end(); BI != BE; ++BI) {
+      bool reached = false;
+      for (auto BI = derivedType->bases_begin(), BE = derivedType->bases_end(); BI != BE && !reached; ++BI) {
          auto* base_class = BI->getType()->getAsCXXRecordDecl();
          if (base_class) {
             if ( isOMRConcreteType(base_class) ) { // Concrete parent terminates search.
-               trace(prefix << "not searching " << base_class->getQualifiedNameAsString() << ", is concrete");
+               trace(std::string(level, '\t') << "not searching " << base_class->getQualifiedNameAsString() << ", is concrete");
             } else {
-               if (inSameClassString(queryType, base_class, level + 1)) {
-                  trace(prefix << query_name <<"\t[ " << level << " ] reached through " << base_class->getQualifiedNameAsString());
-                  return true;
-               } else {
-                  trace(prefix<< query_name <<"\t[ " << level << " ] not reached reached through " << base_class->getQualifiedNameAsString())
-               }
+               reached = inSameClassString(queryType, base_class, level + 1);
+               trace(std::string(level, '\t') << queryType->getQualifiedNameAsString() << "\t[ " << level << " ] " << (reached ? "reached" : "not reached") << " through " << base_class->getQualifiedNameAsString());
             }
          }
       }
 
-      return false;
+      SameClassString[key] = reached;
+      return reached;
    }
 
    /**
@@ -622,52 +826,93 @@ private:
          }
       }
 
+      // Cached concrete types may go through the mappings about to change.
+      ConcreteType.clear();
+
       while (!toProcess.empty()) {
          auto* toUpdate = toProcess.front();
          toProcess.pop();
 
          if (toUpdate != toUpdate->getCanonicalDecl()) trace("Missed cannonicalization")
 
-         if (MostDerivedType.find(toUpdate) != MostDerivedType.end() // Found a most derived type.
-             && MostDerivedType[toUpdate] != decl) {                 // ... and it wasn't this decl
+         llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator itr = MostDerivedType.find(toUpdate);
+         if (itr != MostDerivedType.end()   // Found a most derived type.
+             && itr->second != decl) {      // ... and it wasn't this decl
 
             // Ensure we update everyone who used to think this was most derived
-            auto* oldDerivedType = MostDerivedType[toUpdate];
-            for (auto I = MostDerivedType.begin(), E = MostDerivedType.end(); I != E; ++I) {
-               trace("second == old: " << (I->second == oldDerivedType) );
-               trace("First " << I->first->getQualifiedNameAsString()   << " Concrete: " << isOMRConcreteType(I->first));
-               trace("Second " << I->second->getQualifiedNameAsString() << " Concrete: " << isOMRConcreteType(I->second));
-               if (I->second == oldDerivedType
-                   && !isOMRConcreteType(I->first) ) {
-                  toProcess.push(I->first);
-                  trace("\tQueuing previous most derived for processing " << I->first->getQualifiedNameAsString());
+            auto* oldDerivedType = itr->second;
+            std::vector<const CXXRecordDecl*> &oldDerived = DerivedFrom[oldDerivedType];
+            std::vector<const CXXRecordDecl*> keep;
+            for (auto* derived : oldDerived) {
+               llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator current = MostDerivedType.find(derived);
+               if (current == MostDerivedType.end() || current->second != oldDerivedType)
+                  continue; // Stale, remapped since.
+               if (isOMRConcreteType(derived)) {
+                  keep.push_back(derived);
+               } else {
+                  toProcess.push(derived);
+                  trace("\tQueuing previous most derived for processing " << derived->getQualifiedNameAsString());
                }
             }
+            oldDerived.swap(keep);
 
-            MostDerivedType[toUpdate] = decl;
+            setMostDerivedType(toUpdate, decl);
             trace("\t (X) Updating MDT mapping " << toUpdate->getQualifiedNameAsString() << " -> " << decl->getQualifiedNameAsString());
          } else {
-            MostDerivedType[toUpdate] = decl;
+            setMostDerivedType(toUpdate, decl);
             trace("\t (Y) Updating MDT mapping " << toUpdate->getQualifiedNameAsString() << " -> " << decl->getQualifiedNameAsString());
          }
       }
    }
 
    /**
-    * The list of canonical types
+    * Map a decl to its most derived type, keeping the reverse index up to
+    * date. Entries left behind in the old type's list are skipped as stale.
     */
-   std::map<CXXRecordDecl*, bool> Types;
+   void setMostDerivedType(const CXXRecordDecl* decl, const CXXRecordDecl* mostDerived) {
+      const CXXRecordDecl *&entry = MostDerivedType[decl];
+      if (entry == mostDerived)
+         return;
+      entry = mostDerived;
+      DerivedFrom[mostDerived].push_back(decl);
+   }
+
+   /**
+    * The list of canonical types, in the order they were first visited.
+    */
+   llvm::MapVector<CXXRecordDecl*, bool> Types;
 
    /**
     * The most derived type map.
     */
-   std::map<const CXXRecordDecl*, const CXXRecordDecl*> MostDerivedType;
+   llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*> MostDerivedType;
+
+   /**
+    * The reverse of the most derived type map: the decls each type is, or
+    * was, the most derived type of.
+    */
+   llvm::DenseMap<const CXXRecordDecl*, std::vector<const CXXRecordDecl*> > DerivedFrom;
+
+   /**
+    * Memoized getAssociatedConcreteType answers.
+    */
+   llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*> ConcreteType;
+
+   /**
+    * Memoized inSameClassString answers, keyed by (query, derived).
+    */
+   llvm::DenseMap<std::pair<const CXXRecordDecl*, const CXXRecordDecl*>, bool> SameClassString;
 
    /**
     * This visitor has determined the map of extensible classes
     */
    ExtensibleClassDiscoveryVisitor &Extensible;
 
+   /**
+    * Where errors in the class structure are reported
+    */
+   HierarchyReporter &Reporter;
+
    /**
     * Context, required for diagnostics
     */
@@ -681,7 +926,18 @@ private:
  */
 class OMRThisCheckingVisitor : public RecursiveASTVisitor<OMRThisCheckingVisitor> {
 public:
-   explicit OMRThisCheckingVisitor(ASTContext *Context, OMRClassCheckingVisitor *ClassChecker) : Context(Context), ClassChecker(ClassChecker) {
+   explicit OMRThisCheckingVisitor(ASTContext *Context, OMRClassCheckingVisitor *ClassChecker) : Context(Context), ClassChecker(ClassChecker), lastSeenMethodDecl(NULL) {
+   }
+
+   /**
+    * Walk the body of a method definition, if it belongs to an extensible
+    * class. Calls anywhere else are never diagnosed.
+    */
+   bool checkMethod(CXXMethodDecl* decl) {
+      if (!isExtensible(decl->getParent()))
+         return true;
+      lastSeenMethodDecl = decl;
+      return TraverseStmt(decl->getBody());
    }
 
 
@@ -844,7 +1100,7 @@ public:
          return true;
       } else { 
          trace("isAllowedSelflessCall: false"); 
-         if (getenv("OMR_CHECK_TRACE")) {
+         if (traceEnabled()) {
             llvm::errs() << "isAllowedSelflessCall: calleeDecl            => " << calleeDecl->getQualifiedNameAsString()  << "\n";
             llvm::errs() << "isAllowedSelflessCall: calleeClassDecl       => " << calleeClassDecl->getQualifiedNameAsString()   << "\n";
             llvm::errs() << "isAllowedSelflessCall: calleeMostDerived     => " << calleeMostDerived->getQualifiedNameAsString()   << "\n";
@@ -897,7 +1153,7 @@ public:
       // Most dervied type of the caller 
       callerMostDerived = ClassChecker->mostDerivedType(callerDecl);
      
-      if (getenv("OMR_CHECK_TRACE")) {
+      if (traceEnabled()) {
          llvm::errs() << "computeCallInformation: calleeDecl            => " << calleeDecl->getQualifiedNameAsString()  << "\n";
          llvm::errs() << "computeCallInformation: calleeClassDecl       => " << calleeClassDecl->getQualifiedNameAsString()   << "\n";
          llvm::errs() << "computeCallInformation: calleeMostDerived     => " << calleeMostDerived->getQualifiedNameAsString()   << "\n";
@@ -932,7 +1188,7 @@ public:
       // > For example, in "x.f(5)", this returns the sub-expression "x".
       Expr*             receiver = call->getImplicitObjectArgument()->IgnoreParenImpCasts();
 
-      if (getenv("OMR_CHECK_TRACE")) {
+      if (traceEnabled()) {
          auto bestDynamic = receiver->getBestDynamicClassType(); 
          llvm::errs() << "BestDynamicClassType => ";
          if (bestDynamic) 
@@ -961,7 +1217,7 @@ public:
 
       if (calleeDecl && (methodDecl = dyn_cast<CXXMethodDecl>(calleeDecl))) {
 
-         if (getenv("OMR_CHECK_TRACE")) {
+         if (traceEnabled()) {
             llvm::errs() << "Parent => ";
             llvm::errs() << methodDecl->getParent()->getNameAsString();
             llvm::errs() << "\n";
@@ -985,44 +1241,671 @@ private:
    const CXXMethodDecl* lastSeenMethodDecl;
 };
 
+/**
+ * Append \p line to the file open on \p fd, which was opened with
+ * F_Append. The line goes out in a single write(): the kernel then positions
+ * and writes it as one, so the lines of threads and processes sharing the
+ * file do not interleave. Returns false if the line could not be written
+ * whole.
+ */
+static inline bool appendLine(int fd, StringRef line) {
+   ssize_t written;
+   do {
+      written = ::write(fd, line.data(), line.size());
+   } while (written < 0 && errno == EINTR);
+   return written == (ssize_t)line.size();
+}
+
+/**
+ * Hierarchy cache.
+ *
+ * The verdicts of the class structure analysis on each class hierarchy, kept
+ * across translation units in the file OMR_CHECK_HIERARCHY_CACHE names. The
+ * file holds a line per hierarchy, appended as hierarchies are analyzed, and
+ * may be shared by concurrent compilations: a line that was cut short, or is
+ * otherwise malformed, is ignored when the file is loaded.
+ */
+class OMRHierarchyCache {
+public:
+   struct ClassVerdict {
+      std::string name;
+      bool known;
+      bool extensible;
+      std::string mostDerived;
+      std::string concrete;
+   };
+
+   struct ReportedError {
+      std::string name;
+      unsigned redeclaration;
+      std::string message;
+   };
+
+   struct Verdicts {
+      std::vector<ClassVerdict> classes;
+      std::vector<ReportedError> errors;
+   };
+
+   /**
+    * The cache of this process, or NULL if OMR_CHECK_HIERARCHY_CACHE is not
+    * set. The file is loaded once, and shared by the compiler instances
+    * BruteClang runs on threads.
+    */
+   static OMRHierarchyCache *get() {
+      static OMRHierarchyCache *cache = create();
+      return cache;
+   }
+
+   bool lookup(StringRef key, Verdicts &verdicts) {
+      std::lock_guard<std::mutex> guard(Lock);
+      llvm::StringMap<Verdicts>::iterator itr = Entries.find(key);
+      if (itr == Entries.end())
+         return false;
+      verdicts = itr->second;
+      return true;
+   }
+
+   void store(StringRef key, const Verdicts &verdicts) {
+      SmallString<512> line;
+      line += escape(key);
+      line += "\t" + std::to_string(verdicts.classes.size());
+      for (const ClassVerdict &verdict : verdicts.classes) {
+         line += "\t" + escape(verdict.name);
+         line += "\t" + std::to_string(verdict.known * 2 + verdict.extensible);
+         line += "\t" + escape(verdict.mostDerived);
+         line += "\t" + escape(verdict.concrete);
+      }
+      line += "\t" + std::to_string(verdicts.errors.size());
+      for (const ReportedError &error : verdicts.errors) {
+         line += "\t" + escape(error.name);
+         line += "\t" + std::to_string(error.redeclaration);
+         line += "\t" + escape(error.message);
+      }
+      line += "\n";
+
+      std::lock_guard<std::mutex> guard(Lock);
+      if (!Entries.insert(std::make_pair(key, verdicts)).second)
+         return;
+      // A line cut short is ignored when the file is loaded.
+      if (OutFD >= 0)
+         appendLine(OutFD, line);
+   }
+
+private:
+   static OMRHierarchyCache *create() {
+      const char *path = getenv("OMR_CHECK_HIERARCHY_CACHE");
+      if (!path)
+         return NULL;
+
+      OMRHierarchyCache *cache = new OMRHierarchyCache();
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > buffer = llvm::MemoryBuffer::getFile(path);
+      if (buffer) {
+         StringRef rest = (*buffer)->getBuffer();
+         while (!rest.empty()) {
+            std::pair<StringRef, StringRef> line = rest.split('\n');
+            cache->parse(line.first);
+            rest = line.second;
+         }
+      }
+
+      std::error_code EC = llvm::sys::fs::openFileForWrite(path, cache->OutFD, llvm::sys::fs::F_Append | llvm::sys::fs::F_Text);
+      if (EC) {
+         llvm::errs() << "warning: cannot write hierarchy cache '" << path << "': " << EC.message() << "\n";
+         cache->OutFD = -1;
+      }
+      trace("Loaded " << cache->Entries.size() << " hierarchies from " << path);
+      return cache;
+   }
+
+   void parse(StringRef line) {
+      SmallVector<StringRef, 32> fields;
+      line.split(fields, '\t');
+      Verdicts verdicts;
+      size_t next = 1;
+      unsigned count;
+      if (fields.size() < 2 || fields[next++].getAsInteger(10, count))
+         return;
+      for (unsigned i = 0; i < count; ++i) {
+         unsigned flags;
+         if (fields.size() < next + 4 || fields[next + 1].getAsInteger(10, flags) || flags > 3)
+            return;
+         ClassVerdict verdict;
+         verdict.name = unescape(fields[next]);
+         verdict.known = flags & 2;
+         verdict.extensible = flags & 1;
+         verdict.mostDerived = unescape(fields[next + 2]);
+         verdict.concrete = unescape(fields[next + 3]);
+         verdicts.classes.push_back(verdict);
+         next += 4;
+      }
+      if (fields.size() < next + 1 || fields[next++].getAsInteger(10, count))
+         return;
+      for (unsigned i = 0; i < count; ++i) {
+         ReportedError error;
+         if (fields.size() < next + 3 || fields[next + 1].getAsInteger(10, error.redeclaration))
+            return;
+         error.name = unescape(fields[next]);
+         error.message = unescape(fields[next + 2]);
+         verdicts.errors.push_back(error);
+         next += 3;
+      }
+      if (fields.size() != next)
+         return;
+      Entries[unescape(fields[0])] = verdicts;
+   }
+
+   /**
+    * Fields are separated by tabs and lines by newlines, which messages
+    * contain.
+    */
+   static std::string escape(StringRef field) {
+      std::string escaped;
+      for (char c : field) {
+         if (c == '\\')
+            escaped += "\\\\";
+         else if (c == '\t')
+            escaped += "\\t";
+         else if (c == '\n')
+            escaped += "\\n";
+         else
+            escaped += c;
+      }
+      return escaped;
+   }
+
+   static std::string unescape(StringRef field) {
+      std::string unescaped;
+      for (size_t i = 0; i < field.size(); ++i) {
+         if (field[i] == '\\' && i + 1 < field.size()) {
+            char c = field[++i];
+            unescaped += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+         } else {
+            unescaped += field[i];
+         }
+      }
+      return unescaped;
+   }
+
+   OMRHierarchyCache() : OutFD(-1) { }
+
+   std::mutex Lock;
+   llvm::StringMap<Verdicts> Entries;
+   /* The file, open for appending, or -1. */
+   int OutFD;
+};
+
+/**
+ * Class hierarchy.
+ *
+ * The records of a translation unit connected through their bases. Phases 1
+ * and 2 never relate classes of different hierarchies, so each hierarchy is
+ * analyzed, and cached, on its own.
+ *
+ * The key of a hierarchy covers all of its classes rather than one class at
+ * a time, as the most derived and concrete types of a class depend on the
+ * classes deriving from it. Classes are named by their qualified names, which
+ * are the same in every translation unit declaring them.
+ */
+class OMRHierarchy {
+public:
+   /**
+    * Split records into hierarchies, in the order of their first records.
+    */
+   static void split(const std::vector<CXXRecordDecl*> &records, std::vector<OMRHierarchy> &hierarchies) {
+      llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*> parent;
+      for (CXXRecordDecl *decl : records) {
+         if (!decl->isCompleteDefinition())
+            continue;
+         for (CXXRecordDecl::base_class_iterator BI = decl->bases_begin(), BE = decl->bases_end(); BI != BE; ++BI) {
+            const CXXRecordDecl *base_class = BI->getType()->getAsCXXRecordDecl();
+            if (!base_class)
+               continue;
+            const CXXRecordDecl *root = findRoot(parent, decl->getCanonicalDecl());
+            const CXXRecordDecl *baseRoot = findRoot(parent, base_class->getCanonicalDecl());
+            if (root != baseRoot)
+               parent[root] = baseRoot;
+         }
+      }
+
+      llvm::DenseMap<const CXXRecordDecl*, unsigned> index;
+      for (CXXRecordDecl *decl : records) {
+         const CXXRecordDecl *root = findRoot(parent, decl->getCanonicalDecl());
+         std::pair<llvm::DenseMap<const CXXRecordDecl*, unsigned>::iterator, bool> inserted = index.insert(std::make_pair(root, hierarchies.size()));
+         if (inserted.second)
+            hierarchies.push_back(OMRHierarchy());
+         hierarchies[inserted.first->second].Records.push_back(decl);
+      }
+   }
+
+   /**
+    * Compute the key of the hierarchy.
+    *
+    * Returns false if the hierarchy cannot be cached, as two of its classes
+    * have the same name.
+    */
+   bool computeKey(ASTContext *Context, ExtensibleClassDiscoveryVisitor &extensible) {
+      // Complete definitions first, in the order phase 2 visits them, so
+      // restored types keep that order.
+      for (CXXRecordDecl *decl : Records)
+         if (decl->isCompleteDefinition() && !addClass(Context, decl))
+            return false;
+      for (CXXRecordDecl *decl : Records) {
+         if (!addClass(Context, decl))
+            return false;
+         if (decl->isCompleteDefinition()) {
+            for (CXXRecordDecl::base_class_iterator BI = decl->bases_begin(), BE = decl->bases_end(); BI != BE; ++BI) {
+               CXXRecordDecl *base_class = BI->getType()->getAsCXXRecordDecl();
+               if (base_class && !addClass(Context, base_class))
+                  return false;
+            }
+         }
+      }
+
+      std::string description("OMRChecker hierarchy 1\n");
+      for (CXXRecordDecl *decl : Records) {
+         describeClass(description, decl, extensible);
+         description += " " + std::to_string(redeclarationIndex(decl));
+         if (decl->isCompleteDefinition()) {
+            description += " definition";
+            for (CXXRecordDecl::base_class_iterator BI = decl->bases_begin(), BE = decl->bases_end(); BI != BE; ++BI) {
+               CXXRecordDecl *base_class = BI->getType()->getAsCXXRecordDecl();
+               description += "\t";
+               if (base_class)
+                  describeClass(description, base_class, extensible);
+               else
+                  description += "<dependent>";
+            }
+         }
+         description += "\n";
+      }
+
+      llvm::MD5 hash;
+      hash.update(description);
+      llvm::MD5::MD5Result result;
+      hash.final(result);
+      SmallString<32> digest;
+      llvm::MD5::stringifyResult(result, digest);
+      Key = digest.str();
+      return true;
+   }
+
+   /**
+    * Describe what phase 2 found for the hierarchy, and the errors reported
+    * while it was analyzed.
+    *
+    * Returns false if the verdicts name a class outside of the hierarchy.
+    */
+   bool describe(OMRClassCheckingVisitor &classes, const HierarchyReporter::Errors &errors, OMRHierarchyCache::Verdicts &verdicts) {
+      for (CXXRecordDecl *decl : Classes) {
+         OMRHierarchyCache::ClassVerdict verdict;
+         verdict.name = Names[decl];
+         verdict.known = classes.isKnownType(decl);
+         verdict.extensible = classes.isExtensible(decl);
+         if (!nameOf(classes.mostDerivedType(decl), verdict.mostDerived))
+            return false;
+         if (verdict.known && verdict.extensible && !nameOf(classes.getAssociatedConcreteType(decl), verdict.concrete))
+            return false;
+         verdicts.classes.push_back(verdict);
+      }
+      for (const std::pair<const CXXRecordDecl*, std::string> &error : errors) {
+         OMRHierarchyCache::ReportedError reported;
+         if (!nameOf(error.first, reported.name) || reported.name.empty())
+            return false;
+         reported.redeclaration = redeclarationIndex(error.first);
+         reported.message = error.second;
+         verdicts.errors.push_back(reported);
+      }
+      return true;
+   }
+
+   /**
+    * Restore the verdicts of an earlier analysis into phase 2, and report
+    * again the errors found by it.
+    *
+    * Returns false, having restored nothing, if they do not match the
+    * classes of the hierarchy.
+    */
+   bool restore(const OMRHierarchyCache::Verdicts &verdicts, OMRClassCheckingVisitor &classes, HierarchyReporter &reporter) {
+      std::vector<const CXXRecordDecl*> errorDecls;
+      for (const OMRHierarchyCache::ClassVerdict &verdict : verdicts.classes) {
+         if (!ByName.count(verdict.name)
+             || (!verdict.mostDerived.empty() && !ByName.count(verdict.mostDerived))
+             || (!verdict.concrete.empty() && !ByName.count(verdict.concrete)))
+            return false;
+      }
+      for (const OMRHierarchyCache::ReportedError &error : verdicts.errors) {
+         const CXXRecordDecl *decl = ByName.count(error.name) ? findRedeclaration(ByName[error.name], error.redeclaration) : NULL;
+         if (!decl)
+            return false;
+         errorDecls.push_back(decl);
+      }
+
+      for (const OMRHierarchyCache::ClassVerdict &verdict : verdicts.classes) {
+         CXXRecordDecl *decl = ByName[verdict.name];
+         if (verdict.known)
+            classes.restoreType(decl, verdict.extensible);
+         if (!verdict.mostDerived.empty())
+            classes.restoreMostDerivedType(decl, ByName[verdict.mostDerived]);
+         if (verdict.known && verdict.extensible)
+            classes.restoreConcreteType(decl, verdict.concrete.empty() ? NULL : ByName[verdict.concrete]);
+      }
+      for (size_t i = 0; i < errorDecls.size(); ++i)
+         reporter.report(errorDecls[i], verdicts.errors[i].message);
+      return true;
+   }
+
+   /**
+    * The records of the hierarchy, in traversal order.
+    */
+   std::vector<CXXRecordDecl*> Records;
+
+   std::string Key;
+
+private:
+   static const CXXRecordDecl *findRoot(llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*> &parent, const CXXRecordDecl *decl) {
+      const CXXRecordDecl *root = decl;
+      for (llvm::DenseMap<const CXXRecordDecl*, const CXXRecordDecl*>::iterator itr = parent.find(root); itr != parent.end(); itr = parent.find(root))
+         root = itr->second;
+      while (decl != root) {
+         const CXXRecordDecl *next = parent[decl];
+         parent[decl] = root;
+         decl = next;
+      }
+      return root;
+   }
+
+   static unsigned redeclarationIndex(const CXXRecordDecl *decl) {
+      unsigned index = 0;
+      for (const CXXRecordDecl *previous = decl->getPreviousDecl(); previous; previous = previous->getPreviousDecl())
+         ++index;
+      return index;
+   }
+
+   static const CXXRecordDecl *findRedeclaration(const CXXRecordDecl *decl, unsigned index) {
+      for (const CXXRecordDecl *redecl = decl->getMostRecentDecl(); redecl; redecl = redecl->getPreviousDecl())
+         if (redeclarationIndex(redecl) == index)
+            return redecl;
+      return NULL;
+   }
+
+   /**
+    * Name the canonical decl of decl, unless another class of the hierarchy
+    * already has its name.
+    */
+   bool addClass(ASTContext *Context, CXXRecordDecl *decl) {
+      decl = decl->getCanonicalDecl();
+      if (Names.count(decl))
+         return true;
+      std::string name;
+      llvm::raw_string_ostream OS(name);
+      decl->getNameForDiagnostic(OS, Context->getPrintingPolicy(), true);
+      OS.flush();
+      if (!ByName.insert(std::make_pair(name, decl)).second)
+         return false;
+      Names[decl] = name;
+      Classes.push_back(decl);
+      return true;
+   }
+
+   /**
+    * The name of decl, or the empty name for NULL. Returns false if decl is
+    * not a class of the hierarchy.
+    */
+   bool nameOf(const CXXRecordDecl *decl, std::string &name) {
+      name.clear();
+      if (!decl)
+         return true;
+      llvm::DenseMap<const CXXRecordDecl*, std::string>::iterator itr = Names.find(decl->getCanonicalDecl());
+      if (itr == Names.end())
+         return false;
+      name = itr->second;
+      return true;
+   }
+
+   /**
+    * What the phases ask of a class by itself: its name, whether it is
+    * extensible, and the namespace it is declared in.
+    */
+   void describeClass(std::string &description, const CXXRecordDecl *decl, ExtensibleClassDiscoveryVisitor &extensible) {
+      std::string name;
+      nameOf(decl, name);
+      description += escapeName(name);
+      description += extensible.isExtensible(decl) ? " extensible " : " ";
+      const DeclContext *context = decl->getCanonicalDecl()->getDeclContext();
+      description += context->isNamespace() ? NamespaceDecl::castFromDeclContext(context)->getName().str() : std::string("<none>");
+   }
+
+   /**
+    * Names are separated by tabs and lines by newlines in descriptions.
+    */
+   static std::string escapeName(const std::string &name) {
+      std::string escaped;
+      for (char c : name) {
+         if (c == '\t' || c == '\n' || c == '\\')
+            escaped += '\\';
+         escaped += c;
+      }
+      return escaped;
+   }
+
+   /**
+    * The canonical decls of the classes of the hierarchy, and of their bases,
+    * complete definitions first.
+    */
+   std::vector<CXXRecordDecl*> Classes;
+
+   llvm::StringMap<CXXRecordDecl*> ByName;
+   llvm::DenseMap<const CXXRecordDecl*, std::string> Names;
+};
+
+/**
+ * Phase timer.
+ *
+ * Appends a line per translation unit to the file OMR_CHECK_TIMES names,
+ * giving the wall time of each phase in seconds:
+ *
+ *     {"file": "...", "collect": s, "discovery": s, "hierarchy_cache": s,
+ *      "extensible_chains": s, "class_structure": s, "expressions": s}
+ *
+ * Each line goes out in a single write() to the file opened for appending,
+ * so the compiler instances BruteClang runs on threads, and concurrent
+ * compilations, can share the file.
+ */
+class OMRPhaseTimes {
+public:
+   enum Phase { Collect, Discovery, HierarchyCache, ExtensibleChains, ClassStructure, Expressions, NumPhases };
+
+   OMRPhaseTimes() : seconds() { }
+
+   /**
+    * Whether OMR_CHECK_TIMES names a file that could be opened. Phases are
+    * not timed at all otherwise.
+    */
+   static bool enabled() {
+      return log() >= 0;
+   }
+
+   /**
+    * Add the time from construction to destruction to a phase.
+    */
+   class Scope {
+   public:
+      Scope(OMRPhaseTimes *times, Phase phase) : times(times), phase(phase) {
+         if (times)
+            start = std::chrono::steady_clock::now();
+      }
+
+      ~Scope() {
+         if (times)
+            times->seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+
+   private:
+      OMRPhaseTimes *times;
+      Phase phase;
+      std::chrono::steady_clock::time_point start;
+   };
+
+   void write(StringRef file) {
+      static const char *const names[NumPhases] = {
+         "collect", "discovery", "hierarchy_cache", "extensible_chains", "class_structure", "expressions"
+      };
+      SmallString<256> line;
+      llvm::raw_svector_ostream OS(line);
+      OS << "{\"file\": \"";
+      for (char c : file) {
+         if (c == '"' || c == '\\')
+            OS << '\\';
+         OS << c;
+      }
+      OS << "\"";
+      for (int phase = 0; phase < NumPhases; ++phase)
+         OS << ", \"" << names[phase] << "\": " << llvm::format("%.6f", seconds[phase]);
+      OS << "}\n";
+
+      appendLine(log(), line);
+   }
+
+private:
+   static int log() {
+      static int fd = open();
+      return fd;
+   }
+
+   static int open() {
+      const char *path = getenv("OMR_CHECK_TIMES");
+      if (!path)
+         return -1;
+      int fd;
+      std::error_code EC = llvm::sys::fs::openFileForWrite(path, fd, llvm::sys::fs::F_Append | llvm::sys::fs::F_Text);
+      if (EC) {
+         llvm::errs() << "warning: cannot write phase times '" << path << "': " << EC.message() << "\n";
+         return -1;
+      }
+      return fd;
+   }
+
+   double seconds[NumPhases];
+};
+
 class OMRCheckingConsumer : public ASTConsumer {
 public:
-explicit OMRCheckingConsumer(llvm::StringRef filename) { }
+explicit OMRCheckingConsumer(llvm::StringRef filename, std::shared_ptr<BruteClangDeclFilter> Filter) : Filename(filename), Filter(std::move(Filter)) { }
 
 virtual void HandleTranslationUnit(ASTContext &Context) {
+   if (!OMRPhaseTimes::enabled()) {
+      check(Context, NULL);
+      return;
+   }
+   OMRPhaseTimes times;
+   check(Context, &times);
+   times.write(Filename);
+}
+
+private:
+void check(ASTContext &Context, OMRPhaseTimes *Times) {
+   // Gather the records and method definitions in a single traversal.
+   OMRDeclCollector Collector(&Context);
+   {
+      OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::Collect);
+      Collector.TraverseDecl(Context.getTranslationUnitDecl());
+   }
+
    // Visit the classes, gathering information.
    ExtensibleClassDiscoveryVisitor extVisitor(&Context);
-   if (extVisitor.TraverseDecl(Context.getTranslationUnitDecl())) {
-      ExtensibleClassCheckingVisitor extchkVisitor(&Context, extVisitor);
-      if (extchkVisitor.TraverseDecl(Context.getTranslationUnitDecl())) {
-         OMRClassCheckingVisitor ClassVisitor(&Context, extVisitor);
-         if (ClassVisitor.TraverseDecl(Context.getTranslationUnitDecl())) {
-            // Visit this expressions, printing diagnostics.
-            if (getenv("OMR_CHECK_TRACE_RELATIONS") || getenv("OMR_CHECK_TRACE"))
-               ClassVisitor.printRelations();
-
-            ClassVisitor.VerifyTypeStructure();
-
-            if (ClassVisitor.emptyMap() && !getenv("OMR_CHECK_FORCE_THIS_VISIT"))
-               return;
-
-            OMRThisCheckingVisitor ThisVisitor(&Context, &ClassVisitor);
-            if (!ThisVisitor.TraverseDecl(Context.getTranslationUnitDecl()))
-               {
-               llvm::errs() << "This visitor ended early?\n";
-               }
+   {
+      OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::Discovery);
+      for (CXXRecordDecl *decl : Collector.Records)
+         extVisitor.VisitCXXRecordDecl(decl);
+   }
+
+   // Check each class hierarchy, unless its verdicts are in the cache.
+   HierarchyReporter Reporter(&Context);
+   ExtensibleClassCheckingVisitor extchkVisitor(&Context, extVisitor, Reporter);
+   OMRClassCheckingVisitor ClassVisitor(&Context, extVisitor, Reporter);
+   OMRHierarchyCache *Cache = OMRHierarchyCache::get();
+   std::vector<OMRHierarchy> Hierarchies;
+   OMRHierarchy::split(Collector.Records, Hierarchies);
+   for (OMRHierarchy &hierarchy : Hierarchies) {
+      bool cacheable = false;
+      {
+         OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::HierarchyCache);
+         cacheable = Cache && hierarchy.computeKey(&Context, extVisitor);
+         OMRHierarchyCache::Verdicts verdicts;
+         if (cacheable && Cache->lookup(hierarchy.Key, verdicts) && hierarchy.restore(verdicts, ClassVisitor, Reporter)) {
+            trace("Restored hierarchy " << hierarchy.Key);
+            continue;
          }
       }
+
+      HierarchyReporter::Errors errors;
+      Reporter.record(cacheable ? &errors : NULL);
+      {
+         OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::ExtensibleChains);
+         for (CXXRecordDecl *decl : hierarchy.Records)
+            extchkVisitor.VisitCXXRecordDecl(decl);
+      }
+      {
+         OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::ClassStructure);
+         for (CXXRecordDecl *decl : hierarchy.Records)
+            ClassVisitor.VisitCXXRecordDecl(decl);
+         for (CXXRecordDecl *decl : hierarchy.Records)
+            if (decl->isCompleteDefinition())
+               ClassVisitor.verifyType(decl->getCanonicalDecl());
+      }
+      Reporter.record(NULL);
+
+      OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::HierarchyCache);
+      OMRHierarchyCache::Verdicts verdicts;
+      if (cacheable && hierarchy.describe(ClassVisitor, errors, verdicts))
+         Cache->store(hierarchy.Key, verdicts);
+   }
+
+   // Visit this expressions, printing diagnostics.
+   if (getenv("OMR_CHECK_TRACE_RELATIONS") || traceEnabled())
+      ClassVisitor.printRelations();
+
+   if (ClassVisitor.emptyMap() && !getenv("OMR_CHECK_FORCE_THIS_VISIT"))
+      return;
+
+   // Under BruteClang, skip the methods checked for another variant seeing
+   // the same relations for their class.
+   llvm::DenseMap<const CXXRecordDecl*, std::string> relations;
+
+   OMRPhaseTimes::Scope scope(Times, OMRPhaseTimes::Expressions);
+   OMRThisCheckingVisitor ThisVisitor(&Context, &ClassVisitor);
+   for (CXXMethodDecl *decl : Collector.Methods) {
+      std::unique_ptr<BruteClangDeclFilter::CheckScope> scope;
+      if (Filter) {
+         std::string &context = relations[decl->getParent()->getCanonicalDecl()];
+         if (context.empty())
+            context = "OMRChecker\n" + ClassVisitor.describeRelations(decl->getParent());
+         scope.reset(new BruteClangDeclFilter::CheckScope(*Filter, decl, context));
+         if (!scope->shouldCheck())
+            continue;
+      }
+      if (!ThisVisitor.checkMethod(decl)) {
+         llvm::errs() << "This visitor ended early?\n";
+         break;
+      }
    }
 }
+
+   std::string Filename;
+   std::shared_ptr<BruteClangDeclFilter> Filter;
 };
 
 class CheckingAction : public PluginASTAction {
 protected:
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI, llvm::StringRef filename) override {
-    return llvm::make_unique<OMRCheckingConsumer>(filename);
+    return llvm::make_unique<OMRCheckingConsumer>(filename, CI.getFrontendOpts().DeclFilter);
   }
 
+  /**
+   * The consumer opens a CheckScope around each method it walks.
+   */
+  bool usesDeclCheckScopes() const override { return true; }
+
   /**
    * Required function -- pure virtual in parent
    */
@@ -0,0 +1,270 @@
+#===- generate_corpus.py - Synthetic OMR-style trees -------*- python -*--===#
+#
+#                     The LLVM Compiler Infrastructure
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+#===------------------------------------------------------------------------===#
+#
+# Writes a source tree laid out like OMR's compiler component, for
+# benchmarking OMRChecker and BruteClang's handling of variants:
+#
+#   omr/OMR<Class>.hpp                 root layer, namespace OMR
+#   <platform>/layer<i>/OMR<Class>.hpp one extension layer per platform and i,
+#                                      namespace OMR::<Platform>L<i>
+#   tr/<Class>.hpp                     concrete layer, namespace TR
+#   src/File<f>.cpp                    sources including the concrete headers
+#
+# Every class of a chain is OMR_EXTENSIBLE. The headers of a layer name the
+# connector of the class before including the layer below, as OMR's do, so
+# the class the concrete layer derives from is picked by the order of the
+# -I directories of the platform. Methods of each layer call the methods of
+# the layer below through self(); they are defined in OMR<Class>_inlines.hpp
+# next to each header, which the concrete layer includes once its class is
+# complete.
+#
+# The variants, one per platform, are declared in variants.config and the
+# sources listed in all_files.config; run BruteClang from the output
+# directory.
+#
+#===------------------------------------------------------------------------===#
+
+from __future__ import print_function
+
+import argparse
+import os
+import sys
+
+def platformName(p):
+  return 'p%d' % p
+
+def layerNamespace(platform, layer):
+  if layer == 0:
+    return 'OMR'
+  return 'OMR::%sL%d' % (platform.upper(), layer)
+
+def writeFile(path, lines):
+  directory = os.path.dirname(path)
+  if not os.path.isdir(directory):
+    os.makedirs(directory)
+  with open(path, 'w') as f:
+    f.write('\n'.join(lines) + '\n')
+
+def rootHeader(args, c):
+  name = 'Class%d' % c
+  guard = 'OMR_%s_INCL' % name.upper()
+  connector = 'OMR_%s_CONNECTOR' % name.upper()
+  lines = [
+    '#ifndef %s' % guard,
+    '#define %s' % guard,
+    '',
+    '#ifndef %s' % connector,
+    '#define %s' % connector,
+    'namespace OMR { class %s; }' % name,
+    'namespace OMR { typedef OMR::%s %sConnector; }' % (name, name),
+    '#endif',
+    '',
+    '#include "OMRExtensible.hpp"',
+    '',
+    'namespace TR { class %s; }' % name,
+    '',
+    'namespace OMR {',
+    'class OMR_EXTENSIBLE %s {' % name,
+    'public:',
+    '  TR::%s *self();' % name,
+  ]
+  for k in range(args.methods):
+    lines.append('  int layer0Method%d();' % k)
+  lines += ['};', '}', '', '#endif']
+  return lines
+
+def rootInlines(args, c):
+  name = 'Class%d' % c
+  guard = 'OMR_%s_INLINES_INCL' % name.upper()
+  lines = [
+    '#ifndef %s' % guard,
+    '#define %s' % guard,
+    '',
+    'inline TR::%s *OMR::%s::self() { return static_cast<TR::%s *>(this); }'
+      % (name, name, name),
+  ]
+  for k in range(args.methods):
+    lines.append('inline int OMR::%s::layer0Method%d() { return %d; }'
+                 % (name, k, k))
+  lines += ['', '#endif']
+  return lines
+
+def layerHeader(args, platform, c, layer):
+  name = 'Class%d' % c
+  namespace = layerNamespace(platform, layer)
+  inner = '%sL%d' % (platform.upper(), layer)
+  guard = 'OMR_%s_%s_INCL' % (inner, name.upper())
+  connector = 'OMR_%s_CONNECTOR' % name.upper()
+  if layer == 1:
+    below = '../../omr/OMR%s.hpp' % name
+  else:
+    below = '../layer%d/OMR%s.hpp' % (layer - 1, name)
+  lines = [
+    '#ifndef %s' % guard,
+    '#define %s' % guard,
+    '',
+    '#ifndef %s' % connector,
+    '#define %s' % connector,
+    'namespace OMR { namespace %s { class %s; } }' % (inner, name),
+    'namespace OMR { typedef %s::%s %sConnector; }' % (namespace, name, name),
+    '#endif',
+    '',
+    '#include "%s"' % below,
+    '',
+    'namespace OMR {',
+    'namespace %s {' % inner,
+    'class OMR_EXTENSIBLE %s : public %s::%s {' % (
+      name, layerNamespace(platform, layer - 1), name),
+    'public:',
+  ]
+  for k in range(args.methods):
+    lines.append('  int layer%dMethod%d();' % (layer, k))
+  if hasImplicitThis(args, platform, c, layer):
+    lines.append('  int implicitThis();')
+  lines += ['};', '}', '}', '', '#endif']
+  return lines
+
+def hasImplicitThis(args, platform, c, layer):
+  """The top layer of the first platform calls through an implicit this in
+  every implicit_this-th class, so the variants report different errors."""
+  return (args.implicit_this and platform == platformName(0)
+          and layer == args.layers - 1 and c % args.implicit_this == 0)
+
+def layerInlines(args, platform, c, layer):
+  name = 'Class%d' % c
+  qualified = '%s::%s' % (layerNamespace(platform, layer), name)
+  guard = 'OMR_%sL%d_%s_INLINES_INCL' % (platform.upper(), layer, name.upper())
+  if layer == 1:
+    below = '../../omr/OMR%s_inlines.hpp' % name
+  else:
+    below = '../layer%d/OMR%s_inlines.hpp' % (layer - 1, name)
+  lines = [
+    '#ifndef %s' % guard,
+    '#define %s' % guard,
+    '',
+    '#include "%s"' % below,
+    '',
+  ]
+  for k in range(args.methods):
+    lines.append('inline int %s::layer%dMethod%d() '
+                 '{ return self()->layer%dMethod%d() + 1; }'
+                 % (qualified, layer, k, layer - 1, k))
+  if hasImplicitThis(args, platform, c, layer):
+    lines.append('inline int %s::implicitThis() { return layer%dMethod0(); }'
+                 % (qualified, layer))
+  lines += ['', '#endif']
+  return lines
+
+def concreteHeader(args, c):
+  name = 'Class%d' % c
+  guard = 'TR_%s_INCL' % name.upper()
+  return [
+    '#ifndef %s' % guard,
+    '#define %s' % guard,
+    '',
+    '#include "OMR%s.hpp"' % name,
+    '',
+    'namespace TR {',
+    'class OMR_EXTENSIBLE %s : public OMR::%sConnector {' % (name, name),
+    '};',
+    '}',
+    '',
+    '#include "OMR%s_inlines.hpp"' % name,
+    '',
+    '#endif',
+  ]
+
+def source(args, f):
+  lines = []
+  classes = [(f * 7 + j) % args.classes
+             for j in range(min(args.includes, args.classes))]
+  classes = sorted(set(classes))
+  for c in classes:
+    lines.append('#include "Class%d.hpp"' % c)
+  lines.append('')
+  for c in classes:
+    lines.append('int useFile%dClass%d(TR::Class%d *object) {' % (f, c, c))
+    lines.append('  return object->layer%dMethod0();' % (args.layers - 1))
+    lines.append('}')
+  return lines
+
+def generate(args):
+  out = args.output
+  platforms = [platformName(p) for p in range(args.platforms)]
+
+  writeFile(os.path.join(out, 'omr', 'OMRExtensible.hpp'), [
+    '#ifndef OMR_EXTENSIBLE',
+    '#define OMR_EXTENSIBLE __attribute__((annotate("OMR_Extensible")))',
+    '#endif',
+  ])
+  for c in range(args.classes):
+    writeFile(os.path.join(out, 'omr', 'OMRClass%d.hpp' % c),
+              rootHeader(args, c))
+    writeFile(os.path.join(out, 'omr', 'OMRClass%d_inlines.hpp' % c),
+              rootInlines(args, c))
+    writeFile(os.path.join(out, 'tr', 'Class%d.hpp' % c),
+              concreteHeader(args, c))
+    for platform in platforms:
+      for layer in range(1, args.layers):
+        writeFile(os.path.join(out, platform, 'layer%d' % layer,
+                               'OMRClass%d.hpp' % c),
+                  layerHeader(args, platform, c, layer))
+        writeFile(os.path.join(out, platform, 'layer%d' % layer,
+                               'OMRClass%d_inlines.hpp' % c),
+                  layerInlines(args, platform, c, layer))
+
+  files = []
+  for f in range(args.files):
+    files.append('src/File%d.cpp' % f)
+    writeFile(os.path.join(out, files[-1]), source(args, f))
+  writeFile(os.path.join(out, 'all_files.config'), files)
+
+  config = [
+    '# Generated by generate_corpus.py: %d layers, %d platforms, '
+    '%d classes, %d files.' % (args.layers, args.platforms, args.classes,
+                               args.files),
+    'axis platform ' + ' '.join(platforms),
+  ]
+  for platform in platforms:
+    includes = ['-I%s/layer%d' % (platform, layer)
+                for layer in reversed(range(1, args.layers))]
+    config.append('args platform=%s: -DBENCH_PLATFORM_%s %s -Iomr -Itr'
+                  % (platform, platform.upper(), ' '.join(includes)))
+  config.append('files *: all_files.config')
+  writeFile(os.path.join(out, 'variants.config'), config)
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Write a synthetic OMR-style source tree with BruteClang '
+                'configs for it.')
+  parser.add_argument('output', help='directory to write the tree to')
+  parser.add_argument('--layers', type=int, default=3,
+    help='layers of each class chain below the concrete layer, counting '
+         'the root (default 3)')
+  parser.add_argument('--platforms', type=int, default=4,
+    help='platforms, one variant each (default 4)')
+  parser.add_argument('--classes', type=int, default=20,
+    help='extensible class chains (default 20)')
+  parser.add_argument('--files', type=int, default=20,
+    help='source files (default 20)')
+  parser.add_argument('--includes', type=int, default=8,
+    help='concrete headers each source includes (default 8)')
+  parser.add_argument('--methods', type=int, default=4,
+    help='methods of each class (default 4)')
+  parser.add_argument('--implicit-this', type=int, default=0, metavar='N',
+    help='call through an implicit this in every Nth class on the first '
+         'platform (default 0, never)')
+  args = parser.parse_args()
+  if args.layers < 2 or args.platforms < 1 or args.classes < 1:
+    parser.error('need at least 2 layers, 1 platform and 1 class')
+  generate(args)
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
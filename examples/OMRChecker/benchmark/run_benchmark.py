@@ -0,0 +1,187 @@
+#===- run_benchmark.py - OMRChecker benchmark --------------*- python -*--===#
+#
+#                     The LLVM Compiler Infrastructure
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+#===------------------------------------------------------------------------===#
+#
+# Generates synthetic OMR-style trees of increasing size with
+# generate_corpus.py and runs BruteClang with OMRChecker on each, reporting
+#
+#   * the end-to-end wall time of the BruteClang run,
+#   * the time of the plugin's consumer, summed over the variants, from
+#     -brute-profile,
+#   * the time of each phase of the plugin, summed over the variants, from
+#     OMR_CHECK_TIMES.
+#
+# Each size is run --repeat times and the fastest run is kept. With
+# --output, the results are written as JSON; with --baseline, they are
+# compared with such a file, and the script fails if a time grew by more
+# than --threshold.
+#
+#===------------------------------------------------------------------------===#
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+# name: (layers, platforms, classes, files)
+SIZES = [
+  ('small', (3, 2, 10, 10)),
+  ('medium', (4, 4, 40, 40)),
+  ('large', (5, 8, 100, 100)),
+  # Long extensible class strings, for the hierarchy queries.
+  ('deep', (40, 2, 4, 8)),
+]
+
+PHASES = ['collect', 'discovery', 'hierarchy_cache', 'extensible_chains',
+          'class_structure', 'expressions']
+
+def generate(args, directory, size):
+  layers, platforms, classes, files = size
+  if os.path.isdir(directory):
+    shutil.rmtree(directory)
+  subprocess.check_call([
+    sys.executable,
+    os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                 'generate_corpus.py'),
+    directory,
+    '--layers', str(layers), '--platforms', str(platforms),
+    '--classes', str(classes), '--files', str(files),
+    '--implicit-this', '10'])
+
+def readLines(path):
+  if not os.path.exists(path):
+    return []
+  with open(path) as f:
+    return [json.loads(line) for line in f if line.strip()]
+
+def runOnce(args, directory):
+  profile = os.path.join(directory, 'profile.jsonl')
+  times = os.path.join(directory, 'times.jsonl')
+  for path in (profile, times):
+    if os.path.exists(path):
+      os.remove(path)
+
+  command = [args.clang, '-cc1', '-fsyntax-only',
+             '-load', args.plugin, '-plugin', 'omr-checker',
+             '-brute-batch=all_files.config', '-brute-profile=' + profile]
+  if args.jobs:
+    command.append('-variant-jobs=%d' % args.jobs)
+  command += args.driver_args
+  env = dict(os.environ)
+  env['OMR_CHECK_TIMES'] = times
+
+  with open(os.path.join(directory, 'output.txt'), 'w') as output:
+    start = time.time()
+    # The corpus reports errors on purpose, so the exit code is not checked.
+    subprocess.call(command, cwd=directory, env=env, stdout=output,
+                    stderr=subprocess.STDOUT)
+    result = {'end_to_end': time.time() - start}
+
+  result['plugin'] = sum(
+    record.get('phases', {}).get('consumers', {})
+          .get('omr-checker', {}).get('wall', 0.0)
+    for record in readLines(profile))
+  phases = readLines(times)
+  for phase in PHASES:
+    result[phase] = sum(record.get(phase, 0.0) for record in phases)
+  # A line is written per variant of each file.
+  result['translation_units'] = len(set(record.get('file') for record in phases))
+  result['instances'] = len(phases)
+  return result
+
+def run(args, name, size):
+  directory = os.path.join(args.work, name)
+  generate(args, directory, size)
+  best = None
+  for i in range(args.repeat):
+    result = runOnce(args, directory)
+    if best is None or result['end_to_end'] < best['end_to_end']:
+      best = result
+  best['size'] = dict(zip(['layers', 'platforms', 'classes', 'files'], size))
+  return best
+
+def printResults(results):
+  columns = ['end_to_end', 'plugin'] + PHASES
+  print('%-8s %5s %9s' % ('size', 'TUs', 'instances') +
+        ''.join(' %17s' % column for column in columns))
+  for name, result in results:
+    print('%-8s %5d %9d' % (name, result['translation_units'],
+                            result['instances']) +
+          ''.join(' %17.3f' % result[column] for column in columns))
+
+def compare(args, results):
+  with open(args.baseline) as f:
+    baseline = json.load(f)
+  regressed = False
+  for name, result in results:
+    if name not in baseline:
+      continue
+    for column in ['end_to_end', 'plugin'] + PHASES:
+      before = baseline[name].get(column, 0.0)
+      # Ignore phases too short to time reliably.
+      if before < args.min_time:
+        continue
+      if result[column] > before * args.threshold:
+        print('regression: %s %s took %.3fs, %.3fs in the baseline'
+              % (name, column, result[column], before))
+        regressed = True
+  return regressed
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Benchmark OMRChecker under BruteClang on synthetic trees.')
+  parser.add_argument('--clang', required=True,
+    help='the BruteClang binary')
+  parser.add_argument('--plugin', required=True,
+    help='the OMRChecker plugin library')
+  parser.add_argument('--work', required=True,
+    help='directory to generate the trees in')
+  parser.add_argument('--sizes', default=','.join(name for name, _ in SIZES),
+    help='comma separated sizes to run, of %s (default all)'
+         % ', '.join(name for name, _ in SIZES))
+  parser.add_argument('--repeat', type=int, default=3,
+    help='runs of each size, keeping the fastest (default 3)')
+  parser.add_argument('--jobs', type=int, default=0,
+    help='-variant-jobs to give BruteClang (default its own)')
+  parser.add_argument('--driver-arg', dest='driver_args', action='append',
+    default=[], help='add an argument to the BruteClang command line, '
+                     'e.g. -brute-dedup-decls')
+  parser.add_argument('--output', help='write the results as JSON')
+  parser.add_argument('--baseline',
+    help='compare with the results of an earlier --output')
+  parser.add_argument('--threshold', type=float, default=1.25,
+    help='ratio to the baseline a time may grow by (default 1.25)')
+  parser.add_argument('--min-time', type=float, default=0.05,
+    help='baseline times below this are not compared (default 0.05s)')
+  args = parser.parse_args()
+
+  sizes = dict(SIZES)
+  names = [name for name in args.sizes.split(',') if name]
+  for name in names:
+    if name not in sizes:
+      parser.error('unknown size %s' % name)
+
+  results = []
+  for name in names:
+    results.append((name, run(args, name, sizes[name])))
+  printResults(results)
+
+  if args.output:
+    with open(args.output, 'w') as f:
+      json.dump(dict(results), f, indent=2, sort_keys=True)
+  if args.baseline and compare(args, results):
+    return 1
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -1,42 +1,260 @@
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGDIAGNOSTIC_H
+#define LLVM_CLANG_BASIC_BRUTECLANGDIAGNOSTIC_H
+
 #include "clang/Basic/Diagnostic.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Allocator.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
 
 namespace clang {
     class CustomDiagContainer;
     class CustomDiagConsumer;
+    class CustomDiagFormatter;
 
 
 // ------ Custom Diagnostic Contanier for OMRChecker
+//
+// Each compiler instance (variant) registers itself with AddCompilerInstance
+// before it starts running and gets back an ID. Diagnostics are recorded
+// against that ID, so several compiler instances can report into the same
+// container concurrently. Grouping happens in PrintDiagnostics, walking the
+// compiler instances in registration order, so the output does not depend on
+// the order in which the instances finished.
+//
+// File names and messages are interned when they are reported. A diagnostic
+// is identified by (file, line, column, message), which after interning is a
+// plain tuple of pointers and integers, so grouping is a single hash lookup per
+// reported diagnostic. The ID of the diagnostic is kept along, for the
+// structured output. The compiler instances that reported a diagnostic are
+// kept as a bitset over their IDs; their names are only put together when the
+// diagnostic is printed, once per distinct set of compiler instances.
+//
+// Most diagnostics are not formatted by the compiler instance that reports
+// them: CustomDiagConsumer captures their ID, their arguments and their offset
+// into the file instead, and the container formats the message and computes
+// the line and column once per unique captured diagnostic, when it groups
+// them. A header diagnostic reported by every variant is thus formatted once.
 class CustomDiagContainer{
-    typedef struct DiagData{
-      std::string CI_Names;
-      std::string msg;
-      std::string FileName;
+    //a diagnostic, with FileName and msg pointing into the interned strings.
+    struct DiagKey{
+      const char *FileName;
+      const char *msg;
+      unsigned LineNumber;
+      unsigned ColumnNumber;
+      unsigned DiagID;
+    };
+
+    struct DiagKeyInfo{
+      static DiagKey getEmptyKey();
+      static DiagKey getTombstoneKey();
+      static unsigned getHashValue(const DiagKey &Key);
+      static bool isEqual(const DiagKey &LHS, const DiagKey &RHS);
+    };
+
+    //a diagnostic captured by CustomDiagConsumer before it was formatted or
+    //located: its ID, its arguments as encoded by the consumer and its offset
+    //into FileName. FileName and Args point into the interned strings.
+    struct CapturedKey{
+      const char *FileName;
+      const char *Args;
+      unsigned ArgsSize;
+      unsigned Offset;
+      unsigned DiagID;
+    };
+
+    struct CapturedKeyInfo{
+      static CapturedKey getEmptyKey();
+      static CapturedKey getTombstoneKey();
+      static unsigned getHashValue(const CapturedKey &Key);
+      static bool isEqual(const CapturedKey &LHS, const CapturedKey &RHS);
+    };
+
+    //a unique diagnostic as reported, formatted or captured. A captured one
+    //gets its Key when it is first grouped; see Resolve.
+    struct DiagRecord{
+      DiagKey Key;
+      CapturedKey Captured;
+      bool Resolved;
+      //index into DiagList once grouped, or ~0U
+      unsigned Group;
+      //whether a captured one came with the line and column of Key, its
+      //file being unknown to the container as it was captured from
+      bool Located;
+    };
+
+    //a file captured diagnostics point into
+    struct CapturedFile{
+      //size of the file as the compiler instances saw it
+      unsigned Size;
+      //offset of the start of each line
+      std::vector<unsigned> LineOffsets;
+    };
+
+    struct DiagData{
+      llvm::StringRef msg;
+      llvm::StringRef FileName;
       unsigned LineNumber;
       unsigned ColumnNumber;
-    } DiagData;
+      unsigned DiagID;
+      //bit N is set if compiler instance N reported this diagnostic
+      llvm::SmallBitVector CI_Set;
+    };
   private:
-    std::string CompilerInstanceName;
-    std::list<DiagData> DiagList;
+    //names of the registered compiler instances, indexed by ID
+    std::vector<std::string> CompilerInstanceNames;
 
-    //this function checks if the line number and diag message combination already exists
-    bool DiagExists(std::string &message, unsigned line, std::string &file);
+    //diagnostics as reported by each compiler instance, indexed by ID, as
+    //indices into Records
+    std::vector<std::vector<unsigned>> PendingDiags;
 
-    //if a diagnostic message and line number combination does not already exist, create a new one.
-    void AddNewDiagData(std::string &FileName, unsigned ColumnNumber, unsigned LineNumber, std::string &message);
+    //every unique diagnostic reported, with an index into it for those
+    //reported formatted and for those captured
+    std::vector<DiagRecord> Records;
+    llvm::DenseMap<DiagKey, unsigned, DiagKeyInfo> FormattedIndex;
+    llvm::DenseMap<CapturedKey, unsigned, CapturedKeyInfo> CapturedIndex;
 
-    //if a diagnostic message and line number combination exists, then add to the existing corresponding struct.
-    void AddToExistingDiagData(std::string &message, unsigned line, std::string &file);
+    //the files of the captured diagnostics, by interned name
+    llvm::DenseMap<const char *, CapturedFile> CapturedFiles;
 
+    //formats captured diagnostics, created the first time one is grouped
+    std::unique_ptr<CustomDiagFormatter> Formatter;
+
+    //the compiler instance whose diagnostics each compiler instance reports,
+    //indexed by ID: itself unless it was skipped. See AddEquivalentInstance.
+    std::vector<unsigned> LeaderIDs;
+
+    //every file name and message seen so far
+    llvm::StringSet<llvm::BumpPtrAllocator> InternedStrings;
+
+    //grouped diagnostics in the order they were first reported, filled in by
+    //GroupDiagnostics
+    std::vector<DiagData> DiagList;
+
+    //index into DiagList for each unique diagnostic
+    llvm::DenseMap<DiagKey, unsigned, DiagKeyInfo> DiagIndex;
+
+    //renders a set of compiler instances in place of their names; see
+    //setInstanceSetPrinter
+    std::function<void(const llvm::SmallBitVector &, llvm::raw_ostream &)> InstanceSetPrinter;
+
+    //guards everything above
+    std::mutex Lock;
+
+    //returns a stable copy of Str, shared with every other equal string.
+    llvm::StringRef Intern(llvm::StringRef Str);
+
+    //the key of a record, formatting and locating it if it was captured.
+    const DiagKey &Resolve(DiagRecord &Record);
+
+    //group the pending diagnostics of every compiler instance into DiagList.
+    void GroupDiagnostics();
 
   public:
-    //from cc1_main, this will be used to let the container know what compiler instance this is.
-    void SetCompilerInstanceName(std::string &CI_Name);
+    CustomDiagContainer();
+    ~CustomDiagContainer();
+
+    //a diagnostic as reported by one compiler instance, for handing it on to
+    //another container.
+    struct RecordedDiagnostic{
+      std::string FileName;
+      std::string msg;
+      unsigned LineNumber;
+      unsigned ColumnNumber;
+      //the clang diagnostic ID, or 0 for diagnostics BruteClang reports itself
+      unsigned DiagID;
+    };
+
+    //a diagnostic captured as CustomDiagConsumer captures it, for passing it
+    //on from another compiler instance than the one that reported it.
+    struct CapturedDiagnostic{
+      std::string FileName;
+      //its arguments as encoded by CustomDiagConsumer
+      std::string Args;
+      unsigned Offset;
+      //size of FileName as the capturing compiler instance saw it
+      unsigned FileSize;
+      unsigned LineNumber;
+      unsigned ColumnNumber;
+      unsigned DiagID;
+    };
+
+    //capture Info into Diag, if the container can format and locate it on
+    //its own. Returns false, leaving it to the caller to format it, if not.
+    static bool CaptureDiagnostic(const Diagnostic &Info, CapturedDiagnostic &Diag);
+
+    //from cc1_main, this will be used to let the container know about a
+    //compiler instance before it runs. Returns the ID used to report diagnostics.
+    unsigned AddCompilerInstance(const std::string &CI_Name);
 
     //from HandleDiagnostics, this will be used to pass a new diagnostic to the container.
-    void AddDiagnostic(std::string &FileName, unsigned ColumnNumber, unsigned LineNumber, std::string &message);
+    //Safe to call from several compiler instances at once.
+    void AddDiagnostic(unsigned CI_ID, llvm::StringRef FileName, unsigned ColumnNumber, unsigned LineNumber, llvm::StringRef message, unsigned DiagID = 0);
+
+    //from HandleDiagnostics, to pass a diagnostic that was not formatted yet:
+    //Args are its arguments as encoded by CustomDiagConsumer, and Offset its
+    //location in FileName, whose contents are Text. Returns false, leaving it
+    //to the caller to format it, if Text differs in size from what another
+    //compiler instance saw for FileName.
+    bool AddCapturedDiagnostic(unsigned CI_ID, llvm::StringRef FileName, llvm::StringRef Text, unsigned Offset, unsigned DiagID, llvm::StringRef Args);
+
+    //as above, for a diagnostic captured by CaptureDiagnostic, possibly in
+    //another compiler instance. Usually the instance that captured it
+    //reported it already, and the two are the same record.
+    //Safe to call from several compiler instances at once.
+    void AddCapturedDiagnostic(unsigned CI_ID, const CapturedDiagnostic &Diag);
 
-    //from cc1-main, this will be used for handling 
+    //from cc1_main, this will be used to report that compiler instance CI_ID
+    //was not run because it would have reported exactly what LeaderID
+    //reports. Every diagnostic of LeaderID, reported before or after, is
+    //attributed to CI_ID too.
+    void AddEquivalentInstance(unsigned CI_ID, unsigned LeaderID);
+
+    //from cc1_main, to print the set of compiler instances that reported a
+    //diagnostic some other way than as the list of their names, e.g. as a
+    //pattern over the variant axes. The printer is called once per distinct
+    //set.
+    void setInstanceSetPrinter(std::function<void(const llvm::SmallBitVector &, llvm::raw_ostream &)> Printer);
+
+    //number of unique diagnostics reported so far
+    unsigned getNumDiagnostics();
+
+    //whether every registered compiler instance reported the same
+    //diagnostics so far
+    bool InstancesAgree();
+
+    //the diagnostics compiler instance CI_ID reported so far. Unlike the
+    //other queries, this does not group the pending diagnostics, so it may
+    //be called while other instances are still running without changing
+    //the order the diagnostics are printed in.
+    void GetDiagnostics(unsigned CI_ID, std::vector<RecordedDiagnostic> &Diags);
+
+    //from cc1_main, to hand each grouped diagnostic to a structured output,
+    //in the order PrintDiagnostics prints them, with the set of compiler
+    //instances that reported it.
+    void VisitDiagnostics(llvm::function_ref<void(llvm::StringRef FileName, unsigned LineNumber, unsigned ColumnNumber, unsigned DiagID, llvm::StringRef msg, const llvm::SmallBitVector &CI_Set)> Visitor);
+
+    //from cc1-main, this will be used for handling
     void PrintDiagnostics();
+
+    //as above, printing the summary line to OutOS and the diagnostics to ErrOS.
+    void PrintDiagnostics(llvm::raw_ostream &OutOS, llvm::raw_ostream &ErrOS);
+
+    //as above, printing only the diagnostics located in a file Filter
+    //accepts, e.g. to report those in headers once for a whole batch.
+    //Returns the number of diagnostics left out.
+    unsigned PrintDiagnostics(llvm::raw_ostream &OutOS, llvm::raw_ostream &ErrOS, llvm::function_ref<bool(llvm::StringRef FileName)> Filter);
 };
 
 // ------ custom diagnostic consumer for OMRChecker
@@ -47,8 +265,16 @@ class CustomDiagConsumer : public DiagnosticConsumer {
   private:
     CustomDiagContainer &DiagContainer;
 
+    //ID of the compiler instance this consumer reports for
+    unsigned CI_ID;
+
+    //arguments of the diagnostic being captured, kept to reuse the storage
+    std::string ArgsBuffer;
+
   public:
-    CustomDiagConsumer(CustomDiagContainer& Container) : DiagContainer(Container) {}
+    CustomDiagConsumer(CustomDiagContainer& Container, unsigned ID) : DiagContainer(Container), CI_ID(ID) {}
 };
 
-} //end namespace clang
\ No newline at end of file
+} //end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGDIAGNOSTIC_H
@@ -0,0 +1,110 @@
+//===- BruteClangFileSystem.h - File system shared by variants --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Every variant of a translation unit stats and reads nearly the same set of
+// headers, and in batch mode so does every other file. This file defines the
+// file system the compiler instances of a run share, which stats and reads
+// each path of the underlying file system once and serves every later request
+// from memory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGFILESYSTEM_H
+#define LLVM_CLANG_BASIC_BRUTECLANGFILESYSTEM_H
+
+#include "clang/Basic/LLVM.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/StringMap.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace llvm {
+class MemoryBuffer;
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+/// A thread-safe file system caching the status and contents of every path
+/// looked up through it, including paths that do not exist.
+///
+/// The source tree is assumed not to change during a run. Directory listings
+/// and files read as volatile are not cached.
+class BruteClangFileSystem : public vfs::FileSystem {
+public:
+  struct Statistics {
+    /// status() and openFileForRead() calls made on this file system.
+    unsigned NumStatRequests = 0;
+    /// Of those, the ones that had to stat the underlying file system.
+    unsigned NumStatsForwarded = 0;
+    /// Contents requested from files opened through this file system.
+    unsigned NumReadRequests = 0;
+    /// Of those, the ones that had to read the underlying file system.
+    unsigned NumReadsForwarded = 0;
+  };
+
+  explicit BruteClangFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> Base);
+  ~BruteClangFileSystem() override;
+
+  llvm::ErrorOr<vfs::Status> status(const Twine &Path) override;
+  llvm::ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const Twine &Path) override;
+  vfs::directory_iterator dir_begin(const Twine &Dir,
+                                    std::error_code &EC) override;
+
+  /// Changing the working directory would invalidate the cached relative
+  /// paths, so it is only allowed before the first lookup.
+  std::error_code setCurrentWorkingDirectory(const Twine &Path) override;
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override;
+
+  Statistics getStatistics() const;
+  void printStatistics(llvm::raw_ostream &OS) const;
+
+private:
+  class CachedFile;
+
+  /// What is known about one path.
+  struct Entry {
+    /// The status of the path, or the error looking it up.
+    llvm::ErrorOr<vfs::Status> Status;
+    /// The contents of the file, null terminated. Set by the first read.
+    std::unique_ptr<llvm::MemoryBuffer> Contents;
+
+    explicit Entry(llvm::ErrorOr<vfs::Status> Status)
+        : Status(std::move(Status)) {}
+  };
+
+  /// Find the entry of \p Path, looking it up in the underlying file system
+  /// if this is the first request for it.
+  Entry &getEntry(StringRef Path);
+
+  /// Get the contents of \p E, reading \p Path if this is the first read.
+  llvm::ErrorOr<const llvm::MemoryBuffer *> getContents(Entry &E,
+                                                        StringRef Path);
+
+  /// Read \p Path from the underlying file system without caching it.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getVolatileContents(const Twine &Path, int64_t FileSize,
+                      bool RequiresNullTerminator);
+
+  IntrusiveRefCntPtr<vfs::FileSystem> Base;
+
+  /// Guards Entries and the contents of each entry. Entries are never
+  /// removed, so references to them stay valid after the lock is dropped.
+  mutable std::mutex Lock;
+  llvm::StringMap<std::unique_ptr<Entry>> Entries;
+
+  std::atomic<unsigned> NumStatRequests{0}, NumStatsForwarded{0};
+  std::atomic<unsigned> NumReadRequests{0}, NumReadsForwarded{0};
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGFILESYSTEM_H
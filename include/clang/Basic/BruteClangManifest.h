@@ -0,0 +1,200 @@
+//===- BruteClangManifest.h - Precompiled BruteClang configuration -*- C++ -*-//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// BruteClang decides which variants to analyze a file for, and which -I/-D
+// arguments each variant gets, from a set of text config files. This file
+// defines the manifest those configs are compiled into: a single binary file
+// holding every variant's arguments and an on-disk hash table from file path
+// to the variants it belongs to. A manifest is loaded without parsing, so
+// looking a translation unit up costs one hash probe.
+//
+// Variants are either the four platforms of the original config layout, or
+// the combinations of the values of named axes (platform, language, feature,
+// ...) declared in a variants.config file, which selects the variants of
+// each argument and file list with set expressions over those axes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGMANIFEST_H
+#define LLVM_CLANG_BASIC_BRUTECLANGMANIFEST_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/ADT/StringRef.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+namespace vfs {
+class FileSystem;
+} // end namespace vfs
+
+/// The set of variants a file is analyzed for, as a bitset over variant
+/// indices.
+typedef llvm::SmallBitVector VariantMask;
+
+/// An argument BruteClang adds to the compiler invocation of one variant.
+struct BruteClangVariantArg {
+  enum ArgKind : char {
+    Include = 'I',
+    Define = 'D'
+  };
+
+  ArgKind Kind;
+
+  /// The include directory or macro definition, without the -I/-D prefix or
+  /// any quoting.
+  StringRef Value;
+};
+
+/// A dimension variants are built along, e.g. the platform.
+struct BruteClangVariantAxis {
+  StringRef Name;
+
+  /// The values of the axis, in declaration order.
+  std::vector<StringRef> Values;
+
+  /// Named sets of values, e.g. "x" for amd64 and i386.
+  std::vector<std::pair<StringRef, std::vector<unsigned>>> Groups;
+};
+
+/// A loaded BruteClang manifest.
+///
+/// The manifest is either read from a file produced by \c compileConfigs, in
+/// which case the file is memory-mapped and used in place, or compiled on the
+/// fly from the config files.
+class BruteClangManifest {
+  /// The buffer holding the manifest.
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+
+  /// The name of each variant, in manifest order.
+  std::vector<StringRef> VariantNames;
+
+  /// Where the arguments of each variant start in \c Buffer.
+  std::vector<const unsigned char *> VariantArgs;
+
+  /// The number of 64-bit words in each file's variant mask.
+  unsigned MaskWords = 0;
+
+  /// The axes of the variants; empty for the original config layout.
+  std::vector<BruteClangVariantAxis> Axes;
+
+  /// The value of each axis for each variant, variant by variant.
+  std::vector<unsigned> AxisValues;
+
+  /// A pointer to the on-disk hash table mapping file paths to variant masks.
+  ///
+  /// This is actually an OnDiskChainedHashTable, hidden behind a void pointer
+  /// to keep the trait out of this header.
+  void *FileTable = nullptr;
+
+  explicit BruteClangManifest(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+
+  /// Load the axis table at \p Offset; returns false if it is malformed.
+  bool readAxes(uint32_t Offset);
+
+public:
+  ~BruteClangManifest();
+
+  BruteClangManifest(const BruteClangManifest &) = delete;
+  BruteClangManifest &operator=(const BruteClangManifest &) = delete;
+
+  /// Compile the config files in \p ConfigDir into a manifest, written to
+  /// \p OS.
+  ///
+  /// If \p ConfigDir holds a variants.config, it describes the variants;
+  /// see the README for its syntax. Otherwise the configs consist of the
+  /// file lists (common_files.config, x_files.config, amd64_files.config,
+  /// ...) and one <variant>.config file per variant holding its -I and -D
+  /// arguments.
+  ///
+  /// \returns true on success; otherwise \p Error describes the problem.
+  static bool compileConfigs(vfs::FileSystem &FS, StringRef ConfigDir,
+                             llvm::raw_ostream &OS, std::string &Error);
+
+  /// Load a manifest from \p Buffer, which must hold the output of
+  /// \c compileConfigs.
+  static std::unique_ptr<BruteClangManifest>
+  create(std::unique_ptr<llvm::MemoryBuffer> Buffer, std::string &Error);
+
+  /// Memory-map and load the manifest file at \p Path.
+  static std::unique_ptr<BruteClangManifest> loadFile(StringRef Path,
+                                                      std::string &Error);
+
+  /// Compile the config files in \p ConfigDir and load the result.
+  static std::unique_ptr<BruteClangManifest>
+  createFromConfigs(vfs::FileSystem &FS, StringRef ConfigDir,
+                    std::string &Error);
+
+  /// Read a whitespace separated list of file paths, in the format of the
+  /// *_files.config lists, from \p Path.
+  static bool readFileList(vfs::FileSystem &FS, StringRef Path,
+                           std::vector<std::string> &Files,
+                           std::string &Error);
+
+  /// The number of variants described by the manifest.
+  unsigned getNumVariants() const { return VariantNames.size(); }
+
+  /// The name of variant \p V, e.g. "amd64".
+  StringRef getVariantName(unsigned V) const { return VariantNames[V]; }
+
+  /// Retrieve the -I/-D arguments of variant \p V, in config order.
+  ///
+  /// The returned values point into the manifest.
+  void getVariantArgs(unsigned V,
+                      SmallVectorImpl<BruteClangVariantArg> &Args) const;
+
+  /// The axes the variants are built along, or none if the manifest was
+  /// compiled from the original config layout.
+  ArrayRef<BruteClangVariantAxis> getAxes() const { return Axes; }
+
+  /// The index of the value of axis \p A for variant \p V.
+  unsigned getAxisValue(unsigned V, unsigned A) const {
+    return AxisValues[V * Axes.size() + A];
+  }
+
+  /// Evaluate the set expression \p Expr, in the syntax of
+  /// variants.config, over the variants.
+  bool evaluateVariantSet(StringRef Expr, VariantMask &Mask,
+                          std::string &Error) const;
+
+  /// Print a compact description of \p Mask: one pattern per block of
+  /// variants, giving a value, a group of values or "*" for each axis, e.g.
+  /// "x/cpp/*" or "*" for every variant. Without axes, the variant names are
+  /// listed.
+  void describeVariants(const VariantMask &Mask, llvm::raw_ostream &OS) const;
+
+  /// Pick a subset of \p Candidates such that every combination of values
+  /// of any \p Strength axes that some candidate has is had by a picked
+  /// variant too: a covering array of strength \p Strength, 2 for pairwise.
+  /// The subset is built greedily, each time taking the candidate that
+  /// covers the most combinations not covered yet, so it is small but not
+  /// always minimal.
+  ///
+  /// Without axes, or with no more axes than \p Strength, every candidate
+  /// is needed and \p Sample is \p Candidates.
+  void sampleVariants(const VariantMask &Candidates, unsigned Strength,
+                      VariantMask &Sample) const;
+
+  /// Look up the variants \p FileName is analyzed for.
+  ///
+  /// \returns false if the file is not in any file list.
+  bool lookupFile(StringRef FileName, VariantMask &Mask) const;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGMANIFEST_H
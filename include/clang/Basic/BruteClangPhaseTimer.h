@@ -0,0 +1,99 @@
+//===- BruteClangPhaseTimer.h - Per-thread phase timing ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// BruteClang runs several compiler instances at once, one per thread, so the
+// process-wide times an llvm::Timer records would charge every instance for
+// the work of all of them. This file defines a timer adding up the wall and
+// CPU time of the calling thread over many short regions, e.g. every
+// preprocessor directive of a translation unit.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGPHASETIMER_H
+#define LLVM_CLANG_BASIC_BRUTECLANGPHASETIMER_H
+
+#include "clang/Basic/LLVM.h"
+#include <cassert>
+
+namespace clang {
+
+/// An amount of time, in seconds.
+struct BruteClangPhaseTime {
+  double Wall = 0;
+
+  /// CPU time of the calling thread, user and system. Where that cannot be
+  /// told apart from the other threads, the CPU time of the process.
+  double CPU = 0;
+
+  /// The current wall and CPU time, from an arbitrary origin.
+  static BruteClangPhaseTime now();
+
+  BruteClangPhaseTime &operator+=(const BruteClangPhaseTime &RHS) {
+    Wall += RHS.Wall;
+    CPU += RHS.CPU;
+    return *this;
+  }
+  BruteClangPhaseTime &operator-=(const BruteClangPhaseTime &RHS) {
+    Wall -= RHS.Wall;
+    CPU -= RHS.CPU;
+    return *this;
+  }
+};
+
+/// Adds up the time spent between start and stop calls, all made by the same
+/// thread. Regions may nest; only the outermost one counts.
+class BruteClangPhaseTimer {
+  BruteClangPhaseTime Total;
+  BruteClangPhaseTime Start;
+  unsigned Depth = 0;
+
+  /// The number of outermost regions timed.
+  unsigned Count = 0;
+
+public:
+  void start() {
+    if (Depth++ == 0)
+      Start = BruteClangPhaseTime::now();
+  }
+
+  void stop() {
+    assert(Depth && "timer was not started");
+    if (--Depth)
+      return;
+    BruteClangPhaseTime End = BruteClangPhaseTime::now();
+    End -= Start;
+    Total += End;
+    ++Count;
+  }
+
+  const BruteClangPhaseTime &getTotal() const { return Total; }
+  unsigned getCount() const { return Count; }
+};
+
+/// Times the scope it lives in with a timer, if there is one.
+class BruteClangPhaseRegion {
+  BruteClangPhaseTimer *Timer;
+
+public:
+  explicit BruteClangPhaseRegion(BruteClangPhaseTimer *Timer) : Timer(Timer) {
+    if (Timer)
+      Timer->start();
+  }
+  ~BruteClangPhaseRegion() {
+    if (Timer)
+      Timer->stop();
+  }
+
+  BruteClangPhaseRegion(const BruteClangPhaseRegion &) = delete;
+  BruteClangPhaseRegion &operator=(const BruteClangPhaseRegion &) = delete;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGPHASETIMER_H
@@ -0,0 +1,112 @@
+//===- BruteClangProcessPool.h - Forked jobs for BruteClang -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A crash in one compiler instance takes down every other instance running in
+// the same process, and much of Clang and LLVM keeps global state that is not
+// safe to share between threads. This file defines a pool running each job in
+// a process forked from the caller. The children inherit everything the
+// caller set up (targets, plugins, cached files) copy-on-write, and report
+// back through a pipe.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGPROCESSPOOL_H
+#define LLVM_CLANG_BASIC_BRUTECLANGPROCESSPOOL_H
+
+#include "clang/Basic/LLVM.h"
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+/// A pool running each job in a child process, up to a fixed number at once.
+///
+/// A job writes its result to a stream, which the caller receives, together
+/// with how the child ended, in the job's completion callback. Completion
+/// callbacks run on the thread calling \c wait(), as the children finish.
+///
+/// The caller must not have other threads running when \c wait() is called;
+/// only the forking thread exists in the children. Where fork() is not
+/// available, the jobs run in the calling process, one after another.
+class BruteClangProcessPool {
+public:
+  /// How a job ended.
+  struct Result {
+    /// Everything the job wrote to its stream.
+    std::string Output;
+
+    /// Whether the child exited normally with status 0.
+    bool Succeeded = true;
+
+    /// How the child ended otherwise, e.g. "killed by signal 11".
+    std::string Failure;
+
+    /// The wall time from starting the job until it ended, in seconds.
+    double Seconds = 0;
+  };
+
+  typedef std::function<void(llvm::raw_ostream &)> Job;
+  typedef std::function<void(const Result &)> Completion;
+
+  explicit BruteClangProcessPool(unsigned NumProcesses);
+
+  /// Runs the remaining jobs.
+  ~BruteClangProcessPool();
+
+  BruteClangProcessPool(const BruteClangProcessPool &) = delete;
+  BruteClangProcessPool &operator=(const BruteClangProcessPool &) = delete;
+
+  /// Whether jobs really run in child processes on this host.
+  static bool isSupported();
+
+  /// Queue \p J, to call \p Done with its result.
+  void async(Job J, Completion Done);
+
+  /// Run every queued job and call its completion callback.
+  void wait();
+
+private:
+  struct QueuedJob {
+    Job J;
+    Completion Done;
+  };
+
+  /// A child still running.
+  struct Child {
+    int PID;
+    /// The read end of the pipe the child writes its result to.
+    int FD;
+    /// When the child was forked, as by BruteClangPhaseTime::now().
+    double Start;
+    Result R;
+    Completion Done;
+  };
+
+  /// Fork a child for \p QJ. Returns false, after calling its completion
+  /// callback, if the child could not be started.
+  bool start(QueuedJob &QJ);
+
+  /// Wait for the child \p C, which closed its end of the pipe, and call its
+  /// completion callback.
+  void finish(Child &C);
+
+  unsigned NumProcesses;
+  std::deque<QueuedJob> Queue;
+  std::vector<Child> Running;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGPROCESSPOOL_H
@@ -0,0 +1,93 @@
+//===- BruteClangWorkPool.h - Work-stealing pool for BruteClang -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// BruteClang analyzes every (file, variant) pair of a run as an independent
+// job. Jobs vary wildly in cost, from a few milliseconds for a small source
+// to minutes for the big codegen files, so the pool gives every worker its own
+// queue and lets idle workers steal from the others.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_BASIC_BRUTECLANGWORKPOOL_H
+#define LLVM_CLANG_BASIC_BRUTECLANGWORKPOOL_H
+
+#include "clang/Basic/LLVM.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace clang {
+
+/// A pool of worker threads with one job queue per worker.
+///
+/// Jobs are handed out round-robin. A worker takes jobs from the front of its
+/// own queue and, when that is empty, steals from the back of another
+/// worker's queue.
+///
+/// A pool with a single worker does not start any threads: its jobs run on
+/// the thread calling \c wait(), in submission order.
+class BruteClangWorkPool {
+public:
+  typedef std::function<void()> Job;
+
+  explicit BruteClangWorkPool(unsigned NumWorkers);
+
+  /// Waits for all jobs and stops the workers.
+  ~BruteClangWorkPool();
+
+  BruteClangWorkPool(const BruteClangWorkPool &) = delete;
+  BruteClangWorkPool &operator=(const BruteClangWorkPool &) = delete;
+
+  /// Queue \p J to be run by some worker. May be called from a job.
+  void async(Job J);
+
+  /// Block until every queued job has finished.
+  void wait();
+
+  unsigned getNumWorkers() const { return Queues.size(); }
+
+private:
+  struct WorkerQueue {
+    std::mutex Lock;
+    std::deque<Job> Jobs;
+  };
+
+  /// Take the next job for worker \p Index, stealing if its queue is empty.
+  bool takeJob(unsigned Index, Job &J);
+
+  /// The loop run by worker thread \p Index.
+  void work(unsigned Index);
+
+  std::vector<std::unique_ptr<WorkerQueue>> Queues;
+  std::vector<std::thread> Threads;
+
+  /// Guards the counters below.
+  std::mutex StateLock;
+  std::condition_variable WorkAvailable;
+  std::condition_variable AllDone;
+
+  /// Jobs sitting in some queue.
+  unsigned NumQueued = 0;
+
+  /// Jobs queued or running.
+  unsigned NumPending = 0;
+
+  /// The queue the next job is handed to.
+  unsigned NextQueue = 0;
+
+  bool ShuttingDown = false;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_BASIC_BRUTECLANGWORKPOOL_H
@@ -0,0 +1,190 @@
+//===- BruteClangCacheFile.h - Files kept between runs ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// BruteClang keeps precompiled headers and analysis results on disk between
+// runs. This file defines the pieces their cache files have in common: a
+// little-endian binary encoding starting with a magic number and a version,
+// atomic writes, stamps of the files a cached entry was computed from, and
+// the paths its header searches found nothing at.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGCACHEFILE_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGCACHEFILE_H
+
+#include "clang/Basic/BruteClangDiagnostic.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Frontend/Utils.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+namespace vfs {
+class FileSystem;
+} // end namespace vfs
+
+/// Write \p Contents to \p Path through a temporary file, so that readers
+/// never see a partial file.
+bool writeBruteClangCacheFile(StringRef Path, StringRef Contents);
+
+/// Reads the fields of a cache file. Reading past the end, or a file with
+/// the wrong magic number or version, fails the reader instead of the
+/// program.
+class BruteClangCacheReader {
+  const char *Ptr, *End;
+  bool Failed = false;
+
+public:
+  BruteClangCacheReader(StringRef Buffer, StringRef Magic, unsigned Version);
+
+  template <typename T> T read() {
+    if (Failed || size_t(End - Ptr) < sizeof(T)) {
+      Failed = true;
+      return T();
+    }
+    return llvm::support::endian::readNext<T, llvm::support::little,
+                                           llvm::support::unaligned>(Ptr);
+  }
+
+  template <typename LenT> StringRef readString() {
+    size_t Len = read<LenT>();
+    if (Failed || size_t(End - Ptr) < Len) {
+      Failed = true;
+      return StringRef();
+    }
+    StringRef Str(Ptr, Len);
+    Ptr += Len;
+    return Str;
+  }
+
+  void readDiagnostics(
+      std::vector<CustomDiagContainer::RecordedDiagnostic> &Diags);
+
+  bool hasFailed() const { return Failed; }
+};
+
+/// Builds a cache file in memory, to be written out at once.
+class BruteClangCacheWriter {
+  std::string Contents;
+  llvm::raw_string_ostream OS;
+
+public:
+  BruteClangCacheWriter(StringRef Magic, unsigned Version);
+
+  template <typename T> void write(T Value) {
+    llvm::support::endian::Writer<llvm::support::little>(OS).write<T>(Value);
+  }
+
+  template <typename LenT> void writeString(StringRef Str) {
+    write<LenT>(Str.size());
+    OS << Str;
+  }
+
+  void writeDiagnostics(
+      ArrayRef<CustomDiagContainer::RecordedDiagnostic> Diags);
+
+  StringRef getContents() { return OS.str(); }
+
+  /// Write the file to \p Path. See writeBruteClangCacheFile.
+  bool commit(StringRef Path);
+};
+
+/// Collects every file a compiler instance reads, system headers included,
+/// and every path its header searches looked at before finding a file. A
+/// file added at such a path would be found instead, so an entry computed
+/// from the instance is only valid while all of them stay absent.
+///
+/// The searches of \c \#include directives and of '__has_include'
+/// expressions are recorded, for search lists of plain directories.
+class BruteClangFileCollector : public DependencyCollector {
+  std::vector<std::string> AbsentPaths;
+  llvm::StringSet<> SeenAbsentPaths;
+  bool MissingFiles = false;
+  bool UntrackedLookups = false;
+
+public:
+  void attachToPreprocessor(Preprocessor &PP) override;
+  bool needSystemDependencies() override { return true; }
+  bool sawDependency(StringRef Filename, bool FromModule, bool IsSystem,
+                     bool IsModuleFile, bool IsMissing) override;
+
+  void addAbsentPath(StringRef Path);
+  ArrayRef<std::string> getAbsentPaths() const { return AbsentPaths; }
+
+  /// Note a header search whose probes cannot be told, through a header map
+  /// or a framework say.
+  void setUntrackedLookups() { UntrackedLookups = true; }
+
+  /// Whether an #include directive failed to find its file.
+  bool hasMissingFiles() const { return MissingFiles; }
+
+  /// Whether some header search could not be recorded.
+  bool hasUntrackedLookups() const { return UntrackedLookups; }
+};
+
+/// Stamps files with their size, modification time and a hash of their
+/// contents, to tell whether an entry computed from them is still valid. The
+/// contents of each file are hashed once, so the files must not change
+/// while the object is alive.
+class BruteClangFileStamps {
+  IntrusiveRefCntPtr<vfs::FileSystem> FS;
+
+  std::mutex Lock;
+  llvm::StringMap<std::string> ContentHashes;
+  /// Whether there is a file at each path checked by checkAbsentPaths.
+  llvm::StringMap<bool> PathsExist;
+
+public:
+  explicit BruteClangFileStamps(IntrusiveRefCntPtr<vfs::FileSystem> FS);
+  ~BruteClangFileStamps();
+
+  /// Get the hex MD5 of \p Str.
+  static std::string hashString(StringRef Str);
+
+  /// Get the hash of the contents of \p Path, or return false if it cannot
+  /// be read.
+  bool getContentHash(StringRef Path, std::string &Hash);
+
+  /// Write the stamps of \p Paths. If \p CombinedHash is given, it receives
+  /// a hash of the names and contents of all of them.
+  ///
+  /// \returns false if a file cannot be read.
+  bool writeStamps(ArrayRef<std::string> Paths, BruteClangCacheWriter &Writer,
+                   std::string *CombinedHash = nullptr);
+
+  /// Read stamps written by writeStamps and check them against the files.
+  /// Unless \p CheckModTime is set, a file whose contents are unchanged
+  /// counts as unchanged whatever its modification time.
+  ///
+  /// \returns true if no file changed.
+  bool checkStamps(BruteClangCacheReader &Reader, bool CheckModTime);
+
+  /// Write \p Paths, at which header searches found no file.
+  static void writeAbsentPaths(ArrayRef<std::string> Paths,
+                               BruteClangCacheWriter &Writer);
+
+  /// Read paths written by writeAbsentPaths, adding them to \p Paths if it is
+  /// given, and check that there is still no file at any of them.
+  ///
+  /// \returns true if none appeared.
+  bool checkAbsentPaths(BruteClangCacheReader &Reader,
+                        std::vector<std::string> *Paths = nullptr);
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGCACHEFILE_H
@@ -0,0 +1,162 @@
+//===- BruteClangDeclFingerprint.h - Declaration hashes ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Most of the declarations of a file, in its own text and in the headers it
+// includes, come out of Sema the same for every variant. A plugin checking
+// each declaration on its own reports the same for all of them, so it only
+// needs to check it for one. This file defines the fingerprint declarations
+// are compared by, and the filter BruteClang runs plugin consumers through
+// to check each distinct declaration once per file and hand what was
+// reported for it to every variant that has it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGDECLFINGERPRINT_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGDECLFINGERPRINT_H
+
+#include "clang/Basic/BruteClangDiagnostic.h"
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class ASTConsumer;
+class Decl;
+class DiagnosticsEngine;
+
+/// Compute a hash of declaration \p D as Sema built it, which does not
+/// depend on where the AST is in memory: its ODRHash, extended with the
+/// bases of classes, the bodies of functions and everything declared inside
+/// namespaces and classes, and the attributes of each declaration. The
+/// presumed locations \p D begins and ends at are included as well, so
+/// declarations are only the same if they come from the same text.
+///
+/// \returns false if \p D is not located in a file, in which case
+/// \p Fingerprint is unspecified.
+bool computeDeclFingerprint(const Decl *D, std::string &Fingerprint);
+
+/// The declarations checked by the plugins for the variants of one file,
+/// shared by the compiler instances of the variants.
+class BruteClangCheckedDecls {
+public:
+  /// A diagnostic reported while a declaration was checked: captured
+  /// unformatted, as CustomDiagConsumer captures it, unless it only means
+  /// something in the compiler instance that reported it.
+  struct RecordedDiagnostic {
+    bool Captured;
+    CustomDiagContainer::CapturedDiagnostic CapturedDiag;
+    CustomDiagContainer::RecordedDiagnostic Formatted;
+  };
+
+  /// A declaration, by its fingerprint.
+  struct Entry {
+    /// The compiler instance checking it.
+    unsigned LeaderID;
+    /// Whether it was checked, and what was reported while it was.
+    bool Done = false;
+    std::vector<RecordedDiagnostic> Diags;
+    /// Whether the leader hit a fatal error, after which nothing more is
+    /// reported, so that every other instance is to check it itself.
+    bool Failed = false;
+
+    explicit Entry(unsigned LeaderID) : LeaderID(LeaderID) {}
+  };
+
+  /// The entry of \p Fingerprint. If no compiler instance claimed it yet,
+  /// \p CI_ID does, setting \p Claimed, and is to check it, then call
+  /// finish on it.
+  Entry &claim(StringRef Fingerprint, unsigned CI_ID, bool &Claimed);
+
+  /// Record that the leader of \p E checked it, reporting \p Diags.
+  void finish(Entry &E, std::vector<RecordedDiagnostic> Diags);
+
+  /// Record that the leader of \p E hit a fatal error, so what it reported
+  /// is not to be shared.
+  void abandon(Entry &E);
+
+  /// Wait until the leader of \p E is done with it.
+  void wait(const Entry &E);
+
+  /// Declarations checked for all the files, and declarations of a variant
+  /// left unchecked because another variant checked them.
+  static std::atomic<unsigned> NumChecked;
+  static std::atomic<unsigned> NumShared;
+
+private:
+  std::mutex Lock;
+  std::condition_variable Finished;
+  llvm::StringMap<std::unique_ptr<Entry>> Entries;
+};
+
+/// Decides which declarations a compiler instance checks with the plugins,
+/// and collects what the plugins report for the others once the variants
+/// that checked them are done.
+///
+/// Plugin consumers are run through wrapConsumer, which hands them only the
+/// top-level declarations and inline method definitions not checked for
+/// another variant yet. A plugin checking the whole translation unit at its
+/// end asks for each declaration itself, with a CheckScope, and says so
+/// through FrontendAction::usesDeclCheckScopes to keep its consumer
+/// unwrapped.
+class BruteClangDeclFilter {
+public:
+  BruteClangDeclFilter(BruteClangCheckedDecls &Checked, unsigned CI_ID)
+      : Checked(Checked), CI_ID(CI_ID) {}
+
+  /// Decides whether one declaration is to be checked, and records what is
+  /// reported while it is, until the scope ends. \p Context is made part of
+  /// the fingerprint of the declaration: it names the check, and stands for
+  /// whatever else in the translation unit the check depends on.
+  class CheckScope {
+    BruteClangDeclFilter &Filter;
+    BruteClangCheckedDecls::Entry *Claimed = nullptr;
+    bool Check = true;
+    DiagnosticsEngine *Diags = nullptr;
+    std::unique_ptr<DiagnosticConsumer> Recorder;
+    std::unique_ptr<DiagnosticConsumer> OwnedClient;
+    DiagnosticConsumer *Client = nullptr;
+    std::vector<BruteClangCheckedDecls::RecordedDiagnostic> Recorded;
+
+  public:
+    CheckScope(BruteClangDeclFilter &Filter, const Decl *D,
+               StringRef Context);
+    ~CheckScope();
+
+    /// Whether the declaration is to be checked in this compiler instance.
+    bool shouldCheck() const { return Check; }
+  };
+
+  /// Wrap the consumer of plugin \p Name so it is only handed the
+  /// declarations to check, recording what it reports for each.
+  std::unique_ptr<ASTConsumer>
+  wrapConsumer(std::unique_ptr<ASTConsumer> Consumer, StringRef Name);
+
+  /// Once the frontend action ended, report to \p DiagContainer what was
+  /// reported for the declarations left to other variants.
+  void finish(CustomDiagContainer &DiagContainer);
+
+private:
+  class FilteringConsumer;
+
+  BruteClangCheckedDecls &Checked;
+  unsigned CI_ID;
+
+  /// The declarations left to other variants.
+  std::vector<const BruteClangCheckedDecls::Entry *> Shared;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGDECLFINGERPRINT_H
@@ -0,0 +1,246 @@
+//===- BruteClangDiagnosticOutput.h - Structured reports --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Besides the text it prints, BruteClang can write the grouped diagnostics of
+// a run as a structured report for other tools to read: the variants of the
+// run, then each translation unit with the variants it was analyzed for,
+// followed by its diagnostics. A diagnostic gives its file, line, column,
+// clang diagnostic ID and message, and the variants that reported it as a
+// bitset over the variants of the run. Each translation unit is written out
+// as soon as it is done.
+//
+// A report is written either as JSON Lines, one object per line, or as a
+// serialized diagnostics file in the bitstream format of
+// -serialize-diagnostics, carrying what is specific to BruteClang in records
+// that readers of plain serialized diagnostics skip. Reports of several runs,
+// e.g. of the shards of a batch, can be merged into one.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGDIAGNOSTICOUTPUT_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGDIAGNOSTICOUTPUT_H
+
+#include "clang/Basic/BruteClangManifest.h"
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Allocator.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+/// A grouped diagnostic of a structured report.
+struct BruteClangOutputDiagnostic {
+  StringRef FileName;
+  unsigned LineNumber = 0;
+  unsigned ColumnNumber = 0;
+
+  /// The clang diagnostic ID, or 0 for the diagnostics BruteClang reports
+  /// itself.
+  unsigned DiagID = 0;
+
+  StringRef Message;
+};
+
+/// Receives a structured diagnostic report: \c beginRun, then for each
+/// translation unit \c beginTranslationUnit, its diagnostics and
+/// \c endTranslationUnit, then \c endRun.
+class BruteClangDiagnosticWriter {
+public:
+  enum OutputFormat {
+    /// One JSON object per line; see the README for the schema.
+    JSONLines,
+
+    /// A serialized diagnostics file with BruteClang's extension records.
+    Bitstream
+  };
+
+  virtual ~BruteClangDiagnosticWriter();
+
+  /// Start a report whose variant masks are over \p VariantNames.
+  virtual void beginRun(ArrayRef<StringRef> VariantNames) = 0;
+
+  /// Start translation unit \p Name, analyzed for \p Variants.
+  virtual void beginTranslationUnit(StringRef Name,
+                                    const VariantMask &Variants) = 0;
+
+  /// Add a diagnostic of the current translation unit, reported by
+  /// \p Variants.
+  virtual void writeDiagnostic(const BruteClangOutputDiagnostic &Diag,
+                               const VariantMask &Variants) = 0;
+
+  /// Finish the current translation unit. Writers flush their stream here,
+  /// so a report can be followed while it is written.
+  virtual void endTranslationUnit() {}
+
+  virtual void endRun() {}
+
+  /// Create a writer of \p Format to \p OS.
+  static std::unique_ptr<BruteClangDiagnosticWriter>
+  create(OutputFormat Format, raw_ostream &OS);
+
+  /// Parse the name of a format, "jsonl" or "dia".
+  static bool parseFormat(StringRef Name, OutputFormat &Format);
+
+  /// Replay the report in \p Buffer, in either format, into \p Writer.
+  /// JSON Lines reports may be concatenated, in which case each run is
+  /// replayed in turn.
+  ///
+  /// \returns true on success; otherwise \p Error describes the problem.
+  static bool read(StringRef Buffer, BruteClangDiagnosticWriter &Writer,
+                   std::string &Error);
+};
+
+/// Merges reports into one, in time linear in their size: variants and
+/// translation units are matched by name, and a diagnostic of the same
+/// translation unit, file, line, column, ID and message reported in several
+/// reports is reported once, by the union of their variants.
+class BruteClangDiagnosticMerger : public BruteClangDiagnosticWriter {
+  /// A diagnostic, with FileName and Message pointing into Strings.
+  struct DiagKey {
+    unsigned TranslationUnit;
+    const char *FileName;
+    const char *Message;
+    unsigned LineNumber;
+    unsigned ColumnNumber;
+    unsigned DiagID;
+  };
+
+  struct DiagKeyInfo {
+    static DiagKey getEmptyKey();
+    static DiagKey getTombstoneKey();
+    static unsigned getHashValue(const DiagKey &Key);
+    static bool isEqual(const DiagKey &LHS, const DiagKey &RHS);
+  };
+
+  struct MergedDiagnostic {
+    BruteClangOutputDiagnostic Diag;
+    VariantMask Variants;
+  };
+
+  struct MergedTranslationUnit {
+    StringRef Name;
+    VariantMask Variants;
+
+    /// Indices into Diags, in the order the diagnostics were first seen.
+    std::vector<unsigned> Diags;
+  };
+
+  /// Every name and message seen so far, which outlive the reports.
+  llvm::StringSet<llvm::BumpPtrAllocator> Strings;
+
+  /// The variants of the merged report, in the order they were first seen.
+  std::vector<StringRef> VariantNames;
+  llvm::StringMap<unsigned> VariantIndex;
+
+  /// The merged variant of each variant of the report being read.
+  std::vector<unsigned> InputVariants;
+
+  std::vector<MergedTranslationUnit> TranslationUnits;
+  llvm::StringMap<unsigned> TranslationUnitIndex;
+
+  /// The translation unit of the report being read, as an index into
+  /// TranslationUnits.
+  unsigned CurrentTranslationUnit = 0;
+
+  std::vector<MergedDiagnostic> Diags;
+  llvm::DenseMap<DiagKey, unsigned, DiagKeyInfo> DiagIndex;
+
+  StringRef intern(StringRef Str) {
+    return Strings.insert(Str).first->getKey();
+  }
+
+  /// Add the variants \p Input of the report being read to \p Merged.
+  void mergeVariants(const VariantMask &Input, VariantMask &Merged) const;
+
+public:
+  void beginRun(ArrayRef<StringRef> VariantNames) override;
+  void beginTranslationUnit(StringRef Name,
+                            const VariantMask &Variants) override;
+  void writeDiagnostic(const BruteClangOutputDiagnostic &Diag,
+                       const VariantMask &Variants) override;
+
+  /// Write the merged report to \p Writer: the translation units in the
+  /// order they were first seen, each with its diagnostics in that order.
+  void emit(BruteClangDiagnosticWriter &Writer);
+};
+
+/// Collects the diagnostics located in headers over the translation units of
+/// a run (-brute-dedup-headers). A header diagnostic is kept once, however
+/// many translation units including the header report it, with the union of
+/// the variants that reported it and the translation units it was reported
+/// for. Diagnostics located in the translation unit itself are left out.
+class BruteClangHeaderDiagnostics : public BruteClangDiagnosticWriter {
+public:
+  struct HeaderDiagnostic {
+    BruteClangOutputDiagnostic Diag;
+    VariantMask Variants;
+
+    /// The translation units that reported it, in the order they were
+    /// written.
+    std::vector<StringRef> TranslationUnits;
+  };
+
+private:
+  /// A diagnostic, with FileName and Message pointing into Strings.
+  struct DiagKey {
+    const char *FileName;
+    const char *Message;
+    unsigned LineNumber;
+    unsigned ColumnNumber;
+    unsigned DiagID;
+  };
+
+  struct DiagKeyInfo {
+    static DiagKey getEmptyKey();
+    static DiagKey getTombstoneKey();
+    static unsigned getHashValue(const DiagKey &Key);
+    static bool isEqual(const DiagKey &LHS, const DiagKey &RHS);
+  };
+
+  /// Every name and message seen so far.
+  llvm::StringSet<llvm::BumpPtrAllocator> Strings;
+
+  StringRef CurrentTranslationUnit;
+
+  /// The header diagnostics in the order they were first seen.
+  std::vector<HeaderDiagnostic> Diags;
+  llvm::DenseMap<DiagKey, unsigned, DiagKeyInfo> DiagIndex;
+
+  StringRef intern(StringRef Str) {
+    return Strings.insert(Str).first->getKey();
+  }
+
+public:
+  /// Whether a diagnostic of translation unit \p TU located in \p FileName
+  /// is located in a header. Diagnostics without a file are not.
+  static bool isInHeader(StringRef TU, StringRef FileName) {
+    return !FileName.empty() && FileName != TU;
+  }
+
+  void beginRun(ArrayRef<StringRef> VariantNames) override {}
+  void beginTranslationUnit(StringRef Name,
+                            const VariantMask &Variants) override;
+  void writeDiagnostic(const BruteClangOutputDiagnostic &Diag,
+                       const VariantMask &Variants) override;
+
+  ArrayRef<HeaderDiagnostic> getDiagnostics() const { return Diags; }
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGDIAGNOSTICOUTPUT_H
@@ -0,0 +1,100 @@
+//===- BruteClangJobTimes.h - Job times of earlier runs ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A handful of (file, variant) jobs, the big codegen files, take far longer
+// than the rest. Started last, they keep a worker or two busy long after the
+// others ran out of work. This file defines the record of how long each job
+// took in earlier runs, from which BruteClang orders the jobs of a run
+// longest first.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGJOBTIMES_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGJOBTIMES_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <mutex>
+#include <string>
+
+namespace clang {
+
+/// The wall time each (file, variant) job took, as recorded in earlier runs
+/// and in this one, kept between runs in a small text file
+/// (-brute-job-times=<file>). Each line gives the seconds a job took, the
+/// cost of its file as by \c getFileCost, the variant and the file.
+///
+/// Jobs that were never timed are estimated: from the other variants of the
+/// same file if some were timed, and otherwise from the cost of the file, at
+/// the average seconds per unit of cost of the jobs that were timed.
+class BruteClangJobTimes {
+  struct Entry {
+    double Seconds;
+    double FileCost;
+  };
+
+  struct Totals {
+    double Seconds = 0;
+    double Cost = 0;
+    unsigned NumJobs = 0;
+  };
+
+  /// The time of each job, keyed by file and variant name separated by a
+  /// NUL.
+  llvm::StringMap<Entry> Times;
+
+  /// The sums over the jobs of each file, and over every job, to estimate
+  /// from.
+  llvm::StringMap<Totals> FileTotals;
+  Totals AllTotals;
+
+  /// Guards everything above, which \c record updates from the workers.
+  mutable std::mutex Lock;
+
+  static std::string getKey(StringRef File, StringRef Variant);
+
+  /// Set the time of the job \p Key, keeping the sums up to date.
+  void add(StringRef Key, Entry E);
+
+public:
+  /// Read the times recorded in \p Path, if it exists.
+  ///
+  /// \returns true on success; otherwise \p Error describes the problem.
+  bool load(StringRef Path, std::string &Error);
+
+  /// Write every time known to \p Path, those recorded in this run replacing
+  /// those loaded.
+  bool save(StringRef Path, std::string &Error) const;
+
+  /// Record that \p Variant of \p File, whose cost is \p FileCost, took
+  /// \p Seconds. Safe to call from several threads at once.
+  void record(StringRef File, StringRef Variant, double FileCost,
+              double Seconds);
+
+  /// The seconds \p Variant of \p File is expected to take, where
+  /// \p FileCost is the cost of the file now.
+  double estimate(StringRef File, StringRef Variant, double FileCost) const;
+
+  /// A measure of how much there is to analyze in the source file \p Text:
+  /// its size, plus a fixed amount for each #include directive, which
+  /// stands for the headers it brings in.
+  static double getFileCost(StringRef Text);
+
+  /// The shortest time \p NumWorkers could run jobs taking \p JobSeconds in:
+  /// the total time spread evenly over the workers, or the longest job if
+  /// that takes longer.
+  static double getIdealMakespan(ArrayRef<double> JobSeconds,
+                                 unsigned NumWorkers);
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGJOBTIMES_H
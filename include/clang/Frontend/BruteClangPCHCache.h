@@ -0,0 +1,141 @@
+//===- BruteClangPCHCache.h - Precompiled include blocks --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Most translation units of a project start with a block of #include
+// directives pulling in the same large set of headers, and BruteClang parses
+// those headers again for every file and every variant. This file defines an
+// on-disk cache of precompiled headers for such leading include blocks, one
+// per block and variant, which the compiler instances of later files and
+// later runs load instead of parsing the headers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGPCHCACHE_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGPCHCACHE_H
+
+#include "clang/Basic/BruteClangDiagnostic.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Frontend/BruteClangCacheFile.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+class CompilerInvocation;
+class PCHContainerOperations;
+
+namespace vfs {
+class FileSystem;
+} // end namespace vfs
+
+/// A cache of precompiled headers for the leading include blocks of
+/// translation units, shared by the compiler instances of a run and stored
+/// in a directory so later runs can use it too.
+///
+/// A precompiled header is identified by the compiler options of the variant
+/// and the text of the include block; it is valid as long as every file it
+/// was built from is unchanged and no header appeared ahead of them in the
+/// search path. Files are named after hashes of their contents, so runs
+/// sharing the directory never see each other's partial files.
+///
+/// A translation unit using a precompiled header still includes the headers
+/// of its block itself; their include guards make that a no-op. Blocks
+/// including a header without an include guard are therefore not
+/// precompiled.
+class BruteClangPCHCache {
+public:
+  /// A #include directive of a main file.
+  struct IncludeDirective {
+    /// The directive as written.
+    std::string Text;
+    /// The spelled file name, without quotes or angle brackets.
+    std::string Name;
+    bool IsAngled;
+  };
+
+  /// A precompiled include block.
+  struct Entry {
+    std::string PCHPath;
+    /// The diagnostics raised while parsing the headers, which a translation
+    /// unit using the precompiled header must report as its own.
+    std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+    /// Where the header searches of the build looked before finding a file.
+    /// The translation units using the PCH depend on them too.
+    std::vector<std::string> AbsentPaths;
+    /// Whether some header searches of the build could not be recorded.
+    bool UntrackedLookups = false;
+  };
+
+  BruteClangPCHCache(StringRef CacheDir,
+                     IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps);
+  ~BruteClangPCHCache();
+
+  /// Find the #include directives at the start of \p Source, before any
+  /// other directive or declaration. \p Source must be null terminated.
+  static void getLeadingIncludes(StringRef Source,
+                                 std::vector<IncludeDirective> &Includes);
+
+  /// Decide how many of the leading includes of each of a set of translation
+  /// units to precompile: the longest block any other unit starts with too,
+  /// or the whole block of a unit that shares none.
+  static std::vector<unsigned>
+  getBlockLengths(ArrayRef<std::vector<IncludeDirective>> LeadingIncludes);
+
+  /// Get the precompiled header of \p Includes for the translation unit
+  /// \p MainFile compiled with \p Invocation, building it if there is none.
+  /// Concurrent requests for the same header wait for one build.
+  ///
+  /// \returns null if the block cannot be precompiled.
+  std::shared_ptr<const Entry> getPCH(const CompilerInvocation &Invocation,
+                                      StringRef MainFile,
+                                      ArrayRef<IncludeDirective> Includes);
+
+  void printStatistics(llvm::raw_ostream &OS) const;
+
+private:
+  /// The header text of \p Includes.
+  static std::string getHeaderText(ArrayRef<IncludeDirective> Includes);
+
+  /// Load the entry described by the dependency file of \p Key, if every
+  /// file it was built from is unchanged and still the one found.
+  std::shared_ptr<const Entry> loadEntry(StringRef Key);
+
+  /// Precompile \p HeaderText and write its dependency file. Quoted
+  /// includes are looked up in \p IncluderDir first, unless it is empty.
+  std::shared_ptr<const Entry> buildEntry(const CompilerInvocation &Invocation,
+                                          StringRef Key, StringRef HeaderText,
+                                          StringRef IncluderDir);
+
+  std::string CacheDir;
+  IntrusiveRefCntPtr<vfs::FileSystem> FS;
+  BruteClangFileStamps Stamps;
+  std::shared_ptr<PCHContainerOperations> PCHContainerOps;
+
+  /// The entries requested during this run, by key.
+  std::mutex Lock;
+  llvm::StringMap<std::shared_future<std::shared_ptr<const Entry>>> Entries;
+
+  std::atomic<unsigned> NumRequests{0}, NumLoaded{0}, NumBuilt{0},
+      NumFailed{0};
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGPCHCACHE_H
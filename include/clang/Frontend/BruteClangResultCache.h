@@ -0,0 +1,103 @@
+//===- BruteClangResultCache.h - Diagnostics kept between runs --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Most files of a project are unchanged between two BruteClang runs, and so
+// are most of the headers they include. This file defines an on-disk cache of
+// the diagnostics of each (file, variant) pair, which later runs report
+// without creating a compiler instance as long as nothing the pair was
+// analyzed from has changed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGRESULTCACHE_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGRESULTCACHE_H
+
+#include "clang/Basic/BruteClangDiagnostic.h"
+#include "clang/Basic/BruteClangManifest.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Frontend/BruteClangCacheFile.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+namespace vfs {
+class FileSystem;
+} // end namespace vfs
+
+/// A cache of the diagnostics of compiler instances, stored in a directory
+/// and shared by every run using it.
+///
+/// An entry is keyed by the analyzing tools (the BruteClang binary and the
+/// plugins it loads), the command line of the compiler instance and the
+/// arguments of its variant. It is valid as long as the contents of every
+/// file of the translation unit are unchanged, modification times aside, and
+/// no file appeared where a header search of the instance looked before
+/// finding its header.
+///
+/// Instances that failed to find a file, or whose header searches could not
+/// all be recorded, are not stored.
+class BruteClangResultCache {
+public:
+  /// Collects what a compiler instance depends on, to be added to it with
+  /// addDependencyCollector and handed to store.
+  typedef BruteClangFileCollector FileCollector;
+
+  /// \param ToolHash identifies the analyzing tools; see getToolHash.
+  BruteClangResultCache(StringRef CacheDir,
+                        IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                        StringRef ToolHash);
+  ~BruteClangResultCache();
+
+  /// Hash the contents of \p Executable and of the plugins \p Argv loads
+  /// with -load.
+  ///
+  /// \returns false if one of them cannot be read.
+  static bool getToolHash(StringRef Executable, ArrayRef<const char *> Argv,
+                          std::string &Hash);
+
+  /// Get the key of the compiler instance of \p Argv, run for the variant
+  /// with \p VariantArgs.
+  std::string getKey(ArrayRef<const char *> Argv,
+                     ArrayRef<BruteClangVariantArg> VariantArgs) const;
+
+  /// Get the diagnostics stored for \p Key if the files they were computed
+  /// from are unchanged.
+  bool lookup(StringRef Key,
+              std::vector<CustomDiagContainer::RecordedDiagnostic> &Diags);
+
+  /// Store the diagnostics of the compiler instance with \p Key, computed
+  /// from the files \p Deps collected. Does nothing if the instance failed
+  /// to find a file or made header searches \p Deps could not record.
+  void store(StringRef Key, const FileCollector &Deps,
+             ArrayRef<CustomDiagContainer::RecordedDiagnostic> Diags);
+
+  void printStatistics(llvm::raw_ostream &OS) const;
+
+private:
+  std::string getEntryPath(StringRef Key) const;
+
+  std::string CacheDir;
+  std::string ToolHash;
+  BruteClangFileStamps Stamps;
+
+  std::atomic<unsigned> NumHits{0}, NumMisses{0}, NumStored{0},
+      NumIncomplete{0};
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGRESULTCACHE_H
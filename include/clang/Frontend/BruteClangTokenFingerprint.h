@@ -0,0 +1,44 @@
+//===- BruteClangTokenFingerprint.h - Token stream hashes -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The variants of a translation unit differ only in their -I and -D options,
+// which act on the preprocessor alone. Two variants that preprocess the file
+// to the same tokens, at the same locations, are therefore analyzed alike
+// from Sema on. This file defines the fingerprint BruteClang compares to find
+// such variants.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGTOKENFINGERPRINT_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGTOKENFINGERPRINT_H
+
+#include "clang/Basic/LLVM.h"
+#include <string>
+
+namespace clang {
+
+class CompilerInstance;
+
+/// Compute a hash of everything the preprocessor hands on to the parser for
+/// the input of \p Clang: the kind and spelling of each token, the presumed
+/// location it was expanded at and, for tokens from macro expansions, the
+/// presumed location it was spelled at. The location of every pragma and the
+/// diagnostics raised while preprocessing are included as well.
+///
+/// \p Clang must have its invocation, diagnostics and file manager set up.
+/// Only the preprocessor is run, in a compiler instance of its own; the
+/// invocation and diagnostics of \p Clang are left untouched.
+///
+/// \returns false if the input could not be preprocessed without errors, in
+/// which case \p Fingerprint is unspecified.
+bool computeTokenFingerprint(CompilerInstance &Clang, std::string &Fingerprint);
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGTOKENFINGERPRINT_H
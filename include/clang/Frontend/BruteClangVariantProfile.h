@@ -0,0 +1,128 @@
+//===- BruteClangVariantProfile.h - Per-variant cost records ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Whether a BruteClang run is slow because of one platform, one file or one
+// plugin is invisible in its output. This file defines the profile of a
+// compiler instance, recording the time it spent in each phase of the
+// frontend and the memory it used, and the run-level log the profiles are
+// written to, one JSON object per line.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTPROFILE_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTPROFILE_H
+
+#include "clang/Basic/BruteClangPhaseTimer.h"
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class raw_fd_ostream;
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+class ASTConsumer;
+class CompilerInstance;
+
+/// What the compiler instance analyzing one file for one variant spent its
+/// time and memory on.
+///
+/// The time of the frontend action is split into handling preprocessor
+/// directives (including skipping excluded blocks and finding included
+/// files), running each AST consumer, and the rest: lexing the tokens the
+/// parser consumes, parsing and Sema.
+class BruteClangVariantProfile {
+public:
+  enum OutcomeKind {
+    /// The variant was analyzed.
+    Analyzed,
+    /// Its diagnostics were replayed from the result cache.
+    Replayed,
+    /// It was skipped, being equivalent to another variant.
+    Skipped
+  };
+
+  std::string FileName;
+  std::string VariantName;
+  OutcomeKind Outcome = Analyzed;
+
+  /// The whole time spent on the variant, and the part of it running the
+  /// frontend action. The rest sets the compiler instance up.
+  BruteClangPhaseTime Total;
+  BruteClangPhaseTime Frontend;
+
+  /// Times the preprocessor directives; handed to the preprocessor with
+  /// PreprocessorOptions::DirectiveTimer.
+  std::shared_ptr<BruteClangPhaseTimer> Directives;
+
+  /// Bytes allocated for the AST, as of the end of the translation unit, by
+  /// the preprocessor, and by the source manager for its data structures and
+  /// file buffers.
+  uint64_t ASTBytes = 0;
+  uint64_t PreprocessorBytes = 0;
+  uint64_t SourceManagerBytes = 0;
+
+  /// The peak resident set size of the process so far. It only belongs to
+  /// the variant when the variant runs in a process of its own.
+  uint64_t PeakRSSBytes = 0;
+
+  BruteClangVariantProfile()
+      : Directives(std::make_shared<BruteClangPhaseTimer>()) {}
+
+  /// Wrap \p Consumer so the time spent in it is recorded under \p Name.
+  std::unique_ptr<ASTConsumer>
+  wrapConsumer(std::unique_ptr<ASTConsumer> Consumer, StringRef Name);
+
+  /// Record the memory used by the preprocessor and source manager of \p CI,
+  /// if it still has them, and the peak resident set size.
+  void recordMemory(CompilerInstance &CI);
+
+  /// Write the profile as a JSON object on a single line.
+  void writeJSON(raw_ostream &OS) const;
+
+private:
+  /// The time spent in each wrapped consumer, in the order they were
+  /// wrapped.
+  std::vector<std::pair<std::string, std::unique_ptr<BruteClangPhaseTimer>>>
+      Consumers;
+
+  class TimedConsumer;
+};
+
+/// The file the profiles of a run are written to, one per line. It is opened
+/// for appending, and each profile is written at once, so several threads and
+/// forked children can write to it.
+class BruteClangProfileLog {
+  std::mutex Lock;
+  std::unique_ptr<llvm::raw_fd_ostream> OS;
+
+  explicit BruteClangProfileLog(std::unique_ptr<llvm::raw_fd_ostream> OS);
+
+public:
+  ~BruteClangProfileLog();
+
+  /// Open \p Path, creating it if needed. Returns null, with \p Error
+  /// describing the problem, if it cannot be opened.
+  static std::unique_ptr<BruteClangProfileLog> create(StringRef Path,
+                                                      std::string &Error);
+
+  void write(const BruteClangVariantProfile &Profile);
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTPROFILE_H
@@ -0,0 +1,113 @@
+//===- BruteClangVariantSensitivity.h - Variant dependencies ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The variants of a translation unit differ only in their -I and -D options.
+// This file defines a record of what the preprocessing of a translation unit
+// depended on among those options, which lets BruteClang tell that another
+// variant would preprocess the unit to the same tokens without running it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTSENSITIVITY_H
+#define LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTSENSITIVITY_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class CompilerInstance;
+class DependencyCollector;
+class PreprocessorOptions;
+
+/// The macros the preprocessing of a translation unit queried and the files
+/// its #include directives resolved to, for one variant.
+///
+/// Only the macros given by -D in some variant (the watched macros) are
+/// tracked. A watched macro counts as queried if it was expanded, defined,
+/// undefined or tested, or, when the variant does not define it, if its name
+/// was seen at all. Any other variant that defines the queried macros alike
+/// and finds the same files for the #include directives preprocesses the
+/// unit to the same tokens.
+///
+/// Translation units using __has_include or __has_include_next are not
+/// tracked.
+class BruteClangVariantSensitivity {
+public:
+  /// Prepare to record the preprocessing of a variant with \p PPOpts.
+  BruteClangVariantSensitivity(const llvm::StringSet<> &WatchedMacros,
+                               const PreprocessorOptions &PPOpts);
+  ~BruteClangVariantSensitivity();
+
+  /// Create the collector recording into this object, to be added to the
+  /// compiler instance of the variant with addDependencyCollector.
+  std::shared_ptr<DependencyCollector> createRecorder();
+
+  /// Whether a whole translation unit was recorded and can be compared with
+  /// other variants.
+  bool isComplete() const { return Complete && !Untracked; }
+
+  /// Check whether \p Clang, which must have its invocation and file manager
+  /// set up, would preprocess the recorded translation unit to the same
+  /// tokens. The recording must be complete.
+  bool matches(CompilerInstance &Clang) const;
+
+  unsigned getNumQueriedMacros() const { return QueriedMacros.size(); }
+  unsigned getNumIncludeLookups() const { return Lookups.size(); }
+
+private:
+  class Recorder;
+
+  /// A header search made by an #include directive.
+  struct IncludeLookup {
+    /// The file holding the directive, and the directory quoted includes are
+    /// looked up in first.
+    std::string IncluderFile, IncluderDir;
+    /// The file name as spelled.
+    std::string Name;
+    bool IsAngled;
+    /// For #include_next, the search directory the search starts after;
+    /// empty to start at the front of the search list.
+    std::string FromDir;
+    /// The file found, or none.
+    bool Found;
+    llvm::sys::fs::UniqueID File;
+  };
+
+  /// Get the effective definition under \p PPOpts of each macro in
+  /// \p Names: the text following its name in the last -D option. Macros
+  /// that are not defined get no entry.
+  static void getDefinitions(const PreprocessorOptions &PPOpts,
+                             const llvm::StringSet<> &Names,
+                             llvm::StringMap<std::string> &Definitions);
+
+  const llvm::StringSet<> &WatchedMacros;
+
+  /// The definitions of the watched macros in the recorded variant.
+  llvm::StringMap<std::string> Definitions;
+
+  llvm::StringSet<> QueriedMacros;
+
+  std::vector<IncludeLookup> Lookups;
+
+  /// Keys of the lookups recorded already, to record each lookup once.
+  llvm::StringSet<> LookupKeys;
+
+  bool Complete = false;
+  bool Untracked = false;
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_BRUTECLANGVARIANTSENSITIVITY_H
@@ -186,6 +186,13 @@ public:
   /// \brief Does this action support use with code completion?
   virtual bool hasCodeCompletionSupport() const { return false; }
 
+  /// \brief Does the consumer of this action choose the declarations it
+  /// checks itself, with BruteClangDeclFilter::CheckScope?
+  ///
+  /// If so its consumer is not wrapped to filter the declarations it is
+  /// handed under -brute-dedup-decls.
+  virtual bool usesDeclCheckScopes() const { return false; }
+
   /// @}
   /// @name Public Action Interface
   /// @{
@@ -305,6 +312,7 @@ public:
   bool hasASTFileSupport() const override;
   bool hasIRSupport() const override;
   bool hasCodeCompletionSupport() const override;
+  bool usesDeclCheckScopes() const override;
 };
 
 }  // end namespace clang
@@ -23,6 +23,8 @@ class MemoryBuffer;
 }
 
 namespace clang {
+class BruteClangDeclFilter;
+class BruteClangVariantProfile;
 class FileEntry;
 
 namespace frontend {
@@ -293,6 +295,14 @@ public:
   /// The list of module file extensions.
   std::vector<std::shared_ptr<ModuleFileExtension>> ModuleFileExtensions;
 
+  /// The profile the time spent in each AST consumer is recorded in, when
+  /// set. Set by BruteClang rather than by any command line option.
+  std::shared_ptr<BruteClangVariantProfile> VariantProfile;
+
+  /// The filter deciding which declarations the plugins check, when set.
+  /// Set by BruteClang rather than by any command line option.
+  std::shared_ptr<BruteClangDeclFilter> DeclFilter;
+
   /// \brief The list of module map files to load before processing the input.
   std::vector<std::string> ModuleMapFiles;
 
@@ -0,0 +1,121 @@
+//===- BruteClangConditionalScan.h - Shared conditional blocks --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The variants of a translation unit take different branches of the same
+// #if/#ifdef blocks, and each of them lexes every branch it does not take
+// token by token to find the directive ending it. This file defines a scan,
+// shared by the compiler instances of a run, that finds where each
+// conditional block of a file ends once, so that skipping a block becomes a
+// jump over it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_BRUTECLANGCONDITIONALSCAN_H
+#define LLVM_CLANG_LEX_BRUTECLANGCONDITIONALSCAN_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+class LangOptions;
+
+/// Where the conditional blocks of one file end. It is declared outside
+/// BruteClangConditionalScan so that Preprocessor.h can hold pointers to it
+/// without including this file.
+class BruteClangConditionalBlocks {
+  friend class BruteClangConditionalScan;
+
+  /// By the offset of the directive name opening a block (the "if" of an
+  /// #if, #ifdef or #ifndef, or the name of an #elif or #else), the offset of
+  /// the '#' of the #elif, #else or #endif ending it at the same nesting
+  /// level.
+  llvm::DenseMap<unsigned, unsigned> Ends;
+
+public:
+  /// Get the offset of the '#' of the directive ending the block opened by
+  /// the directive named at \p DirectiveOffset, or 0 if it is not known.
+  unsigned getEnd(unsigned DirectiveOffset) const {
+    return Ends.lookup(DirectiveOffset);
+  }
+
+  unsigned size() const { return Ends.size(); }
+};
+
+/// Scans files for their conditional blocks and keeps the result for every
+/// compiler instance of a run.
+///
+/// The blocks are found by raw lexing the file from its start, as the
+/// preprocessor does when it skips a block, and nested blocks are part of
+/// the block they are in. Files are identified by their name, size and the
+/// language options lexing depends on; like BruteClangFileSystem, the scan
+/// assumes the source tree does not change during a run. A file whose
+/// directives the preprocessor would diagnose while skipping (an #else or
+/// #elif after an #else, or a directive name that needs cleaning) gets no
+/// blocks, so that it is lexed and diagnosed as usual.
+///
+/// The scan is thread-safe.
+class BruteClangConditionalScan {
+public:
+  typedef BruteClangConditionalBlocks Blocks;
+
+  struct Statistics {
+    /// Files scanned for their blocks.
+    unsigned NumFilesScanned = 0;
+    /// Blocks the preprocessor jumped over instead of lexing them.
+    unsigned NumJumps = 0;
+    /// Bytes of the files it did not lex because of those jumps.
+    uint64_t NumBytesSkipped = 0;
+  };
+
+  BruteClangConditionalScan() = default;
+  BruteClangConditionalScan(const BruteClangConditionalScan &) = delete;
+  BruteClangConditionalScan &
+  operator=(const BruteClangConditionalScan &) = delete;
+
+  /// Find the conditional blocks of \p Buffer, lexed with \p LangOpts.
+  static std::unique_ptr<Blocks> scan(StringRef Buffer,
+                                      const LangOptions &LangOpts);
+
+  /// Get the blocks of the file \p Name, whose contents are \p Buffer,
+  /// scanning it if no instance has done so yet.
+  const Blocks &getBlocks(StringRef Name, StringRef Buffer,
+                          const LangOptions &LangOpts);
+
+  /// Record that the preprocessor jumped over \p Bytes bytes of a file.
+  void noteJump(unsigned Bytes) {
+    ++NumJumps;
+    NumBytesSkipped += Bytes;
+  }
+
+  Statistics getStatistics() const;
+  void printStatistics(llvm::raw_ostream &OS) const;
+
+private:
+  std::mutex Lock;
+
+  /// The blocks of every file scanned, by name, size and language options.
+  llvm::StringMap<std::unique_ptr<Blocks>> Files;
+
+  std::atomic<unsigned> NumFilesScanned{0}, NumJumps{0};
+  std::atomic<uint64_t> NumBytesSkipped{0};
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_LEX_BRUTECLANGCONDITIONALSCAN_H
@@ -0,0 +1,113 @@
+//===- BruteClangHeaderLookupCache.h - Shared header lookups --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The -I lists of the variants of a translation unit differ in their leading,
+// platform specific directories (x/i386, x, p, ...) but end in the same long
+// sequence of common ones. This file defines a cache, shared by the compiler
+// instances of a run, remembering where in such a sequence a header name was
+// found, so that only the first variant probes it directory by directory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_BRUTECLANGHEADERLOOKUPCACHE_H
+#define LLVM_CLANG_LEX_BRUTECLANGHEADERLOOKUPCACHE_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Allocator.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace llvm {
+class raw_ostream;
+} // end namespace llvm
+
+namespace clang {
+
+/// An interned sequence of search directories of a
+/// BruteClangHeaderLookupCache. It is declared outside the cache so that
+/// HeaderSearch.h can hold pointers to it without including this file.
+class BruteClangHeaderLookupSuffix {
+  friend class BruteClangHeaderLookupCache;
+
+  /// The number of directories in the sequence.
+  unsigned Length;
+
+  /// For each header name looked up, how many directories to skip to reach
+  /// the one holding it. Length if no directory holds it. Guarded by the lock
+  /// of the cache.
+  mutable llvm::StringMap<unsigned> Results;
+
+public:
+  explicit BruteClangHeaderLookupSuffix(unsigned Length) : Length(Length) {}
+
+  unsigned getLength() const { return Length; }
+};
+
+/// Caches the results of header searches through sequences of directories.
+///
+/// A search list is represented by its suffixes: the suffix starting at
+/// search directory i is directory i followed by the suffix starting at i+1.
+/// Suffixes are interned, so two search lists ending in the same directories
+/// share the same suffix objects for them. For each suffix and header name
+/// the cache records how many directories of the suffix are to be skipped to
+/// reach the one holding the header; a search starting at any directory of
+/// that suffix can jump straight there, whatever directories precede it in
+/// its own search list.
+///
+/// Only the existence of files is cached, so only suffixes made of plain
+/// directories (no header maps or frameworks) are represented. The cache is
+/// thread-safe.
+class BruteClangHeaderLookupCache {
+public:
+  typedef BruteClangHeaderLookupSuffix Suffix;
+
+  BruteClangHeaderLookupCache() = default;
+  BruteClangHeaderLookupCache(const BruteClangHeaderLookupCache &) = delete;
+  BruteClangHeaderLookupCache &
+  operator=(const BruteClangHeaderLookupCache &) = delete;
+
+  /// Get the suffix made of directory \p DirName followed by \p Next, which
+  /// may be null for the end of the search list.
+  const Suffix *getSuffix(StringRef DirName, const Suffix *Next);
+
+  /// Look up how many directories of \p S to skip to find \p Filename.
+  ///
+  /// \returns false if no search for \p Filename through \p S was recorded.
+  bool lookup(const Suffix *S, StringRef Filename, unsigned &DirsToSkip);
+
+  /// Record a search for \p Filename through directories \p StartIdx up to
+  /// \p HitIdx of a search list, which found it in \p HitIdx, or nowhere if
+  /// \p HitIdx is the size of the list. \p Suffixes holds the suffix starting
+  /// at each directory of the search list, or null where there is none.
+  void record(ArrayRef<const Suffix *> SearchDirSuffixes, unsigned StartIdx,
+              unsigned HitIdx, StringRef Filename);
+
+  void printStatistics(llvm::raw_ostream &OS) const;
+
+private:
+  std::mutex Lock;
+
+  /// The directory names of all suffixes.
+  llvm::StringSet<llvm::BumpPtrAllocator> DirNames;
+
+  /// Suffixes by (interned directory name, following suffix).
+  llvm::DenseMap<std::pair<const char *, const Suffix *>, Suffix *>
+      SuffixIndex;
+  std::deque<Suffix> Suffixes;
+
+  std::atomic<unsigned> NumLookups{0}, NumHits{0}, NumDirsSkipped{0};
+};
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_LEX_BRUTECLANGHEADERLOOKUPCACHE_H
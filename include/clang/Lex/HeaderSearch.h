@@ -26,6 +26,8 @@
 
 namespace clang {
   
+class BruteClangHeaderLookupCache;
+class BruteClangHeaderLookupSuffix;
 class DiagnosticsEngine;  
 class ExternalPreprocessorSource;
 class FileEntry;
@@ -199,6 +201,11 @@ class HeaderSearch {
   };
   llvm::StringMap<LookupFileCacheInfo, llvm::BumpPtrAllocator> LookupFileCache;
 
+  /// The suffix of the search list starting at each entry of SearchDirs in
+  /// the run-level cache of BruteClang, or null where the suffix contains
+  /// something other than plain directories. Computed by the first lookup.
+  std::vector<const BruteClangHeaderLookupSuffix *> SearchDirSuffixes;
+
   /// \brief Collection mapping a framework or subframework
   /// name like "Carbon" to the Carbon.framework directory.
   llvm::StringMap<FrameworkCacheEntry, llvm::BumpPtrAllocator> FrameworkMap;
@@ -269,7 +276,8 @@ public:
     AngledDirIdx = angledDirIdx;
     SystemDirIdx = systemDirIdx;
     NoCurDirSearch = noCurDirSearch;
-    //LookupFileCache.clear();
+    LookupFileCache.clear();
+    SearchDirSuffixes.clear();
   }
 
   /// \brief Add an additional search path.
@@ -279,6 +287,7 @@ public:
     if (!isAngled)
       AngledDirIdx++;
     SystemDirIdx++;
+    SearchDirSuffixes.clear();
   }
 
   /// \brief Set the list of system header prefixes.
@@ -619,6 +628,10 @@ private:
                           Module *RequestingModule,
                           ModuleMap::KnownHeader *SuggestedModule);
 
+  /// Compute SearchDirSuffixes for the current search list, unless it is
+  /// already known.
+  void computeSearchDirSuffixes(BruteClangHeaderLookupCache &Cache);
+
 public:
   /// \brief Retrieve the module map.
   ModuleMap &getModuleMap() { return ModMap; }
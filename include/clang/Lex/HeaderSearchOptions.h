@@ -15,11 +15,14 @@
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/StringRef.h"
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace clang {
 
+class BruteClangHeaderLookupCache;
+
 namespace frontend {
   /// IncludeDirGroup - Identifies the group an include Entry belongs to,
   /// representing its relative positive in the search list.
@@ -150,6 +153,10 @@ public:
   /// \brief The set of user-provided virtual filesystem overlay files.
   std::vector<std::string> VFSOverlayFiles;
 
+  /// Header search results shared with the other compiler instances of a
+  /// BruteClang run. Set by BruteClang rather than by any command line option.
+  std::shared_ptr<BruteClangHeaderLookupCache> SharedLookupCache;
+
   /// Include the compiler builtin includes.
   unsigned UseBuiltinIncludes : 1;
 
@@ -224,7 +224,19 @@ public:
 
   /// \brief Return the current location in the buffer.
   const char *getBufferLocation() const { return BufferPtr; }
-  
+
+  /// Move the lexer to \p Offset in its buffer, as if everything up to it
+  /// had been lexed. \p IsAtStartOfLine tells whether the next token starts a
+  /// line.
+  void seek(unsigned Offset, bool IsAtStartOfLine) {
+    BufferPtr = BufferStart + Offset;
+    if (BufferPtr > BufferEnd)
+      BufferPtr = BufferEnd;
+    this->IsAtStartOfLine = IsAtStartOfLine;
+    IsAtPhysicalStartOfLine = IsAtStartOfLine;
+    HasLeadingSpace = false;
+  }
+
   /// Stringify - Convert the specified string into a C string by escaping '\'
   /// and " characters.  This does not add surrounding ""'s to the string.
   /// If Charify is true, this escapes the ' character instead of ".
@@ -0,0 +1,66 @@
+//===--- LexerScan.h - Vector scanning of character runs --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The lexer spends much of its time stepping over runs of characters that
+// need no decoding: identifier bodies, whitespace, comments and the bodies
+// of string literals. This file declares routines finding where such a run
+// ends many characters at a time, with the widest vector instructions the
+// host supports, chosen when they are first used.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_LEXERSCAN_H
+#define LLVM_CLANG_LEX_LEXERSCAN_H
+
+namespace clang {
+
+/// The instructions the scanning routines use.
+enum class LexerScanLevel {
+  Scalar,
+  SSE2,
+  AVX2,
+  AVX512
+};
+
+/// The widest level both the host and the compiler clang was built with
+/// support.
+LexerScanLevel getHostLexerScanLevel();
+
+/// The level the scanning routines use: the host's, unless set otherwise.
+LexerScanLevel getLexerScanLevel();
+
+/// Make the scanning routines use \p Level, which the host must support.
+/// Meant for testing and measuring; not to be called while lexing.
+void setLexerScanLevel(LexerScanLevel Level);
+
+/// Each routine returns the first character in [Ptr, End) that ends its
+/// kind of run, or End if there is none. Characters at and after End are not
+/// read. None of the runs includes '\0', so they end at the null terminator
+/// of a buffer, and at a code completion point, as the byte loops they
+/// replace do.
+
+/// Identifier body characters: [A-Za-z0-9_].
+const char *scanIdentifierBody(const char *Ptr, const char *End);
+
+/// Horizontal whitespace: ' ', '\\t', '\\f', '\\v'.
+const char *scanHorizontalWhitespace(const char *Ptr, const char *End);
+
+/// The body of a line comment: anything but '\\0', '\\n' and '\\r'.
+const char *scanLineCommentBody(const char *Ptr, const char *End);
+
+/// The characters of a string literal that stand for themselves: anything
+/// but '"', '\\\\', '?' (which may start a trigraph), '\\0', '\\n' and '\\r'.
+const char *scanStringLiteralBody(const char *Ptr, const char *End);
+
+/// Preprocessing number body characters: [A-Za-z0-9_.].
+const char *scanNumberBody(const char *Ptr, const char *End);
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_LEX_LEXERSCAN_H
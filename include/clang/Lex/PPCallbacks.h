@@ -28,6 +28,7 @@ namespace clang {
   class MacroDefinition;
   class MacroDirective;
   class MacroArgs;
+  class DirectoryLookup;
 
 /// \brief This interface provides a way to observe the actions of the
 /// preprocessor as it does its thing.
@@ -128,6 +129,27 @@ public:
                                   const Module *Imported) {
   }
 
+  /// \brief Callback invoked whenever a '__has_include' or
+  /// '__has_include_next' expression has looked up its file.
+  ///
+  /// \param Loc The location of the file name.
+  ///
+  /// \param FileName The name of the file, as for InclusionDirective.
+  ///
+  /// \param IsAngled Whether the file name was enclosed in angle brackets.
+  ///
+  /// \param FromDir The search directory a '__has_include_next' started
+  /// looking in, or null for a lookup like that of \c \#include.
+  ///
+  /// \param File The file found, or null if there is none.
+  ///
+  /// \param SearchPath The search path the file was found in, as for
+  /// InclusionDirective.
+  virtual void HasInclude(SourceLocation Loc, StringRef FileName,
+                          bool IsAngled, const DirectoryLookup *FromDir,
+                          const FileEntry *File, StringRef SearchPath) {
+  }
+
   /// \brief Callback invoked whenever there was an explicit module-import
   /// syntax.
   ///
@@ -365,6 +387,13 @@ public:
                                Imported);
   }
 
+  void HasInclude(SourceLocation Loc, StringRef FileName, bool IsAngled,
+                  const DirectoryLookup *FromDir, const FileEntry *File,
+                  StringRef SearchPath) override {
+    First->HasInclude(Loc, FileName, IsAngled, FromDir, File, SearchPath);
+    Second->HasInclude(Loc, FileName, IsAngled, FromDir, File, SearchPath);
+  }
+
   void moduleImport(SourceLocation ImportLoc, ModuleIdPath Path,
                     const Module *Imported) override {
     First->moduleImport(ImportLoc, Path, Imported);
@@ -43,6 +43,7 @@ namespace llvm {
 namespace clang {
 
 class SourceManager;
+class BruteClangConditionalBlocks;
 class ExternalPreprocessorSource;
 class FileManager;
 class FileEntry;
@@ -615,6 +616,12 @@ class Preprocessor {
   /// we keep a MacroInfo stack used to restore the previous macro value.
   llvm::DenseMap<IdentifierInfo*, std::vector<MacroInfo*> > PragmaPushMacroInfo;
 
+  /// The conditional blocks of each file entered, looked up in
+  /// PreprocessorOptions::ConditionalScan the first time a block of the file
+  /// is skipped. Null for files the scan does not cover.
+  llvm::DenseMap<FileID, const BruteClangConditionalBlocks *>
+      ConditionalBlocks;
+
   // Various statistics we track for performance analysis.
   unsigned NumDirectives, NumDefined, NumUndefined, NumPragma;
   unsigned NumIf, NumElse, NumEndif;
@@ -1843,6 +1850,15 @@ private:
   /// \brief A fast PTH version of SkipExcludedConditionalBlock.
   void PTHSkipExcludedConditionalBlock();
 
+  /// Get the conditional blocks of the file being lexed, or null if the
+  /// blocks of the file are not to be jumped over.
+  const BruteClangConditionalBlocks *getConditionalBlocks();
+
+  /// Move the lexer of the current file past the block opened by the
+  /// directive named at \p DirectiveLoc, to the directive ending it.
+  void jumpOverConditionalBlock(const BruteClangConditionalBlocks &Blocks,
+                                SourceLocation DirectiveLoc);
+
   /// Information about the result for evaluating an expression for a
   /// preprocessor directive.
   struct DirectiveEvalResult {
@@ -26,6 +26,8 @@ namespace llvm {
 
 namespace clang {
 
+class BruteClangConditionalScan;
+class BruteClangPhaseTimer;
 class Preprocessor;
 class LangOptions;
 
@@ -155,6 +157,15 @@ public:
   /// build it again.
   std::shared_ptr<FailedModulesSet> FailedModules;
 
+  /// Adds up the time spent handling preprocessor directives, when set.
+  /// Set by BruteClang rather than by any command line option.
+  std::shared_ptr<BruteClangPhaseTimer> DirectiveTimer;
+
+  /// The conditional blocks shared with the other compiler instances of the
+  /// run, which lets skipped blocks be jumped over. Set by BruteClang, and
+  /// only for instances reading files through its shared file system.
+  std::shared_ptr<BruteClangConditionalScan> ConditionalScan;
+
 public:
   PreprocessorOptions() : UsePredefines(true), DetailedRecord(false),
                           DisablePCHValidation(false),
@@ -2,99 +2,520 @@
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Basic/IdentifierTable.h"
+#include "clang/Basic/LangOptions.h"
 #include "clang/Basic/PartialDiagnostic.h"
 #include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CrashRecoveryContext.h"
 #include "llvm/Support/Locale.h"
 #include "llvm/Support/raw_ostream.h"
 #include "clang/Basic/BruteClangDiagnostic.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 using namespace clang;
 
 void CustomDiagConsumer::anchor() { }
 
+//the arguments of a captured diagnostic are encoded as a kind byte each,
+//followed for strings and identifiers by a 32-bit length, the characters
+//and a NUL (a length of ~0U if null), and by the raw value for
+//the others. Returns false if an argument only makes sense while the
+//compiler instance is alive, e.g. a type or a declaration.
+static bool EncodeArgs(const Diagnostic &Info, std::string &Args){
+  for (unsigned I = 0, E = Info.getNumArgs(); I != E; ++I){
+    DiagnosticsEngine::ArgumentKind Kind = Info.getArgKind(I);
+    llvm::StringRef Str;
+    bool Null = false;
+    switch (Kind){
+    case DiagnosticsEngine::ak_std_string:
+      Str = Info.getArgStdStr(I);
+      break;
+    case DiagnosticsEngine::ak_c_string:
+      if (const char *CStr = Info.getArgCStr(I))
+        Str = CStr;
+      else
+        Null = true;
+      break;
+    case DiagnosticsEngine::ak_identifierinfo:
+      if (const IdentifierInfo *II = Info.getArgIdentifier(I))
+        Str = II->getName();
+      else
+        Null = true;
+      break;
+    case DiagnosticsEngine::ak_sint:
+    case DiagnosticsEngine::ak_uint:
+    case DiagnosticsEngine::ak_tokenkind:{
+      intptr_t Value = Info.getRawArg(I);
+      Args.push_back(Kind);
+      Args.append(reinterpret_cast<const char *>(&Value), sizeof(Value));
+      continue;
+    }
+    default:
+      return false;
+    }
+    uint32_t Size = Null ? ~0U : Str.size();
+    Args.push_back(Kind);
+    Args.append(reinterpret_cast<const char *>(&Size), sizeof(Size));
+    if (!Null){
+      Args.append(Str.begin(), Str.end());
+      Args.push_back('\0');
+    }
+  }
+  return true;
+}
+
+//whether the container can format and locate Info on its own: the location
+//is in a file and the diagnostic and its arguments mean the same outside the
+//compiler instance. The arguments are checked by EncodeArgs.
+static bool IsCapturable(const Diagnostic &Info){
+  SourceLocation Loc = Info.getLocation();
+  return Info.hasSourceManager() && Loc.isValid() && Loc.isFileID() &&
+         Info.getID() < diag::DIAG_UPPER_LIMIT && Info.getFlagValue().empty();
+}
+
 void CustomDiagConsumer::HandleDiagnostic(DiagnosticsEngine::Level DiagLevel, const Diagnostic &Info){
+  //capture the diagnostic for the container to format and locate once, if
+  //it can do so on its own.
+  SourceLocation Loc = Info.getLocation();
+  if (IsCapturable(Info)){
+    const SourceManager &SM = Info.getSourceManager();
+    std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+    const FileEntry *File = SM.getFileEntryForID(Decomposed.first);
+    bool Invalid = false;
+    llvm::StringRef Text = SM.getBufferData(Decomposed.first, &Invalid);
+    ArgsBuffer.clear();
+    if (File && !Invalid && EncodeArgs(Info, ArgsBuffer) &&
+        DiagContainer.AddCapturedDiagnostic(CI_ID, File->getName(), Text, Decomposed.second, Info.getID(), ArgsBuffer))
+      return;
+  }
 
   llvm::SmallVector<char, 256> message_SmallVector; //character buffer for formatting diagnostics messages
   Info.FormatDiagnostic(message_SmallVector); //format the diagnostic message into the message buffer
-  std::string message(message_SmallVector.begin(), message_SmallVector.end()); //convert the llvm::SmallVector buffer to a std::string obj
+  llvm::StringRef message(message_SmallVector.data(), message_SmallVector.size());
   
   unsigned LineNumber = Info.getSourceManager().getSpellingLineNumber(Info.getLocation());
   //get column number using PresumedLocation
 
   unsigned ColumnNumber = Info.getSourceManager().getPresumedColumnNumber(Info.getLocation());
   
-  llvm::StringRef FileName_StringRef = Info.getSourceManager().getFilename(Info.getLocation());
-  std::string FileName(FileName_StringRef.begin(), FileName_StringRef.end()); //file name as std::string
+  llvm::StringRef FileName = Info.getSourceManager().getFilename(Info.getLocation());
 
-  DiagContainer.AddDiagnostic(FileName, ColumnNumber, LineNumber, message);
+  DiagContainer.AddDiagnostic(CI_ID, FileName, ColumnNumber, LineNumber, message, Info.getID());
 }
 
+namespace clang {
+//formats captured diagnostics once the compiler instances that reported them
+//are gone, replaying their ID and arguments into an engine of its own.
+class CustomDiagFormatter : public DiagnosticConsumer {
+  LangOptions LangOpts;
+  IdentifierTable Idents;
+  DiagnosticsEngine Engine;
+  llvm::SmallString<256> Message;
 
-bool CustomDiagContainer::DiagExists(std::string &message, unsigned line, std::string &file){
-  for (std::list<DiagData>::iterator it = DiagList.begin(); it != DiagList.end(); it++){
-    if((it->msg == message)&&(it->LineNumber == line)&&(it->FileName == file)){
-      return true; //return true if any of the structs match line number and message and file name
+  void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel, const Diagnostic &Info) override {
+    Message.clear();
+    Info.FormatDiagnostic(Message);
+  }
+
+public:
+  CustomDiagFormatter()
+      : Idents(LangOpts), Engine(new DiagnosticIDs(), new DiagnosticOptions(), this, false) {}
+
+  //the message of diagnostic DiagID with the arguments encoded in Args, as
+  //by EncodeArgs. Valid until the next call.
+  llvm::StringRef Format(unsigned DiagID, llvm::StringRef Args){
+    //the diagnostic may be ignored by default, but was not where it was
+    //reported; force emitting it at a level it cannot be ignored at.
+    Engine.setSeverity(DiagID, diag::Severity::Error, SourceLocation());
+    Message.clear();
+    {
+      DiagnosticBuilder Builder = Engine.Report(DiagID);
+      Builder.setForceEmit();
+      const char *Ptr = Args.begin();
+      while (Ptr != Args.end()){
+        auto Kind = static_cast<DiagnosticsEngine::ArgumentKind>(*Ptr++);
+        if (Kind == DiagnosticsEngine::ak_sint || Kind == DiagnosticsEngine::ak_uint ||
+            Kind == DiagnosticsEngine::ak_tokenkind){
+          intptr_t Value;
+          memcpy(&Value, Ptr, sizeof(Value));
+          Ptr += sizeof(Value);
+          Builder.AddTaggedVal(Value, Kind);
+          continue;
+        }
+        uint32_t Size;
+        memcpy(&Size, Ptr, sizeof(Size));
+        Ptr += sizeof(Size);
+        if (Size == ~0U){
+          Builder.AddTaggedVal(0, Kind);
+          continue;
+        }
+        llvm::StringRef Str(Ptr, Size);
+        Ptr += Size + 1;
+        if (Kind == DiagnosticsEngine::ak_std_string)
+          Builder.AddString(Str);
+        else if (Kind == DiagnosticsEngine::ak_c_string)
+          Builder.AddTaggedVal(reinterpret_cast<intptr_t>(Str.data()), Kind);
+        else
+          Builder.AddTaggedVal(reinterpret_cast<intptr_t>(&Idents.get(Str)), Kind);
+      }
     }
+    return Message;
   }
-  return false; //if for loop did not return true, then return false.
+};
+} //end namespace clang
+
+bool CustomDiagContainer::CaptureDiagnostic(const Diagnostic &Info, CapturedDiagnostic &Diag){
+  if (!IsCapturable(Info))
+    return false;
+  const SourceManager &SM = Info.getSourceManager();
+  SourceLocation Loc = Info.getLocation();
+  std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+  const FileEntry *File = SM.getFileEntryForID(Decomposed.first);
+  bool Invalid = false;
+  llvm::StringRef Text = SM.getBufferData(Decomposed.first, &Invalid);
+  Diag.Args.clear();
+  if (!File || Invalid || !EncodeArgs(Info, Diag.Args))
+    return false;
+  Diag.FileName = File->getName().str();
+  Diag.Offset = Decomposed.second;
+  Diag.FileSize = Text.size();
+  Diag.LineNumber = SM.getSpellingLineNumber(Loc);
+  Diag.ColumnNumber = SM.getPresumedColumnNumber(Loc);
+  Diag.DiagID = Info.getID();
+  return true;
 }
 
-void CustomDiagContainer::AddNewDiagData(std::string &FileName, unsigned ColumnNumber, unsigned LineNumber, std::string &message){
-  DiagData DD;
-  DD.CI_Names = CompilerInstanceName;
-  DD.msg = message;
-  DD.FileName = FileName;
-  DD.LineNumber = LineNumber;
-  DiagList.push_back(DD);
-  return;
+CustomDiagContainer::CustomDiagContainer() = default;
+CustomDiagContainer::~CustomDiagContainer() = default;
+
+CustomDiagContainer::DiagKey CustomDiagContainer::DiagKeyInfo::getEmptyKey(){
+  DiagKey Key = {llvm::DenseMapInfo<const char *>::getEmptyKey(), nullptr, 0, 0, 0};
+  return Key;
 }
 
-void CustomDiagContainer::AddToExistingDiagData(std::string &message, unsigned line, std::string &file){
+CustomDiagContainer::DiagKey CustomDiagContainer::DiagKeyInfo::getTombstoneKey(){
+  DiagKey Key = {llvm::DenseMapInfo<const char *>::getTombstoneKey(), nullptr, 0, 0, 0};
+  return Key;
+}
+
+unsigned CustomDiagContainer::DiagKeyInfo::getHashValue(const DiagKey &Key){
+  //the strings are interned, so hashing the pointers is enough.
+  return llvm::hash_combine(Key.FileName, Key.msg, Key.LineNumber, Key.ColumnNumber, Key.DiagID);
+}
+
+bool CustomDiagContainer::DiagKeyInfo::isEqual(const DiagKey &LHS, const DiagKey &RHS){
+  return LHS.FileName == RHS.FileName && LHS.msg == RHS.msg &&
+         LHS.LineNumber == RHS.LineNumber && LHS.ColumnNumber == RHS.ColumnNumber &&
+         LHS.DiagID == RHS.DiagID;
+}
 
-  for (std::list<DiagData>::iterator it = DiagList.begin(); it != DiagList.end(); it++){
-    if((it->msg == message)&&(it->LineNumber == line)&&(it->FileName == file)){
-      it->CI_Names.append(", ");
-      it->CI_Names.append(CompilerInstanceName);
+CustomDiagContainer::CapturedKey CustomDiagContainer::CapturedKeyInfo::getEmptyKey(){
+  CapturedKey Key = {llvm::DenseMapInfo<const char *>::getEmptyKey(), nullptr, 0, 0, 0};
+  return Key;
+}
+
+CustomDiagContainer::CapturedKey CustomDiagContainer::CapturedKeyInfo::getTombstoneKey(){
+  CapturedKey Key = {llvm::DenseMapInfo<const char *>::getTombstoneKey(), nullptr, 0, 0, 0};
+  return Key;
+}
+
+unsigned CustomDiagContainer::CapturedKeyInfo::getHashValue(const CapturedKey &Key){
+  //as for DiagKey, the file name and the arguments are interned.
+  return llvm::hash_combine(Key.FileName, Key.Args, Key.Offset, Key.DiagID);
+}
+
+bool CustomDiagContainer::CapturedKeyInfo::isEqual(const CapturedKey &LHS, const CapturedKey &RHS){
+  return LHS.FileName == RHS.FileName && LHS.Args == RHS.Args &&
+         LHS.Offset == RHS.Offset && LHS.DiagID == RHS.DiagID;
+}
+
+llvm::StringRef CustomDiagContainer::Intern(llvm::StringRef Str){
+  return InternedStrings.insert(Str).first->getKey();
+}
+
+unsigned CustomDiagContainer::AddCompilerInstance(const std::string &CI_Name){
+  std::lock_guard<std::mutex> Guard(Lock);
+  CompilerInstanceNames.push_back(CI_Name);
+  PendingDiags.emplace_back();
+  LeaderIDs.push_back(PendingDiags.size() - 1);
+  return CompilerInstanceNames.size() - 1;
+}
+
+void CustomDiagContainer::AddDiagnostic(unsigned CI_ID, llvm::StringRef FileName, unsigned ColumnNumber, unsigned LineNumber, llvm::StringRef message, unsigned DiagID){
+  std::lock_guard<std::mutex> Guard(Lock);
+  assert(CI_ID < PendingDiags.size() && "compiler instance was not registered");
+  DiagKey Key = {Intern(FileName).data(), Intern(message).data(), LineNumber, ColumnNumber, DiagID};
+  auto Inserted = FormattedIndex.insert(std::make_pair(Key, unsigned(Records.size())));
+  if (Inserted.second){
+    DiagRecord Record = {Key, CapturedKeyInfo::getEmptyKey(), true, ~0U, false};
+    Records.push_back(Record);
+  }
+  PendingDiags[CI_ID].push_back(Inserted.first->second);
+}
+
+bool CustomDiagContainer::AddCapturedDiagnostic(unsigned CI_ID, llvm::StringRef FileName, llvm::StringRef Text, unsigned Offset, unsigned DiagID, llvm::StringRef Args){
+  std::lock_guard<std::mutex> Guard(Lock);
+  assert(CI_ID < PendingDiags.size() && "compiler instance was not registered");
+  llvm::StringRef InternedArgs = Intern(Args);
+  CapturedKey Key = {Intern(FileName).data(), InternedArgs.data(), unsigned(InternedArgs.size()), Offset, DiagID};
+
+  //find where the lines of the file start the first time it is seen, once
+  //for every compiler instance
+  auto File = CapturedFiles.insert(std::make_pair(Key.FileName, CapturedFile()));
+  if (File.second){
+    CapturedFile &CF = File.first->second;
+    CF.Size = Text.size();
+    CF.LineOffsets.push_back(0);
+    for (unsigned I = 0, E = Text.size(); I != E; ++I){
+      //a line ends at \n, \r, \r\n or \n\r, as for the SourceManager
+      if (Text[I] != '\n' && Text[I] != '\r')
+        continue;
+      if (I + 1 != E && (Text[I + 1] == '\n' || Text[I + 1] == '\r') && Text[I + 1] != Text[I])
+        ++I;
+      CF.LineOffsets.push_back(I + 1);
     }
   }
+  else if (File.first->second.Size != Text.size())
+    return false;
+
+  auto Inserted = CapturedIndex.insert(std::make_pair(Key, unsigned(Records.size())));
+  if (Inserted.second){
+    DiagRecord Record = {DiagKeyInfo::getEmptyKey(), Key, false, ~0U, false};
+    Records.push_back(Record);
+  }
+  PendingDiags[CI_ID].push_back(Inserted.first->second);
+  return true;
 }
 
-void CustomDiagContainer::SetCompilerInstanceName(std::string &CI_Name){
-  CompilerInstanceName = CI_Name;
-  return;
+void CustomDiagContainer::AddCapturedDiagnostic(unsigned CI_ID, const CapturedDiagnostic &Diag){
+  std::lock_guard<std::mutex> Guard(Lock);
+  assert(CI_ID < PendingDiags.size() && "compiler instance was not registered");
+  llvm::StringRef InternedArgs = Intern(Diag.Args);
+  CapturedKey Key = {Intern(Diag.FileName).data(), InternedArgs.data(), unsigned(InternedArgs.size()), Diag.Offset, Diag.DiagID};
+
+  //the lines of the file as it was captured from locate it as they do the
+  //others. Without them, it keeps the line and column it was captured with,
+  //and if the file differs from the one the container knows, it is not the
+  //same as any diagnostic captured from that one.
+  auto File = CapturedFiles.find(Key.FileName);
+  bool Located = File == CapturedFiles.end() || File->second.Size != Diag.FileSize;
+  DiagKey Location = {Key.FileName, nullptr, Diag.LineNumber, Diag.ColumnNumber, Diag.DiagID};
+  DiagRecord Record = {Located ? Location : DiagKeyInfo::getEmptyKey(), Key, false, ~0U, Located};
+  if (File != CapturedFiles.end() && Located){
+    PendingDiags[CI_ID].push_back(Records.size());
+    Records.push_back(Record);
+    return;
+  }
+
+  auto Inserted = CapturedIndex.insert(std::make_pair(Key, unsigned(Records.size())));
+  if (Inserted.second)
+    Records.push_back(Record);
+  PendingDiags[CI_ID].push_back(Inserted.first->second);
 }
 
-void CustomDiagContainer::AddDiagnostic(std::string &FileName, unsigned ColumnNumber, unsigned LineNumber, std::string &message){
+const CustomDiagContainer::DiagKey &CustomDiagContainer::Resolve(DiagRecord &Record){
+  if (Record.Resolved)
+    return Record.Key;
 
-  //if diaglist is empty, then does not exist & create new struct
-  if (DiagList.empty()){
-    AddNewDiagData(FileName, ColumnNumber, LineNumber, message);
+  const CapturedKey &Captured = Record.Captured;
+  DiagKey &Key = Record.Key;
+  if (!Record.Located){
+    Key.FileName = Captured.FileName;
+    Key.DiagID = Captured.DiagID;
+
+    //lines and columns count from 1, columns in bytes
+    const std::vector<unsigned> &LineOffsets = CapturedFiles[Captured.FileName].LineOffsets;
+    auto Next = std::upper_bound(LineOffsets.begin(), LineOffsets.end(), Captured.Offset);
+    Key.LineNumber = Next - LineOffsets.begin();
+    Key.ColumnNumber = Captured.Offset - Next[-1] + 1;
   }
-  //if diaglist is not empty, use AlreadyExists to check if already exists
-  else{
-    if(!(DiagExists(message, LineNumber, FileName))){
-      //does not already exist, so add new struct
-      AddNewDiagData(FileName, ColumnNumber, LineNumber, message);
+
+  if (!Formatter)
+    Formatter.reset(new CustomDiagFormatter());
+  Key.msg = Intern(Formatter->Format(Captured.DiagID, llvm::StringRef(Captured.Args, Captured.ArgsSize))).data();
+  Record.Resolved = true;
+  return Key;
+}
+
+void CustomDiagContainer::AddEquivalentInstance(unsigned CI_ID, unsigned LeaderID){
+  std::lock_guard<std::mutex> Guard(Lock);
+  assert(CI_ID < PendingDiags.size() && LeaderID < PendingDiags.size() &&
+         "compiler instance was not registered");
+  assert(PendingDiags[CI_ID].empty() && LeaderIDs[LeaderID] == LeaderID &&
+         "a skipped instance cannot report diagnostics");
+  LeaderIDs[CI_ID] = LeaderID;
+
+  //the diagnostics of LeaderID grouped already. The ones still pending are
+  //picked up by GroupDiagnostics.
+  for (DiagData &DD : DiagList){
+    if (LeaderID < DD.CI_Set.size() && DD.CI_Set.test(LeaderID)){
+      if (DD.CI_Set.size() <= CI_ID)
+        DD.CI_Set.resize(PendingDiags.size());
+      DD.CI_Set.set(CI_ID);
     }
-    else{
-      AddToExistingDiagData(message, LineNumber, FileName);
+  }
+}
+
+void CustomDiagContainer::GroupDiagnostics(){
+  //walk the compiler instances in registration order, so the grouping (and
+  //the order of the diagnostics) is the same no matter which instance
+  //finished first. A skipped instance is grouped as if it had reported the
+  //diagnostics of its leader itself, so it does not matter either which of
+  //a set of equivalent instances ran.
+  unsigned NumCIs = PendingDiags.size();
+  for (unsigned ID = 0; ID != NumCIs; ++ID){
+    for (unsigned RecordID : PendingDiags[LeaderIDs[ID]]){
+      DiagRecord &Record = Records[RecordID];
+      if (Record.Group == ~0U){
+        //a captured diagnostic may read the same as one reported formatted,
+        //so the records are grouped by their resolved key
+        const DiagKey &Key = Resolve(Record);
+        auto Inserted = DiagIndex.insert(std::make_pair(Key, unsigned(DiagList.size())));
+        if (Inserted.second){
+          //does not already exist, so add new entry
+          DiagData DD;
+          DD.FileName = llvm::StringRef(Key.FileName);
+          DD.msg = llvm::StringRef(Key.msg);
+          DD.LineNumber = Key.LineNumber;
+          DD.ColumnNumber = Key.ColumnNumber;
+          DD.DiagID = Key.DiagID;
+          DiagList.push_back(std::move(DD));
+        }
+        Record.Group = Inserted.first->second;
+      }
+      DiagData &DD = DiagList[Record.Group];
+      if (DD.CI_Set.size() < NumCIs)
+        DD.CI_Set.resize(NumCIs);
+      DD.CI_Set.set(ID);
     }
   }
+  for (std::vector<unsigned> &Pending : PendingDiags)
+    Pending.clear();
 }
 
-void CustomDiagContainer::PrintDiagnostics(){ //TODO: Multiple structs case not handled yet
-  unsigned NumStructs = DiagList.size();
-  if (NumStructs == 0){
-    llvm::outs() << "No errors reported!\n";
+void CustomDiagContainer::setInstanceSetPrinter(std::function<void(const llvm::SmallBitVector &, llvm::raw_ostream &)> Printer){
+  std::lock_guard<std::mutex> Guard(Lock);
+  InstanceSetPrinter = std::move(Printer);
+}
+
+unsigned CustomDiagContainer::getNumDiagnostics(){
+  std::lock_guard<std::mutex> Guard(Lock);
+  GroupDiagnostics();
+  return DiagList.size();
+}
+
+bool CustomDiagContainer::InstancesAgree(){
+  std::lock_guard<std::mutex> Guard(Lock);
+  GroupDiagnostics();
+  for (const DiagData &DD : DiagList)
+    if (DD.CI_Set.count() != PendingDiags.size())
+      return false;
+  return true;
+}
+
+void CustomDiagContainer::GetDiagnostics(unsigned CI_ID, std::vector<RecordedDiagnostic> &Diags){
+  std::lock_guard<std::mutex> Guard(Lock);
+  assert(CI_ID < PendingDiags.size() && "compiler instance was not registered");
+  for (const DiagData &DD : DiagList){
+    if (CI_ID >= DD.CI_Set.size() || !DD.CI_Set.test(CI_ID))
+      continue;
+    RecordedDiagnostic RD = {DD.FileName.str(), DD.msg.str(), DD.LineNumber, DD.ColumnNumber, DD.DiagID};
+    Diags.push_back(std::move(RD));
   }
-  else{
-    for (std::list<DiagData>::iterator it = DiagList.begin(); it != DiagList.end(); it++){
-      llvm::errs() << it->CI_Names << ":\n In file ";
-      llvm::errs() << it->FileName << ": Line " << it->LineNumber << ":" << " error: " << it->msg << "\n";
+
+  //then the ones not grouped yet, skipping those grouped already
+  llvm::DenseMap<DiagKey, unsigned, DiagKeyInfo> Seen;
+  for (unsigned RecordID : PendingDiags[LeaderIDs[CI_ID]]){
+    const DiagKey &Key = Resolve(Records[RecordID]);
+    auto Grouped = DiagIndex.find(Key);
+    if (Grouped != DiagIndex.end()){
+      const llvm::SmallBitVector &CI_Set = DiagList[Grouped->second].CI_Set;
+      if (CI_ID < CI_Set.size() && CI_Set.test(CI_ID))
+        continue;
     }
+    if (!Seen.insert(std::make_pair(Key, 0)).second)
+      continue;
+    RecordedDiagnostic RD = {Key.FileName, Key.msg, Key.LineNumber, Key.ColumnNumber, Key.DiagID};
+    Diags.push_back(std::move(RD));
   }
-    
-}
\ No newline at end of file
+}
+
+void CustomDiagContainer::VisitDiagnostics(llvm::function_ref<void(llvm::StringRef FileName, unsigned LineNumber, unsigned ColumnNumber, unsigned DiagID, llvm::StringRef msg, const llvm::SmallBitVector &CI_Set)> Visitor){
+  std::lock_guard<std::mutex> Guard(Lock);
+  GroupDiagnostics();
+  for (const DiagData &DD : DiagList)
+    Visitor(DD.FileName, DD.LineNumber, DD.ColumnNumber, DD.DiagID, DD.msg, DD.CI_Set);
+}
+
+void CustomDiagContainer::PrintDiagnostics(){
+  PrintDiagnostics(llvm::outs(), llvm::errs());
+}
+
+void CustomDiagContainer::PrintDiagnostics(llvm::raw_ostream &OutOS, llvm::raw_ostream &ErrOS){
+  PrintDiagnostics(OutOS, ErrOS, [](llvm::StringRef){ return true; });
+}
+
+unsigned CustomDiagContainer::PrintDiagnostics(llvm::raw_ostream &OutOS, llvm::raw_ostream &ErrOS, llvm::function_ref<bool(llvm::StringRef FileName)> Filter){
+  std::lock_guard<std::mutex> Guard(Lock);
+  GroupDiagnostics();
+
+  if (DiagList.empty()){
+    OutOS << "No errors reported!\n";
+    return 0;
+  }
+
+  //diagnostics mostly come from a handful of sets of compiler instances, so
+  //each distinct set is rendered once. The sets may differ in size, so they
+  //are hashed and compared by the instances they hold.
+  struct RenderedSet{
+    const llvm::SmallBitVector *CI_Set;
+    std::string Text;
+  };
+  std::unordered_map<size_t, std::vector<RenderedSet>> RenderedSets;
+  auto SameInstances = [](const llvm::SmallBitVector &LHS, const llvm::SmallBitVector &RHS){
+    int L = LHS.find_first(), R = RHS.find_first();
+    for (; L != -1 && L == R; L = LHS.find_next(L), R = RHS.find_next(R))
+      ;
+    return L == R;
+  };
+
+  unsigned NumLeftOut = 0;
+  for (const DiagData &DD : DiagList){
+    if (!Filter(DD.FileName)){
+      ++NumLeftOut;
+      continue;
+    }
+
+    //render the compiler instances that reported this diagnostic
+    llvm::hash_code Hash = llvm::hash_value(0);
+    for (int ID = DD.CI_Set.find_first(); ID != -1; ID = DD.CI_Set.find_next(ID))
+      Hash = llvm::hash_combine(Hash, ID);
+    std::vector<RenderedSet> &Bucket = RenderedSets[Hash];
+    auto Rendered = std::find_if(Bucket.begin(), Bucket.end(), [&](const RenderedSet &RS){
+      return SameInstances(*RS.CI_Set, DD.CI_Set);
+    });
+    if (Rendered == Bucket.end()){
+      RenderedSet RS = {&DD.CI_Set, std::string()};
+      llvm::raw_string_ostream OS(RS.Text);
+      if (InstanceSetPrinter)
+        InstanceSetPrinter(DD.CI_Set, OS);
+      else{
+        const char *Separator = "";
+        for (int ID = DD.CI_Set.find_first(); ID != -1; ID = DD.CI_Set.find_next(ID)){
+          OS << Separator << CompilerInstanceNames[ID];
+          Separator = ", ";
+        }
+      }
+      OS.flush();
+      Bucket.push_back(std::move(RS));
+      Rendered = Bucket.end() - 1;
+    }
+    ErrOS << Rendered->Text << ":\n In file ";
+    ErrOS << DD.FileName << ": Line " << DD.LineNumber << ":" << " error: " << DD.msg << "\n";
+  }
+  return NumLeftOut;
+}
@@ -0,0 +1,172 @@
+//===- BruteClangFileSystem.cpp - File system shared by variants ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangFileSystem.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using llvm::ErrorOr;
+using llvm::MemoryBuffer;
+
+/// A file opened through the shared file system. Its contents are read on
+/// the first request and shared with every other file opened for the path.
+class BruteClangFileSystem::CachedFile : public vfs::File {
+  BruteClangFileSystem &FS;
+  Entry &E;
+  vfs::Status S;
+
+public:
+  CachedFile(BruteClangFileSystem &FS, Entry &E, StringRef Name)
+      : FS(FS), E(E), S(vfs::Status::copyWithNewName(*E.Status, Name)) {}
+
+  ~CachedFile() override { close(); }
+
+  ErrorOr<vfs::Status> status() override { return S; }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>>
+  getBuffer(const Twine &Name, int64_t FileSize, bool RequiresNullTerminator,
+            bool IsVolatile) override {
+    // Volatile files, such as precompiled headers written during the run,
+    // are read afresh every time and not kept.
+    if (IsVolatile)
+      return FS.getVolatileContents(Name, FileSize, RequiresNullTerminator);
+
+    ErrorOr<const MemoryBuffer *> Contents = FS.getContents(E, S.getName());
+    if (!Contents)
+      return Contents.getError();
+    // The cached contents are always null terminated, so they suit either
+    // kind of request.
+    return MemoryBuffer::getMemBuffer((*Contents)->getBuffer(), Name.str(),
+                                      RequiresNullTerminator);
+  }
+
+  std::error_code close() override { return std::error_code(); }
+};
+
+BruteClangFileSystem::BruteClangFileSystem(
+    IntrusiveRefCntPtr<vfs::FileSystem> Base)
+    : Base(std::move(Base)) {}
+
+BruteClangFileSystem::~BruteClangFileSystem() {}
+
+BruteClangFileSystem::Entry &BruteClangFileSystem::getEntry(StringRef Path) {
+  ++NumStatRequests;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto Known = Entries.find(Path);
+    if (Known != Entries.end())
+      return *Known->second;
+  }
+
+  // Stat without holding the lock. If another thread races us to the same
+  // path, the first result wins and the path was merely stat'ed twice.
+  ++NumStatsForwarded;
+  std::unique_ptr<Entry> New(new Entry(Base->status(Path)));
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Inserted = Entries.try_emplace(Path, std::move(New));
+  return *Inserted.first->second;
+}
+
+ErrorOr<const MemoryBuffer *>
+BruteClangFileSystem::getContents(Entry &E, StringRef Path) {
+  ++NumReadRequests;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (E.Contents)
+      return E.Contents.get();
+  }
+
+  ++NumReadsForwarded;
+  auto Buffer = Base->getBufferForFile(Path, /*FileSize=*/-1,
+                                       /*RequiresNullTerminator=*/true);
+  if (!Buffer)
+    return Buffer.getError();
+
+  // Keep a copy rather than the buffer itself: the underlying file system may
+  // have memory-mapped the file, and a run keeps thousands of headers alive.
+  std::unique_ptr<MemoryBuffer> Contents =
+      MemoryBuffer::getMemBufferCopy((*Buffer)->getBuffer(), Path);
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (!E.Contents)
+    E.Contents = std::move(Contents);
+  return E.Contents.get();
+}
+
+ErrorOr<std::unique_ptr<MemoryBuffer>>
+BruteClangFileSystem::getVolatileContents(const Twine &Path, int64_t FileSize,
+                                          bool RequiresNullTerminator) {
+  ++NumReadRequests;
+  ++NumReadsForwarded;
+  return Base->getBufferForFile(Path, FileSize, RequiresNullTerminator,
+                                /*IsVolatile=*/true);
+}
+
+ErrorOr<vfs::Status> BruteClangFileSystem::status(const Twine &Path) {
+  SmallString<256> Storage;
+  StringRef P = Path.toStringRef(Storage);
+  Entry &E = getEntry(P);
+  if (!E.Status)
+    return E.Status.getError();
+  return vfs::Status::copyWithNewName(*E.Status, P);
+}
+
+ErrorOr<std::unique_ptr<vfs::File>>
+BruteClangFileSystem::openFileForRead(const Twine &Path) {
+  SmallString<256> Storage;
+  StringRef P = Path.toStringRef(Storage);
+  Entry &E = getEntry(P);
+  if (!E.Status)
+    return E.Status.getError();
+  // Like the real file system, let directories be "opened"; the file manager
+  // checks the status of what it opened.
+  return std::unique_ptr<vfs::File>(new CachedFile(*this, E, P));
+}
+
+vfs::directory_iterator BruteClangFileSystem::dir_begin(const Twine &Dir,
+                                                        std::error_code &EC) {
+  return Base->dir_begin(Dir, EC);
+}
+
+std::error_code
+BruteClangFileSystem::setCurrentWorkingDirectory(const Twine &Path) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Entries.empty())
+      return std::make_error_code(std::errc::operation_not_permitted);
+  }
+  return Base->setCurrentWorkingDirectory(Path);
+}
+
+ErrorOr<std::string> BruteClangFileSystem::getCurrentWorkingDirectory() const {
+  return Base->getCurrentWorkingDirectory();
+}
+
+BruteClangFileSystem::Statistics BruteClangFileSystem::getStatistics() const {
+  Statistics Stats;
+  Stats.NumStatRequests = NumStatRequests;
+  Stats.NumStatsForwarded = NumStatsForwarded;
+  Stats.NumReadRequests = NumReadRequests;
+  Stats.NumReadsForwarded = NumReadsForwarded;
+  return Stats;
+}
+
+void BruteClangFileSystem::printStatistics(llvm::raw_ostream &OS) const {
+  Statistics Stats = getStatistics();
+  OS << "\n*** BruteClang File System Stats:\n";
+  OS << Stats.NumStatRequests << " stat requests, "
+     << Stats.NumStatRequests - Stats.NumStatsForwarded
+     << " served from cache.\n";
+  OS << Stats.NumReadRequests << " file reads, "
+     << Stats.NumReadRequests - Stats.NumReadsForwarded
+     << " served from cache.\n";
+}
@@ -0,0 +1,1213 @@
+//===- BruteClangManifest.cpp - Precompiled BruteClang configuration -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The manifest file layout is (all integers little-endian):
+//
+//   Header:        "BCMF", version, number of variants, mask words,
+//                  variant table offset, file table bucket offset, axis
+//                  table offset or 0 (all u32)
+//   Variants:      for each variant: u16 name length, name, u32 argument
+//                  count, then for each argument: u8 kind ('I' or 'D'),
+//                  u16 value length, value
+//   Axis table:    u32 axis count, then for each axis: u16 name length,
+//                  name, u32 value count, each value as u16 length and
+//                  string, u32 group count, then for each group: u16 name
+//                  length, name, u32 member count, u32 value indices;
+//                  followed by the u32 value index of every axis for every
+//                  variant
+//   Variant table: u32 offset of each variant record
+//   File table:    OnDiskChainedHashTable from file path to a variant mask of
+//                  "mask words" u64 words
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangManifest.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace clang;
+using namespace llvm::support;
+
+/// \brief The manifest file version.
+static const unsigned CurrentVersion = 2;
+
+static const char ManifestMagic[4] = {'B', 'C', 'M', 'F'};
+
+static const unsigned HeaderSize = 28;
+
+/// The most variants a variants.config may describe.
+static const unsigned MaxVariants = 1 << 16;
+
+/// The variants of the config file layout, in the order their diagnostics are
+/// grouped.
+static const char *const ConfigVariants[] = {"amd64", "i386", "p", "z"};
+
+/// The file lists of the config file layout, with the variants (as a mask over
+/// ConfigVariants) a listed file is analyzed for. A file is analyzed for the
+/// variants of the first list it appears in.
+static const struct {
+  const char *FileList;
+  unsigned Variants;
+} ConfigFileLists[] = {
+  {"common_files.config", 0xF},
+  {"x_files.config", 0x3},
+  {"amd64_files.config", 0x1},
+  {"i386_files.config", 0x2},
+  {"p_files.config", 0x4},
+  {"z_files.config", 0x8},
+};
+
+//----------------------------------------------------------------------------//
+// Variant sets.
+//----------------------------------------------------------------------------//
+
+static bool isNameChar(char C) {
+  return isAlphanumeric(C) || C == '_' || C == '.' || C == '+';
+}
+
+static bool isName(StringRef Str) {
+  return !Str.empty() && std::all_of(Str.begin(), Str.end(), isNameChar);
+}
+
+namespace {
+
+/// Evaluates set expressions over variants built along axes:
+///
+///   expr   := term (('|' | '-') term)*
+///   term   := factor ('&' factor)*
+///   factor := '!' factor | '(' expr ')' | '*' | axis '=' value (',' value)*
+///
+/// where a value may also name a group of values of the axis.
+class VariantSetParser {
+  ArrayRef<BruteClangVariantAxis> Axes;
+
+  /// The value of each axis for each variant, variant by variant.
+  ArrayRef<unsigned> AxisValues;
+
+  unsigned NumVariants;
+  std::string &Error;
+
+  /// What is left of the expression.
+  StringRef Text;
+
+  bool consume(char C) {
+    Text = Text.ltrim(" \t");
+    if (Text.empty() || Text.front() != C)
+      return false;
+    Text = Text.drop_front();
+    return true;
+  }
+
+  StringRef lexName() {
+    Text = Text.ltrim(" \t");
+    size_t Len = 0;
+    while (Len != Text.size() && isNameChar(Text[Len]))
+      ++Len;
+    StringRef Name = Text.substr(0, Len);
+    Text = Text.substr(Len);
+    return Name;
+  }
+
+  bool fail(const Twine &Message) {
+    Error = Message.str();
+    return false;
+  }
+
+  bool parseExpr(VariantMask &Mask);
+  bool parseTerm(VariantMask &Mask);
+  bool parseFactor(VariantMask &Mask);
+
+public:
+  VariantSetParser(ArrayRef<BruteClangVariantAxis> Axes,
+                   ArrayRef<unsigned> AxisValues, unsigned NumVariants,
+                   std::string &Error)
+      : Axes(Axes), AxisValues(AxisValues), NumVariants(NumVariants),
+        Error(Error) {}
+
+  bool parse(StringRef Expr, VariantMask &Mask) {
+    Text = Expr;
+    if (!parseExpr(Mask))
+      return false;
+    Text = Text.ltrim(" \t");
+    if (!Text.empty())
+      return fail("unexpected '" + Text + "' in variant set");
+    return true;
+  }
+};
+
+} // end anonymous namespace
+
+bool VariantSetParser::parseExpr(VariantMask &Mask) {
+  if (!parseTerm(Mask))
+    return false;
+  while (true) {
+    bool Union = consume('|');
+    if (!Union && !consume('-'))
+      return true;
+    VariantMask RHS;
+    if (!parseTerm(RHS))
+      return false;
+    if (Union)
+      Mask |= RHS;
+    else
+      Mask.reset(RHS);
+  }
+}
+
+bool VariantSetParser::parseTerm(VariantMask &Mask) {
+  if (!parseFactor(Mask))
+    return false;
+  while (consume('&')) {
+    VariantMask RHS;
+    if (!parseFactor(RHS))
+      return false;
+    Mask &= RHS;
+  }
+  return true;
+}
+
+bool VariantSetParser::parseFactor(VariantMask &Mask) {
+  if (consume('!')) {
+    if (!parseFactor(Mask))
+      return false;
+    Mask.flip();
+    return true;
+  }
+  if (consume('(')) {
+    if (!parseExpr(Mask))
+      return false;
+    if (!consume(')'))
+      return fail("expected ')' in variant set");
+    return true;
+  }
+  if (consume('*')) {
+    Mask = VariantMask(NumVariants, true);
+    return true;
+  }
+
+  StringRef Name = lexName();
+  if (Name.empty())
+    return fail(Text.empty() ? Twine("expected a variant set")
+                             : "expected a variant set at '" + Text + "'");
+  auto Axis = std::find_if(
+      Axes.begin(), Axes.end(),
+      [&](const BruteClangVariantAxis &A) { return A.Name == Name; });
+  if (Axis == Axes.end())
+    return fail("unknown axis '" + Name + "'");
+  if (!consume('='))
+    return fail("expected '=' after axis '" + Name + "'");
+
+  llvm::SmallBitVector Values(Axis->Values.size());
+  do {
+    StringRef Value = lexName();
+    auto Known = std::find(Axis->Values.begin(), Axis->Values.end(), Value);
+    if (Known != Axis->Values.end()) {
+      Values.set(Known - Axis->Values.begin());
+      continue;
+    }
+    auto Group = std::find_if(
+        Axis->Groups.begin(), Axis->Groups.end(),
+        [&](const std::pair<StringRef, std::vector<unsigned>> &G) {
+          return G.first == Value;
+        });
+    if (Group == Axis->Groups.end())
+      return fail("unknown value '" + Value + "' of axis '" + Name + "'");
+    for (unsigned Member : Group->second)
+      Values.set(Member);
+  } while (consume(','));
+
+  unsigned A = Axis - Axes.begin();
+  Mask = VariantMask(NumVariants);
+  for (unsigned V = 0; V != NumVariants; ++V)
+    if (Values.test(AxisValues[V * Axes.size() + A]))
+      Mask.set(V);
+  return true;
+}
+
+//----------------------------------------------------------------------------//
+// Manifest writer.
+//----------------------------------------------------------------------------//
+
+namespace {
+
+/// \brief Trait used to generate the file table as an on-disk hash table.
+class FileTableWriterTrait {
+public:
+  typedef StringRef key_type;
+  typedef StringRef key_type_ref;
+  typedef VariantMask data_type;
+  typedef const VariantMask &data_type_ref;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  explicit FileTableWriterTrait(unsigned MaskWords) : MaskWords(MaskWords) {}
+
+  static hash_value_type ComputeHash(key_type_ref Key) {
+    return llvm::HashString(Key);
+  }
+
+  std::pair<unsigned, unsigned>
+  EmitKeyDataLength(raw_ostream &Out, key_type_ref Key, data_type_ref Data) {
+    endian::Writer<little> LE(Out);
+    unsigned KeyLen = Key.size();
+    unsigned DataLen = MaskWords * 8;
+    LE.write<uint16_t>(KeyLen);
+    LE.write<uint16_t>(DataLen);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  void EmitKey(raw_ostream &Out, key_type_ref Key, unsigned KeyLen) {
+    Out.write(Key.data(), KeyLen);
+  }
+
+  void EmitData(raw_ostream &Out, key_type_ref Key, data_type_ref Data,
+                unsigned DataLen) {
+    endian::Writer<little> LE(Out);
+    SmallVector<uint64_t, 4> Words(MaskWords);
+    for (int V = Data.find_first(); V != -1; V = Data.find_next(V))
+      Words[V / 64] |= uint64_t(1) << (V % 64);
+    for (uint64_t Word : Words)
+      LE.write<uint64_t>(Word);
+  }
+
+private:
+  unsigned MaskWords;
+};
+
+/// Accumulates the contents of a manifest and writes it out.
+class ManifestBuilder {
+  struct Variant {
+    std::string Name;
+    std::vector<std::pair<char, std::string>> Args;
+  };
+
+  std::vector<Variant> Variants;
+  llvm::StringMap<VariantMask> Files;
+
+  std::vector<BruteClangVariantAxis> Axes;
+  std::vector<unsigned> AxisValues;
+
+public:
+  /// Add a variant with the value index \p Values of every axis.
+  unsigned addVariant(StringRef Name, ArrayRef<unsigned> Values = None) {
+    Variants.push_back(Variant());
+    Variants.back().Name = Name;
+    AxisValues.insert(AxisValues.end(), Values.begin(), Values.end());
+    return Variants.size() - 1;
+  }
+
+  /// Set the axes the variants are built along. The names must stay valid
+  /// until the manifest is emitted.
+  void setAxes(std::vector<BruteClangVariantAxis> NewAxes) {
+    Axes = std::move(NewAxes);
+  }
+
+  void addVariantArg(unsigned V, char Kind, StringRef Value) {
+    Variants[V].Args.push_back(std::make_pair(Kind, Value.str()));
+  }
+
+  /// Record that \p File is analyzed for \p Mask, unless it already has
+  /// variants.
+  void addFileIfNew(StringRef File, const VariantMask &Mask) {
+    Files.insert(std::make_pair(File, Mask));
+  }
+
+  /// Record that \p File is analyzed for \p Mask too.
+  void addFile(StringRef File, const VariantMask &Mask) {
+    Files[File] |= Mask;
+  }
+
+  /// The union of the variant masks of every file.
+  VariantMask getUsedVariants() const {
+    VariantMask Used(Variants.size());
+    for (const auto &File : Files)
+      Used |= File.second;
+    return Used;
+  }
+
+  bool emit(raw_ostream &OS, std::string &Error);
+};
+
+} // end anonymous namespace
+
+bool ManifestBuilder::emit(raw_ostream &OS, std::string &Error) {
+  SmallString<4096> Buffer;
+  llvm::raw_svector_ostream Out(Buffer);
+  endian::Writer<little> LE(Out);
+
+  unsigned MaskWords = (Variants.size() + 63) / 64;
+
+  // Header. The offsets are patched in once they are known.
+  Out.write(ManifestMagic, sizeof(ManifestMagic));
+  LE.write<uint32_t>(CurrentVersion);
+  LE.write<uint32_t>(Variants.size());
+  LE.write<uint32_t>(MaskWords);
+  LE.write<uint32_t>(0);
+  LE.write<uint32_t>(0);
+  LE.write<uint32_t>(0);
+  assert(Buffer.size() == HeaderSize);
+
+  // Variant records.
+  std::vector<uint32_t> VariantOffsets;
+  for (const Variant &V : Variants) {
+    if (V.Name.size() > UINT16_MAX) {
+      Error = "variant name too long: " + V.Name;
+      return false;
+    }
+    VariantOffsets.push_back(Buffer.size());
+    LE.write<uint16_t>(V.Name.size());
+    Out << V.Name;
+    LE.write<uint32_t>(V.Args.size());
+    for (const auto &Arg : V.Args) {
+      if (Arg.second.size() > UINT16_MAX) {
+        Error = "argument too long in variant " + V.Name;
+        return false;
+      }
+      LE.write<uint8_t>(Arg.first);
+      LE.write<uint16_t>(Arg.second.size());
+      Out << Arg.second;
+    }
+  }
+
+  // Axis table.
+  uint32_t AxisTableOffset = 0;
+  if (!Axes.empty()) {
+    auto writeName = [&](StringRef Name) {
+      LE.write<uint16_t>(Name.size());
+      Out << Name;
+    };
+    AxisTableOffset = Buffer.size();
+    LE.write<uint32_t>(Axes.size());
+    for (const BruteClangVariantAxis &Axis : Axes) {
+      writeName(Axis.Name);
+      LE.write<uint32_t>(Axis.Values.size());
+      for (StringRef Value : Axis.Values)
+        writeName(Value);
+      LE.write<uint32_t>(Axis.Groups.size());
+      for (const auto &Group : Axis.Groups) {
+        writeName(Group.first);
+        LE.write<uint32_t>(Group.second.size());
+        for (unsigned Member : Group.second)
+          LE.write<uint32_t>(Member);
+      }
+    }
+    for (unsigned Value : AxisValues)
+      LE.write<uint32_t>(Value);
+  }
+
+  // Variant table.
+  for (uint64_t N = llvm::OffsetToAlignment(Buffer.size(), 4); N; --N)
+    LE.write<uint8_t>(0);
+  uint32_t VariantTableOffset = Buffer.size();
+  for (uint32_t Offset : VariantOffsets)
+    LE.write<uint32_t>(Offset);
+
+  // File table.
+  uint32_t FileTableOffset;
+  {
+    llvm::OnDiskChainedHashTableGenerator<FileTableWriterTrait> Generator;
+    FileTableWriterTrait Trait(MaskWords);
+    for (const auto &File : Files) {
+      if (File.first().size() > UINT16_MAX) {
+        Error = "file path too long: " + File.first().str();
+        return false;
+      }
+      Generator.insert(File.first(), File.second, Trait);
+    }
+    FileTableOffset = Generator.Emit(Out, Trait);
+  }
+
+  endian::write32le(Buffer.data() + 16, VariantTableOffset);
+  endian::write32le(Buffer.data() + 20, FileTableOffset);
+  endian::write32le(Buffer.data() + 24, AxisTableOffset);
+
+  OS << Buffer;
+  return true;
+}
+
+/// Split \p Text into whitespace separated tokens, like reading it with
+/// std::istream's operator>>.
+static void tokenize(StringRef Text, SmallVectorImpl<StringRef> &Tokens) {
+  const char *Whitespace = " \t\n\v\f\r";
+  while (true) {
+    Text = Text.ltrim(Whitespace);
+    if (Text.empty())
+      return;
+    size_t End = Text.find_first_of(Whitespace);
+    Tokens.push_back(Text.substr(0, End));
+    Text = Text.substr(End);
+  }
+}
+
+bool BruteClangManifest::readFileList(vfs::FileSystem &FS, StringRef Path,
+                                      std::vector<std::string> &Files,
+                                      std::string &Error) {
+  auto Buffer = FS.getBufferForFile(Path);
+  if (!Buffer) {
+    Error = "unable to read '" + Path.str() +
+            "': " + Buffer.getError().message();
+    return false;
+  }
+
+  SmallVector<StringRef, 256> Tokens;
+  tokenize((*Buffer)->getBuffer(), Tokens);
+  for (StringRef Token : Tokens)
+    Files.push_back(Token);
+  return true;
+}
+
+/// Add the -I and -D arguments among \p Tokens to variant \p V.
+static void addVariantArgs(ManifestBuilder &Builder, unsigned V,
+                           ArrayRef<StringRef> Tokens) {
+  for (StringRef Token : Tokens) {
+    if (Token.size() < 2 || Token[0] != '-')
+      continue;
+    char Kind = Token[1];
+    StringRef Value = Token.drop_front(2);
+    if (Kind == BruteClangVariantArg::Include) {
+      // Include paths are usually quoted: -I'../../compiler'.
+      if (Value.size() >= 2 && Value.front() == '\'' && Value.back() == '\'')
+        Value = Value.drop_front().drop_back();
+      Builder.addVariantArg(V, Kind, Value);
+    } else if (Kind == BruteClangVariantArg::Define) {
+      Builder.addVariantArg(V, Kind, Value);
+    }
+  }
+}
+
+/// Compile \p Config, the variants.config in \p ConfigDir.
+///
+/// The variants are the combinations of the values of the declared axes,
+/// restricted to the union of any 'variants' sets. The 'args', 'argfile' and
+/// 'files' directives then apply to the variants in their set, so a file
+/// belongs to the union of the sets of the lists naming it.
+static bool compileVariantsConfig(vfs::FileSystem &FS, StringRef ConfigDir,
+                                  StringRef Config, ManifestBuilder &Builder,
+                                  std::string &Error) {
+  auto fail = [&](unsigned Line, const Twine &Message) {
+    Error = ("variants.config:" + Twine(Line) + ": " + Message).str();
+    return false;
+  };
+
+  struct Directive {
+    unsigned Line;
+    StringRef Kind;
+    /// The variant set of args, argfile and files directives.
+    StringRef Set;
+    /// Everything after the kind, or after the set.
+    StringRef Rest;
+    SmallVector<StringRef, 8> Operands;
+  };
+
+  std::vector<Directive> Directives;
+  SmallVector<StringRef, 64> Lines;
+  Config.split(Lines, '\n');
+  for (unsigned I = 0, E = Lines.size(); I != E; ++I) {
+    StringRef Line = Lines[I].split('#').first.trim();
+    if (Line.empty())
+      continue;
+
+    Directive D;
+    D.Line = I + 1;
+    size_t KindEnd = Line.find_first_of(" \t");
+    D.Kind = Line.substr(0, KindEnd);
+    D.Rest = Line.substr(KindEnd).trim();
+    if (D.Kind == "args" || D.Kind == "argfile" || D.Kind == "files") {
+      size_t Colon = D.Rest.find(':');
+      if (Colon == StringRef::npos)
+        return fail(D.Line, "expected '<variant set>:' after '" + D.Kind + "'");
+      D.Set = D.Rest.substr(0, Colon).trim();
+      D.Rest = D.Rest.substr(Colon + 1).trim();
+    } else if (D.Kind != "axis" && D.Kind != "group" && D.Kind != "variants") {
+      return fail(D.Line, "unknown directive '" + D.Kind + "'");
+    }
+    tokenize(D.Rest, D.Operands);
+    Directives.push_back(std::move(D));
+  }
+
+  // Axes and groups.
+  std::vector<BruteClangVariantAxis> Axes;
+  auto findAxis = [&](StringRef Name) -> BruteClangVariantAxis * {
+    for (BruteClangVariantAxis &Axis : Axes)
+      if (Axis.Name == Name)
+        return &Axis;
+    return nullptr;
+  };
+  for (const Directive &D : Directives) {
+    if (D.Kind == "axis") {
+      if (D.Operands.size() < 2)
+        return fail(D.Line, "expected 'axis <name> <value>...'");
+      if (!isName(D.Operands[0]))
+        return fail(D.Line, "invalid axis name '" + D.Operands[0] + "'");
+      if (findAxis(D.Operands[0]))
+        return fail(D.Line, "axis '" + D.Operands[0] + "' declared twice");
+      BruteClangVariantAxis Axis;
+      Axis.Name = D.Operands[0];
+      for (StringRef Value : makeArrayRef(D.Operands).drop_front()) {
+        if (!isName(Value))
+          return fail(D.Line, "invalid value name '" + Value + "'");
+        if (llvm::is_contained(Axis.Values, Value))
+          return fail(D.Line, "value '" + Value + "' declared twice");
+        Axis.Values.push_back(Value);
+      }
+      Axes.push_back(std::move(Axis));
+    } else if (D.Kind == "group") {
+      if (D.Operands.size() < 3)
+        return fail(D.Line, "expected 'group <axis> <name> <value>...'");
+      BruteClangVariantAxis *Axis = findAxis(D.Operands[0]);
+      if (!Axis)
+        return fail(D.Line, "unknown axis '" + D.Operands[0] + "'");
+      StringRef Name = D.Operands[1];
+      if (!isName(Name))
+        return fail(D.Line, "invalid group name '" + Name + "'");
+      if (llvm::is_contained(Axis->Values, Name) ||
+          llvm::any_of(Axis->Groups, [&](const std::pair<StringRef,
+                                                   std::vector<unsigned>> &G) {
+            return G.first == Name;
+          }))
+        return fail(D.Line, "'" + Name + "' already names a value or group "
+                            "of axis '" + Axis->Name + "'");
+      std::vector<unsigned> Members;
+      for (StringRef Value : makeArrayRef(D.Operands).drop_front(2)) {
+        auto Known = std::find(Axis->Values.begin(), Axis->Values.end(), Value);
+        if (Known == Axis->Values.end())
+          return fail(D.Line, "unknown value '" + Value + "' of axis '" +
+                                  Axis->Name + "'");
+        Members.push_back(Known - Axis->Values.begin());
+      }
+      Axis->Groups.push_back(std::make_pair(Name, std::move(Members)));
+    }
+  }
+  if (Axes.empty()) {
+    Error = "variants.config declares no axis";
+    return false;
+  }
+
+  // Every combination of values, the first axis varying slowest.
+  uint64_t NumCombinations = 1;
+  for (const BruteClangVariantAxis &Axis : Axes) {
+    NumCombinations *= Axis.Values.size();
+    if (NumCombinations > MaxVariants) {
+      Error = "variants.config describes more than " +
+              std::to_string(MaxVariants) + " variants";
+      return false;
+    }
+  }
+  unsigned NumAxes = Axes.size();
+  std::vector<unsigned> Combinations(NumCombinations * NumAxes);
+  for (unsigned C = 0; C != NumCombinations; ++C) {
+    unsigned Rest = C;
+    for (unsigned A = NumAxes; A-- != 0;) {
+      Combinations[C * NumAxes + A] = Rest % Axes[A].Values.size();
+      Rest /= Axes[A].Values.size();
+    }
+  }
+
+  // The variants directives restrict the combinations to those that exist.
+  VariantSetParser CombinationParser(Axes, Combinations, NumCombinations,
+                                     Error);
+  VariantMask Selected(NumCombinations);
+  bool Restricted = false;
+  for (const Directive &D : Directives) {
+    if (D.Kind != "variants")
+      continue;
+    VariantMask Set;
+    if (!CombinationParser.parse(D.Rest, Set))
+      return fail(D.Line, Error);
+    Selected |= Set;
+    Restricted = true;
+  }
+  if (!Restricted)
+    Selected.set();
+
+  std::vector<unsigned> AxisValues;
+  for (int C = Selected.find_first(); C != -1; C = Selected.find_next(C)) {
+    ArrayRef<unsigned> Values(&Combinations[C * NumAxes], NumAxes);
+    std::string Name;
+    for (unsigned A = 0; A != NumAxes; ++A) {
+      if (A)
+        Name += '/';
+      Name += Axes[A].Values[Values[A]];
+    }
+    Builder.addVariant(Name, Values);
+    AxisValues.insert(AxisValues.end(), Values.begin(), Values.end());
+  }
+  unsigned NumVariants = AxisValues.size() / NumAxes;
+  if (!NumVariants) {
+    Error = "variants.config selects no variant";
+    return false;
+  }
+
+  // Arguments and file lists.
+  VariantSetParser Parser(Axes, AxisValues, NumVariants, Error);
+  for (const Directive &D : Directives) {
+    if (D.Kind != "args" && D.Kind != "argfile" && D.Kind != "files")
+      continue;
+    VariantMask Set;
+    if (!Parser.parse(D.Set, Set))
+      return fail(D.Line, Error);
+
+    if (D.Kind == "args") {
+      for (int V = Set.find_first(); V != -1; V = Set.find_next(V))
+        addVariantArgs(Builder, V, D.Operands);
+      continue;
+    }
+
+    for (StringRef Operand : D.Operands) {
+      SmallString<128> Path;
+      if (!llvm::sys::path::is_absolute(Operand))
+        Path = ConfigDir;
+      llvm::sys::path::append(Path, Operand);
+      auto Buffer = FS.getBufferForFile(Path);
+      if (!Buffer)
+        return fail(D.Line, "unable to read '" + Path.str() + "': " +
+                                Buffer.getError().message());
+
+      SmallVector<StringRef, 256> Tokens;
+      tokenize((*Buffer)->getBuffer(), Tokens);
+      if (D.Kind == "argfile") {
+        for (int V = Set.find_first(); V != -1; V = Set.find_next(V))
+          addVariantArgs(Builder, V, Tokens);
+      } else {
+        for (StringRef File : Tokens)
+          Builder.addFile(File, Set);
+      }
+    }
+  }
+
+  Builder.setAxes(std::move(Axes));
+  return true;
+}
+
+bool BruteClangManifest::compileConfigs(vfs::FileSystem &FS,
+                                        StringRef ConfigDir, raw_ostream &OS,
+                                        std::string &Error) {
+  ManifestBuilder Builder;
+
+  SmallString<128> VariantsConfig(ConfigDir);
+  llvm::sys::path::append(VariantsConfig, "variants.config");
+  if (auto Buffer = FS.getBufferForFile(VariantsConfig)) {
+    // The builder refers to the axis names in the buffer until it emits.
+    return compileVariantsConfig(FS, ConfigDir, (*Buffer)->getBuffer(),
+                                 Builder, Error) &&
+           Builder.emit(OS, Error);
+  }
+
+  unsigned NumVariants = llvm::array_lengthof(ConfigVariants);
+  for (const char *Name : ConfigVariants)
+    Builder.addVariant(Name);
+
+  // A file list that does not exist simply lists no files.
+  for (const auto &List : ConfigFileLists) {
+    SmallString<128> Path(ConfigDir);
+    llvm::sys::path::append(Path, List.FileList);
+    auto Buffer = FS.getBufferForFile(Path);
+    if (!Buffer)
+      continue;
+
+    VariantMask Mask(NumVariants);
+    for (unsigned V = 0; V != NumVariants; ++V)
+      if (List.Variants & (1u << V))
+        Mask.set(V);
+
+    SmallVector<StringRef, 256> Files;
+    tokenize((*Buffer)->getBuffer(), Files);
+    for (StringRef File : Files)
+      Builder.addFileIfNew(File, Mask);
+  }
+
+  // Read the -I and -D arguments of every variant some file is analyzed for.
+  VariantMask Used = Builder.getUsedVariants();
+  for (unsigned V = 0; V != NumVariants; ++V) {
+    if (!Used.test(V))
+      continue;
+
+    SmallString<128> Path(ConfigDir);
+    llvm::sys::path::append(Path, Twine(ConfigVariants[V]) + ".config");
+    auto Buffer = FS.getBufferForFile(Path);
+    if (!Buffer) {
+      Error = "unable to read '" + Path.str().str() +
+              "': " + Buffer.getError().message();
+      return false;
+    }
+
+    SmallVector<StringRef, 64> Tokens;
+    tokenize((*Buffer)->getBuffer(), Tokens);
+    addVariantArgs(Builder, V, Tokens);
+  }
+
+  return Builder.emit(OS, Error);
+}
+
+//----------------------------------------------------------------------------//
+// Manifest reader.
+//----------------------------------------------------------------------------//
+
+namespace {
+
+/// \brief Trait used to read the file table from the on-disk hash table.
+class FileTableReaderTrait {
+public:
+  typedef StringRef external_key_type;
+  typedef StringRef internal_key_type;
+  typedef StringRef data_type;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  static bool EqualKey(const internal_key_type &a, const internal_key_type &b) {
+    return a == b;
+  }
+
+  static hash_value_type ComputeHash(const internal_key_type &a) {
+    return llvm::HashString(a);
+  }
+
+  static std::pair<unsigned, unsigned>
+  ReadKeyDataLength(const unsigned char *&d) {
+    unsigned KeyLen = endian::readNext<uint16_t, little, unaligned>(d);
+    unsigned DataLen = endian::readNext<uint16_t, little, unaligned>(d);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  static const internal_key_type &
+  GetInternalKey(const external_key_type &x) { return x; }
+
+  static const external_key_type &
+  GetExternalKey(const internal_key_type &x) { return x; }
+
+  static internal_key_type ReadKey(const unsigned char *d, unsigned n) {
+    return StringRef((const char *)d, n);
+  }
+
+  static data_type ReadData(const internal_key_type &k, const unsigned char *d,
+                            unsigned DataLen) {
+    return StringRef((const char *)d, DataLen);
+  }
+};
+
+typedef llvm::OnDiskChainedHashTable<FileTableReaderTrait> FileTableType;
+
+} // end anonymous namespace
+
+BruteClangManifest::BruteClangManifest(
+    std::unique_ptr<llvm::MemoryBuffer> Buffer)
+    : Buffer(std::move(Buffer)) {}
+
+BruteClangManifest::~BruteClangManifest() {
+  delete static_cast<FileTableType *>(FileTable);
+}
+
+std::unique_ptr<BruteClangManifest>
+BruteClangManifest::create(std::unique_ptr<llvm::MemoryBuffer> Buffer,
+                           std::string &Error) {
+  StringRef Name = Buffer->getBufferIdentifier();
+  const unsigned char *Start =
+      (const unsigned char *)Buffer->getBufferStart();
+  size_t Size = Buffer->getBufferSize();
+
+  auto Malformed = [&]() -> std::unique_ptr<BruteClangManifest> {
+    Error = "malformed BruteClang manifest '" + Name.str() + "'";
+    return nullptr;
+  };
+
+  if (Size < HeaderSize ||
+      memcmp(Start, ManifestMagic, sizeof(ManifestMagic)) != 0)
+    return Malformed();
+
+  const unsigned char *Ptr = Start + sizeof(ManifestMagic);
+  unsigned Version = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  if (Version != CurrentVersion) {
+    Error = "BruteClang manifest '" + Name.str() +
+            "' has an unsupported version; recompile it";
+    return nullptr;
+  }
+  unsigned NumVariants = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  unsigned MaskWords = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  uint32_t VariantTableOffset =
+      endian::readNext<uint32_t, little, unaligned>(Ptr);
+  uint32_t FileTableOffset = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  uint32_t AxisTableOffset = endian::readNext<uint32_t, little, unaligned>(Ptr);
+
+  if (MaskWords != (NumVariants + 63) / 64 ||
+      VariantTableOffset + uint64_t(NumVariants) * 4 > Size ||
+      FileTableOffset % 4 != 0 || uint64_t(FileTableOffset) + 8 > Size)
+    return Malformed();
+
+  std::unique_ptr<BruteClangManifest> Manifest(
+      new BruteClangManifest(std::move(Buffer)));
+  Manifest->MaskWords = MaskWords;
+
+  // Read the variant names; the arguments are decoded on demand.
+  Ptr = Start + VariantTableOffset;
+  for (unsigned V = 0; V != NumVariants; ++V) {
+    uint32_t Offset = endian::readNext<uint32_t, little, unaligned>(Ptr);
+    if (uint64_t(Offset) + 2 > Size)
+      return Malformed();
+    const unsigned char *Record = Start + Offset;
+    unsigned NameLen = endian::readNext<uint16_t, little, unaligned>(Record);
+    if (uint64_t(Record - Start) + NameLen + 4 > Size)
+      return Malformed();
+    Manifest->VariantNames.push_back(StringRef((const char *)Record, NameLen));
+    Record += NameLen;
+    Manifest->VariantArgs.push_back(Record);
+
+    // Make sure getVariantArgs stays within the buffer.
+    unsigned NumArgs = endian::readNext<uint32_t, little, unaligned>(Record);
+    for (unsigned I = 0; I != NumArgs; ++I) {
+      if (uint64_t(Record - Start) + 3 > Size)
+        return Malformed();
+      Record += 1;
+      unsigned Len = endian::readNext<uint16_t, little, unaligned>(Record);
+      if (uint64_t(Record - Start) + Len > Size)
+        return Malformed();
+      Record += Len;
+    }
+  }
+
+  if (AxisTableOffset && !Manifest->readAxes(AxisTableOffset))
+    return Malformed();
+
+  Manifest->FileTable =
+      FileTableType::Create(Start + FileTableOffset, Start);
+  return Manifest;
+}
+
+bool BruteClangManifest::readAxes(uint32_t Offset) {
+  const char *Ptr = Buffer->getBufferStart() + Offset;
+  const char *End = Buffer->getBufferEnd();
+  bool Failed = Offset > Buffer->getBufferSize();
+
+  auto read = [&](unsigned Bytes) -> uint32_t {
+    if (Failed || unsigned(End - Ptr) < Bytes) {
+      Failed = true;
+      return 0;
+    }
+    if (Bytes == 2)
+      return endian::readNext<uint16_t, little, unaligned>(Ptr);
+    return endian::readNext<uint32_t, little, unaligned>(Ptr);
+  };
+  auto readName = [&]() -> StringRef {
+    unsigned Len = read(2);
+    if (Failed || unsigned(End - Ptr) < Len) {
+      Failed = true;
+      return StringRef();
+    }
+    StringRef Name(Ptr, Len);
+    Ptr += Len;
+    return Name;
+  };
+
+  // Every count is checked against the data left by the reads it implies.
+  unsigned NumAxes = read(4);
+  for (unsigned A = 0; A != NumAxes && !Failed; ++A) {
+    BruteClangVariantAxis Axis;
+    Axis.Name = readName();
+    for (unsigned I = 0, N = read(4); I != N && !Failed; ++I)
+      Axis.Values.push_back(readName());
+    for (unsigned I = 0, N = read(4); I != N && !Failed; ++I) {
+      StringRef Name = readName();
+      std::vector<unsigned> Members;
+      for (unsigned J = 0, M = read(4); J != M && !Failed; ++J) {
+        Members.push_back(read(4));
+        Failed |= Members.back() >= Axis.Values.size();
+      }
+      Axis.Groups.push_back(std::make_pair(Name, std::move(Members)));
+    }
+    Axes.push_back(std::move(Axis));
+  }
+  for (unsigned I = 0, N = getNumVariants() * NumAxes; I != N && !Failed;
+       ++I) {
+    AxisValues.push_back(read(4));
+    Failed |= AxisValues.back() >= Axes[I % NumAxes].Values.size();
+  }
+  return !Failed && !Axes.empty();
+}
+
+std::unique_ptr<BruteClangManifest>
+BruteClangManifest::loadFile(StringRef Path, std::string &Error) {
+  // No null terminator is needed, which lets MemoryBuffer map the file
+  // instead of copying it.
+  auto Buffer = llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    Error = "unable to read BruteClang manifest '" + Path.str() +
+            "': " + Buffer.getError().message();
+    return nullptr;
+  }
+  return create(std::move(*Buffer), Error);
+}
+
+std::unique_ptr<BruteClangManifest>
+BruteClangManifest::createFromConfigs(vfs::FileSystem &FS,
+                                      StringRef ConfigDir,
+                                      std::string &Error) {
+  SmallString<4096> Compiled;
+  llvm::raw_svector_ostream OS(Compiled);
+  if (!compileConfigs(FS, ConfigDir, OS, Error))
+    return nullptr;
+  return create(llvm::MemoryBuffer::getMemBufferCopy(Compiled, ConfigDir),
+                Error);
+}
+
+void BruteClangManifest::getVariantArgs(
+    unsigned V, SmallVectorImpl<BruteClangVariantArg> &Args) const {
+  const unsigned char *Ptr = VariantArgs[V];
+  unsigned NumArgs = endian::readNext<uint32_t, little, unaligned>(Ptr);
+  for (unsigned I = 0; I != NumArgs; ++I) {
+    BruteClangVariantArg Arg;
+    Arg.Kind = static_cast<BruteClangVariantArg::ArgKind>(
+        endian::readNext<uint8_t, little, unaligned>(Ptr));
+    unsigned Len = endian::readNext<uint16_t, little, unaligned>(Ptr);
+    Arg.Value = StringRef((const char *)Ptr, Len);
+    Ptr += Len;
+    Args.push_back(Arg);
+  }
+}
+
+bool BruteClangManifest::lookupFile(StringRef FileName,
+                                    VariantMask &Mask) const {
+  FileTableType *Table = static_cast<FileTableType *>(FileTable);
+  FileTableType::iterator Known = Table->find(FileName);
+  if (Known == Table->end())
+    return false;
+
+  StringRef Data = *Known;
+  const unsigned char *Ptr = (const unsigned char *)Data.data();
+  unsigned NumVariants = getNumVariants();
+  Mask.clear();
+  Mask.resize(NumVariants);
+  for (unsigned W = 0; W != MaskWords; ++W) {
+    uint64_t Word = endian::readNext<uint64_t, little, unaligned>(Ptr);
+    for (; Word; Word &= Word - 1) {
+      unsigned V = W * 64 + llvm::countTrailingZeros(Word);
+      if (V < NumVariants)
+        Mask.set(V);
+    }
+  }
+  return true;
+}
+
+bool BruteClangManifest::evaluateVariantSet(StringRef Expr, VariantMask &Mask,
+                                            std::string &Error) const {
+  return VariantSetParser(Axes, AxisValues, getNumVariants(), Error)
+      .parse(Expr, Mask);
+}
+
+namespace {
+
+/// Describes sets of variants as patterns over their axes.
+class VariantSetDescriber {
+  const BruteClangManifest &Manifest;
+  ArrayRef<BruteClangVariantAxis> Axes;
+
+  /// Describe \p Values, a set of values of axis \p A, where \p Present are
+  /// the values the variants being described can have.
+  std::string describeValues(unsigned A, llvm::SmallBitVector Values,
+                             const llvm::SmallBitVector &Present) const;
+
+public:
+  explicit VariantSetDescriber(const BruteClangManifest &Manifest)
+      : Manifest(Manifest), Axes(Manifest.getAxes()) {}
+
+  /// Describe \p Subset, a non-empty subset of \p Universe, as patterns over
+  /// axis \p A and those after it. All variants of \p Universe agree on the
+  /// axes before \p A, and the pattern "*" stands for all of them.
+  void describe(ArrayRef<unsigned> Subset, ArrayRef<unsigned> Universe,
+                unsigned A, std::vector<std::string> &Patterns) const;
+};
+
+} // end anonymous namespace
+
+std::string
+VariantSetDescriber::describeValues(unsigned A, llvm::SmallBitVector Values,
+                                    const llvm::SmallBitVector &Present) const {
+  if (Values == Present)
+    return "*";
+
+  // Use the groups the values cover, then the remaining values.
+  std::string Description;
+  auto add = [&](StringRef Name) {
+    if (!Description.empty())
+      Description += ',';
+    Description += Name;
+  };
+  for (const auto &Group : Axes[A].Groups) {
+    bool Covered = !Group.second.empty();
+    for (unsigned Member : Group.second)
+      Covered &= Values.test(Member);
+    if (!Covered)
+      continue;
+    add(Group.first);
+    for (unsigned Member : Group.second)
+      Values.reset(Member);
+  }
+  for (int V = Values.find_first(); V != -1; V = Values.find_next(V))
+    add(Axes[A].Values[V]);
+  return Description;
+}
+
+void VariantSetDescriber::describe(ArrayRef<unsigned> Subset,
+                                   ArrayRef<unsigned> Universe, unsigned A,
+                                   std::vector<std::string> &Patterns) const {
+  if (Subset.size() == Universe.size()) {
+    Patterns.push_back("*");
+    return;
+  }
+  assert(A < Axes.size() && "no axis left to tell variants apart");
+
+  // Split both sets by the value of this axis.
+  unsigned NumValues = Axes[A].Values.size();
+  std::vector<std::vector<unsigned>> SubsetByValue(NumValues);
+  std::vector<std::vector<unsigned>> UniverseByValue(NumValues);
+  for (unsigned V : Subset)
+    SubsetByValue[Manifest.getAxisValue(V, A)].push_back(V);
+  for (unsigned V : Universe)
+    UniverseByValue[Manifest.getAxisValue(V, A)].push_back(V);
+
+  // Values whose variants are described alike share their patterns.
+  struct Block {
+    std::vector<std::string> Patterns;
+    llvm::SmallBitVector Values;
+  };
+  std::vector<Block> Blocks;
+  llvm::StringMap<unsigned> BlockIndex;
+  llvm::SmallBitVector Present(NumValues);
+  for (unsigned Value = 0; Value != NumValues; ++Value) {
+    if (!UniverseByValue[Value].empty())
+      Present.set(Value);
+    if (SubsetByValue[Value].empty())
+      continue;
+
+    std::vector<std::string> Sub;
+    describe(SubsetByValue[Value], UniverseByValue[Value], A + 1, Sub);
+    std::string Key = llvm::join(Sub, " ");
+    auto Inserted = BlockIndex.insert(std::make_pair(Key, Blocks.size()));
+    if (Inserted.second)
+      Blocks.push_back(Block{std::move(Sub), llvm::SmallBitVector(NumValues)});
+    Blocks[Inserted.first->second].Values.set(Value);
+  }
+
+  for (const Block &B : Blocks) {
+    std::string Values = describeValues(A, B.Values, Present);
+    for (const std::string &Sub : B.Patterns)
+      Patterns.push_back(A + 1 == Axes.size() ? Values : Values + "/" + Sub);
+  }
+}
+
+void BruteClangManifest::describeVariants(const VariantMask &Mask,
+                                          raw_ostream &OS) const {
+  if (Axes.empty()) {
+    bool First = true;
+    for (int V = Mask.find_first(); V != -1; V = Mask.find_next(V)) {
+      OS << (First ? "" : ", ") << getVariantName(V);
+      First = false;
+    }
+    return;
+  }
+
+  std::vector<unsigned> Subset, Universe;
+  for (unsigned V = 0, E = getNumVariants(); V != E; ++V) {
+    Universe.push_back(V);
+    if (V < Mask.size() && Mask.test(V))
+      Subset.push_back(V);
+  }
+  if (Subset.empty())
+    return;
+
+  std::vector<std::string> Patterns;
+  VariantSetDescriber(*this).describe(Subset, Universe, 0, Patterns);
+  OS << llvm::join(Patterns, " | ");
+}
+
+void BruteClangManifest::sampleVariants(const VariantMask &Candidates,
+                                        unsigned Strength,
+                                        VariantMask &Sample) const {
+  Sample = Candidates;
+  Sample.resize(getNumVariants());
+  if (Axes.size() <= Strength)
+    return;
+
+  // Every set of Strength axes, in lexicographic order.
+  std::vector<SmallVector<unsigned, 4>> AxisSets;
+  SmallVector<unsigned, 4> AxisSet;
+  for (unsigned I = 0; I != Strength; ++I)
+    AxisSet.push_back(I);
+  for (;;) {
+    AxisSets.push_back(AxisSet);
+    int I = Strength - 1;
+    while (I >= 0 && AxisSet[I] == Axes.size() - Strength + I)
+      --I;
+    if (I < 0)
+      break;
+    ++AxisSet[I];
+    for (unsigned J = I + 1; J != Strength; ++J)
+      AxisSet[J] = AxisSet[J - 1] + 1;
+  }
+
+  // Number the value combinations of each axis set the candidates have, and
+  // list the ones each candidate has.
+  std::vector<unsigned> Pool;
+  for (int V = Sample.find_first(); V != -1; V = Sample.find_next(V))
+    Pool.push_back(V);
+  llvm::DenseMap<std::pair<unsigned, uint64_t>, unsigned> CombinationIDs;
+  std::vector<unsigned> Combinations;
+  Combinations.reserve(Pool.size() * AxisSets.size());
+  for (unsigned V : Pool) {
+    for (unsigned S = 0, E = AxisSets.size(); S != E; ++S) {
+      uint64_t Values = 0;
+      for (unsigned A : AxisSets[S])
+        Values = Values * Axes[A].Values.size() + getAxisValue(V, A);
+      auto Inserted = CombinationIDs.insert(
+          std::make_pair(std::make_pair(S, Values), CombinationIDs.size()));
+      Combinations.push_back(Inserted.first->second);
+    }
+  }
+
+  // Take the candidate covering the most combinations not covered yet until
+  // every combination is covered. Ties go to the first candidate, so the
+  // sample only depends on the manifest.
+  llvm::BitVector Covered(CombinationIDs.size());
+  llvm::BitVector Taken(Pool.size());
+  unsigned NumUncovered = CombinationIDs.size();
+  Sample.reset();
+  while (NumUncovered) {
+    unsigned Best = 0, BestGain = 0;
+    for (unsigned P = 0, E = Pool.size(); P != E; ++P) {
+      if (Taken.test(P))
+        continue;
+      unsigned Gain = 0;
+      for (unsigned S = 0, N = AxisSets.size(); S != N; ++S)
+        Gain += !Covered.test(Combinations[P * N + S]);
+      if (Gain > BestGain) {
+        Best = P;
+        BestGain = Gain;
+      }
+    }
+    assert(BestGain && "an uncovered combination no candidate has");
+
+    Taken.set(Best);
+    Sample.set(Pool[Best]);
+    for (unsigned S = 0, N = AxisSets.size(); S != N; ++S)
+      Covered.set(Combinations[Best * N + S]);
+    NumUncovered -= BestGain;
+  }
+}
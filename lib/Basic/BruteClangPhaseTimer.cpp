@@ -0,0 +1,36 @@
+//===- BruteClangPhaseTimer.cpp - Per-thread phase timing ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangPhaseTimer.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Process.h"
+#include <chrono>
+#include <time.h>
+
+using namespace clang;
+
+BruteClangPhaseTime BruteClangPhaseTime::now() {
+  BruteClangPhaseTime Now;
+  Now.Wall = std::chrono::duration<double>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+                 .count();
+#if defined(LLVM_ON_UNIX) && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec TS;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS) == 0) {
+    Now.CPU = TS.tv_sec + TS.tv_nsec / 1e9;
+    return Now;
+  }
+#endif
+  std::chrono::nanoseconds User, System;
+  llvm::sys::TimePoint<> Elapsed;
+  llvm::sys::Process::GetTimeUsage(Elapsed, User, System);
+  Now.CPU = std::chrono::duration<double>(User + System).count();
+  return Now;
+}
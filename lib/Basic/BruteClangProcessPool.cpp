@@ -0,0 +1,183 @@
+//===- BruteClangProcessPool.cpp - Forked jobs for BruteClang ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangProcessPool.h"
+#include "clang/Basic/BruteClangPhaseTimer.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef LLVM_ON_UNIX
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace clang;
+
+BruteClangProcessPool::BruteClangProcessPool(unsigned NumProcesses)
+    : NumProcesses(NumProcesses ? NumProcesses : 1) {}
+
+BruteClangProcessPool::~BruteClangProcessPool() { wait(); }
+
+bool BruteClangProcessPool::isSupported() {
+#ifdef LLVM_ON_UNIX
+  return true;
+#else
+  return false;
+#endif
+}
+
+void BruteClangProcessPool::async(Job J, Completion Done) {
+  Queue.push_back(QueuedJob{std::move(J), std::move(Done)});
+}
+
+#ifdef LLVM_ON_UNIX
+
+bool BruteClangProcessPool::start(QueuedJob &QJ) {
+  int Pipe[2];
+  if (pipe(Pipe) != 0) {
+    Result R;
+    R.Succeeded = false;
+    R.Failure = std::string("could not be started: ") + strerror(errno);
+    QJ.Done(R);
+    return false;
+  }
+
+  // Output buffered so far would be written again by the child.
+  llvm::outs().flush();
+  llvm::errs().flush();
+
+  double Start = BruteClangPhaseTime::now().Wall;
+  pid_t PID = fork();
+  if (PID < 0) {
+    int Error = errno;
+    close(Pipe[0]);
+    close(Pipe[1]);
+    Result R;
+    R.Succeeded = false;
+    R.Failure = std::string("could not be started: ") + strerror(Error);
+    QJ.Done(R);
+    return false;
+  }
+
+  if (PID == 0) {
+    close(Pipe[0]);
+    for (const Child &C : Running)
+      close(C.FD);
+    {
+      llvm::raw_fd_ostream OS(Pipe[1], /*shouldClose=*/true);
+      QJ.J(OS);
+    }
+    llvm::outs().flush();
+    // Skip the destructors of the state shared with the parent.
+    _exit(0);
+  }
+
+  close(Pipe[1]);
+  Child C;
+  C.PID = PID;
+  C.FD = Pipe[0];
+  C.Start = Start;
+  C.Done = std::move(QJ.Done);
+  Running.push_back(std::move(C));
+  return true;
+}
+
+void BruteClangProcessPool::finish(Child &C) {
+  close(C.FD);
+  int Status;
+  while (waitpid(C.PID, &Status, 0) < 0) {
+    if (errno != EINTR) {
+      C.R.Succeeded = false;
+      C.R.Failure = std::string("was lost: ") + strerror(errno);
+      C.R.Seconds = BruteClangPhaseTime::now().Wall - C.Start;
+      C.Done(C.R);
+      return;
+    }
+  }
+  C.R.Seconds = BruteClangPhaseTime::now().Wall - C.Start;
+
+  if (WIFEXITED(Status) && WEXITSTATUS(Status) != 0) {
+    C.R.Succeeded = false;
+    C.R.Failure = "exited with status " + std::to_string(WEXITSTATUS(Status));
+  } else if (WIFSIGNALED(Status)) {
+    C.R.Succeeded = false;
+    C.R.Failure = "killed by signal " + std::to_string(WTERMSIG(Status));
+    if (const char *Name = strsignal(WTERMSIG(Status)))
+      C.R.Failure += std::string(" (") + Name + ")";
+  }
+  C.Done(C.R);
+}
+
+void BruteClangProcessPool::wait() {
+  std::vector<struct pollfd> FDs;
+  char Buffer[4096];
+  while (!Queue.empty() || !Running.empty()) {
+    while (!Queue.empty() && Running.size() < NumProcesses) {
+      QueuedJob QJ = std::move(Queue.front());
+      Queue.pop_front();
+      start(QJ);
+    }
+    if (Running.empty())
+      continue;
+
+    FDs.clear();
+    for (const Child &C : Running)
+      FDs.push_back(pollfd{C.FD, POLLIN, 0});
+    if (poll(FDs.data(), FDs.size(), -1) < 0)
+      continue;
+
+    // Read what is available from each child; a child is done when it
+    // closes its end of the pipe.
+    std::vector<Child> StillRunning;
+    for (unsigned I = 0, E = Running.size(); I != E; ++I) {
+      Child &C = Running[I];
+      if (FDs[I].revents) {
+        ssize_t N = read(C.FD, Buffer, sizeof(Buffer));
+        if (N > 0) {
+          C.R.Output.append(Buffer, N);
+        } else if (N == 0 || errno != EINTR) {
+          finish(C);
+          continue;
+        }
+      }
+      StillRunning.push_back(std::move(C));
+    }
+    Running.swap(StillRunning);
+  }
+}
+
+#else
+
+bool BruteClangProcessPool::start(QueuedJob &QJ) {
+  Result R;
+  double Start = BruteClangPhaseTime::now().Wall;
+  {
+    llvm::raw_string_ostream OS(R.Output);
+    QJ.J(OS);
+  }
+  R.Seconds = BruteClangPhaseTime::now().Wall - Start;
+  QJ.Done(R);
+  return true;
+}
+
+void BruteClangProcessPool::finish(Child &C) {}
+
+void BruteClangProcessPool::wait() {
+  while (!Queue.empty()) {
+    QueuedJob QJ = std::move(Queue.front());
+    Queue.pop_front();
+    start(QJ);
+  }
+}
+
+#endif
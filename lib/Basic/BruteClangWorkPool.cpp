@@ -0,0 +1,127 @@
+//===- BruteClangWorkPool.cpp - Work-stealing pool for BruteClang --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangWorkPool.h"
+#include "llvm/Config/llvm-config.h"
+
+using namespace clang;
+
+BruteClangWorkPool::BruteClangWorkPool(unsigned NumWorkers) {
+#if !LLVM_ENABLE_THREADS
+  NumWorkers = 1;
+#endif
+  if (NumWorkers == 0)
+    NumWorkers = 1;
+
+  for (unsigned I = 0; I != NumWorkers; ++I)
+    Queues.emplace_back(new WorkerQueue);
+
+  if (NumWorkers == 1)
+    return;
+
+  Threads.reserve(NumWorkers);
+  for (unsigned I = 0; I != NumWorkers; ++I)
+    Threads.emplace_back([this, I] { work(I); });
+}
+
+BruteClangWorkPool::~BruteClangWorkPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> Guard(StateLock);
+    ShuttingDown = true;
+  }
+  WorkAvailable.notify_all();
+  for (std::thread &T : Threads)
+    T.join();
+}
+
+void BruteClangWorkPool::async(Job J) {
+  // Jobs are pushed while holding StateLock, so a worker that saw NumQueued
+  // go up is guaranteed to find a job in some queue.
+  std::lock_guard<std::mutex> Guard(StateLock);
+  WorkerQueue &Queue = *Queues[NextQueue];
+  NextQueue = (NextQueue + 1) % Queues.size();
+  {
+    std::lock_guard<std::mutex> QueueGuard(Queue.Lock);
+    Queue.Jobs.push_back(std::move(J));
+  }
+  ++NumQueued;
+  ++NumPending;
+  WorkAvailable.notify_one();
+}
+
+bool BruteClangWorkPool::takeJob(unsigned Index, Job &J) {
+  // Own queue first, oldest job first.
+  {
+    WorkerQueue &Own = *Queues[Index];
+    std::lock_guard<std::mutex> Guard(Own.Lock);
+    if (!Own.Jobs.empty()) {
+      J = std::move(Own.Jobs.front());
+      Own.Jobs.pop_front();
+      return true;
+    }
+  }
+
+  // Then steal the newest job of another worker.
+  for (unsigned I = 1, E = Queues.size(); I != E; ++I) {
+    WorkerQueue &Victim = *Queues[(Index + I) % E];
+    std::lock_guard<std::mutex> Guard(Victim.Lock);
+    if (!Victim.Jobs.empty()) {
+      J = std::move(Victim.Jobs.back());
+      Victim.Jobs.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void BruteClangWorkPool::work(unsigned Index) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> Lock(StateLock);
+      WorkAvailable.wait(Lock, [&] { return NumQueued != 0 || ShuttingDown; });
+      if (NumQueued == 0)
+        return;
+      // Claim one of the queued jobs.
+      --NumQueued;
+    }
+
+    // Another worker may take the job this one claimed, but then the one it
+    // claimed is still queued somewhere.
+    Job J;
+    while (!takeJob(Index, J))
+      std::this_thread::yield();
+    J();
+
+    std::lock_guard<std::mutex> Guard(StateLock);
+    if (--NumPending == 0)
+      AllDone.notify_all();
+  }
+}
+
+void BruteClangWorkPool::wait() {
+  if (Threads.empty()) {
+    // Single worker: drain the queue on this thread. Jobs may queue more
+    // jobs while we go.
+    Job J;
+    while (takeJob(0, J)) {
+      {
+        std::lock_guard<std::mutex> Guard(StateLock);
+        --NumQueued;
+      }
+      J();
+      std::lock_guard<std::mutex> Guard(StateLock);
+      --NumPending;
+    }
+    return;
+  }
+
+  std::unique_lock<std::mutex> Lock(StateLock);
+  AllDone.wait(Lock, [&] { return NumPending == 0; });
+}
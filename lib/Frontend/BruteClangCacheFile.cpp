@@ -0,0 +1,337 @@
+//===- BruteClangCacheFile.cpp - Files kept between runs ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Stamps are written as a u32 count, then for each file: u16 path length,
+// path, u64 size, u64 modification time, u16 hash length, content hash.
+// Diagnostics are written as a u32 count, then for each: u32 line, u32
+// column, u32 diagnostic ID, u16 file name length, file name, u32 message
+// length, message. Absent paths are written as a u32 count, then for each:
+// u16 path length, path.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangCacheFile.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Lex/DirectoryLookup.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+bool clang::writeBruteClangCacheFile(StringRef Path, StringRef Contents) {
+  SmallString<256> TempPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", FD, TempPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Contents;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(TempPath, Path)) {
+    llvm::sys::fs::remove(TempPath);
+    return false;
+  }
+  return true;
+}
+
+BruteClangCacheReader::BruteClangCacheReader(StringRef Buffer, StringRef Magic,
+                                             unsigned Version)
+    : Ptr(Buffer.begin()), End(Buffer.end()) {
+  if (!Buffer.startswith(Magic)) {
+    Failed = true;
+    return;
+  }
+  Ptr += Magic.size();
+  if (read<uint32_t>() != Version)
+    Failed = true;
+}
+
+void BruteClangCacheReader::readDiagnostics(
+    std::vector<CustomDiagContainer::RecordedDiagnostic> &Diags) {
+  for (unsigned I = 0, N = read<uint32_t>(); I != N && !Failed; ++I) {
+    CustomDiagContainer::RecordedDiagnostic Diag;
+    Diag.LineNumber = read<uint32_t>();
+    Diag.ColumnNumber = read<uint32_t>();
+    Diag.DiagID = read<uint32_t>();
+    Diag.FileName = readString<uint16_t>();
+    Diag.msg = readString<uint32_t>();
+    Diags.push_back(std::move(Diag));
+  }
+}
+
+BruteClangCacheWriter::BruteClangCacheWriter(StringRef Magic, unsigned Version)
+    : OS(Contents) {
+  OS << Magic;
+  write<uint32_t>(Version);
+}
+
+void BruteClangCacheWriter::writeDiagnostics(
+    ArrayRef<CustomDiagContainer::RecordedDiagnostic> Diags) {
+  write<uint32_t>(Diags.size());
+  for (const CustomDiagContainer::RecordedDiagnostic &Diag : Diags) {
+    write<uint32_t>(Diag.LineNumber);
+    write<uint32_t>(Diag.ColumnNumber);
+    write<uint32_t>(Diag.DiagID);
+    writeString<uint16_t>(Diag.FileName);
+    writeString<uint32_t>(Diag.msg);
+  }
+}
+
+bool BruteClangCacheWriter::commit(StringRef Path) {
+  return writeBruteClangCacheFile(Path, OS.str());
+}
+
+namespace {
+
+/// Records the paths the header searches of a preprocessor look at before
+/// finding a file, mirroring Preprocessor::LookupFile and
+/// HeaderSearch::LookupFile.
+class HeaderProbeRecorder : public PPCallbacks {
+  Preprocessor &PP;
+  BruteClangFileCollector &Collector;
+
+  void addProbe(StringRef Dir, StringRef FileName) {
+    SmallString<256> Path(Dir);
+    llvm::sys::path::append(Path, FileName);
+    Collector.addAbsentPath(Path);
+  }
+
+  /// Record a search for \p FileName that found \p File, if any, in
+  /// \p SearchPath. \p FromDir is where an #include_next started.
+  void recordLookup(StringRef FileName, bool IsAngled,
+                    const DirectoryLookup *FromDir, const FileEntry *File,
+                    StringRef SearchPath) {
+    if (llvm::sys::path::is_absolute(FileName))
+      return;
+    // MSVC looks up quoted includes relative to the whole include stack, and
+    // modules relative to the including file.
+    if (PP.getLangOpts().MSVCCompat || PP.getCurrentLexerSubmodule()) {
+      Collector.setUntrackedLookups();
+      return;
+    }
+
+    HeaderSearch &HS = PP.getHeaderSearchInfo();
+    HeaderSearch::search_dir_iterator I =
+        IsAngled ? HS.angled_dir_begin() : HS.search_dir_begin();
+    if (FromDir) {
+      I = HS.search_dir_begin() + (FromDir - &*HS.search_dir_begin());
+    } else if (!IsAngled) {
+      // Quoted includes look in the directory of the including file first,
+      // or in the working directory for -include files.
+      FileID FID = PP.getCurrentFileLexer()->getFileID();
+      const FileEntry *Includer =
+          PP.getSourceManager().getFileEntryForID(FID);
+      StringRef IncluderDir = Includer ? Includer->getDir()->getName() : ".";
+      if (File && SearchPath == IncluderDir)
+        return;
+      addProbe(IncluderDir, FileName);
+    }
+
+    for (HeaderSearch::search_dir_iterator E = HS.search_dir_end(); I != E;
+         ++I) {
+      if (!I->isNormalDir()) {
+        Collector.setUntrackedLookups();
+        return;
+      }
+      StringRef Dir = I->getDir()->getName();
+      if (File && SearchPath == Dir)
+        return;
+      addProbe(Dir, FileName);
+    }
+
+    // Found outside the search list, as a subframework header say.
+    if (File)
+      Collector.setUntrackedLookups();
+  }
+
+public:
+  HeaderProbeRecorder(Preprocessor &PP, BruteClangFileCollector &Collector)
+      : PP(PP), Collector(Collector) {}
+
+  void InclusionDirective(SourceLocation HashLoc, const Token &IncludeTok,
+                          StringRef FileName, bool IsAngled,
+                          CharSourceRange FilenameRange, const FileEntry *File,
+                          StringRef SearchPath, StringRef RelativePath,
+                          const Module *Imported) override {
+    // The collector sees the missing file itself.
+    if (!File)
+      return;
+
+    // Mirror Preprocessor::HandleIncludeNextDirective.
+    const DirectoryLookup *FromDir = nullptr;
+    const IdentifierInfo *II = IncludeTok.getIdentifierInfo();
+    if (II && II->getPPKeywordID() == tok::pp_include_next &&
+        !PP.isInPrimaryFile())
+      if ((FromDir = PP.GetCurDirLookup()))
+        ++FromDir;
+    recordLookup(FileName, IsAngled, FromDir, File, SearchPath);
+  }
+
+  void HasInclude(SourceLocation Loc, StringRef FileName, bool IsAngled,
+                  const DirectoryLookup *FromDir, const FileEntry *File,
+                  StringRef SearchPath) override {
+    recordLookup(FileName, IsAngled, FromDir, File, SearchPath);
+  }
+};
+
+} // end anonymous namespace
+
+void BruteClangFileCollector::attachToPreprocessor(Preprocessor &PP) {
+  DependencyCollector::attachToPreprocessor(PP);
+  PP.addPPCallbacks(llvm::make_unique<HeaderProbeRecorder>(PP, *this));
+}
+
+bool BruteClangFileCollector::sawDependency(StringRef Filename,
+                                            bool FromModule, bool IsSystem,
+                                            bool IsModuleFile,
+                                            bool IsMissing) {
+  if (IsMissing) {
+    MissingFiles = true;
+    return false;
+  }
+  return DependencyCollector::sawDependency(Filename, FromModule, IsSystem,
+                                            IsModuleFile, IsMissing);
+}
+
+void BruteClangFileCollector::addAbsentPath(StringRef Path) {
+  if (SeenAbsentPaths.insert(Path).second)
+    AbsentPaths.push_back(Path);
+}
+
+BruteClangFileStamps::BruteClangFileStamps(
+    IntrusiveRefCntPtr<vfs::FileSystem> FS)
+    : FS(std::move(FS)) {}
+
+BruteClangFileStamps::~BruteClangFileStamps() {}
+
+std::string BruteClangFileStamps::hashString(StringRef Str) {
+  llvm::MD5 Hash;
+  Hash.update(Str);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+  return Hex.str();
+}
+
+bool BruteClangFileStamps::getContentHash(StringRef Path, std::string &Hash) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto Known = ContentHashes.find(Path);
+    if (Known != ContentHashes.end()) {
+      Hash = Known->second;
+      return true;
+    }
+  }
+
+  auto Buffer = FS->getBufferForFile(Path);
+  if (!Buffer)
+    return false;
+  Hash = hashString((*Buffer)->getBuffer());
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  ContentHashes.insert(std::make_pair(Path, Hash));
+  return true;
+}
+
+bool BruteClangFileStamps::writeStamps(ArrayRef<std::string> Paths,
+                                       BruteClangCacheWriter &Writer,
+                                       std::string *CombinedHash) {
+  std::string Combined;
+  Writer.write<uint32_t>(Paths.size());
+  for (const std::string &Path : Paths) {
+    auto Status = FS->status(Path);
+    std::string Hash;
+    if (!Status || !getContentHash(Path, Hash))
+      return false;
+    Writer.writeString<uint16_t>(Path);
+    Writer.write<uint64_t>(Status->getSize());
+    Writer.write<uint64_t>(
+        llvm::sys::toTimeT(Status->getLastModificationTime()));
+    Writer.writeString<uint16_t>(Hash);
+    Combined += Path + "=" + Hash + "\n";
+  }
+  if (CombinedHash)
+    *CombinedHash = hashString(Combined);
+  return true;
+}
+
+bool BruteClangFileStamps::checkStamps(BruteClangCacheReader &Reader,
+                                       bool CheckModTime) {
+  for (unsigned I = 0, N = Reader.read<uint32_t>(); I != N; ++I) {
+    StringRef Path = Reader.readString<uint16_t>();
+    uint64_t Size = Reader.read<uint64_t>();
+    uint64_t ModTime = Reader.read<uint64_t>();
+    StringRef Hash = Reader.readString<uint16_t>();
+    if (Reader.hasFailed())
+      return false;
+
+    // Compare the cheap parts of the stamp first.
+    auto Status = FS->status(Path);
+    if (!Status || Status->getSize() != Size)
+      return false;
+    if (CheckModTime &&
+        uint64_t(llvm::sys::toTimeT(Status->getLastModificationTime())) !=
+            ModTime)
+      return false;
+    std::string CurrentHash;
+    if (!getContentHash(Path, CurrentHash) || CurrentHash != Hash)
+      return false;
+  }
+  return !Reader.hasFailed();
+}
+
+void BruteClangFileStamps::writeAbsentPaths(ArrayRef<std::string> Paths,
+                                            BruteClangCacheWriter &Writer) {
+  Writer.write<uint32_t>(Paths.size());
+  for (const std::string &Path : Paths)
+    Writer.writeString<uint16_t>(Path);
+}
+
+bool BruteClangFileStamps::checkAbsentPaths(BruteClangCacheReader &Reader,
+                                            std::vector<std::string> *Paths) {
+  for (unsigned I = 0, N = Reader.read<uint32_t>(); I != N; ++I) {
+    StringRef Path = Reader.readString<uint16_t>();
+    if (Reader.hasFailed())
+      return false;
+
+    bool Exists;
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      auto Known = PathsExist.find(Path);
+      if (Known == PathsExist.end()) {
+        // A directory of that name does not stop the search.
+        auto Status = FS->status(Path);
+        Known = PathsExist
+                    .insert(std::make_pair(Path,
+                                           Status && !Status->isDirectory()))
+                    .first;
+      }
+      Exists = Known->second;
+    }
+    if (Exists)
+      return false;
+    if (Paths)
+      Paths->push_back(Path);
+  }
+  return !Reader.hasFailed();
+}
@@ -0,0 +1,382 @@
+//===- BruteClangDeclFingerprint.cpp - Declaration hashes -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangDeclFingerprint.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/AST/ODRHash.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MD5.h"
+
+using namespace clang;
+
+std::atomic<unsigned> BruteClangCheckedDecls::NumChecked{0};
+std::atomic<unsigned> BruteClangCheckedDecls::NumShared{0};
+
+namespace {
+
+/// The hash of a declaration and of everything declared inside it. Each
+/// part of it is hashed with an ODRHash of its own, which only identifies
+/// the declarations it refers to by name.
+class DeclHasher {
+  llvm::MD5 Hash;
+
+public:
+  void addInteger(uint64_t Value) {
+    uint8_t Bytes[sizeof(Value)];
+    llvm::support::endian::write64le(Bytes, Value);
+    Hash.update(Bytes);
+  }
+
+  void addString(StringRef Str) {
+    addInteger(Str.size());
+    Hash.update(Str);
+  }
+
+  /// Add the presumed location of \p Loc. Returns false if it has none.
+  bool addLocation(const SourceManager &SM, SourceLocation Loc) {
+    PresumedLoc PLoc = SM.getPresumedLoc(SM.getExpansionLoc(Loc));
+    if (PLoc.isInvalid())
+      return false;
+    addString(PLoc.getFilename());
+    addInteger(PLoc.getLine());
+    addInteger(PLoc.getColumn());
+    return true;
+  }
+
+  void addStmt(const Stmt *S) {
+    if (!S) {
+      addInteger(0);
+      return;
+    }
+    ODRHash StmtHash;
+    StmtHash.AddStmt(S);
+    addInteger(1);
+    addInteger(StmtHash.CalculateHash());
+  }
+
+  void addDecl(const Decl *D);
+
+  std::string finish() {
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Hex;
+    llvm::MD5::stringifyResult(Result, Hex);
+    return Hex.str();
+  }
+};
+
+} // end anonymous namespace
+
+void DeclHasher::addDecl(const Decl *D) {
+  addInteger(D->getKind());
+  // ODRHash leaves attributes out, and plugins look for annotations.
+  for (const Attr *A : D->attrs()) {
+    addInteger(A->getKind());
+    if (const auto *Annotation = dyn_cast<AnnotateAttr>(A))
+      addString(Annotation->getAnnotation());
+  }
+
+  if (const auto *Template = dyn_cast<TemplateDecl>(D)) {
+    ODRHash NameHash;
+    NameHash.AddDecl(Template);
+    addInteger(NameHash.CalculateHash());
+    if (const NamedDecl *Templated = Template->getTemplatedDecl())
+      addDecl(Templated);
+    return;
+  }
+
+  // ODRHash leaves out the bases of a class, and everything it does not
+  // know how to compare yet: function bodies, constructor initializers,
+  // enumerator values and nested classes.
+  ODRHash DeclHash;
+  const auto *Record = dyn_cast<CXXRecordDecl>(D);
+  if (Record && Record->isThisDeclarationADefinition()) {
+    DeclHash.AddCXXRecordDecl(Record);
+    addInteger(DeclHash.CalculateHash());
+    addInteger(Record->getNumBases());
+    for (const CXXBaseSpecifier &Base : Record->bases()) {
+      addInteger(Base.isVirtual());
+      addInteger(Base.getAccessSpecifierAsWritten());
+      addString(Base.getType().getAsString());
+    }
+  } else {
+    DeclHash.AddSubDecl(D);
+    addInteger(DeclHash.CalculateHash());
+  }
+
+  if (const auto *Function = dyn_cast<FunctionDecl>(D)) {
+    if (const auto *Constructor = dyn_cast<CXXConstructorDecl>(D))
+      for (const CXXCtorInitializer *Init : Constructor->inits())
+        if (Init->isWritten())
+          addStmt(Init->getInit());
+    addStmt(Function->doesThisDeclarationHaveABody() ? Function->getBody()
+                                                     : nullptr);
+    return;
+  }
+  if (const auto *Enumerator = dyn_cast<EnumConstantDecl>(D))
+    addStmt(Enumerator->getInitExpr());
+
+  if (const auto *Context = dyn_cast<DeclContext>(D))
+    for (const Decl *Child : Context->decls())
+      if (!Child->isImplicit())
+        addDecl(Child);
+}
+
+bool clang::computeDeclFingerprint(const Decl *D, std::string &Fingerprint) {
+  DeclHasher Hasher;
+  const SourceManager &SM = D->getASTContext().getSourceManager();
+  if (!Hasher.addLocation(SM, D->getLocStart()) ||
+      !Hasher.addLocation(SM, D->getLocEnd()))
+    return false;
+  Hasher.addDecl(D);
+  Fingerprint = Hasher.finish();
+  return true;
+}
+
+BruteClangCheckedDecls::Entry &
+BruteClangCheckedDecls::claim(StringRef Fingerprint, unsigned CI_ID,
+                              bool &Claimed) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::unique_ptr<Entry> &E = Entries[Fingerprint];
+  Claimed = !E;
+  if (Claimed)
+    E.reset(new Entry(CI_ID));
+  return *E;
+}
+
+void BruteClangCheckedDecls::finish(Entry &E,
+                                    std::vector<RecordedDiagnostic> Diags) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    E.Diags = std::move(Diags);
+    E.Done = true;
+  }
+  Finished.notify_all();
+}
+
+void BruteClangCheckedDecls::abandon(Entry &E) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    E.Done = true;
+    E.Failed = true;
+  }
+  Finished.notify_all();
+}
+
+void BruteClangCheckedDecls::wait(const Entry &E) {
+  std::unique_lock<std::mutex> Guard(Lock);
+  Finished.wait(Guard, [&E] { return E.Done; });
+}
+
+namespace {
+
+/// Forwards each diagnostic to the client of the engine, keeping a copy of
+/// it captured or formatted as CustomDiagConsumer would.
+class DiagnosticRecorder : public ForwardingDiagnosticConsumer {
+  std::vector<BruteClangCheckedDecls::RecordedDiagnostic> &Recorded;
+
+public:
+  DiagnosticRecorder(
+      DiagnosticConsumer &Target,
+      std::vector<BruteClangCheckedDecls::RecordedDiagnostic> &Recorded)
+      : ForwardingDiagnosticConsumer(Target), Recorded(Recorded) {}
+
+  void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,
+                        const Diagnostic &Info) override {
+    ForwardingDiagnosticConsumer::HandleDiagnostic(DiagLevel, Info);
+
+    Recorded.emplace_back();
+    BruteClangCheckedDecls::RecordedDiagnostic &Diag = Recorded.back();
+    Diag.Captured =
+        CustomDiagContainer::CaptureDiagnostic(Info, Diag.CapturedDiag);
+    if (Diag.Captured)
+      return;
+
+    SmallString<256> Message;
+    Info.FormatDiagnostic(Message);
+    CustomDiagContainer::RecordedDiagnostic &Formatted = Diag.Formatted;
+    Formatted.msg = Message.str().str();
+    Formatted.DiagID = Info.getID();
+    SourceLocation Loc = Info.getLocation();
+    if (Info.hasSourceManager() && Loc.isValid()) {
+      const SourceManager &SM = Info.getSourceManager();
+      Formatted.FileName = SM.getFilename(Loc).str();
+      Formatted.LineNumber = SM.getSpellingLineNumber(Loc);
+      Formatted.ColumnNumber = SM.getPresumedColumnNumber(Loc);
+    }
+  }
+};
+
+} // end anonymous namespace
+
+BruteClangDeclFilter::CheckScope::CheckScope(BruteClangDeclFilter &Filter,
+                                             const Decl *D, StringRef Context)
+    : Filter(Filter) {
+  // Nothing is reported after a fatal error, so the check of this instance
+  // is of no use to the others.
+  if (D->getASTContext().getDiagnostics().hasFatalErrorOccurred())
+    return;
+  std::string Fingerprint;
+  if (!computeDeclFingerprint(D, Fingerprint))
+    return;
+  // The context comes first; fingerprints are all of the same size.
+  std::string Key = Context.str();
+  Key += '\0';
+  Key += Fingerprint;
+
+  bool IsNew;
+  BruteClangCheckedDecls::Entry &E =
+      Filter.Checked.claim(Key, Filter.CI_ID, IsNew);
+  if (!IsNew) {
+    // Handed over twice in this instance.
+    if (E.LeaderID == Filter.CI_ID) {
+      Check = false;
+      return;
+    }
+    // Checked by another instance, which is to be waited for to know whether
+    // it hit a fatal error. A leader does not wait for other entries while it
+    // checks one, so this cannot deadlock.
+    Filter.Checked.wait(E);
+    if (E.Failed)
+      return;
+    Check = false;
+    Filter.Shared.push_back(&E);
+    ++BruteClangCheckedDecls::NumShared;
+    return;
+  }
+  ++BruteClangCheckedDecls::NumChecked;
+  Claimed = &E;
+
+  Diags = &D->getASTContext().getDiagnostics();
+  Client = Diags->getClient();
+  OwnedClient = Diags->takeClient();
+  Recorder.reset(new DiagnosticRecorder(*Client, Recorded));
+  Diags->setClient(Recorder.get(), false);
+}
+
+BruteClangDeclFilter::CheckScope::~CheckScope() {
+  if (!Claimed)
+    return;
+  if (OwnedClient)
+    Diags->setClient(OwnedClient.release(), true);
+  else
+    Diags->setClient(Client, false);
+  if (Diags->hasFatalErrorOccurred())
+    Filter.Checked.abandon(*Claimed);
+  else
+    Filter.Checked.finish(*Claimed, std::move(Recorded));
+}
+
+/// Forwards every callback to the wrapped consumer, except for the
+/// declarations it is not to check.
+class BruteClangDeclFilter::FilteringConsumer : public ASTConsumer {
+  std::unique_ptr<ASTConsumer> Consumer;
+  BruteClangDeclFilter &Filter;
+  std::string Context;
+
+public:
+  FilteringConsumer(std::unique_ptr<ASTConsumer> Consumer,
+                    BruteClangDeclFilter &Filter, StringRef Name)
+      : Consumer(std::move(Consumer)), Filter(Filter),
+        Context(("plugin " + Name).str()) {}
+
+  void Initialize(ASTContext &Context) override {
+    Consumer->Initialize(Context);
+  }
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    for (Decl *D : DG) {
+      CheckScope Scope(Filter, D, Context);
+      if (Scope.shouldCheck() && !Consumer->HandleTopLevelDecl(DeclGroupRef(D)))
+        return false;
+    }
+    return true;
+  }
+  void HandleInlineFunctionDefinition(FunctionDecl *D) override {
+    CheckScope Scope(Filter, D, Context);
+    if (Scope.shouldCheck())
+      Consumer->HandleInlineFunctionDefinition(D);
+  }
+  void HandleInterestingDecl(DeclGroupRef DG) override {
+    for (Decl *D : DG) {
+      CheckScope Scope(Filter, D, Context);
+      if (Scope.shouldCheck())
+        Consumer->HandleInterestingDecl(DeclGroupRef(D));
+    }
+  }
+  void HandleTranslationUnit(ASTContext &Ctx) override {
+    Consumer->HandleTranslationUnit(Ctx);
+  }
+  void HandleTagDeclDefinition(TagDecl *D) override {
+    Consumer->HandleTagDeclDefinition(D);
+  }
+  void HandleTagDeclRequiredDefinition(const TagDecl *D) override {
+    Consumer->HandleTagDeclRequiredDefinition(D);
+  }
+  void HandleCXXImplicitFunctionInstantiation(FunctionDecl *D) override {
+    Consumer->HandleCXXImplicitFunctionInstantiation(D);
+  }
+  void HandleTopLevelDeclInObjCContainer(DeclGroupRef D) override {
+    Consumer->HandleTopLevelDeclInObjCContainer(D);
+  }
+  void HandleImplicitImportDecl(ImportDecl *D) override {
+    Consumer->HandleImplicitImportDecl(D);
+  }
+  void CompleteTentativeDefinition(VarDecl *D) override {
+    Consumer->CompleteTentativeDefinition(D);
+  }
+  void AssignInheritanceModel(CXXRecordDecl *RD) override {
+    Consumer->AssignInheritanceModel(RD);
+  }
+  void HandleCXXStaticMemberVarInstantiation(VarDecl *D) override {
+    Consumer->HandleCXXStaticMemberVarInstantiation(D);
+  }
+  void HandleVTable(CXXRecordDecl *RD) override {
+    Consumer->HandleVTable(RD);
+  }
+  ASTMutationListener *GetASTMutationListener() override {
+    return Consumer->GetASTMutationListener();
+  }
+  ASTDeserializationListener *GetASTDeserializationListener() override {
+    return Consumer->GetASTDeserializationListener();
+  }
+  void PrintStats() override { Consumer->PrintStats(); }
+  bool shouldSkipFunctionBody(Decl *D) override {
+    return Consumer->shouldSkipFunctionBody(D);
+  }
+};
+
+std::unique_ptr<ASTConsumer>
+BruteClangDeclFilter::wrapConsumer(std::unique_ptr<ASTConsumer> Consumer,
+                                   StringRef Name) {
+  return llvm::make_unique<FilteringConsumer>(std::move(Consumer), *this,
+                                              Name);
+}
+
+void BruteClangDeclFilter::finish(CustomDiagContainer &DiagContainer) {
+  for (const BruteClangCheckedDecls::Entry *E : Shared) {
+    for (const BruteClangCheckedDecls::RecordedDiagnostic &Diag : E->Diags) {
+      if (Diag.Captured) {
+        DiagContainer.AddCapturedDiagnostic(CI_ID, Diag.CapturedDiag);
+        continue;
+      }
+      const CustomDiagContainer::RecordedDiagnostic &Formatted = Diag.Formatted;
+      DiagContainer.AddDiagnostic(CI_ID, Formatted.FileName,
+                                  Formatted.ColumnNumber, Formatted.LineNumber,
+                                  Formatted.msg, Formatted.DiagID);
+    }
+  }
+  Shared.clear();
+}
@@ -0,0 +1,955 @@
+//===- BruteClangDiagnosticOutput.cpp - Structured diagnostic reports -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A JSON Lines report holds one object per line, told apart by "kind":
+//
+//   {"kind": "run", "version": 1, "variants": ["amd64", ...]}
+//   {"kind": "tu", "name": "a.cpp", "variants": "f"}
+//   {"kind": "diagnostic", "tu": "a.cpp", "file": "a.hpp", "line": 3,
+//    "column": 5, "id": 1234, "message": "...", "variants": "5"}
+//
+// Variant masks are hexadecimal numbers whose bit N stands for variant N of
+// the run.
+//
+// A bitstream report is a serialized diagnostics file. Its first metadata
+// block gives the version of BruteClang's records and the variants; each
+// translation unit starts with a metadata block naming it. Every diagnostic
+// block holds a plain diagnostic record, reported as an error, and a record
+// with the diagnostic ID and the variants. Variant masks are defined once, as
+// arrays of 32-bit words, and referred to by number.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangDiagnosticOutput.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/DiagnosticIDs.h"
+#include "clang/Frontend/SerializedDiagnostics.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitstreamReader.h"
+#include "llvm/Bitcode/BitstreamWriter.h"
+#include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// The version of the JSON objects and of BruteClang's records.
+static const unsigned FormatVersion = 1;
+
+/// The records BruteClang adds to serialized diagnostics.
+enum BruteClangRecordIDs {
+  /// Metadata: the version of these records. Starts a report.
+  RECORD_BRUTE_FORMAT = serialized_diags::RECORD_LAST + 1,
+
+  /// Metadata: the name of the next variant.
+  RECORD_BRUTE_VARIANT,
+
+  /// Metadata or diagnostic: a variant mask and its number.
+  RECORD_BRUTE_VARIANT_MASK,
+
+  /// Metadata: the variant mask and name of a translation unit. Starts it.
+  RECORD_BRUTE_TRANSLATION_UNIT,
+
+  /// Diagnostic: the diagnostic ID and variant mask of the diagnostic.
+  RECORD_BRUTE_DIAG
+};
+
+BruteClangDiagnosticWriter::~BruteClangDiagnosticWriter() {}
+
+bool BruteClangDiagnosticWriter::parseFormat(StringRef Name,
+                                             OutputFormat &Format) {
+  if (Name == "jsonl")
+    Format = JSONLines;
+  else if (Name == "dia")
+    Format = Bitstream;
+  else
+    return false;
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// JSON Lines
+//===----------------------------------------------------------------------===//
+
+static void writeJSONString(raw_ostream &OS, StringRef Str) {
+  OS << '"';
+  for (unsigned char C : Str) {
+    if (C == '"' || C == '\\')
+      OS << '\\' << C;
+    else if (C < 0x20)
+      OS << llvm::format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+/// Write \p Mask as a hexadecimal number whose bit N is variant N.
+static void writeHexMask(raw_ostream &OS, const VariantMask &Mask) {
+  SmallString<64> Digits; // least significant first
+  for (int V = Mask.find_first(); V != -1; V = Mask.find_next(V)) {
+    if (Digits.size() <= unsigned(V) / 4)
+      Digits.resize(V / 4 + 1, 0);
+    Digits[V / 4] |= 1 << (V % 4);
+  }
+  if (Digits.empty())
+    OS << '0';
+  for (unsigned I = Digits.size(); I != 0; --I)
+    OS << llvm::hexdigit(Digits[I - 1], /*LowerCase=*/true);
+}
+
+/// Parse a mask written by writeHexMask into a mask over \p NumVariants
+/// variants.
+static bool parseHexMask(StringRef Hex, unsigned NumVariants,
+                         VariantMask &Mask) {
+  Mask.clear();
+  Mask.resize(NumVariants);
+  if (Hex.empty())
+    return false;
+  for (unsigned I = 0, E = Hex.size(); I != E; ++I) {
+    unsigned Digit = llvm::hexDigitValue(Hex[E - 1 - I]);
+    if (Digit == -1U)
+      return false;
+    for (unsigned Bit = 0; Bit != 4; ++Bit) {
+      if (!(Digit & (1 << Bit)))
+        continue;
+      if (I * 4 + Bit >= NumVariants)
+        return false;
+      Mask.set(I * 4 + Bit);
+    }
+  }
+  return true;
+}
+
+namespace {
+
+class JSONLinesWriter : public BruteClangDiagnosticWriter {
+  raw_ostream &OS;
+  std::string TranslationUnit;
+
+public:
+  explicit JSONLinesWriter(raw_ostream &OS) : OS(OS) {}
+
+  void beginRun(ArrayRef<StringRef> VariantNames) override {
+    OS << "{\"kind\": \"run\", \"version\": " << FormatVersion
+       << ", \"variants\": [";
+    for (unsigned V = 0, E = VariantNames.size(); V != E; ++V) {
+      if (V)
+        OS << ", ";
+      writeJSONString(OS, VariantNames[V]);
+    }
+    OS << "]}\n";
+    OS.flush();
+  }
+
+  void beginTranslationUnit(StringRef Name,
+                            const VariantMask &Variants) override {
+    TranslationUnit = Name;
+    OS << "{\"kind\": \"tu\", \"name\": ";
+    writeJSONString(OS, Name);
+    OS << ", \"variants\": \"";
+    writeHexMask(OS, Variants);
+    OS << "\"}\n";
+  }
+
+  void writeDiagnostic(const BruteClangOutputDiagnostic &Diag,
+                       const VariantMask &Variants) override {
+    OS << "{\"kind\": \"diagnostic\", \"tu\": ";
+    writeJSONString(OS, TranslationUnit);
+    OS << ", \"file\": ";
+    writeJSONString(OS, Diag.FileName);
+    OS << ", \"line\": " << Diag.LineNumber
+       << ", \"column\": " << Diag.ColumnNumber << ", \"id\": " << Diag.DiagID
+       << ", \"message\": ";
+    writeJSONString(OS, Diag.Message);
+    OS << ", \"variants\": \"";
+    writeHexMask(OS, Variants);
+    OS << "\"}\n";
+  }
+
+  void endTranslationUnit() override { OS.flush(); }
+  void endRun() override { OS.flush(); }
+};
+
+/// A value of the flat objects of a JSON Lines report.
+struct JSONValue {
+  enum ValueKind { String, Number, StringArray } Kind = String;
+  std::string Str;
+  uint64_t Num = 0;
+  std::vector<std::string> Strings;
+};
+
+/// Parses one line of a JSON Lines report: an object whose values are
+/// strings, unsigned numbers or arrays of strings.
+class JSONLineParser {
+  StringRef Rest;
+
+  void skipSpace() { Rest = Rest.ltrim(" \t\r"); }
+
+  bool consume(char C) {
+    skipSpace();
+    if (Rest.empty() || Rest.front() != C)
+      return false;
+    Rest = Rest.drop_front();
+    return true;
+  }
+
+  bool parseHex4(unsigned &Value) {
+    if (Rest.size() < 4 || Rest.take_front(4).getAsInteger(16, Value))
+      return false;
+    Rest = Rest.drop_front(4);
+    return true;
+  }
+
+  bool parseString(std::string &Str) {
+    if (!consume('"'))
+      return false;
+    Str.clear();
+    while (!Rest.empty()) {
+      char C = Rest.front();
+      Rest = Rest.drop_front();
+      if (C == '"')
+        return true;
+      if (C != '\\') {
+        Str += C;
+        continue;
+      }
+      if (Rest.empty())
+        return false;
+      C = Rest.front();
+      Rest = Rest.drop_front();
+      switch (C) {
+      case '"': case '\\': case '/': Str += C; break;
+      case 'b': Str += '\b'; break;
+      case 'f': Str += '\f'; break;
+      case 'n': Str += '\n'; break;
+      case 'r': Str += '\r'; break;
+      case 't': Str += '\t'; break;
+      case 'u': {
+        unsigned CodePoint, Low;
+        if (!parseHex4(CodePoint))
+          return false;
+        if (CodePoint >= 0xD800 && CodePoint < 0xDC00) {
+          if (!Rest.startswith("\\u"))
+            return false;
+          Rest = Rest.drop_front(2);
+          if (!parseHex4(Low) || Low < 0xDC00 || Low >= 0xE000)
+            return false;
+          CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+        }
+        char Buffer[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+        char *End = Buffer;
+        if (!llvm::ConvertCodePointToUTF8(CodePoint, End))
+          return false;
+        Str.append(Buffer, End);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  bool parseValue(JSONValue &Value) {
+    skipSpace();
+    if (Rest.startswith("\"")) {
+      Value.Kind = JSONValue::String;
+      return parseString(Value.Str);
+    }
+    if (consume('[')) {
+      Value.Kind = JSONValue::StringArray;
+      if (consume(']'))
+        return true;
+      do {
+        Value.Strings.emplace_back();
+        if (!parseString(Value.Strings.back()))
+          return false;
+      } while (consume(','));
+      return consume(']');
+    }
+    Value.Kind = JSONValue::Number;
+    StringRef Digits = Rest.take_while(isDigit);
+    Rest = Rest.drop_front(Digits.size());
+    return !Digits.getAsInteger(10, Value.Num);
+  }
+
+public:
+  explicit JSONLineParser(StringRef Line) : Rest(Line) {}
+
+  bool parseObject(llvm::StringMap<JSONValue> &Object) {
+    if (!consume('{'))
+      return false;
+    if (consume('}'))
+      return Rest.trim().empty();
+    do {
+      std::string Key;
+      if (!parseString(Key) || !consume(':') || !parseValue(Object[Key]))
+        return false;
+    } while (consume(','));
+    return consume('}') && Rest.trim().empty();
+  }
+};
+
+} // end anonymous namespace
+
+static bool readJSONLines(StringRef Buffer, BruteClangDiagnosticWriter &Writer,
+                          std::string &Error) {
+  std::vector<std::string> VariantNames;
+  bool InRun = false, InTranslationUnit = false;
+  std::string TranslationUnit;
+  VariantMask Variants;
+  unsigned LineNo = 0;
+
+  auto fail = [&](const Twine &Message) {
+    Error = ("line " + Twine(LineNo) + ": " + Message).str();
+    return false;
+  };
+
+  while (!Buffer.empty()) {
+    StringRef Line;
+    std::tie(Line, Buffer) = Buffer.split('\n');
+    ++LineNo;
+    if (Line.trim().empty())
+      continue;
+
+    llvm::StringMap<JSONValue> Object;
+    if (!JSONLineParser(Line).parseObject(Object))
+      return fail("malformed JSON object");
+    auto getString = [&](StringRef Key) -> const std::string * {
+      auto Value = Object.find(Key);
+      if (Value == Object.end() || Value->second.Kind != JSONValue::String)
+        return nullptr;
+      return &Value->second.Str;
+    };
+    auto getNumber = [&](StringRef Key, unsigned &Num) {
+      auto Value = Object.find(Key);
+      if (Value == Object.end() || Value->second.Kind != JSONValue::Number ||
+          Value->second.Num > ~0U)
+        return false;
+      Num = Value->second.Num;
+      return true;
+    };
+
+    const std::string *Kind = getString("kind");
+    if (!Kind)
+      return fail("object without a kind");
+
+    if (*Kind == "run") {
+      unsigned Version;
+      auto Names = Object.find("variants");
+      if (!getNumber("version", Version) || Names == Object.end() ||
+          Names->second.Kind != JSONValue::StringArray)
+        return fail("malformed run");
+      if (Version != FormatVersion)
+        return fail("unsupported version " + Twine(Version));
+      if (InTranslationUnit)
+        Writer.endTranslationUnit();
+      if (InRun)
+        Writer.endRun();
+      VariantNames = std::move(Names->second.Strings);
+      std::vector<StringRef> Refs(VariantNames.begin(), VariantNames.end());
+      Writer.beginRun(Refs);
+      InRun = true;
+      InTranslationUnit = false;
+      continue;
+    }
+
+    if (*Kind == "tu") {
+      const std::string *Name = getString("name");
+      const std::string *Mask = getString("variants");
+      if (!InRun)
+        return fail("translation unit before the run");
+      if (!Name || !Mask ||
+          !parseHexMask(*Mask, VariantNames.size(), Variants))
+        return fail("malformed translation unit");
+      if (InTranslationUnit)
+        Writer.endTranslationUnit();
+      TranslationUnit = *Name;
+      Writer.beginTranslationUnit(TranslationUnit, Variants);
+      InTranslationUnit = true;
+      continue;
+    }
+
+    if (*Kind == "diagnostic") {
+      const std::string *TU = getString("tu");
+      const std::string *FileName = getString("file");
+      const std::string *Message = getString("message");
+      const std::string *Mask = getString("variants");
+      BruteClangOutputDiagnostic Diag;
+      if (!TU || !FileName || !Message || !Mask ||
+          !getNumber("line", Diag.LineNumber) ||
+          !getNumber("column", Diag.ColumnNumber) ||
+          !getNumber("id", Diag.DiagID) ||
+          !parseHexMask(*Mask, VariantNames.size(), Variants))
+        return fail("malformed diagnostic");
+      if (!InTranslationUnit || *TU != TranslationUnit)
+        return fail("diagnostic outside of its translation unit");
+      Diag.FileName = *FileName;
+      Diag.Message = *Message;
+      Writer.writeDiagnostic(Diag, Variants);
+      continue;
+    }
+    // Objects of a later version are skipped.
+  }
+
+  if (!InRun) {
+    Error = "no run in the report";
+    return false;
+  }
+  if (InTranslationUnit)
+    Writer.endTranslationUnit();
+  Writer.endRun();
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Serialized diagnostics
+//===----------------------------------------------------------------------===//
+
+/// Split \p Mask into 32-bit words, least significant first.
+static void getMaskWords(const VariantMask &Mask,
+                         SmallVectorImpl<uint64_t> &Words) {
+  for (int V = Mask.find_first(); V != -1; V = Mask.find_next(V)) {
+    if (Words.size() <= unsigned(V) / 32)
+      Words.resize(V / 32 + 1, 0);
+    Words[V / 32] |= uint64_t(1) << (V % 32);
+  }
+}
+
+namespace {
+
+class BitstreamReportWriter : public BruteClangDiagnosticWriter {
+  raw_ostream &OS;
+  SmallVector<char, 4096> Buffer;
+  llvm::BitstreamWriter Stream;
+  SmallVector<uint64_t, 16> MaskRecord;
+
+  unsigned VersionAbbrev, FormatAbbrev, VariantAbbrev, MetaMaskAbbrev,
+      TranslationUnitAbbrev, DiagAbbrev, FlagAbbrev, FileNameAbbrev,
+      DiagMaskAbbrev, BruteDiagAbbrev;
+
+  /// The files, diagnostic flags and variant masks defined so far, by
+  /// number. File and flag 0 stand for none.
+  llvm::StringMap<unsigned> Files, Flags, Masks;
+
+  void emitBlockInfoBlock();
+
+  /// Enter a metadata block, which starts with the version of serialized
+  /// diagnostics.
+  void enterMetaBlock() {
+    Stream.EnterSubblock(serialized_diags::BLOCK_META, 3);
+    uint64_t Version[] = {serialized_diags::RECORD_VERSION,
+                          serialized_diags::VersionNumber};
+    Stream.EmitRecordWithAbbrev(VersionAbbrev, Version);
+  }
+
+  /// The number of \p Mask, defining it with \p Abbrev first if needed.
+  unsigned getMask(const VariantMask &Mask, unsigned Abbrev) {
+    SmallVector<uint64_t, 4> Words;
+    getMaskWords(Mask, Words);
+    StringRef Key(reinterpret_cast<const char *>(Words.data()),
+                  Words.size() * sizeof(uint64_t));
+    auto Inserted = Masks.insert(std::make_pair(Key, Masks.size()));
+    if (Inserted.second) {
+      MaskRecord.clear();
+      MaskRecord.push_back(RECORD_BRUTE_VARIANT_MASK);
+      MaskRecord.push_back(Inserted.first->second);
+      MaskRecord.append(Words.begin(), Words.end());
+      Stream.EmitRecordWithAbbrev(Abbrev, MaskRecord);
+    }
+    return Inserted.first->second;
+  }
+
+  unsigned getFile(StringRef FileName) {
+    if (FileName.empty())
+      return 0;
+    auto Inserted = Files.insert(std::make_pair(FileName, Files.size() + 1));
+    if (Inserted.second) {
+      uint64_t Record[] = {serialized_diags::RECORD_FILENAME,
+                           Inserted.first->second, 0, 0, FileName.size()};
+      Stream.EmitRecordWithBlob(FileNameAbbrev, Record, FileName);
+    }
+    return Inserted.first->second;
+  }
+
+  unsigned getFlag(unsigned DiagID) {
+    StringRef Flag = DiagID ? DiagnosticIDs::getWarningOptionForDiag(DiagID)
+                            : StringRef();
+    if (Flag.empty())
+      return 0;
+    auto Inserted = Flags.insert(std::make_pair(Flag, Flags.size() + 1));
+    if (Inserted.second) {
+      uint64_t Record[] = {serialized_diags::RECORD_DIAG_FLAG,
+                           Inserted.first->second, Flag.size()};
+      Stream.EmitRecordWithBlob(FlagAbbrev, Record, Flag);
+    }
+    return Inserted.first->second;
+  }
+
+  /// Hand what was written so far to the output. Between top-level blocks
+  /// the stream ends on a word boundary, so the buffer holds whole bytes and
+  /// no size of an open block is waiting to be backpatched.
+  void flush() {
+    OS.write(Buffer.data(), Buffer.size());
+    OS.flush();
+    Buffer.clear();
+  }
+
+public:
+  explicit BitstreamReportWriter(raw_ostream &OS) : OS(OS), Stream(Buffer) {}
+
+  void beginRun(ArrayRef<StringRef> VariantNames) override {
+    Stream.Emit((unsigned)'D', 8);
+    Stream.Emit((unsigned)'I', 8);
+    Stream.Emit((unsigned)'A', 8);
+    Stream.Emit((unsigned)'G', 8);
+    emitBlockInfoBlock();
+
+    enterMetaBlock();
+    uint64_t Format[] = {RECORD_BRUTE_FORMAT, FormatVersion};
+    Stream.EmitRecordWithAbbrev(FormatAbbrev, Format);
+    for (StringRef Name : VariantNames) {
+      uint64_t Record[] = {RECORD_BRUTE_VARIANT, Name.size()};
+      Stream.EmitRecordWithBlob(VariantAbbrev, Record, Name);
+    }
+    Stream.ExitBlock();
+    flush();
+  }
+
+  void beginTranslationUnit(StringRef Name,
+                            const VariantMask &Variants) override {
+    enterMetaBlock();
+    uint64_t Record[] = {RECORD_BRUTE_TRANSLATION_UNIT,
+                         getMask(Variants, MetaMaskAbbrev), Name.size()};
+    Stream.EmitRecordWithBlob(TranslationUnitAbbrev, Record, Name);
+    Stream.ExitBlock();
+  }
+
+  void writeDiagnostic(const BruteClangOutputDiagnostic &Diag,
+                       const VariantMask &Variants) override {
+    Stream.EnterSubblock(serialized_diags::BLOCK_DIAG, 4);
+    unsigned File = getFile(Diag.FileName);
+    unsigned Flag = getFlag(Diag.DiagID);
+    unsigned Mask = getMask(Variants, DiagMaskAbbrev);
+    uint64_t Record[] = {serialized_diags::RECORD_DIAG,
+                         serialized_diags::Error,
+                         File,
+                         Diag.LineNumber,
+                         Diag.ColumnNumber,
+                         0, // offset
+                         0, // category
+                         Flag,
+                         Diag.Message.size()};
+    Stream.EmitRecordWithBlob(DiagAbbrev, Record, Diag.Message);
+    uint64_t BruteRecord[] = {RECORD_BRUTE_DIAG, Diag.DiagID, Mask};
+    Stream.EmitRecordWithAbbrev(BruteDiagAbbrev, BruteRecord);
+    Stream.ExitBlock();
+  }
+
+  void endTranslationUnit() override { flush(); }
+  void endRun() override { flush(); }
+};
+
+} // end anonymous namespace
+
+void BitstreamReportWriter::emitBlockInfoBlock() {
+  using llvm::BitCodeAbbrev;
+  using llvm::BitCodeAbbrevOp;
+  // Readers of serialized diagnostics only accept abbreviated records.
+  auto addAbbrev = [&](unsigned BlockID, unsigned RecordID,
+                       std::initializer_list<BitCodeAbbrevOp> Ops) {
+    auto Abbrev = std::make_shared<BitCodeAbbrev>();
+    Abbrev->Add(BitCodeAbbrevOp(RecordID));
+    for (const BitCodeAbbrevOp &Op : Ops)
+      Abbrev->Add(Op);
+    return Stream.EmitBlockInfoAbbrev(BlockID, Abbrev);
+  };
+  BitCodeAbbrevOp VBR6(BitCodeAbbrevOp::VBR, 6);
+  BitCodeAbbrevOp Blob(BitCodeAbbrevOp::Blob);
+  BitCodeAbbrevOp Mask[] = {VBR6, BitCodeAbbrevOp(BitCodeAbbrevOp::Array),
+                            BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 32)};
+  const unsigned Meta = serialized_diags::BLOCK_META,
+                 Diag = serialized_diags::BLOCK_DIAG;
+
+  Stream.EnterBlockInfoBlock();
+  VersionAbbrev = addAbbrev(Meta, serialized_diags::RECORD_VERSION,
+                            {BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 32)});
+  FormatAbbrev = addAbbrev(Meta, RECORD_BRUTE_FORMAT, {VBR6});
+  VariantAbbrev = addAbbrev(Meta, RECORD_BRUTE_VARIANT, {VBR6, Blob});
+  MetaMaskAbbrev = addAbbrev(Meta, RECORD_BRUTE_VARIANT_MASK,
+                             {Mask[0], Mask[1], Mask[2]});
+  TranslationUnitAbbrev =
+      addAbbrev(Meta, RECORD_BRUTE_TRANSLATION_UNIT, {VBR6, VBR6, Blob});
+
+  // File, line, column, offset, category, flag and message size.
+  DiagAbbrev = addAbbrev(Diag, serialized_diags::RECORD_DIAG,
+                         {BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 3), VBR6,
+                          BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 8), VBR6,
+                          VBR6, VBR6, VBR6, VBR6, Blob});
+  FlagAbbrev =
+      addAbbrev(Diag, serialized_diags::RECORD_DIAG_FLAG, {VBR6, VBR6, Blob});
+  // ID, the legacy size and modification time, and name size.
+  FileNameAbbrev = addAbbrev(Diag, serialized_diags::RECORD_FILENAME,
+                             {VBR6, VBR6, VBR6, VBR6, Blob});
+  DiagMaskAbbrev = addAbbrev(Diag, RECORD_BRUTE_VARIANT_MASK,
+                             {Mask[0], Mask[1], Mask[2]});
+  BruteDiagAbbrev = addAbbrev(Diag, RECORD_BRUTE_DIAG,
+                              {BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 8), VBR6});
+  Stream.ExitBlock();
+}
+
+namespace {
+
+/// Replays a bitstream report into a writer.
+class BitstreamReportReader {
+  llvm::BitstreamCursor Stream;
+  BruteClangDiagnosticWriter &Writer;
+  std::string &Error;
+
+  std::vector<StringRef> VariantNames;
+  bool InRun = false, InTranslationUnit = false;
+
+  /// The variant masks and file names by number.
+  std::vector<VariantMask> Masks;
+  llvm::DenseMap<uint64_t, StringRef> Files;
+
+  bool fail(const Twine &Message) {
+    Error = Message.str();
+    return false;
+  }
+
+  bool readMask(ArrayRef<uint64_t> Record) {
+    if (Record.empty() || Record[0] != Masks.size())
+      return fail("malformed variant mask");
+    Masks.emplace_back(VariantNames.size());
+    for (unsigned W = 1, E = Record.size(); W != E; ++W)
+      for (unsigned Bit = 0; Bit != 32; ++Bit) {
+        if (!(Record[W] & (uint64_t(1) << Bit)))
+          continue;
+        unsigned V = (W - 1) * 32 + Bit;
+        if (V >= VariantNames.size())
+          return fail("variant mask out of range");
+        Masks.back().set(V);
+      }
+    return true;
+  }
+
+  const VariantMask *getMask(uint64_t Number) {
+    return Number < Masks.size() ? &Masks[Number] : nullptr;
+  }
+
+  bool readBlock(unsigned BlockID);
+
+public:
+  BitstreamReportReader(StringRef Buffer, BruteClangDiagnosticWriter &Writer,
+                        std::string &Error)
+      : Stream(ArrayRef<uint8_t>(
+            reinterpret_cast<const uint8_t *>(Buffer.data()), Buffer.size())),
+        Writer(Writer), Error(Error) {}
+
+  bool read();
+};
+
+} // end anonymous namespace
+
+bool BitstreamReportReader::readBlock(unsigned BlockID) {
+  if (Stream.EnterSubBlock(BlockID))
+    return fail("malformed block");
+
+  SmallVector<uint64_t, 16> Record;
+  BruteClangOutputDiagnostic Diag;
+  bool HasDiag = false, IsRunHeader = false;
+  // Masks defined later in the block may move the one of the diagnostic.
+  uint64_t DiagMask = ~uint64_t(0);
+  while (true) {
+    llvm::BitstreamEntry Entry = Stream.advance();
+    if (Entry.Kind == llvm::BitstreamEntry::Error)
+      return fail("malformed block");
+    if (Entry.Kind == llvm::BitstreamEntry::EndBlock)
+      break;
+    if (Entry.Kind == llvm::BitstreamEntry::SubBlock) {
+      if (Stream.SkipBlock())
+        return fail("malformed block");
+      continue;
+    }
+
+    Record.clear();
+    StringRef Blob;
+    switch (Stream.readRecord(Entry.ID, Record, &Blob)) {
+    case RECORD_BRUTE_FORMAT:
+      if (Record.size() != 1 || Record[0] != FormatVersion)
+        return fail("unsupported version");
+      if (InRun)
+        return fail("more than one run in the report");
+      InRun = IsRunHeader = true;
+      break;
+    case RECORD_BRUTE_VARIANT:
+      if (!IsRunHeader)
+        return fail("variant outside of the run header");
+      VariantNames.push_back(Blob);
+      break;
+    case RECORD_BRUTE_VARIANT_MASK:
+      if (!readMask(Record))
+        return false;
+      break;
+    case RECORD_BRUTE_TRANSLATION_UNIT: {
+      const VariantMask *Mask = Record.size() == 2 ? getMask(Record[0]) : nullptr;
+      if (!InRun || !Mask)
+        return fail("malformed translation unit");
+      if (InTranslationUnit)
+        Writer.endTranslationUnit();
+      Writer.beginTranslationUnit(Blob, *Mask);
+      InTranslationUnit = true;
+      break;
+    }
+    case serialized_diags::RECORD_FILENAME:
+      if (Record.size() != 4)
+        return fail("malformed file name");
+      Files[Record[0]] = Blob;
+      break;
+    case serialized_diags::RECORD_DIAG:
+      if (Record.size() != 8 || Record[2] > ~0U || Record[3] > ~0U)
+        return fail("malformed diagnostic");
+      Diag.FileName = Files.lookup(Record[1]);
+      Diag.LineNumber = Record[2];
+      Diag.ColumnNumber = Record[3];
+      Diag.Message = Blob;
+      HasDiag = true;
+      break;
+    case RECORD_BRUTE_DIAG:
+      if (Record.size() != 2 || Record[0] > ~0U || !getMask(Record[1]))
+        return fail("malformed diagnostic");
+      Diag.DiagID = Record[0];
+      DiagMask = Record[1];
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Every variant is known at the end of the run header.
+  if (IsRunHeader)
+    Writer.beginRun(VariantNames);
+  if (BlockID == serialized_diags::BLOCK_DIAG) {
+    if (!HasDiag || !getMask(DiagMask) || !InTranslationUnit)
+      return fail("diagnostic without BruteClang's records");
+    Writer.writeDiagnostic(Diag, *getMask(DiagMask));
+  }
+  return true;
+}
+
+bool BitstreamReportReader::read() {
+  if (Stream.Read(8) != 'D' || Stream.Read(8) != 'I' ||
+      Stream.Read(8) != 'A' || Stream.Read(8) != 'G')
+    return fail("not a serialized diagnostics file");
+
+  llvm::Optional<llvm::BitstreamBlockInfo> BlockInfo;
+  while (!Stream.AtEndOfStream()) {
+    llvm::BitstreamEntry Entry = Stream.advance();
+    if (Entry.Kind != llvm::BitstreamEntry::SubBlock)
+      return fail("malformed top-level block");
+    switch (Entry.ID) {
+    case llvm::bitc::BLOCKINFO_BLOCK_ID:
+      BlockInfo = Stream.ReadBlockInfoBlock();
+      if (!BlockInfo)
+        return fail("malformed block info block");
+      Stream.setBlockInfo(&*BlockInfo);
+      break;
+    case serialized_diags::BLOCK_META:
+    case serialized_diags::BLOCK_DIAG:
+      if (!readBlock(Entry.ID))
+        return false;
+      break;
+    default:
+      if (Stream.SkipBlock())
+        return fail("malformed top-level block");
+      break;
+    }
+  }
+
+  if (!InRun)
+    return fail("not a BruteClang report");
+  if (InTranslationUnit)
+    Writer.endTranslationUnit();
+  Writer.endRun();
+  return true;
+}
+
+std::unique_ptr<BruteClangDiagnosticWriter>
+BruteClangDiagnosticWriter::create(OutputFormat Format, raw_ostream &OS) {
+  if (Format == Bitstream)
+    return llvm::make_unique<BitstreamReportWriter>(OS);
+  return llvm::make_unique<JSONLinesWriter>(OS);
+}
+
+bool BruteClangDiagnosticWriter::read(StringRef Buffer,
+                                      BruteClangDiagnosticWriter &Writer,
+                                      std::string &Error) {
+  if (Buffer.startswith("DIAG"))
+    return BitstreamReportReader(Buffer, Writer, Error).read();
+  return readJSONLines(Buffer, Writer, Error);
+}
+
+//===----------------------------------------------------------------------===//
+// Merging
+//===----------------------------------------------------------------------===//
+
+BruteClangDiagnosticMerger::DiagKey
+BruteClangDiagnosticMerger::DiagKeyInfo::getEmptyKey() {
+  DiagKey Key = {0, llvm::DenseMapInfo<const char *>::getEmptyKey(), nullptr,
+                 0, 0, 0};
+  return Key;
+}
+
+BruteClangDiagnosticMerger::DiagKey
+BruteClangDiagnosticMerger::DiagKeyInfo::getTombstoneKey() {
+  DiagKey Key = {0, llvm::DenseMapInfo<const char *>::getTombstoneKey(),
+                 nullptr, 0, 0, 0};
+  return Key;
+}
+
+unsigned
+BruteClangDiagnosticMerger::DiagKeyInfo::getHashValue(const DiagKey &Key) {
+  // The strings are interned, so hashing the pointers is enough.
+  return llvm::hash_combine(Key.TranslationUnit, Key.FileName, Key.Message,
+                            Key.LineNumber, Key.ColumnNumber, Key.DiagID);
+}
+
+bool BruteClangDiagnosticMerger::DiagKeyInfo::isEqual(const DiagKey &LHS,
+                                                      const DiagKey &RHS) {
+  return LHS.TranslationUnit == RHS.TranslationUnit &&
+         LHS.FileName == RHS.FileName && LHS.Message == RHS.Message &&
+         LHS.LineNumber == RHS.LineNumber &&
+         LHS.ColumnNumber == RHS.ColumnNumber && LHS.DiagID == RHS.DiagID;
+}
+
+void BruteClangDiagnosticMerger::mergeVariants(const VariantMask &Input,
+                                               VariantMask &Merged) const {
+  if (Merged.size() < VariantNames.size())
+    Merged.resize(VariantNames.size());
+  for (int V = Input.find_first(); V != -1; V = Input.find_next(V))
+    Merged.set(InputVariants[V]);
+}
+
+void BruteClangDiagnosticMerger::beginRun(ArrayRef<StringRef> Names) {
+  InputVariants.clear();
+  for (StringRef Name : Names) {
+    auto Inserted =
+        VariantIndex.insert(std::make_pair(Name, VariantNames.size()));
+    if (Inserted.second)
+      VariantNames.push_back(Inserted.first->getKey());
+    InputVariants.push_back(Inserted.first->second);
+  }
+}
+
+void BruteClangDiagnosticMerger::beginTranslationUnit(
+    StringRef Name, const VariantMask &Variants) {
+  auto Inserted = TranslationUnitIndex.insert(
+      std::make_pair(Name, TranslationUnits.size()));
+  if (Inserted.second) {
+    TranslationUnits.emplace_back();
+    TranslationUnits.back().Name = Inserted.first->getKey();
+  }
+  CurrentTranslationUnit = Inserted.first->second;
+  mergeVariants(Variants, TranslationUnits[CurrentTranslationUnit].Variants);
+}
+
+void BruteClangDiagnosticMerger::writeDiagnostic(
+    const BruteClangOutputDiagnostic &Diag, const VariantMask &Variants) {
+  StringRef FileName = intern(Diag.FileName);
+  StringRef Message = intern(Diag.Message);
+  DiagKey Key = {CurrentTranslationUnit, FileName.data(), Message.data(),
+                 Diag.LineNumber, Diag.ColumnNumber, Diag.DiagID};
+  auto Inserted = DiagIndex.insert(std::make_pair(Key, Diags.size()));
+  if (Inserted.second) {
+    Diags.emplace_back();
+    Diags.back().Diag = Diag;
+    Diags.back().Diag.FileName = FileName;
+    Diags.back().Diag.Message = Message;
+    TranslationUnits[CurrentTranslationUnit].Diags.push_back(
+        Inserted.first->second);
+  }
+  mergeVariants(Variants, Diags[Inserted.first->second].Variants);
+}
+
+void BruteClangDiagnosticMerger::emit(BruteClangDiagnosticWriter &Writer) {
+  Writer.beginRun(VariantNames);
+  for (MergedTranslationUnit &TU : TranslationUnits) {
+    TU.Variants.resize(VariantNames.size());
+    Writer.beginTranslationUnit(TU.Name, TU.Variants);
+    for (unsigned I : TU.Diags) {
+      Diags[I].Variants.resize(VariantNames.size());
+      Writer.writeDiagnostic(Diags[I].Diag, Diags[I].Variants);
+    }
+    Writer.endTranslationUnit();
+  }
+  Writer.endRun();
+}
+
+//===----------------------------------------------------------------------===//
+// Header diagnostics
+//===----------------------------------------------------------------------===//
+
+BruteClangHeaderDiagnostics::DiagKey
+BruteClangHeaderDiagnostics::DiagKeyInfo::getEmptyKey() {
+  DiagKey Key = {llvm::DenseMapInfo<const char *>::getEmptyKey(), nullptr, 0,
+                 0, 0};
+  return Key;
+}
+
+BruteClangHeaderDiagnostics::DiagKey
+BruteClangHeaderDiagnostics::DiagKeyInfo::getTombstoneKey() {
+  DiagKey Key = {llvm::DenseMapInfo<const char *>::getTombstoneKey(), nullptr,
+                 0, 0, 0};
+  return Key;
+}
+
+unsigned
+BruteClangHeaderDiagnostics::DiagKeyInfo::getHashValue(const DiagKey &Key) {
+  // The strings are interned, so hashing the pointers is enough.
+  return llvm::hash_combine(Key.FileName, Key.Message, Key.LineNumber,
+                            Key.ColumnNumber, Key.DiagID);
+}
+
+bool BruteClangHeaderDiagnostics::DiagKeyInfo::isEqual(const DiagKey &LHS,
+                                                       const DiagKey &RHS) {
+  return LHS.FileName == RHS.FileName && LHS.Message == RHS.Message &&
+         LHS.LineNumber == RHS.LineNumber &&
+         LHS.ColumnNumber == RHS.ColumnNumber && LHS.DiagID == RHS.DiagID;
+}
+
+void BruteClangHeaderDiagnostics::beginTranslationUnit(
+    StringRef Name, const VariantMask &Variants) {
+  CurrentTranslationUnit = intern(Name);
+}
+
+void BruteClangHeaderDiagnostics::writeDiagnostic(
+    const BruteClangOutputDiagnostic &Diag, const VariantMask &Variants) {
+  if (!isInHeader(CurrentTranslationUnit, Diag.FileName))
+    return;
+  StringRef FileName = intern(Diag.FileName);
+  StringRef Message = intern(Diag.Message);
+  DiagKey Key = {FileName.data(), Message.data(), Diag.LineNumber,
+                 Diag.ColumnNumber, Diag.DiagID};
+  auto Inserted = DiagIndex.insert(std::make_pair(Key, Diags.size()));
+  if (Inserted.second) {
+    Diags.emplace_back();
+    Diags.back().Diag = Diag;
+    Diags.back().Diag.FileName = FileName;
+    Diags.back().Diag.Message = Message;
+  }
+  HeaderDiagnostic &HD = Diags[Inserted.first->second];
+  HD.Variants |= Variants;
+  if (HD.TranslationUnits.empty() ||
+      HD.TranslationUnits.back() != CurrentTranslationUnit)
+    HD.TranslationUnits.push_back(CurrentTranslationUnit);
+}
@@ -0,0 +1,157 @@
+//===- BruteClangJobTimes.cpp - Job times of earlier runs -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangJobTimes.h"
+#include "clang/Frontend/BruteClangCacheFile.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+using namespace clang;
+
+/// The cost an #include directive adds to a file. The headers of the big
+/// OMR sources make up most of what the compiler reads for them, and a
+/// header closure adds some tens of kilobytes per directive.
+static const double CostPerInclude = 16384;
+
+std::string BruteClangJobTimes::getKey(StringRef File, StringRef Variant) {
+  std::string Key = File.str();
+  Key += '\0';
+  Key += Variant;
+  return Key;
+}
+
+void BruteClangJobTimes::add(StringRef Key, Entry E) {
+  auto Inserted = Times.insert(std::make_pair(Key, E));
+  Totals &File = FileTotals[Key.split('\0').first];
+  if (!Inserted.second) {
+    Entry &Old = Inserted.first->second;
+    File.Seconds -= Old.Seconds;
+    --File.NumJobs;
+    AllTotals.Seconds -= Old.Seconds;
+    AllTotals.Cost -= Old.FileCost;
+    --AllTotals.NumJobs;
+    Old = E;
+  }
+  File.Seconds += E.Seconds;
+  ++File.NumJobs;
+  AllTotals.Seconds += E.Seconds;
+  AllTotals.Cost += E.FileCost;
+  ++AllTotals.NumJobs;
+}
+
+bool BruteClangJobTimes::load(StringRef Path, std::string &Error) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    if (Buffer.getError() == llvm::errc::no_such_file_or_directory)
+      return true;
+    Error = "cannot read '" + Path.str() + "': " + Buffer.getError().message();
+    return false;
+  }
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  StringRef Rest = (*Buffer)->getBuffer();
+  for (unsigned LineNo = 1; !Rest.empty(); ++LineNo) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (Line.empty())
+      continue;
+    StringRef Seconds, Cost, Variant, File;
+    std::tie(Seconds, Line) = Line.split('\t');
+    std::tie(Cost, Line) = Line.split('\t');
+    std::tie(Variant, File) = Line.split('\t');
+    Entry E;
+    if (Seconds.getAsDouble(E.Seconds) || Cost.getAsDouble(E.FileCost) ||
+        Variant.empty() || File.empty()) {
+      Error = "'" + Path.str() + "': line " + std::to_string(LineNo) +
+              ": malformed job time";
+      return false;
+    }
+    add(getKey(File, Variant), E);
+  }
+  return true;
+}
+
+bool BruteClangJobTimes::save(StringRef Path, std::string &Error) const {
+  std::string Contents;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    // Sorted, so the file only changes where the times do.
+    std::vector<StringRef> Keys;
+    for (const auto &Time : Times)
+      Keys.push_back(Time.getKey());
+    std::sort(Keys.begin(), Keys.end());
+
+    llvm::raw_string_ostream OS(Contents);
+    for (StringRef Key : Keys) {
+      const Entry &E = Times.find(Key)->second;
+      std::pair<StringRef, StringRef> FileAndVariant = Key.split('\0');
+      OS << llvm::format("%.3f\t%.0f\t", E.Seconds, E.FileCost)
+         << FileAndVariant.second << "\t" << FileAndVariant.first << "\n";
+    }
+  }
+  if (!writeBruteClangCacheFile(Path, Contents)) {
+    Error = "cannot write '" + Path.str() + "'";
+    return false;
+  }
+  return true;
+}
+
+void BruteClangJobTimes::record(StringRef File, StringRef Variant,
+                                double FileCost, double Seconds) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Entry E = {Seconds, FileCost};
+  add(getKey(File, Variant), E);
+}
+
+double BruteClangJobTimes::estimate(StringRef File, StringRef Variant,
+                                    double FileCost) const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Time = Times.find(getKey(File, Variant));
+  if (Time != Times.end())
+    return Time->second.Seconds;
+
+  // The variants of a file mostly take about as long as each other.
+  auto FileTime = FileTotals.find(File);
+  if (FileTime != FileTotals.end() && FileTime->second.NumJobs)
+    return FileTime->second.Seconds / FileTime->second.NumJobs;
+
+  // Without any time at all, the cost still orders the jobs.
+  if (!AllTotals.NumJobs || AllTotals.Cost <= 0)
+    return FileCost;
+  return FileCost * AllTotals.Seconds / AllTotals.Cost;
+}
+
+double BruteClangJobTimes::getFileCost(StringRef Text) {
+  unsigned NumIncludes = 0;
+  for (StringRef Rest = Text; !Rest.empty();) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line = Line.ltrim();
+    if (!Line.consume_front("#"))
+      continue;
+    if (Line.ltrim().startswith("include"))
+      ++NumIncludes;
+  }
+  return Text.size() + NumIncludes * CostPerInclude;
+}
+
+double BruteClangJobTimes::getIdealMakespan(ArrayRef<double> JobSeconds,
+                                            unsigned NumWorkers) {
+  if (JobSeconds.empty())
+    return 0;
+  double Total = std::accumulate(JobSeconds.begin(), JobSeconds.end(), 0.0);
+  double Longest = *std::max_element(JobSeconds.begin(), JobSeconds.end());
+  return std::max(Total / std::max(NumWorkers, 1u), Longest);
+}
@@ -0,0 +1,432 @@
+//===- BruteClangPCHCache.cpp - Precompiled include blocks ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// For an include block with key K (a hash of the variant's options and the
+// block's text), the cache directory holds:
+//
+//   K.h              the include block, which the PCH is built from
+//   K-<content>.pch  the PCH, <content> being a hash of every file it was
+//                    built from
+//   K.deps           which PCH is current, and what it was built from
+//
+// The dependency file holds, in the encoding of BruteClangCacheFile.h:
+//
+//   Header:       "BCPH", version (u32)
+//   Dependencies: the stamps of the files the PCH was built from
+//   Absent paths: where its header searches looked before finding a file
+//   Untracked:    u8, whether some header searches were not recorded
+//   PCH:          u16 PCH file name length, name
+//   Diagnostics:  the diagnostics raised while building the PCH
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangPCHCache.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace clang;
+
+/// \brief The dependency file version.
+static const unsigned CurrentVersion = 4;
+
+static const char DepsMagic[4] = {'B', 'C', 'P', 'H'};
+
+namespace {
+
+/// Records the files the include block itself includes.
+class BlockIncludeRecorder : public PPCallbacks {
+  SourceManager &SM;
+  std::vector<const FileEntry *> &Files;
+
+public:
+  BlockIncludeRecorder(SourceManager &SM, std::vector<const FileEntry *> &Files)
+      : SM(SM), Files(Files) {}
+
+  void InclusionDirective(SourceLocation HashLoc, const Token &IncludeTok,
+                          StringRef FileName, bool IsAngled,
+                          CharSourceRange FilenameRange, const FileEntry *File,
+                          StringRef SearchPath, StringRef RelativePath,
+                          const Module *Imported) override {
+    if (File && SM.isInMainFile(HashLoc))
+      Files.push_back(File);
+  }
+};
+
+/// Generates the PCH of an include block, checking that the translation
+/// units using it can include the block's headers again harmlessly.
+class BuildPCHAction : public GeneratePCHAction {
+  std::vector<const FileEntry *> BlockFiles;
+  bool AllGuarded = true;
+
+protected:
+  bool BeginSourceFileAction(CompilerInstance &CI) override {
+    if (!GeneratePCHAction::BeginSourceFileAction(CI))
+      return false;
+    CI.getPreprocessor().addPPCallbacks(llvm::make_unique<BlockIncludeRecorder>(
+        CI.getSourceManager(), BlockFiles));
+    return true;
+  }
+
+  void EndSourceFileAction() override {
+    HeaderSearch &HS =
+        getCompilerInstance().getPreprocessor().getHeaderSearchInfo();
+    for (const FileEntry *File : BlockFiles)
+      if (!HS.isFileMultipleIncludeGuarded(File))
+        AllGuarded = false;
+    GeneratePCHAction::EndSourceFileAction();
+  }
+
+public:
+  bool areAllIncludesGuarded() const { return AllGuarded; }
+};
+
+} // end anonymous namespace
+
+BruteClangPCHCache::BruteClangPCHCache(
+    StringRef CacheDir, IntrusiveRefCntPtr<vfs::FileSystem> FS,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps)
+    : CacheDir(CacheDir), FS(FS), Stamps(FS),
+      PCHContainerOps(std::move(PCHContainerOps)) {}
+
+BruteClangPCHCache::~BruteClangPCHCache() {}
+
+void BruteClangPCHCache::getLeadingIncludes(
+    StringRef Source, std::vector<IncludeDirective> &Includes) {
+  // Lex raw tokens, like Lexer::ComputePreamble, but stop at the first thing
+  // that is not an #include directive. The fake file location at offset 1
+  // lets the lexer track our position within the buffer.
+  const unsigned StartOffset = 1;
+  SourceLocation FileLoc = SourceLocation::getFromRawEncoding(StartOffset);
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  Lexer TheLexer(FileLoc, LangOpts, Source.begin(), Source.begin(),
+                 Source.end());
+  auto getOffset = [&](const Token &Tok) {
+    return Tok.getLocation().getRawEncoding() - StartOffset;
+  };
+
+  Token TheTok;
+  TheLexer.LexFromRawLexer(TheTok);
+  while (TheTok.isAtStartOfLine() && TheTok.is(tok::hash)) {
+    unsigned Begin = getOffset(TheTok);
+    TheLexer.LexFromRawLexer(TheTok);
+    if (TheTok.isNot(tok::raw_identifier) || TheTok.needsCleaning() ||
+        TheTok.getRawIdentifier() != "include")
+      return;
+
+    // The file name, then nothing else on the line.
+    TheLexer.LexFromRawLexer(TheTok);
+    if (TheTok.isAtStartOfLine())
+      return;
+    IncludeDirective Directive;
+    unsigned End;
+    if (TheTok.is(tok::string_literal)) {
+      StringRef Spelling(Source.data() + getOffset(TheTok), TheTok.getLength());
+      if (Spelling.size() < 2 || Spelling.front() != '"')
+        return;
+      Directive.Name = Spelling.drop_front().drop_back();
+      Directive.IsAngled = false;
+      End = getOffset(TheTok) + TheTok.getLength();
+      TheLexer.LexFromRawLexer(TheTok);
+    } else if (TheTok.is(tok::less)) {
+      unsigned NameBegin = getOffset(TheTok) + 1;
+      do
+        TheLexer.LexFromRawLexer(TheTok);
+      while (TheTok.isNot(tok::greater) && TheTok.isNot(tok::eof) &&
+             !TheTok.isAtStartOfLine());
+      if (TheTok.isNot(tok::greater))
+        return;
+      Directive.Name = Source.slice(NameBegin, getOffset(TheTok));
+      Directive.IsAngled = true;
+      End = getOffset(TheTok) + 1;
+      TheLexer.LexFromRawLexer(TheTok);
+    } else {
+      // A macro naming the file; leave it to the preprocessor.
+      return;
+    }
+    if (TheTok.isNot(tok::eof) && !TheTok.isAtStartOfLine())
+      return;
+
+    Directive.Text = Source.slice(Begin, End);
+    Includes.push_back(std::move(Directive));
+  }
+}
+
+std::vector<unsigned> BruteClangPCHCache::getBlockLengths(
+    ArrayRef<std::vector<IncludeDirective>> LeadingIncludes) {
+  typedef std::vector<IncludeDirective> Block;
+  auto lessThan = [](const Block &LHS, const Block &RHS) {
+    return std::lexicographical_compare(
+        LHS.begin(), LHS.end(), RHS.begin(), RHS.end(),
+        [](const IncludeDirective &L, const IncludeDirective &R) {
+          return L.Text < R.Text;
+        });
+  };
+  auto commonPrefix = [](const Block &LHS, const Block &RHS) {
+    unsigned N = 0;
+    while (N != LHS.size() && N != RHS.size() && LHS[N].Text == RHS[N].Text)
+      ++N;
+    return N;
+  };
+
+  // In sorted order, the longest prefix a block shares with any other block
+  // is the one it shares with one of its neighbours.
+  std::vector<unsigned> Order(LeadingIncludes.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  std::sort(Order.begin(), Order.end(), [&](unsigned L, unsigned R) {
+    return lessThan(LeadingIncludes[L], LeadingIncludes[R]);
+  });
+
+  std::vector<unsigned> Lengths(LeadingIncludes.size(), 0);
+  for (unsigned I = 0, E = Order.size(); I != E; ++I) {
+    const Block &B = LeadingIncludes[Order[I]];
+    unsigned Shared = 0;
+    if (I != 0)
+      Shared = commonPrefix(B, LeadingIncludes[Order[I - 1]]);
+    if (I + 1 != E)
+      Shared = std::max(Shared, commonPrefix(B, LeadingIncludes[Order[I + 1]]));
+    Lengths[Order[I]] = Shared ? Shared : B.size();
+  }
+  return Lengths;
+}
+
+std::string
+BruteClangPCHCache::getHeaderText(ArrayRef<IncludeDirective> Includes) {
+  std::string Text;
+  for (const IncludeDirective &Include : Includes)
+    Text += Include.Text + "\n";
+  return Text;
+}
+
+std::shared_ptr<const BruteClangPCHCache::Entry>
+BruteClangPCHCache::loadEntry(StringRef Key) {
+  SmallString<256> DepsPath(CacheDir);
+  llvm::sys::path::append(DepsPath, Key + ".deps");
+  auto Buffer = llvm::MemoryBuffer::getFile(DepsPath);
+  if (!Buffer)
+    return nullptr;
+
+  BruteClangCacheReader Reader((*Buffer)->getBuffer(),
+                               StringRef(DepsMagic, sizeof(DepsMagic)),
+                               CurrentVersion);
+
+  // Every file the PCH was built from must be unchanged, and still be the
+  // one its header search finds. Compare the modification times too: the PCH
+  // identifies headers by them.
+  auto Result = std::make_shared<Entry>();
+  if (!Stamps.checkStamps(Reader, /*CheckModTime=*/true) ||
+      !Stamps.checkAbsentPaths(Reader, &Result->AbsentPaths))
+    return nullptr;
+  Result->UntrackedLookups = Reader.read<uint8_t>() != 0;
+
+  SmallString<256> PCHPath(CacheDir);
+  llvm::sys::path::append(PCHPath, Reader.readString<uint16_t>());
+  Result->PCHPath = PCHPath.str();
+  Reader.readDiagnostics(Result->Diags);
+  if (Reader.hasFailed() || !llvm::sys::fs::exists(Result->PCHPath))
+    return nullptr;
+  return Result;
+}
+
+std::shared_ptr<const BruteClangPCHCache::Entry>
+BruteClangPCHCache::buildEntry(const CompilerInvocation &Invocation,
+                               StringRef Key, StringRef HeaderText,
+                               StringRef IncluderDir) {
+  if (llvm::sys::fs::create_directories(CacheDir))
+    return nullptr;
+
+  SmallString<256> HeaderPath(CacheDir);
+  llvm::sys::path::append(HeaderPath, Key + ".h");
+  if (!writeBruteClangCacheFile(HeaderPath, HeaderText))
+    return nullptr;
+
+  SmallString<256> OutputPath;
+  if (llvm::sys::fs::createUniqueFile(
+          Twine(CacheDir) + "/" + Key + "-build-%%%%%%%%.pch", OutputPath))
+    return nullptr;
+
+  // Compile the block as a header with the options of the translation unit,
+  // minus anything producing other output.
+  auto PCHInvocation = std::make_shared<CompilerInvocation>(Invocation);
+  FrontendOptions &FrontendOpts = PCHInvocation->getFrontendOpts();
+  InputKind Kind = FrontendOpts.Inputs.empty()
+                       ? InputKind(InputKind::CXX)
+                       : FrontendOpts.Inputs[0].getKind();
+  FrontendOpts.Inputs.clear();
+  FrontendOpts.Inputs.emplace_back(HeaderPath.str(), Kind);
+  FrontendOpts.ProgramAction = frontend::GeneratePCH;
+  FrontendOpts.OutputFile = OutputPath.str();
+  FrontendOpts.AddPluginActions.clear();
+  FrontendOpts.DisableFree = false;
+  PCHInvocation->getPreprocessorOpts().ImplicitPCHInclude.clear();
+  PCHInvocation->getDependencyOutputOpts() = DependencyOutputOptions();
+
+  // The block is built from the cache directory, while the main file looks
+  // up quoted includes in its own directory first. Search that directory
+  // first for quoted includes, under the name the main file knows it by, so
+  // the headers keep the names their diagnostics are reported under without
+  // the PCH.
+  if (!IncluderDir.empty()) {
+    std::vector<HeaderSearchOptions::Entry> &UserEntries =
+        PCHInvocation->getHeaderSearchOpts().UserEntries;
+    UserEntries.insert(UserEntries.begin(),
+                       HeaderSearchOptions::Entry(IncluderDir, frontend::Quoted,
+                                                  /*IsFramework=*/false,
+                                                  /*IgnoreSysRoot=*/true));
+  }
+
+  CustomDiagContainer DiagContainer;
+  unsigned CI_ID = DiagContainer.AddCompilerInstance("pch");
+
+  CompilerInstance Clang(PCHContainerOps);
+  Clang.setInvocation(std::move(PCHInvocation));
+  Clang.createDiagnostics(new CustomDiagConsumer(DiagContainer, CI_ID), true);
+  Clang.getDiagnostics().setErrorLimit(0);
+  Clang.setFileManager(new FileManager(Clang.getFileSystemOpts(), FS));
+  auto Deps = std::make_shared<BruteClangFileCollector>();
+  Clang.addDependencyCollector(Deps);
+
+  BuildPCHAction Action;
+  bool Success = Clang.ExecuteAction(Action) &&
+                 !Clang.getDiagnostics().hasErrorOccurred() &&
+                 Action.areAllIncludesGuarded();
+  if (!Success) {
+    llvm::sys::fs::remove(OutputPath);
+    return nullptr;
+  }
+
+  // Name the PCH after the contents of everything it was built from.
+  BruteClangCacheWriter Writer(StringRef(DepsMagic, sizeof(DepsMagic)),
+                               CurrentVersion);
+  std::string DepsHash;
+  if (!Stamps.writeStamps(Deps->getDependencies(), Writer, &DepsHash)) {
+    llvm::sys::fs::remove(OutputPath);
+    return nullptr;
+  }
+
+  BruteClangFileStamps::writeAbsentPaths(Deps->getAbsentPaths(), Writer);
+  Writer.write<uint8_t>(Deps->hasUntrackedLookups());
+
+  std::string PCHName = Key.str() + "-" + DepsHash + ".pch";
+  auto Result = std::make_shared<Entry>();
+  Result->AbsentPaths = Deps->getAbsentPaths();
+  Result->UntrackedLookups = Deps->hasUntrackedLookups();
+  SmallString<256> PCHPath(CacheDir);
+  llvm::sys::path::append(PCHPath, PCHName);
+  Result->PCHPath = PCHPath.str();
+  if (llvm::sys::fs::rename(OutputPath, PCHPath)) {
+    llvm::sys::fs::remove(OutputPath);
+    return nullptr;
+  }
+  DiagContainer.GetDiagnostics(CI_ID, Result->Diags);
+  Writer.writeString<uint16_t>(PCHName);
+  Writer.writeDiagnostics(Result->Diags);
+
+  // If the dependency file cannot be written the PCH is still good for this
+  // run; the next run builds it again.
+  SmallString<256> DepsPath(CacheDir);
+  llvm::sys::path::append(DepsPath, Key + ".deps");
+  Writer.commit(DepsPath);
+  return Result;
+}
+
+std::shared_ptr<const BruteClangPCHCache::Entry>
+BruteClangPCHCache::getPCH(const CompilerInvocation &Invocation,
+                           StringRef MainFile,
+                           ArrayRef<IncludeDirective> Includes) {
+  ++NumRequests;
+  if (Includes.empty())
+    return nullptr;
+
+  // The key covers everything that affects how the block is parsed and what
+  // it is diagnosed with: the module hash of the invocation (language and
+  // target options, macro definitions, ...), the include paths, the warning
+  // options, the block itself and, if it has quoted includes, the directory
+  // they are looked up in first.
+  std::string HeaderText = getHeaderText(Includes);
+  std::string IncluderDir;
+  if (std::any_of(Includes.begin(), Includes.end(),
+                  [](const IncludeDirective &I) { return !I.IsAngled; })) {
+    IncluderDir = llvm::sys::path::parent_path(MainFile);
+    // The directory of a file named without one, as the FileManager names
+    // it.
+    if (IncluderDir.empty())
+      IncluderDir = ".";
+  }
+  std::string KeyText;
+  {
+    llvm::raw_string_ostream OS(KeyText);
+    OS << Invocation.getModuleHash() << "\n";
+    const HeaderSearchOptions &HSOpts = Invocation.getHeaderSearchOpts();
+    for (const HeaderSearchOptions::Entry &E : HSOpts.UserEntries)
+      OS << "I" << E.Group << E.IsFramework << E.IgnoreSysRoot << E.Path
+         << "\n";
+    for (const HeaderSearchOptions::SystemHeaderPrefix &P :
+         HSOpts.SystemHeaderPrefixes)
+      OS << "S" << P.IsSystemHeader << P.Prefix << "\n";
+    const DiagnosticOptions &DiagOpts = Invocation.getDiagnosticOpts();
+    OS << "W" << DiagOpts.IgnoreWarnings << DiagOpts.Pedantic
+       << DiagOpts.PedanticErrors << "\n";
+    for (const std::string &Warning : DiagOpts.Warnings)
+      OS << "W" << Warning << "\n";
+    const PreprocessorOptions &PPOpts = Invocation.getPreprocessorOpts();
+    for (const std::string &Include : PPOpts.Includes)
+      OS << "include " << Include << "\n";
+    for (const std::string &Include : PPOpts.MacroIncludes)
+      OS << "imacros " << Include << "\n";
+    OS << "Q" << IncluderDir << "\n" << HeaderText;
+  }
+  std::string Key = BruteClangFileStamps::hashString(KeyText);
+
+  std::promise<std::shared_ptr<const Entry>> Promise;
+  {
+    std::unique_lock<std::mutex> Guard(Lock);
+    auto Known = Entries.find(Key);
+    if (Known != Entries.end()) {
+      std::shared_future<std::shared_ptr<const Entry>> Future =
+          Known->second;
+      Guard.unlock();
+      return Future.get();
+    }
+    Entries[Key] = Promise.get_future().share();
+  }
+
+  std::shared_ptr<const Entry> Result = loadEntry(Key);
+  if (Result) {
+    ++NumLoaded;
+  } else {
+    Result = buildEntry(Invocation, Key, HeaderText, IncluderDir);
+    ++(Result ? NumBuilt : NumFailed);
+  }
+  Promise.set_value(Result);
+  return Result;
+}
+
+void BruteClangPCHCache::printStatistics(llvm::raw_ostream &OS) const {
+  OS << "\n*** BruteClang PCH Cache Stats:\n";
+  OS << NumRequests << " requests, " << NumLoaded << " PCHs loaded from "
+     << CacheDir << ", " << NumBuilt << " built, " << NumFailed
+     << " include blocks could not be precompiled.\n";
+}
@@ -0,0 +1,143 @@
+//===- BruteClangResultCache.cpp - Diagnostics kept between runs ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The entry of key K is the file K.result in the cache directory, holding in
+// the encoding of BruteClangCacheFile.h:
+//
+//   Header:       "BCRS", version (u32)
+//   Dependencies: the stamps of the files of the translation unit
+//   Absent paths: where its header searches looked before finding a file
+//   Diagnostics:  the diagnostics of the compiler instance
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangResultCache.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// \brief The entry file version.
+static const unsigned CurrentVersion = 3;
+
+static const char ResultMagic[4] = {'B', 'C', 'R', 'S'};
+
+BruteClangResultCache::BruteClangResultCache(
+    StringRef CacheDir, IntrusiveRefCntPtr<vfs::FileSystem> FS,
+    StringRef ToolHash)
+    : CacheDir(CacheDir), ToolHash(ToolHash), Stamps(std::move(FS)) {}
+
+BruteClangResultCache::~BruteClangResultCache() {}
+
+bool BruteClangResultCache::getToolHash(StringRef Executable,
+                                        ArrayRef<const char *> Argv,
+                                        std::string &Hash) {
+  std::vector<StringRef> Tools(1, Executable);
+  for (unsigned I = 0, E = Argv.size(); I + 1 < E; ++I)
+    if (StringRef(Argv[I]) == "-load")
+      Tools.push_back(Argv[++I]);
+
+  std::string Hashes;
+  for (StringRef Tool : Tools) {
+    auto Buffer = llvm::MemoryBuffer::getFile(Tool, /*FileSize=*/-1,
+                                              /*RequiresNullTerminator=*/false);
+    if (!Buffer)
+      return false;
+    Hashes += BruteClangFileStamps::hashString((*Buffer)->getBuffer()) + "\n";
+  }
+  Hash = BruteClangFileStamps::hashString(Hashes);
+  return true;
+}
+
+std::string
+BruteClangResultCache::getKey(ArrayRef<const char *> Argv,
+                              ArrayRef<BruteClangVariantArg> VariantArgs) const {
+  // Relative paths on the command line depend on the working directory.
+  SmallString<256> WorkingDir;
+  llvm::sys::fs::current_path(WorkingDir);
+
+  std::string KeyText;
+  llvm::raw_string_ostream OS(KeyText);
+  OS << ToolHash << '\0' << WorkingDir << '\0';
+  for (const char *Arg : Argv)
+    OS << Arg << '\0';
+  for (const BruteClangVariantArg &Arg : VariantArgs)
+    OS << char(Arg.Kind) << Arg.Value << '\0';
+  return BruteClangFileStamps::hashString(OS.str());
+}
+
+std::string BruteClangResultCache::getEntryPath(StringRef Key) const {
+  SmallString<256> Path(CacheDir);
+  llvm::sys::path::append(Path, Key + ".result");
+  return Path.str();
+}
+
+bool BruteClangResultCache::lookup(
+    StringRef Key, std::vector<CustomDiagContainer::RecordedDiagnostic> &Diags) {
+  auto Buffer = llvm::MemoryBuffer::getFile(getEntryPath(Key));
+  if (!Buffer) {
+    ++NumMisses;
+    return false;
+  }
+
+  BruteClangCacheReader Reader((*Buffer)->getBuffer(),
+                               StringRef(ResultMagic, sizeof(ResultMagic)),
+                               CurrentVersion);
+  std::vector<CustomDiagContainer::RecordedDiagnostic> Stored;
+  if (!Stamps.checkStamps(Reader, /*CheckModTime=*/false) ||
+      !Stamps.checkAbsentPaths(Reader)) {
+    ++NumMisses;
+    return false;
+  }
+  Reader.readDiagnostics(Stored);
+  if (Reader.hasFailed()) {
+    ++NumMisses;
+    return false;
+  }
+
+  ++NumHits;
+  Diags.insert(Diags.end(), Stored.begin(), Stored.end());
+  return true;
+}
+
+void BruteClangResultCache::store(
+    StringRef Key, const FileCollector &Deps,
+    ArrayRef<CustomDiagContainer::RecordedDiagnostic> Diags) {
+  // A missing header may be added before the next run, and a header added
+  // ahead of one found through untracked searches would go unnoticed.
+  if (Deps.hasMissingFiles() || Deps.hasUntrackedLookups()) {
+    ++NumIncomplete;
+    return;
+  }
+
+  BruteClangCacheWriter Writer(StringRef(ResultMagic, sizeof(ResultMagic)),
+                               CurrentVersion);
+  if (!Stamps.writeStamps(Deps.getDependencies(), Writer)) {
+    ++NumIncomplete;
+    return;
+  }
+  BruteClangFileStamps::writeAbsentPaths(Deps.getAbsentPaths(), Writer);
+  Writer.writeDiagnostics(Diags);
+
+  // If the entry cannot be written the next run analyzes the pair again.
+  if (!llvm::sys::fs::create_directories(CacheDir) &&
+      Writer.commit(getEntryPath(Key)))
+    ++NumStored;
+}
+
+void BruteClangResultCache::printStatistics(llvm::raw_ostream &OS) const {
+  OS << "\n*** BruteClang Result Cache Stats:\n";
+  OS << NumHits << " results replayed from " << CacheDir << ", " << NumMisses
+     << " analyzed, " << NumStored << " stored, " << NumIncomplete
+     << " not stored for missing files or untracked header searches.\n";
+}
@@ -0,0 +1,151 @@
+//===- BruteClangTokenFingerprint.cpp - Token stream hashes ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangTokenFingerprint.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MD5.h"
+
+using namespace clang;
+
+namespace {
+
+/// The hash being computed, fed by the preprocessor, its callbacks and its
+/// diagnostics.
+class FingerprintBuilder {
+  llvm::MD5 Hash;
+
+public:
+  void addInteger(uint64_t Value) {
+    uint8_t Bytes[sizeof(Value)];
+    llvm::support::endian::write64le(Bytes, Value);
+    Hash.update(Bytes);
+  }
+
+  void addString(StringRef Str) {
+    addInteger(Str.size());
+    Hash.update(Str);
+  }
+
+  /// Add the presumed location of \p Loc, which must be a file location.
+  void addLocation(const SourceManager &SM, SourceLocation Loc) {
+    PresumedLoc PLoc = SM.getPresumedLoc(Loc);
+    if (PLoc.isInvalid()) {
+      addInteger(0);
+      return;
+    }
+    addString(PLoc.getFilename());
+    addInteger(PLoc.getLine());
+    addInteger(PLoc.getColumn());
+  }
+
+  std::string finish() {
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Hex;
+    llvm::MD5::stringifyResult(Result, Hex);
+    return Hex.str();
+  }
+};
+
+class PragmaRecorder : public PPCallbacks {
+  const SourceManager &SM;
+  FingerprintBuilder &Builder;
+
+public:
+  PragmaRecorder(const SourceManager &SM, FingerprintBuilder &Builder)
+      : SM(SM), Builder(Builder) {}
+
+  void PragmaDirective(SourceLocation Loc,
+                       PragmaIntroducerKind Introducer) override {
+    // The pragmas are consumed here, unlike when parsing; their location
+    // identifies the text of each.
+    Builder.addInteger(Introducer);
+    Builder.addLocation(SM, SM.getExpansionLoc(Loc));
+  }
+};
+
+class FingerprintDiagConsumer : public DiagnosticConsumer {
+  FingerprintBuilder &Builder;
+
+public:
+  explicit FingerprintDiagConsumer(FingerprintBuilder &Builder)
+      : Builder(Builder) {}
+
+  void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,
+                        const Diagnostic &Info) override {
+    DiagnosticConsumer::HandleDiagnostic(DiagLevel, Info);
+    SmallString<256> Message;
+    Info.FormatDiagnostic(Message);
+    Builder.addInteger(DiagLevel);
+    Builder.addString(Message);
+    if (Info.getLocation().isValid() && Info.hasSourceManager()) {
+      const SourceManager &SM = Info.getSourceManager();
+      Builder.addLocation(SM, SM.getExpansionLoc(Info.getLocation()));
+    }
+  }
+};
+
+class FingerprintAction : public PreprocessorFrontendAction {
+  FingerprintBuilder &Builder;
+
+protected:
+  void ExecuteAction() override {
+    Preprocessor &PP = getCompilerInstance().getPreprocessor();
+    const SourceManager &SM = PP.getSourceManager();
+    PP.addPPCallbacks(llvm::make_unique<PragmaRecorder>(SM, Builder));
+    PP.IgnorePragmas();
+
+    SmallString<64> Buffer;
+    Token Tok;
+    PP.EnterMainSourceFile();
+    do {
+      PP.Lex(Tok);
+      Builder.addInteger(Tok.getKind());
+      Builder.addString(PP.getSpelling(Tok, Buffer));
+      SourceLocation Loc = Tok.getLocation();
+      Builder.addLocation(SM, SM.getExpansionLoc(Loc));
+      if (Loc.isMacroID())
+        Builder.addLocation(SM, SM.getSpellingLoc(Loc));
+    } while (Tok.isNot(tok::eof));
+  }
+
+public:
+  explicit FingerprintAction(FingerprintBuilder &Builder) : Builder(Builder) {}
+};
+
+} // end anonymous namespace
+
+bool clang::computeTokenFingerprint(CompilerInstance &Clang,
+                                    std::string &Fingerprint) {
+  auto Invocation = std::make_shared<CompilerInvocation>(Clang.getInvocation());
+  Invocation->getFrontendOpts().ProgramAction = frontend::RunPreprocessorOnly;
+  Invocation->getFrontendOpts().AddPluginActions.clear();
+  Invocation->getFrontendOpts().DisableFree = false;
+  Invocation->getDependencyOutputOpts() = DependencyOutputOptions();
+
+  FingerprintBuilder Builder;
+  CompilerInstance Preprocessing(Clang.getPCHContainerOperations());
+  Preprocessing.setInvocation(std::move(Invocation));
+  Preprocessing.createDiagnostics(new FingerprintDiagConsumer(Builder), true);
+  Preprocessing.getDiagnostics().setErrorLimit(0);
+  if (Clang.hasFileManager())
+    Preprocessing.setFileManager(&Clang.getFileManager());
+
+  FingerprintAction Action(Builder);
+  if (!Preprocessing.ExecuteAction(Action))
+    return false;
+  Fingerprint = Builder.finish();
+  return true;
+}
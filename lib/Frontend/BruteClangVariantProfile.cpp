@@ -0,0 +1,251 @@
+//===- BruteClangVariantProfile.cpp - Per-variant cost records ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A profile is written as one line of the form
+//
+//   {"file": ..., "variant": ..., "outcome": "analyzed",
+//    "wall": s, "cpu": s,
+//    "phases": {"setup": T, "preprocess": T, "parse_sema": T,
+//               "consumers": {"<name>": T, ...}},
+//    "memory": {"ast_bytes": n, "preprocessor_bytes": n,
+//               "source_manager_bytes": n, "peak_rss_bytes": n}}
+//
+// where each T is {"wall": s, "cpu": s}, in seconds. The preprocess and
+// consumer timings also give the number of timed regions as "count".
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangVariantProfile.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace clang;
+
+/// Forwards every callback to the wrapped consumer, timing it.
+class BruteClangVariantProfile::TimedConsumer : public ASTConsumer {
+  std::unique_ptr<ASTConsumer> Consumer;
+  BruteClangPhaseTimer &Timer;
+  BruteClangVariantProfile &Profile;
+
+public:
+  TimedConsumer(std::unique_ptr<ASTConsumer> Consumer,
+                BruteClangPhaseTimer &Timer, BruteClangVariantProfile &Profile)
+      : Consumer(std::move(Consumer)), Timer(Timer), Profile(Profile) {}
+
+  void Initialize(ASTContext &Context) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->Initialize(Context);
+  }
+  bool HandleTopLevelDecl(DeclGroupRef D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    return Consumer->HandleTopLevelDecl(D);
+  }
+  void HandleInlineFunctionDefinition(FunctionDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleInlineFunctionDefinition(D);
+  }
+  void HandleInterestingDecl(DeclGroupRef D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleInterestingDecl(D);
+  }
+  void HandleTranslationUnit(ASTContext &Ctx) override {
+    {
+      BruteClangPhaseRegion Timing(&Timer);
+      Consumer->HandleTranslationUnit(Ctx);
+    }
+    // The AST is gone once the frontend action ends.
+    Profile.ASTBytes =
+        std::max<uint64_t>(Profile.ASTBytes, Ctx.getASTAllocatedMemory() +
+                                                 Ctx.getSideTableAllocatedMemory());
+  }
+  void HandleTagDeclDefinition(TagDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleTagDeclDefinition(D);
+  }
+  void HandleTagDeclRequiredDefinition(const TagDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleTagDeclRequiredDefinition(D);
+  }
+  void HandleCXXImplicitFunctionInstantiation(FunctionDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleCXXImplicitFunctionInstantiation(D);
+  }
+  void HandleTopLevelDeclInObjCContainer(DeclGroupRef D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleTopLevelDeclInObjCContainer(D);
+  }
+  void HandleImplicitImportDecl(ImportDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleImplicitImportDecl(D);
+  }
+  void CompleteTentativeDefinition(VarDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->CompleteTentativeDefinition(D);
+  }
+  void AssignInheritanceModel(CXXRecordDecl *RD) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->AssignInheritanceModel(RD);
+  }
+  void HandleCXXStaticMemberVarInstantiation(VarDecl *D) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleCXXStaticMemberVarInstantiation(D);
+  }
+  void HandleVTable(CXXRecordDecl *RD) override {
+    BruteClangPhaseRegion Timing(&Timer);
+    Consumer->HandleVTable(RD);
+  }
+  ASTMutationListener *GetASTMutationListener() override {
+    return Consumer->GetASTMutationListener();
+  }
+  ASTDeserializationListener *GetASTDeserializationListener() override {
+    return Consumer->GetASTDeserializationListener();
+  }
+  void PrintStats() override { Consumer->PrintStats(); }
+  bool shouldSkipFunctionBody(Decl *D) override {
+    return Consumer->shouldSkipFunctionBody(D);
+  }
+};
+
+std::unique_ptr<ASTConsumer>
+BruteClangVariantProfile::wrapConsumer(std::unique_ptr<ASTConsumer> Consumer,
+                                       StringRef Name) {
+  Consumers.emplace_back(Name, llvm::make_unique<BruteClangPhaseTimer>());
+  return llvm::make_unique<TimedConsumer>(std::move(Consumer),
+                                          *Consumers.back().second, *this);
+}
+
+void BruteClangVariantProfile::recordMemory(CompilerInstance &CI) {
+  if (CI.hasPreprocessor())
+    PreprocessorBytes = CI.getPreprocessor().getTotalMemory();
+  if (CI.hasSourceManager()) {
+    SourceManager &SM = CI.getSourceManager();
+    SourceManager::MemoryBufferSizes Buffers = SM.getMemoryBufferSizes();
+    SourceManagerBytes = SM.getDataStructureSizes() + Buffers.malloc_bytes +
+                         Buffers.mmap_bytes;
+  }
+#ifdef LLVM_ON_UNIX
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+#ifdef __APPLE__
+    PeakRSSBytes = Usage.ru_maxrss;
+#else
+    PeakRSSBytes = uint64_t(Usage.ru_maxrss) * 1024;
+#endif
+  }
+#endif
+}
+
+static void writeString(raw_ostream &OS, StringRef Str) {
+  OS << '"';
+  for (unsigned char C : Str) {
+    if (C == '"' || C == '\\')
+      OS << '\\' << C;
+    else if (C < 0x20)
+      OS << llvm::format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+static void writeTime(raw_ostream &OS, const BruteClangPhaseTime &Time) {
+  OS << "\"wall\": " << llvm::format("%.6f", Time.Wall)
+     << ", \"cpu\": " << llvm::format("%.6f", Time.CPU);
+}
+
+static void writeTimer(raw_ostream &OS, const BruteClangPhaseTimer &Timer) {
+  OS << '{';
+  writeTime(OS, Timer.getTotal());
+  OS << ", \"count\": " << Timer.getCount() << '}';
+}
+
+void BruteClangVariantProfile::writeJSON(raw_ostream &OS) const {
+  static const char *const OutcomeNames[] = {"analyzed", "replayed", "skipped"};
+
+  OS << "{\"file\": ";
+  writeString(OS, FileName);
+  OS << ", \"variant\": ";
+  writeString(OS, VariantName);
+  OS << ", \"outcome\": \"" << OutcomeNames[Outcome] << "\", ";
+  writeTime(OS, Total);
+
+  // What the phases below do not account for of the frontend action is
+  // parsing and Sema, with the lexing they drive.
+  BruteClangPhaseTime Setup = Total;
+  Setup -= Frontend;
+  BruteClangPhaseTime ParseSema = Frontend;
+  ParseSema -= Directives->getTotal();
+  for (const auto &Consumer : Consumers)
+    ParseSema -= Consumer.second->getTotal();
+  ParseSema.Wall = std::max(ParseSema.Wall, 0.0);
+  ParseSema.CPU = std::max(ParseSema.CPU, 0.0);
+
+  OS << ", \"phases\": {\"setup\": {";
+  writeTime(OS, Setup);
+  OS << "}, \"preprocess\": ";
+  writeTimer(OS, *Directives);
+  OS << ", \"parse_sema\": {";
+  writeTime(OS, ParseSema);
+  OS << "}, \"consumers\": {";
+  for (unsigned I = 0, E = Consumers.size(); I != E; ++I) {
+    if (I)
+      OS << ", ";
+    writeString(OS, Consumers[I].first);
+    OS << ": ";
+    writeTimer(OS, *Consumers[I].second);
+  }
+  OS << "}}, \"memory\": {\"ast_bytes\": " << ASTBytes
+     << ", \"preprocessor_bytes\": " << PreprocessorBytes
+     << ", \"source_manager_bytes\": " << SourceManagerBytes
+     << ", \"peak_rss_bytes\": " << PeakRSSBytes << "}}";
+}
+
+BruteClangProfileLog::BruteClangProfileLog(
+    std::unique_ptr<llvm::raw_fd_ostream> OS)
+    : OS(std::move(OS)) {}
+
+BruteClangProfileLog::~BruteClangProfileLog() {}
+
+std::unique_ptr<BruteClangProfileLog>
+BruteClangProfileLog::create(StringRef Path, std::string &Error) {
+  std::error_code EC;
+  auto OS = llvm::make_unique<llvm::raw_fd_ostream>(
+      Path, EC, llvm::sys::fs::F_Append | llvm::sys::fs::F_Text);
+  if (EC) {
+    Error = "unable to open '" + Path.str() + "': " + EC.message();
+    return nullptr;
+  }
+  return std::unique_ptr<BruteClangProfileLog>(
+      new BruteClangProfileLog(std::move(OS)));
+}
+
+void BruteClangProfileLog::write(const BruteClangVariantProfile &Profile) {
+  // Format the line first, so it reaches the file in a single write.
+  std::string Line;
+  llvm::raw_string_ostream LineOS(Line);
+  Profile.writeJSON(LineOS);
+  LineOS << '\n';
+  LineOS.flush();
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  OS->write(Line.data(), Line.size());
+  OS->flush();
+}
@@ -0,0 +1,294 @@
+//===- BruteClangVariantSensitivity.cpp - Variant dependencies ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangVariantSensitivity.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Triple.h"
+#include <algorithm>
+#include <functional>
+
+using namespace clang;
+
+/// Records the macros queried and the headers searched while a translation
+/// unit is preprocessed.
+class BruteClangVariantSensitivity::Recorder : public PPCallbacks {
+  Preprocessor &PP;
+  BruteClangVariantSensitivity &S;
+
+  /// The search directory each file entered was found in; empty if it was
+  /// not found through the search list, null if that differed between
+  /// inclusions.
+  llvm::DenseMap<const FileEntry *, const char *> FoundIn;
+
+  void query(const Token &MacroNameTok) {
+    if (const IdentifierInfo *II = MacroNameTok.getIdentifierInfo())
+      if (S.WatchedMacros.count(II->getName()))
+        S.QueriedMacros.insert(II->getName());
+  }
+
+  /// Whether \p Loc is in the predefines buffer, which holds the -D options.
+  bool isPredefined(SourceLocation Loc) const {
+    const SourceManager &SM = PP.getSourceManager();
+    return Loc.isValid() &&
+           SM.getFileID(SM.getExpansionLoc(Loc)) == PP.getPredefinesFileID();
+  }
+
+  /// Get the name of the search directory \p SearchPath names, or null if
+  /// it is not in the search list.
+  const char *getSearchDir(StringRef SearchPath) const {
+    HeaderSearch &HS = PP.getHeaderSearchInfo();
+    for (auto I = HS.search_dir_begin(), E = HS.search_dir_end(); I != E; ++I)
+      if (I->getName() == SearchPath)
+        return I->getName().data();
+    return nullptr;
+  }
+
+public:
+  Recorder(Preprocessor &PP, BruteClangVariantSensitivity &S) : PP(PP), S(S) {
+    // MSVC looks up quoted includes relative to the whole include stack.
+    if (PP.getLangOpts().MSVCCompat)
+      S.Untracked = true;
+  }
+
+  void MacroExpands(const Token &MacroNameTok, const MacroDefinition &MD,
+                    SourceRange Range, const MacroArgs *Args) override {
+    const IdentifierInfo *II = MacroNameTok.getIdentifierInfo();
+    if (II && (II->getName() == "__has_include" ||
+               II->getName() == "__has_include_next"))
+      S.Untracked = true;
+    query(MacroNameTok);
+  }
+
+  void MacroDefined(const Token &MacroNameTok,
+                    const MacroDirective *MD) override {
+    if (!isPredefined(MacroNameTok.getLocation()))
+      query(MacroNameTok);
+  }
+
+  void MacroUndefined(const Token &MacroNameTok, const MacroDefinition &MD,
+                      const MacroDirective *Undef) override {
+    if (!isPredefined(MacroNameTok.getLocation()))
+      query(MacroNameTok);
+  }
+
+  void Defined(const Token &MacroNameTok, const MacroDefinition &MD,
+               SourceRange Range) override {
+    query(MacroNameTok);
+  }
+
+  void Ifdef(SourceLocation Loc, const Token &MacroNameTok,
+             const MacroDefinition &MD) override {
+    query(MacroNameTok);
+  }
+
+  void Ifndef(SourceLocation Loc, const Token &MacroNameTok,
+              const MacroDefinition &MD) override {
+    query(MacroNameTok);
+  }
+
+  void InclusionDirective(SourceLocation HashLoc, const Token &IncludeTok,
+                          StringRef FileName, bool IsAngled,
+                          CharSourceRange FilenameRange, const FileEntry *File,
+                          StringRef SearchPath, StringRef RelativePath,
+                          const Module *Imported) override {
+    SourceManager &SM = PP.getSourceManager();
+    FileID FID = SM.getFileID(HashLoc);
+    const FileEntry *Includer = SM.getFileEntryForID(FID);
+
+    IncludeLookup Lookup;
+    Lookup.Name = FileName;
+    Lookup.IsAngled = IsAngled;
+
+    // Mirror Preprocessor::LookupFile and HandleIncludeNextDirective.
+    const IdentifierInfo *II = IncludeTok.getIdentifierInfo();
+    bool IsIncludeNext =
+        II && II->getPPKeywordID() == tok::pp_include_next &&
+        FID != SM.getMainFileID();
+    if (IsIncludeNext && Includer) {
+      const char *Dir = FoundIn.lookup(Includer);
+      if (!Dir) {
+        S.Untracked = true;
+        return;
+      }
+      Lookup.FromDir = Dir;
+    }
+    if (Lookup.FromDir.empty()) {
+      if (Includer) {
+        Lookup.IncluderFile = Includer->getName();
+        Lookup.IncluderDir = Includer->getDir()->getName();
+      } else if (const FileEntry *MainFile =
+                     SM.getFileEntryForID(SM.getMainFileID())) {
+        // -include files are looked up from the working directory.
+        Lookup.IncluderFile = MainFile->getName();
+        Lookup.IncluderDir = ".";
+      }
+    }
+
+    Lookup.Found = File != nullptr;
+    if (File) {
+      Lookup.File = File->getUniqueID();
+
+      // Where #include_next directives in File start searching.
+      const char *Dir = "";
+      if (IsAngled || !Lookup.FromDir.empty() ||
+          SearchPath != Lookup.IncluderDir)
+        if (const char *SearchDir = getSearchDir(SearchPath))
+          Dir = SearchDir;
+      auto Inserted = FoundIn.insert(std::make_pair(File, Dir));
+      if (!Inserted.second && Inserted.first->second &&
+          StringRef(Inserted.first->second) != Dir)
+        Inserted.first->second = nullptr;
+    }
+
+    std::string Key = Lookup.IncluderDir + '\0' + Lookup.Name + '\0' +
+                      Lookup.FromDir + (IsAngled ? "<" : "\"");
+    if (S.LookupKeys.insert(Key).second)
+      S.Lookups.push_back(std::move(Lookup));
+  }
+
+  void EndOfMainFile() override {
+    // A watched macro the variant does not define changes nothing unless its
+    // name comes up somewhere, which would have added it to the identifiers.
+    for (const auto &Entry : PP.getIdentifierTable())
+      if (S.WatchedMacros.count(Entry.getKey()) &&
+          !S.Definitions.count(Entry.getKey()))
+        S.QueriedMacros.insert(Entry.getKey());
+    S.Complete = true;
+  }
+};
+
+namespace {
+
+/// Attaches a recorder to the preprocessor of a compiler instance.
+class RecorderCollector : public DependencyCollector {
+  std::function<std::unique_ptr<PPCallbacks>(Preprocessor &)> CreateRecorder;
+
+public:
+  explicit RecorderCollector(
+      std::function<std::unique_ptr<PPCallbacks>(Preprocessor &)>
+          CreateRecorder)
+      : CreateRecorder(std::move(CreateRecorder)) {}
+
+  void attachToPreprocessor(Preprocessor &PP) override {
+    PP.addPPCallbacks(CreateRecorder(PP));
+  }
+};
+
+} // end anonymous namespace
+
+BruteClangVariantSensitivity::BruteClangVariantSensitivity(
+    const llvm::StringSet<> &WatchedMacros, const PreprocessorOptions &PPOpts)
+    : WatchedMacros(WatchedMacros) {
+  getDefinitions(PPOpts, WatchedMacros, Definitions);
+
+  // A function-like macro is not expanded where its name is not followed by
+  // a parenthesis, so it may be used without any sign of it.
+  for (const auto &Definition : Definitions)
+    if (StringRef(Definition.getValue()).startswith("("))
+      QueriedMacros.insert(Definition.getKey());
+}
+
+BruteClangVariantSensitivity::~BruteClangVariantSensitivity() {}
+
+void BruteClangVariantSensitivity::getDefinitions(
+    const PreprocessorOptions &PPOpts, const llvm::StringSet<> &Names,
+    llvm::StringMap<std::string> &Definitions) {
+  for (const std::pair<std::string, bool> &Macro : PPOpts.Macros) {
+    StringRef Option = Macro.first;
+    StringRef Name = Option.substr(0, Option.find_first_of("=("));
+    if (!Names.count(Name))
+      continue;
+    if (Macro.second)
+      Definitions.erase(Name);
+    else
+      Definitions[Name] = Option.substr(Name.size());
+  }
+}
+
+std::shared_ptr<DependencyCollector>
+BruteClangVariantSensitivity::createRecorder() {
+  return std::make_shared<RecorderCollector>([this](Preprocessor &PP) {
+    return llvm::make_unique<Recorder>(PP, *this);
+  });
+}
+
+bool BruteClangVariantSensitivity::matches(CompilerInstance &Clang) const {
+  assert(isComplete() && "comparing with an incomplete recording");
+
+  llvm::StringMap<std::string> OtherDefinitions;
+  getDefinitions(Clang.getPreprocessorOpts(), QueriedMacros, OtherDefinitions);
+  for (const auto &Name : QueriedMacros) {
+    auto Recorded = Definitions.find(Name.getKey());
+    auto Other = OtherDefinitions.find(Name.getKey());
+    if ((Recorded == Definitions.end()) != (Other == OtherDefinitions.end()))
+      return false;
+    if (Recorded != Definitions.end() && Recorded->second != Other->second)
+      return false;
+  }
+
+  if (Lookups.empty())
+    return true;
+
+  // Repeat the header searches with the search list of the other variant.
+  FileManager &FileMgr = Clang.getFileManager();
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagIDs(new DiagnosticIDs());
+  DiagnosticsEngine Diags(DiagIDs, new DiagnosticOptions,
+                          new IgnoringDiagConsumer());
+  SourceManager SourceMgr(Diags, FileMgr);
+  HeaderSearch HS(Clang.getHeaderSearchOptsPtr(), SourceMgr, Diags,
+                  Clang.getLangOpts(), /*Target=*/nullptr);
+  ApplyHeaderSearchOptions(HS, Clang.getHeaderSearchOpts(), Clang.getLangOpts(),
+                           llvm::Triple(Clang.getTargetOpts().Triple));
+
+  for (const IncludeLookup &Lookup : Lookups) {
+    const DirectoryLookup *FromDir = nullptr;
+    SmallVector<std::pair<const FileEntry *, const DirectoryEntry *>, 1>
+        Includers;
+    if (!Lookup.FromDir.empty()) {
+      auto Dir = std::find_if(HS.search_dir_begin(), HS.search_dir_end(),
+                              [&](const DirectoryLookup &DL) {
+                                return DL.getName() == Lookup.FromDir;
+                              });
+      if (Dir == HS.search_dir_end())
+        return false;
+      if (++Dir == HS.search_dir_end()) {
+        if (Lookup.Found)
+          return false;
+        continue;
+      }
+      FromDir = &*Dir;
+    } else if (!Lookup.IncluderFile.empty()) {
+      const FileEntry *Includer = FileMgr.getFile(Lookup.IncluderFile);
+      const DirectoryEntry *IncluderDir =
+          FileMgr.getDirectory(Lookup.IncluderDir);
+      if (!Includer || !IncluderDir)
+        return false;
+      Includers.push_back(std::make_pair(Includer, IncluderDir));
+    }
+
+    const DirectoryLookup *CurDir;
+    const FileEntry *File = HS.LookupFile(
+        Lookup.Name, SourceLocation(), Lookup.IsAngled, FromDir, CurDir,
+        Includers, nullptr, nullptr, nullptr, nullptr, nullptr);
+    if ((File != nullptr) != Lookup.Found ||
+        (File && File->getUniqueID() != Lookup.File))
+      return false;
+  }
+  return true;
+}
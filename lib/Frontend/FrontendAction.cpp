@@ -12,6 +12,8 @@
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/DeclGroup.h"
 #include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/BruteClangDeclFingerprint.h"
+#include "clang/Frontend/BruteClangVariantProfile.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
@@ -149,6 +151,23 @@ FrontendAction::CreateWrappedASTConsumer(CompilerInstance &CI,
   if (!Consumer)
     return nullptr;
 
+  // Hand the plugins only the declarations not checked for another variant
+  // yet, unless they ask for each declaration themselves, and time each
+  // consumer on its own for BruteClang. The main consumer is the plugin's
+  // when a plugin replaces the main action.
+  BruteClangDeclFilter *Filter = CI.getFrontendOpts().DeclFilter.get();
+  if (Filter && CI.getFrontendOpts().ProgramAction == frontend::PluginAction &&
+      !usesDeclCheckScopes())
+    Consumer = Filter->wrapConsumer(std::move(Consumer),
+                                    CI.getFrontendOpts().ActionName);
+  BruteClangVariantProfile *Profile = CI.getFrontendOpts().VariantProfile.get();
+  if (Profile)
+    Consumer = Profile->wrapConsumer(
+        std::move(Consumer),
+        CI.getFrontendOpts().ProgramAction == frontend::PluginAction
+            ? StringRef(CI.getFrontendOpts().ActionName)
+            : StringRef("main action"));
+
   // If there are no registered plugins we don't need to wrap the consumer
   if (FrontendPluginRegistry::begin() == FrontendPluginRegistry::end())
     return Consumer;
@@ -177,6 +196,12 @@ FrontendAction::CreateWrappedASTConsumer(CompilerInstance &CI,
          ActionType == PluginASTAction::AddAfterMainAction) &&
         P->ParseArgs(CI, CI.getFrontendOpts().PluginArgs[it->getName()])) {
       std::unique_ptr<ASTConsumer> PluginConsumer = P->CreateASTConsumer(CI, InFile);
+      if (Filter && PluginConsumer && !P->usesDeclCheckScopes())
+        PluginConsumer = Filter->wrapConsumer(std::move(PluginConsumer),
+                                              it->getName());
+      if (Profile && PluginConsumer)
+        PluginConsumer = Profile->wrapConsumer(std::move(PluginConsumer),
+                                               it->getName());
       if (ActionType == PluginASTAction::AddBeforeMainAction) {
         Consumers.push_back(std::move(PluginConsumer));
       } else {
@@ -1053,6 +1078,9 @@ bool WrapperFrontendAction::hasIRSupport() const {
 bool WrapperFrontendAction::hasCodeCompletionSupport() const {
   return WrappedAction->hasCodeCompletionSupport();
 }
+bool WrapperFrontendAction::usesDeclCheckScopes() const {
+  return WrappedAction->usesDeclCheckScopes();
+}
 
 WrapperFrontendAction::WrapperFrontendAction(
     std::unique_ptr<FrontendAction> WrappedAction)
@@ -0,0 +1,159 @@
+//===- BruteClangConditionalScan.cpp - Shared conditional blocks ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/BruteClangConditionalScan.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// Whether the '<' at \p Ptr opens what an #include would take as a header
+/// name, and that name holds something raw lexing takes as the start of a
+/// comment. The preprocessor lexes such a directive differently depending on
+/// whether it is skipped.
+static bool headerNameHoldsComment(const char *Ptr, const char *End) {
+  bool Comment = false;
+  for (++Ptr; Ptr != End; ++Ptr) {
+    if (*Ptr == '>')
+      return Comment;
+    if (*Ptr == '\n' || *Ptr == '\r')
+      return false;
+    if (*Ptr == '/' && Ptr + 1 != End && (Ptr[1] == '*' || Ptr[1] == '/'))
+      Comment = true;
+  }
+  return false;
+}
+
+std::unique_ptr<BruteClangConditionalBlocks>
+BruteClangConditionalScan::scan(StringRef Buffer,
+                                const LangOptions &LangOpts) {
+  auto Result = llvm::make_unique<Blocks>();
+
+  // Lex at a made up file location, as Lexer::ComputePreamble does, so that
+  // the offset of a token can be read off its location.
+  Lexer L(SourceLocation::getFromRawEncoding(1), LangOpts, Buffer.begin(),
+          Buffer.begin(), Buffer.end());
+  auto getOffset = [](const Token &Tok) {
+    return Tok.getLocation().getRawEncoding() - 1;
+  };
+
+  // For each conditional open at this point, the directive name opening its
+  // current block and whether an #else was seen.
+  struct OpenConditional {
+    unsigned NameOffset;
+    bool FoundElse;
+  };
+  SmallVector<OpenConditional, 8> Open;
+
+  Token Tok;
+  L.LexFromRawLexer(Tok);
+  while (Tok.isNot(tok::eof)) {
+    if (Tok.isNot(tok::hash) || !Tok.isAtStartOfLine()) {
+      L.LexFromRawLexer(Tok);
+      continue;
+    }
+
+    unsigned HashOffset = getOffset(Tok);
+    L.LexFromRawLexer(Tok);
+    // A null directive.
+    if (Tok.isAtStartOfLine())
+      continue;
+
+    if (Tok.is(tok::raw_identifier)) {
+      if (Tok.needsCleaning())
+        return llvm::make_unique<Blocks>();
+
+      StringRef Name = Tok.getRawIdentifier();
+      if (Name == "if" || Name == "ifdef" || Name == "ifndef") {
+        Open.push_back({getOffset(Tok), false});
+      } else if ((Name == "elif" || Name == "else" || Name == "endif") &&
+                 !Open.empty()) {
+        OpenConditional &Cond = Open.back();
+        // The preprocessor diagnoses these even in nested skipped blocks.
+        if (Cond.FoundElse && Name != "endif")
+          return llvm::make_unique<Blocks>();
+        Result->Ends[Cond.NameOffset] = HashOffset;
+        if (Name == "endif")
+          Open.pop_back();
+        else
+          Cond = {getOffset(Tok), Name == "else"};
+      }
+    }
+
+    // Skip the rest of the directive.
+    do {
+      if (Tok.is(tok::less) &&
+          headerNameHoldsComment(Buffer.begin() + getOffset(Tok),
+                                 Buffer.end()))
+        return llvm::make_unique<Blocks>();
+      L.LexFromRawLexer(Tok);
+    } while (Tok.isNot(tok::eof) && !Tok.isAtStartOfLine());
+  }
+  return Result;
+}
+
+/// Append to \p Key the language options that change how a file is lexed.
+static void addLexingOptions(SmallVectorImpl<char> &Key,
+                             const LangOptions &LangOpts) {
+  unsigned Bits = LangOpts.CPlusPlus | LangOpts.CPlusPlus11 << 1 |
+                  LangOpts.CPlusPlus14 << 2 | LangOpts.CPlusPlus1z << 3 |
+                  LangOpts.C11 << 4 | LangOpts.Digraphs << 5 |
+                  LangOpts.Trigraphs << 6 | LangOpts.LineComment << 7 |
+                  LangOpts.MicrosoftExt << 8 | LangOpts.DollarIdents << 9 |
+                  LangOpts.AsmPreprocessor << 10 | LangOpts.ObjC1 << 11 |
+                  LangOpts.TraditionalCPP << 12;
+  llvm::raw_svector_ostream(Key) << ':' << Bits;
+}
+
+const BruteClangConditionalBlocks &
+BruteClangConditionalScan::getBlocks(StringRef Name, StringRef Buffer,
+                                     const LangOptions &LangOpts) {
+  SmallString<256> Key(Name);
+  Key.push_back('\0');
+  llvm::raw_svector_ostream(Key) << Buffer.size();
+  addLexingOptions(Key, LangOpts);
+
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto Known = Files.find(Key);
+    if (Known != Files.end())
+      return *Known->second;
+  }
+
+  // Scan without holding the lock. Should two instances scan the same file
+  // at once, the first result stored is the one kept.
+  std::unique_ptr<Blocks> Scanned = scan(Buffer, LangOpts);
+  ++NumFilesScanned;
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::unique_ptr<Blocks> &Entry = Files[Key];
+  if (!Entry)
+    Entry = std::move(Scanned);
+  return *Entry;
+}
+
+BruteClangConditionalScan::Statistics
+BruteClangConditionalScan::getStatistics() const {
+  Statistics Stats;
+  Stats.NumFilesScanned = NumFilesScanned;
+  Stats.NumJumps = NumJumps;
+  Stats.NumBytesSkipped = NumBytesSkipped;
+  return Stats;
+}
+
+void BruteClangConditionalScan::printStatistics(llvm::raw_ostream &OS) const {
+  OS << "\n*** BruteClang Conditional Scan Stats:\n";
+  OS << NumFilesScanned << " files scanned for their conditional blocks.\n";
+  OS << NumJumps << " skipped blocks jumped over, " << NumBytesSkipped
+     << " bytes not lexed.\n";
+}
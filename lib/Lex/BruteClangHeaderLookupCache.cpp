@@ -0,0 +1,62 @@
+//===- BruteClangHeaderLookupCache.cpp - Shared header lookups ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/BruteClangHeaderLookupCache.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace clang;
+
+const BruteClangHeaderLookupCache::Suffix *
+BruteClangHeaderLookupCache::getSuffix(StringRef DirName, const Suffix *Next) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  const char *Name = DirNames.insert(DirName).first->getKeyData();
+  Suffix *&S = SuffixIndex[std::make_pair(Name, Next)];
+  if (!S) {
+    Suffixes.emplace_back(Next ? Next->Length + 1 : 1);
+    S = &Suffixes.back();
+  }
+  return S;
+}
+
+bool BruteClangHeaderLookupCache::lookup(const Suffix *S, StringRef Filename,
+                                         unsigned &DirsToSkip) {
+  ++NumLookups;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto Known = S->Results.find(Filename);
+    if (Known == S->Results.end())
+      return false;
+    DirsToSkip = Known->second;
+  }
+  ++NumHits;
+  NumDirsSkipped += DirsToSkip;
+  return true;
+}
+
+void BruteClangHeaderLookupCache::record(
+    ArrayRef<const Suffix *> SearchDirSuffixes, unsigned StartIdx,
+    unsigned HitIdx, StringRef Filename) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  // Every directory from StartIdx up to the hit missed, so the suffix of each
+  // of them reaches the hit (or the end of the list) after the same
+  // directories.
+  unsigned E = std::min<unsigned>(HitIdx + 1, SearchDirSuffixes.size());
+  for (unsigned I = StartIdx; I < E; ++I)
+    if (const Suffix *S = SearchDirSuffixes[I])
+      S->Results.insert(std::make_pair(Filename, HitIdx - I));
+}
+
+void BruteClangHeaderLookupCache::printStatistics(
+    llvm::raw_ostream &OS) const {
+  OS << "\n*** BruteClang Header Lookup Stats:\n";
+  OS << Suffixes.size() << " search directory suffixes.\n";
+  OS << NumLookups << " lookups, " << NumHits << " answered from cache, "
+     << NumDirsSkipped << " directory probes skipped.\n";
+}
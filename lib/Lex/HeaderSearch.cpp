@@ -14,6 +14,7 @@
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/IdentifierTable.h"
+#include "clang/Lex/BruteClangHeaderLookupCache.h"
 #include "clang/Lex/ExternalPreprocessorSource.h"
 #include "clang/Lex/HeaderMap.h"
 #include "clang/Lex/HeaderSearchOptions.h"
@@ -771,8 +772,26 @@ const FileEntry *HeaderSearch::LookupFile(
 
   SmallString<64> MappedName;
 
+  // Other compiler instances of a BruteClang run may have searched the same
+  // trailing directories for this file already. Whether a requesting module
+  // may use a file depends on more than its name, so don't share those.
+  BruteClangHeaderLookupCache *SharedCache =
+      SkipCache || RequestingModule ? nullptr
+                                    : HSOpts->SharedLookupCache.get();
+  if (SharedCache)
+    computeSearchDirSuffixes(*SharedCache);
+  unsigned SharedStartIdx = i;
+
   // Check each directory in sequence to see if it contains this file.
   for (; i != SearchDirs.size(); ++i) {
+    unsigned DirsToSkip;
+    if (SharedCache && SearchDirSuffixes[i] &&
+        SharedCache->lookup(SearchDirSuffixes[i], Filename, DirsToSkip)) {
+      i += DirsToSkip;
+      if (i == SearchDirs.size())
+        break;
+    }
+
     bool InUserSpecifiedSystemFramework = false;
     bool HasBeenMapped = false;
     const FileEntry *FE = SearchDirs[i].LookupFile(
@@ -828,9 +847,15 @@ const FileEntry *HeaderSearch::LookupFile(
 
     // Remember this location for the next lookup we do.
     CacheLookup.HitIdx = i;
+    if (SharedCache)
+      SharedCache->record(SearchDirSuffixes, SharedStartIdx, i, Filename);
     return FE;
   }
 
+  if (SharedCache)
+    SharedCache->record(SearchDirSuffixes, SharedStartIdx, SearchDirs.size(),
+                        Filename);
+
   // If we are including a file with a quoted include "foo.h" from inside
   // a header in a framework that is currently being built, and we couldn't
   // resolve "foo.h" any other way, change the include to <Foo/foo.h>, where
@@ -873,6 +898,25 @@ const FileEntry *HeaderSearch::LookupFile(
   return nullptr;
 }
 
+void HeaderSearch::computeSearchDirSuffixes(
+    BruteClangHeaderLookupCache &Cache) {
+  if (SearchDirSuffixes.size() == SearchDirs.size())
+    return;
+
+  // Build the suffixes back to front. Anything but a plain directory ends the
+  // suffixes that can be shared: whether a header map or framework holds a
+  // file depends on more than the file's name.
+  SearchDirSuffixes.assign(SearchDirs.size(), nullptr);
+  const BruteClangHeaderLookupCache::Suffix *Next = nullptr;
+  for (unsigned i = SearchDirs.size(); i != 0; --i) {
+    const DirectoryLookup &Dir = SearchDirs[i - 1];
+    if (!Dir.isNormalDir())
+      break;
+    Next = Cache.getSuffix(Dir.getName(), Next);
+    SearchDirSuffixes[i - 1] = Next;
+  }
+}
+
 /// LookupSubframeworkHeader - Look up a subframework for the specified
 /// \#include file.  For example, if \#include'ing <HIToolbox/HIToolbox.h> from
 /// within ".../Carbon.framework/Headers/Carbon.h", check to see if HIToolbox
@@ -0,0 +1,366 @@
+//===--- LexerScan.cpp - Vector scanning of character runs ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Each kind of run is scanned by a loop per instruction set, classifying a
+// whole vector of characters at once into a mask of those ending the run.
+// SSE2 is part of x86-64, so its loops are used whenever clang was built
+// with it. The AVX2 and AVX-512 loops are built for those instruction sets
+// alone, and only used when the host CPU and OS support them. The loops
+// never load past the end of the range: its last few characters are
+// classified one at a time, or with a masked load for AVX-512.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/LexerScan.h"
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MathExtras.h"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+// Compilers that build functions for AVX2 and AVX-512 without enabling them
+// for the whole file.
+#if defined(__x86_64__) &&                                                     \
+    ((defined(__clang__) && __clang_major__ >= 4) ||                           \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6))
+#define LEXER_SCAN_DISPATCH 1
+#define LEXER_SCAN_TARGET(Features) __attribute__((target(Features)))
+#elif defined(_M_X64) && defined(_MSC_VER) && _MSC_VER >= 1910
+#define LEXER_SCAN_DISPATCH 1
+#define LEXER_SCAN_TARGET(Features)
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LEXER_SCAN_SSE2 1
+#endif
+
+#ifdef LEXER_SCAN_DISPATCH
+#include <immintrin.h>
+#elif defined(LEXER_SCAN_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace clang;
+
+namespace {
+
+enum ScanKind {
+  IdentifierBody,
+  HorizontalWhitespace,
+  LineCommentBody,
+  StringLiteralBody,
+  NumberBody
+};
+
+template <ScanKind Kind> inline bool continuesRun(unsigned char C) {
+  switch (Kind) {
+  case IdentifierBody:
+    return isIdentifierBody(C);
+  case HorizontalWhitespace:
+    return isHorizontalWhitespace(C);
+  case LineCommentBody:
+    return C != '\0' && C != '\n' && C != '\r';
+  case StringLiteralBody:
+    return C != '"' && C != '\\' && C != '?' && C != '\0' && C != '\n' &&
+           C != '\r';
+  case NumberBody:
+    return isPreprocessingNumberBody(C);
+  }
+  llvm_unreachable("unknown scan kind");
+}
+
+template <ScanKind Kind>
+inline const char *scanScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && continuesRun<Kind>(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+#ifdef LEXER_SCAN_SSE2
+
+/// The bytes of \p V in [\p Lo, \p Hi], for bounds in 0..127. Bytes from 128
+/// up compare as negative, and are never in range.
+inline __m128i inRangeSSE2(__m128i V, char Lo, char Hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(V, _mm_set1_epi8(Lo - 1)),
+                       _mm_cmplt_epi8(V, _mm_set1_epi8(Hi + 1)));
+}
+
+inline __m128i isSSE2(__m128i V, char C) {
+  return _mm_cmpeq_epi8(V, _mm_set1_epi8(C));
+}
+
+/// A mask of the bytes of \p V ending a run, bit I standing for byte I.
+template <ScanKind Kind> inline unsigned endsRunSSE2(__m128i V) {
+  __m128i Run, Ends;
+  switch (Kind) {
+  case IdentifierBody:
+  case NumberBody:
+    // Letters are the bytes in 'a'..'z' once lowered.
+    Run = _mm_or_si128(
+        inRangeSSE2(_mm_or_si128(V, _mm_set1_epi8(0x20)), 'a', 'z'),
+        _mm_or_si128(inRangeSSE2(V, '0', '9'), isSSE2(V, '_')));
+    if (Kind == NumberBody)
+      Run = _mm_or_si128(Run, isSSE2(V, '.'));
+    return ~_mm_movemask_epi8(Run) & 0xFFFF;
+  case HorizontalWhitespace:
+    Run = _mm_or_si128(_mm_or_si128(isSSE2(V, ' '), isSSE2(V, '\t')),
+                       inRangeSSE2(V, '\v', '\f'));
+    return ~_mm_movemask_epi8(Run) & 0xFFFF;
+  case LineCommentBody:
+    Ends = _mm_or_si128(_mm_or_si128(isSSE2(V, '\0'), isSSE2(V, '\n')),
+                        isSSE2(V, '\r'));
+    return _mm_movemask_epi8(Ends);
+  case StringLiteralBody:
+    Ends = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(isSSE2(V, '"'), isSSE2(V, '\\')),
+                     _mm_or_si128(isSSE2(V, '?'), isSSE2(V, '\0'))),
+        _mm_or_si128(isSSE2(V, '\n'), isSSE2(V, '\r')));
+    return _mm_movemask_epi8(Ends);
+  }
+  llvm_unreachable("unknown scan kind");
+}
+
+/// Whether runs of \p Kind are mostly shorter than a 16 byte vector, so that
+/// the first is best classified with SSE2 before trying a wider one.
+template <ScanKind Kind> constexpr bool hasShortRuns() {
+  return Kind == IdentifierBody || Kind == HorizontalWhitespace ||
+         Kind == NumberBody;
+}
+
+/// Classify the 16 bytes at \p Ptr, if there are as many before \p End.
+/// Returns true and sets \p Result if the run ends among them.
+template <ScanKind Kind>
+inline bool probeSSE2(const char *&Ptr, const char *End,
+                      const char *&Result) {
+  if (End - Ptr < 16)
+    return false;
+  __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+  if (unsigned Ends = endsRunSSE2<Kind>(V)) {
+    Result = Ptr + llvm::countTrailingZeros(Ends);
+    return true;
+  }
+  Ptr += 16;
+  return false;
+}
+
+template <ScanKind Kind>
+const char *scanSSE2(const char *Ptr, const char *End) {
+  while (End - Ptr >= 16) {
+    __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+    if (unsigned Ends = endsRunSSE2<Kind>(V))
+      return Ptr + llvm::countTrailingZeros(Ends);
+    Ptr += 16;
+  }
+  return scanScalar<Kind>(Ptr, End);
+}
+
+#endif // LEXER_SCAN_SSE2
+
+#ifdef LEXER_SCAN_DISPATCH
+
+LEXER_SCAN_TARGET("avx2")
+inline __m256i inRangeAVX2(__m256i V, char Lo, char Hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(V, _mm256_set1_epi8(Lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(Hi + 1), V));
+}
+
+LEXER_SCAN_TARGET("avx2") inline __m256i isAVX2(__m256i V, char C) {
+  return _mm256_cmpeq_epi8(V, _mm256_set1_epi8(C));
+}
+
+template <ScanKind Kind>
+LEXER_SCAN_TARGET("avx2") inline uint32_t endsRunAVX2(__m256i V) {
+  __m256i Run, Ends;
+  switch (Kind) {
+  case IdentifierBody:
+  case NumberBody:
+    Run = _mm256_or_si256(
+        inRangeAVX2(_mm256_or_si256(V, _mm256_set1_epi8(0x20)), 'a', 'z'),
+        _mm256_or_si256(inRangeAVX2(V, '0', '9'), isAVX2(V, '_')));
+    if (Kind == NumberBody)
+      Run = _mm256_or_si256(Run, isAVX2(V, '.'));
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(Run));
+  case HorizontalWhitespace:
+    Run = _mm256_or_si256(_mm256_or_si256(isAVX2(V, ' '), isAVX2(V, '\t')),
+                          inRangeAVX2(V, '\v', '\f'));
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(Run));
+  case LineCommentBody:
+    Ends = _mm256_or_si256(_mm256_or_si256(isAVX2(V, '\0'), isAVX2(V, '\n')),
+                           isAVX2(V, '\r'));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(Ends));
+  case StringLiteralBody:
+    Ends = _mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(isAVX2(V, '"'), isAVX2(V, '\\')),
+                        _mm256_or_si256(isAVX2(V, '?'), isAVX2(V, '\0'))),
+        _mm256_or_si256(isAVX2(V, '\n'), isAVX2(V, '\r')));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(Ends));
+  }
+  llvm_unreachable("unknown scan kind");
+}
+
+template <ScanKind Kind>
+LEXER_SCAN_TARGET("avx2")
+const char *scanAVX2(const char *Ptr, const char *End) {
+  const char *Result;
+  if (hasShortRuns<Kind>() && probeSSE2<Kind>(Ptr, End, Result))
+    return Result;
+  while (End - Ptr >= 32) {
+    __m256i V = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+    if (uint32_t Ends = endsRunAVX2<Kind>(V))
+      return Ptr + llvm::countTrailingZeros(Ends);
+    Ptr += 32;
+  }
+  return scanSSE2<Kind>(Ptr, End);
+}
+
+/// The bytes of \p V in [\p Lo, \p Hi], compared unsigned.
+LEXER_SCAN_TARGET("avx512f,avx512bw")
+inline __mmask64 inRangeAVX512(__m512i V, char Lo, char Hi) {
+  return _mm512_cmplt_epu8_mask(_mm512_sub_epi8(V, _mm512_set1_epi8(Lo)),
+                                _mm512_set1_epi8(Hi - Lo + 1));
+}
+
+LEXER_SCAN_TARGET("avx512f,avx512bw")
+inline __mmask64 isAVX512(__m512i V, char C) {
+  return _mm512_cmpeq_epi8_mask(V, _mm512_set1_epi8(C));
+}
+
+template <ScanKind Kind>
+LEXER_SCAN_TARGET("avx512f,avx512bw") inline uint64_t endsRunAVX512(__m512i V) {
+  uint64_t Run;
+  switch (Kind) {
+  case IdentifierBody:
+  case NumberBody:
+    Run = inRangeAVX512(_mm512_or_si512(V, _mm512_set1_epi8(0x20)), 'a', 'z') |
+          inRangeAVX512(V, '0', '9') | isAVX512(V, '_');
+    if (Kind == NumberBody)
+      Run |= isAVX512(V, '.');
+    return ~Run;
+  case HorizontalWhitespace:
+    return ~(isAVX512(V, ' ') | isAVX512(V, '\t') |
+             inRangeAVX512(V, '\v', '\f'));
+  case LineCommentBody:
+    return isAVX512(V, '\0') | isAVX512(V, '\n') | isAVX512(V, '\r');
+  case StringLiteralBody:
+    return isAVX512(V, '"') | isAVX512(V, '\\') | isAVX512(V, '?') |
+           isAVX512(V, '\0') | isAVX512(V, '\n') | isAVX512(V, '\r');
+  }
+  llvm_unreachable("unknown scan kind");
+}
+
+template <ScanKind Kind>
+LEXER_SCAN_TARGET("avx512f,avx512bw")
+const char *scanAVX512(const char *Ptr, const char *End) {
+  const char *Result;
+  if (hasShortRuns<Kind>() && probeSSE2<Kind>(Ptr, End, Result))
+    return Result;
+  while (End - Ptr >= 64) {
+    __m512i V = _mm512_loadu_si512(Ptr);
+    if (uint64_t Ends = endsRunAVX512<Kind>(V))
+      return Ptr + llvm::countTrailingZeros(Ends);
+    Ptr += 64;
+  }
+  if (Ptr == End)
+    return End;
+  // A masked load does not touch the bytes masked out, past End.
+  uint64_t Valid = ~uint64_t(0) >> (64 - (End - Ptr));
+  __m512i V = _mm512_maskz_loadu_epi8(Valid, Ptr);
+  if (uint64_t Ends = endsRunAVX512<Kind>(V) & Valid)
+    return Ptr + llvm::countTrailingZeros(Ends);
+  return End;
+}
+
+#endif // LEXER_SCAN_DISPATCH
+
+LexerScanLevel detectHostLevel() {
+#ifdef LEXER_SCAN_DISPATCH
+  // The host's features include whether the OS saves the vector registers.
+  llvm::StringMap<bool> Features;
+  if (llvm::sys::getHostCPUFeatures(Features)) {
+    if (Features.lookup("avx512f") && Features.lookup("avx512bw"))
+      return LexerScanLevel::AVX512;
+    if (Features.lookup("avx2"))
+      return LexerScanLevel::AVX2;
+  }
+#endif
+#ifdef LEXER_SCAN_SSE2
+  return LexerScanLevel::SSE2;
+#else
+  return LexerScanLevel::Scalar;
+#endif
+}
+
+/// The level in use, or -1 until it is first asked for. Lexers on several
+/// threads may all detect it; they store the same value.
+std::atomic<int> CurrentLevel(-1);
+
+template <ScanKind Kind>
+inline const char *scan(const char *Ptr, const char *End) {
+  assert(Ptr <= End && "scanning from past the end");
+  switch (getLexerScanLevel()) {
+#ifdef LEXER_SCAN_DISPATCH
+  case LexerScanLevel::AVX512:
+    return scanAVX512<Kind>(Ptr, End);
+  case LexerScanLevel::AVX2:
+    return scanAVX2<Kind>(Ptr, End);
+#endif
+#ifdef LEXER_SCAN_SSE2
+  case LexerScanLevel::SSE2:
+    return scanSSE2<Kind>(Ptr, End);
+#endif
+  default:
+    return scanScalar<Kind>(Ptr, End);
+  }
+}
+
+} // end anonymous namespace
+
+LexerScanLevel clang::getHostLexerScanLevel() {
+  static const LexerScanLevel Host = detectHostLevel();
+  return Host;
+}
+
+LexerScanLevel clang::getLexerScanLevel() {
+  int Level = CurrentLevel.load(std::memory_order_relaxed);
+  if (LLVM_UNLIKELY(Level < 0)) {
+    Level = static_cast<int>(getHostLexerScanLevel());
+    CurrentLevel.store(Level, std::memory_order_relaxed);
+  }
+  return static_cast<LexerScanLevel>(Level);
+}
+
+void clang::setLexerScanLevel(LexerScanLevel Level) {
+  assert(Level <= getHostLexerScanLevel() && "level not supported by host");
+  CurrentLevel.store(static_cast<int>(Level), std::memory_order_relaxed);
+}
+
+const char *clang::scanIdentifierBody(const char *Ptr, const char *End) {
+  return scan<IdentifierBody>(Ptr, End);
+}
+
+const char *clang::scanHorizontalWhitespace(const char *Ptr,
+                                            const char *End) {
+  return scan<HorizontalWhitespace>(Ptr, End);
+}
+
+const char *clang::scanLineCommentBody(const char *Ptr, const char *End) {
+  return scan<LineCommentBody>(Ptr, End);
+}
+
+const char *clang::scanStringLiteralBody(const char *Ptr, const char *End) {
+  return scan<StringLiteralBody>(Ptr, End);
+}
+
+const char *clang::scanNumberBody(const char *Ptr, const char *End) {
+  return scan<NumberBody>(Ptr, End);
+}
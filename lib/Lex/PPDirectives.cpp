@@ -12,6 +12,7 @@
 ///
 //===----------------------------------------------------------------------===//
 
+#include "clang/Basic/BruteClangPhaseTimer.h"
 #include "clang/Basic/CharInfo.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/IdentifierTable.h"
@@ -20,6 +21,7 @@
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TokenKinds.h"
+#include "clang/Lex/BruteClangConditionalScan.h"
 #include "clang/Lex/CodeCompletionHandler.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/LexDiagnostic.h"
@@ -364,6 +366,12 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
     return;
   }
 
+  // If the end of the block is known, there is nothing to lex up to it.
+  const BruteClangConditionalBlocks *Blocks = getConditionalBlocks();
+  if (Blocks)
+    jumpOverConditionalBlock(*Blocks,
+                             ElseLoc.isValid() ? ElseLoc : IfTokenLoc);
+
   // Enter raw mode to disable identifier lookup (and thus macro expansion),
   // disabling warnings, etc.
   CurPPLexer->LexingRawMode = true;
@@ -512,6 +520,8 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
           break;
         } else {
           DiscardUntilEndOfDirective();  // C99 6.10p4.
+          if (Blocks && !CondInfo.WasSkipping)
+            jumpOverConditionalBlock(*Blocks, Tok.getLocation());
         }
       } else if (Sub == "lif") {  // "elif".
         PPConditionalInfo &CondInfo = CurPPLexer->peekConditionalLevel();
@@ -523,6 +533,8 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
         // block, don't bother parsing the condition.
         if (CondInfo.WasSkipping || CondInfo.FoundNonSkip) {
           DiscardUntilEndOfDirective();
+          if (Blocks && !CondInfo.WasSkipping)
+            jumpOverConditionalBlock(*Blocks, Tok.getLocation());
         } else {
           const SourceLocation CondBegin = CurPPLexer->getSourceLocation();
           // Restore the value of LexingRawMode so that identifiers are
@@ -543,6 +555,8 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
             CondInfo.FoundNonSkip = true;
             break;
           }
+          if (Blocks)
+            jumpOverConditionalBlock(*Blocks, Tok.getLocation());
         }
       }
     }
@@ -563,6 +577,48 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
   }
 }
 
+const BruteClangConditionalBlocks *Preprocessor::getConditionalBlocks() {
+  BruteClangConditionalScan *Scan = PPOpts->ConditionalScan.get();
+  // The lexer must see the code completion point, wherever it is.
+  if (!Scan || !CurLexer || isCodeCompletionEnabled())
+    return nullptr;
+
+  FileID FID = CurLexer->getFileID();
+  auto Known = ConditionalBlocks.find(FID);
+  if (Known != ConditionalBlocks.end())
+    return Known->second;
+
+  // Only files read from disk are shared with the other instances; the
+  // contents of an overridden file may differ from one instance to the next.
+  const BruteClangConditionalBlocks *Blocks = nullptr;
+  StringRef Buffer = CurLexer->getBuffer();
+  const FileEntry *File = SourceMgr.getFileEntryForID(FID);
+  if (File && !SourceMgr.isFileOverridden(File) &&
+      Buffer.size() == (uint64_t)File->getSize())
+    Blocks = &Scan->getBlocks(File->getName(), Buffer, getLangOpts());
+  ConditionalBlocks[FID] = Blocks;
+  return Blocks;
+}
+
+void Preprocessor::jumpOverConditionalBlock(
+    const BruteClangConditionalBlocks &Blocks, SourceLocation DirectiveLoc) {
+  SourceLocation FileLoc = CurLexer->getFileLoc();
+  if (!DirectiveLoc.isFileID() || DirectiveLoc < FileLoc)
+    return;
+  StringRef Buffer = CurLexer->getBuffer();
+  unsigned Offset = DirectiveLoc.getRawEncoding() - FileLoc.getRawEncoding();
+  if (Offset >= Buffer.size())
+    return;
+
+  // The directive itself has been lexed; only ever jump forward.
+  unsigned End = Blocks.getEnd(Offset);
+  unsigned Current = CurLexer->getBufferLocation() - Buffer.data();
+  if (End <= Current)
+    return;
+  CurLexer->seek(End, /*IsAtStartOfLine*/true);
+  PPOpts->ConditionalScan->noteJump(End - Current);
+}
+
 void Preprocessor::PTHSkipExcludedConditionalBlock() {
   while (true) {
     assert(CurPTHLexer);
@@ -872,6 +928,10 @@ private:
 void Preprocessor::HandleDirective(Token &Result) {
   // FIXME: Traditional: # with whitespace before it not recognized by K&R?
 
+  // Time the directive, including skipping the block it excludes and finding
+  // the file it includes, but not lexing that file.
+  BruteClangPhaseRegion DirectiveTiming(PPOpts->DirectiveTimer.get());
+
   // We just parsed a # character at the start of a line, so we're in directive
   // mode.  Tell the lexer this so any newlines we see will be converted into an
   // EOD token (which terminates the directive).
@@ -1423,9 +1423,14 @@ static bool EvaluateHasIncludeCommon(Token &Tok,
 
   // Search include directories.
   const DirectoryLookup *CurDir;
+  SmallString<128> SearchPath;
   const FileEntry *File =
       PP.LookupFile(FilenameLoc, Filename, isAngled, LookupFrom, LookupFromFile,
-                    CurDir, nullptr, nullptr, nullptr, nullptr);
+                    CurDir, &SearchPath, nullptr, nullptr, nullptr);
+
+  if (PPCallbacks *Callbacks = PP.getPPCallbacks())
+    Callbacks->HasInclude(FilenameLoc, Filename, isAngled, LookupFrom, File,
+                          SearchPath);
 
   // Get the result value.  A result of true means the file exists.
   return File != nullptr;
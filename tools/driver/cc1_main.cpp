@@ -21,28 +21,53 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Basic/BruteClangDiagnostic.h" //access the functionality of BruteClangDiagnostic classes
+#include "clang/Basic/BruteClangFileSystem.h"
+#include "clang/Basic/BruteClangManifest.h"
+#include "clang/Basic/BruteClangProcessPool.h"
+#include "clang/Basic/BruteClangWorkPool.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Frontend/BruteClangCacheFile.h"
+#include "clang/Frontend/BruteClangDeclFingerprint.h"
+#include "clang/Frontend/BruteClangDiagnosticOutput.h"
+#include "clang/Frontend/BruteClangJobTimes.h"
+#include "clang/Frontend/BruteClangPCHCache.h"
+#include "clang/Frontend/BruteClangResultCache.h"
+#include "clang/Frontend/BruteClangTokenFingerprint.h"
+#include "clang/Frontend/BruteClangVariantProfile.h"
+#include "clang/Frontend/BruteClangVariantSensitivity.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/TextDiagnosticBuffer.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/Utils.h"
 #include "clang/FrontendTool/Utils.h"
+#include "clang/Lex/BruteClangConditionalScan.h"
+#include "clang/Lex/BruteClangHeaderLookupCache.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/LinkAllPasses.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/OptTable.h"
 #include "llvm/Support/Compiler.h"
+#include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdio>
-#include <fstream>
-#include <list>
-#include <set>
-#include <iterator>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #ifdef CLANG_HAVE_RLIMITS
 #include <sys/resource.h>
@@ -55,11 +80,26 @@ using namespace llvm::opt;
 // Main driver
 //===----------------------------------------------------------------------===//
 
+// LLVM only has one process-wide fatal error handler, but BruteClang may run
+// several compiler instances at once, one per thread. The handler is installed
+// once by cc1_main and reports to the diagnostics of whichever compiler
+// instance is running on the faulting thread.
+static LLVM_THREAD_LOCAL DiagnosticsEngine *CurrentThreadDiags = nullptr;
+
+// In a child process running one compiler instance (-brute-fork), sends the
+// diagnostics of the instance to the parent. The handler calls it before
+// exiting, so the parent gets the fatal error too.
+static std::function<void()> WriteForkedResult;
+
 static void LLVMErrorHandler(void *UserData, const std::string &Message,
                              bool GenCrashDiag) {
-  DiagnosticsEngine &Diags = *static_cast<DiagnosticsEngine*>(UserData);
+  if (DiagnosticsEngine *Diags = CurrentThreadDiags)
+    Diags->Report(diag::err_fe_error_backend) << Message;
+  else
+    llvm::errs() << "error: " << Message << "\n";
 
-  Diags.Report(diag::err_fe_error_backend) << Message;
+  if (WriteForkedResult)
+    WriteForkedResult();
 
   // Run the interrupt handlers to make sure any special cleanups get done, in
   // particular that we remove files registered with RemoveFileOnSignal.
@@ -173,33 +213,521 @@ static void ensureSufficientStack() {
 static void ensureSufficientStack() {}
 #endif
 
-bool isInFileList(std::string configFile, std::string &fileName){ 
-//this function checks if fileName exists in the configFile
-  std::ifstream CFStream;
-  CFStream.open(configFile);
+/// Options understood by BruteClang itself. They are stripped from the
+/// command line before it is handed to the compiler instances.
+struct BruteClangOptions {
+  /// Number of variants to run concurrently (-variant-jobs=N). 0 means one
+  /// per hardware thread.
+  unsigned VariantJobs = 1;
+
+  /// Analyze every file in this list instead of the input file
+  /// (-brute-batch=<filelist>).
+  std::string BatchFileList;
+
+  /// Precompiled manifest to read the file lists and variant arguments from
+  /// (-brute-manifest=<file>). If empty, the config files in the current
+  /// directory are read instead.
+  std::string ManifestPath;
+
+  /// Compile the config files in the current directory into this manifest
+  /// and exit (-brute-compile-manifest=<file>).
+  std::string CompileManifestPath;
+
+  /// Also write the grouped diagnostics of each file to this file as it is
+  /// printed, as a structured report (-brute-diag-output=<file>).
+  std::string DiagOutputPath;
+
+  /// Merge the structured reports given as inputs into this file and exit
+  /// (-brute-merge-diagnostics=<file>).
+  std::string MergeDiagnosticsPath;
+
+  /// The format of the structured reports written
+  /// (-brute-diag-format=jsonl|dia).
+  BruteClangDiagnosticWriter::OutputFormat DiagOutputFormat = BruteClangDiagnosticWriter::JSONLines;
+
+  /// Print the diagnostics located in headers once for the whole run, with
+  /// the files that reported them, rather than with each file
+  /// (-brute-dedup-headers).
+  bool DedupHeaderDiagnostics = false;
+
+  /// Run each variant in a child process forked from this one, so a crash
+  /// only loses that variant (-brute-fork).
+  bool ForkVariants = false;
+
+  /// Append the time and memory each file and variant took to this file, one
+  /// JSON object per line (-brute-profile=<file>).
+  std::string ProfilePath;
+
+  /// Start the jobs longest first, by the times they took in earlier runs
+  /// as kept in this file, and record their times in it
+  /// (-brute-job-times=<file>).
+  std::string JobTimesPath;
+
+  /// Print how many stats, reads and header search probes the shared files
+  /// saved (-brute-fs-stats).
+  bool PrintFileSystemStats = false;
+
+  /// Precompile the leading include blocks of the files into this directory
+  /// and load them from there (-brute-pch-cache=<dir>).
+  std::string PCHCacheDir;
+
+  /// Keep the diagnostics of every file and variant in this directory and
+  /// replay them while nothing they were computed from changes
+  /// (-brute-result-cache=<dir>).
+  std::string ResultCacheDir;
 
-  std::set<std::string> FileSet;
+  /// Analyze only one of the variants preprocessing a file to the same tokens
+  /// and report its diagnostics for all of them (-brute-skip-identical).
+  bool SkipIdenticalVariants = false;
 
-  //copy contents of the config file into a set
-  std::copy(std::istream_iterator<std::string>(CFStream),
-            std::istream_iterator<std::string>(),
-            std::inserter(FileSet, FileSet.end()));
+  /// Analyze only one of the variants agreeing on the macros a file queries
+  /// and on the files its #include directives find, and report its
+  /// diagnostics for all of them (-brute-skip-insensitive).
+  bool SkipInsensitiveVariants = false;
 
-  std::set<std::string>::iterator it;
-  it = FileSet.find(fileName);
-  if (it == FileSet.end()){
+  /// Have the plugins check each declaration once for all the variants of
+  /// a file that parse it the same, and report what they reported for it
+  /// for all of them (-brute-dedup-decls).
+  bool DedupDecls = false;
+
+  /// Analyze only a sample of each file's variants, such that every
+  /// combination of values of any N axes is analyzed in some variant
+  /// (-brute-sample[=N], pairwise by default). 0 analyzes every variant.
+  unsigned SampleStrength = 0;
+
+  /// Analyze the variants left out of a file's sample too if the sampled
+  /// variants do not all report the same diagnostics
+  /// (-brute-sample-escalate).
+  bool EscalateSamples = false;
+};
+
+/// Split BruteClang's own options out of \p Argv. Everything else is copied
+/// into \p ForwardedArgv. Returns false on a malformed option.
+static bool ParseBruteClangArgs(ArrayRef<const char *> Argv,
+                                BruteClangOptions &Opts,
+                                SmallVectorImpl<const char *> &ForwardedArgv) {
+  bool HasLLVMArgs = false;
+  for (const char *Arg : Argv) {
+    StringRef A(Arg);
+    if (A.startswith("-variant-jobs=")) {
+      if (A.substr(strlen("-variant-jobs=")).getAsInteger(10, Opts.VariantJobs)) {
+        llvm::errs() << "error: invalid value in '" << A << "'\n";
+        return false;
+      }
+      continue;
+    }
+    if (A.startswith("-brute-manifest=")) {
+      Opts.ManifestPath = A.substr(strlen("-brute-manifest="));
+      continue;
+    }
+    if (A.startswith("-brute-batch=")) {
+      Opts.BatchFileList = A.substr(strlen("-brute-batch="));
+      continue;
+    }
+    if (A.startswith("-brute-compile-manifest=")) {
+      Opts.CompileManifestPath = A.substr(strlen("-brute-compile-manifest="));
+      continue;
+    }
+    if (A.startswith("-brute-diag-output=")) {
+      Opts.DiagOutputPath = A.substr(strlen("-brute-diag-output="));
+      continue;
+    }
+    if (A.startswith("-brute-merge-diagnostics=")) {
+      Opts.MergeDiagnosticsPath = A.substr(strlen("-brute-merge-diagnostics="));
+      continue;
+    }
+    if (A.startswith("-brute-diag-format=")) {
+      if (!BruteClangDiagnosticWriter::parseFormat(A.substr(strlen("-brute-diag-format=")), Opts.DiagOutputFormat)) {
+        llvm::errs() << "error: invalid value in '" << A << "'\n";
+        return false;
+      }
+      continue;
+    }
+    if (A.startswith("-brute-pch-cache=")) {
+      Opts.PCHCacheDir = A.substr(strlen("-brute-pch-cache="));
+      continue;
+    }
+    if (A.startswith("-brute-profile=")) {
+      Opts.ProfilePath = A.substr(strlen("-brute-profile="));
+      continue;
+    }
+    if (A.startswith("-brute-job-times=")) {
+      Opts.JobTimesPath = A.substr(strlen("-brute-job-times="));
+      continue;
+    }
+    if (A.startswith("-brute-result-cache=")) {
+      Opts.ResultCacheDir = A.substr(strlen("-brute-result-cache="));
+      continue;
+    }
+    if (A == "-brute-skip-identical") {
+      Opts.SkipIdenticalVariants = true;
+      continue;
+    }
+    if (A == "-brute-skip-insensitive") {
+      Opts.SkipInsensitiveVariants = true;
+      continue;
+    }
+    if (A == "-brute-dedup-decls") {
+      Opts.DedupDecls = true;
+      continue;
+    }
+    if (A == "-brute-sample") {
+      Opts.SampleStrength = 2;
+      continue;
+    }
+    if (A.startswith("-brute-sample=")) {
+      if (A.substr(strlen("-brute-sample=")).getAsInteger(10, Opts.SampleStrength) ||
+          Opts.SampleStrength == 0) {
+        llvm::errs() << "error: invalid value in '" << A << "'\n";
+        return false;
+      }
+      continue;
+    }
+    if (A == "-brute-sample-escalate") {
+      Opts.EscalateSamples = true;
+      continue;
+    }
+    if (A == "-brute-fork") {
+      Opts.ForkVariants = true;
+      continue;
+    }
+    if (A == "-brute-dedup-headers") {
+      Opts.DedupHeaderDiagnostics = true;
+      continue;
+    }
+    if (A == "-brute-fs-stats") {
+      Opts.PrintFileSystemStats = true;
+      continue;
+    }
+    if (A == "-mllvm")
+      HasLLVMArgs = true;
+    ForwardedArgv.push_back(Arg);
+  }
+
+  if (Opts.VariantJobs == 0)
+    Opts.VariantJobs = std::max(1u, std::thread::hardware_concurrency());
+
+  // Every compiler instance hands its -mllvm options to
+  // llvm::cl::ParseCommandLineOptions, which is not thread-safe. Forked
+  // children each have their own copy of the options.
+  if (HasLLVMArgs && !Opts.ForkVariants)
+    Opts.VariantJobs = 1;
+  return true;
+}
+
+/// Compile the config files in the current directory into a manifest at
+/// \p Path. The manifest is written to a temporary file first, so processes
+/// reading an older manifest at \p Path never see a partial file.
+static bool CompileManifest(StringRef Path) {
+  SmallString<128> TempPath;
+  int FD;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", FD, TempPath)) {
+    llvm::errs() << "error: unable to create '" << TempPath << "': " << EC.message() << "\n";
     return false;
   }
-  else{
-    return true;
+
+  std::string Error;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    if (!BruteClangManifest::compileConfigs(*vfs::getRealFileSystem(), ".", OS, Error)) {
+      OS.close();
+      llvm::sys::fs::remove(TempPath);
+      llvm::errs() << "error: " << Error << "\n";
+      return false;
+    }
+  }
+
+  if (std::error_code EC = llvm::sys::fs::rename(TempPath, Path)) {
+    llvm::sys::fs::remove(TempPath);
+    llvm::errs() << "error: unable to write '" << Path << "': " << EC.message() << "\n";
+    return false;
   }
+  return true;
 }
 
-void ExecuteCI(std::string platform, frontend::IncludeDirGroup Group, CustomDiagContainer &DiagContainer, ArrayRef<const char *> Argv, const char *Argv0, void *MainAddr){
-  std::string current_CI;
-  current_CI = platform;
-  DiagContainer.SetCompilerInstanceName(current_CI);
-  
+/// Merge the structured reports \p Inputs into one at \p Path. Diagnostics
+/// several reports hold are reported once, by the variants of all of them.
+static bool MergeDiagnosticReports(ArrayRef<std::string> Inputs, StringRef Path, BruteClangDiagnosticWriter::OutputFormat Format) {
+  BruteClangDiagnosticMerger Merger;
+  for (const std::string &Input : Inputs) {
+    auto Buffer = llvm::MemoryBuffer::getFileOrSTDIN(Input);
+    if (!Buffer) {
+      llvm::errs() << "error: unable to read '" << Input << "': " << Buffer.getError().message() << "\n";
+      return false;
+    }
+    std::string Error;
+    if (!BruteClangDiagnosticWriter::read((*Buffer)->getBuffer(), Merger, Error)) {
+      llvm::errs() << "error: " << Input << ": " << Error << "\n";
+      return false;
+    }
+  }
+
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    llvm::errs() << "error: unable to open '" << Path << "': " << EC.message() << "\n";
+    return false;
+  }
+  Merger.emit(*BruteClangDiagnosticWriter::create(Format, OS));
+  return true;
+}
+
+/// The files shared by every compiler instance of a run: a file system that
+/// stats and reads each path once, one FileManager over it per worker thread,
+/// the results of header searches and where the conditional blocks of each
+/// file end. A FileManager is not thread-safe, but
+/// the instances of one thread run one after the other and can reuse the same
+/// one, as ASTUnit does across reparses.
+class BruteClangSharedFiles {
+  IntrusiveRefCntPtr<BruteClangFileSystem> FS;
+  std::shared_ptr<BruteClangHeaderLookupCache> HeaderLookups;
+  std::shared_ptr<BruteClangConditionalScan> ConditionalBlocks;
+
+  /// Keeps the FileManager of every worker alive until the end of the run.
+  std::mutex Lock;
+  std::vector<IntrusiveRefCntPtr<FileManager>> FileManagers;
+
+  static LLVM_THREAD_LOCAL FileManager *ThreadFileManager;
+
+public:
+  BruteClangSharedFiles()
+      : FS(new BruteClangFileSystem(vfs::getRealFileSystem())),
+        HeaderLookups(std::make_shared<BruteClangHeaderLookupCache>()),
+        ConditionalBlocks(std::make_shared<BruteClangConditionalScan>()) {}
+
+  /// Make \p Clang use the shared files, unless its invocation asks for a
+  /// file system of its own.
+  void setUp(CompilerInstance &Clang) {
+    if (!Clang.getHeaderSearchOpts().VFSOverlayFiles.empty())
+      return;
+
+    FileManager *FileMgr = ThreadFileManager;
+    if (!FileMgr ||
+        FileMgr->getFileSystemOpts().WorkingDir != Clang.getFileSystemOpts().WorkingDir){
+      FileMgr = new FileManager(Clang.getFileSystemOpts(), FS);
+      std::lock_guard<std::mutex> Guard(Lock);
+      FileManagers.push_back(FileMgr);
+      ThreadFileManager = FileMgr;
+    }
+    Clang.setFileManager(FileMgr);
+    Clang.getHeaderSearchOpts().SharedLookupCache = HeaderLookups;
+    Clang.getPreprocessorOpts().ConditionalScan = ConditionalBlocks;
+  }
+
+  IntrusiveRefCntPtr<vfs::FileSystem> getFileSystem() const { return FS; }
+
+  void printStatistics(raw_ostream &OS) const {
+    FS->printStatistics(OS);
+    HeaderLookups->printStatistics(OS);
+    ConditionalBlocks->printStatistics(OS);
+  }
+};
+
+LLVM_THREAD_LOCAL FileManager *BruteClangSharedFiles::ThreadFileManager = nullptr;
+
+/// Finds the variants of one file that need not be analyzed, because another
+/// variant reports exactly what they would.
+class BruteClangEquivalentVariants {
+  std::mutex Lock;
+
+  /// The analyzed variants by the fingerprint of the tokens they preprocess
+  /// the file to.
+  llvm::StringMap<unsigned> FingerprintLeaders;
+
+  /// What the analyzed variants depended on, with their compiler instance.
+  std::vector<std::pair<unsigned, std::shared_ptr<const BruteClangVariantSensitivity>>> Sensitivities;
+
+public:
+  /// Compare the fingerprints of the preprocessed tokens
+  /// (-brute-skip-identical).
+  bool CompareFingerprints = false;
+
+  /// Compare what the variants depend on among these macros and the include
+  /// paths (-brute-skip-insensitive), or null.
+  const llvm::StringSet<> *WatchedMacros = nullptr;
+
+  /// The number of variants skipped in the whole run, by either comparison.
+  static std::atomic<unsigned> NumSkippedInsensitive, NumSkippedIdentical;
+
+  bool isEnabled() const { return CompareFingerprints || WatchedMacros; }
+
+  /// Find an analyzed compiler instance reporting what \p Clang, which must
+  /// have its invocation and file manager set up, would. Returns \p CI_ID,
+  /// claiming the fingerprint of \p Clang, if there is none.
+  unsigned findLeader(CompilerInstance &Clang, unsigned CI_ID) {
+    if (WatchedMacros){
+      std::vector<std::pair<unsigned, std::shared_ptr<const BruteClangVariantSensitivity>>> Known;
+      {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Known = Sensitivities;
+      }
+      for (const auto &Leader : Known){
+        if (Leader.second->matches(Clang)){
+          ++NumSkippedInsensitive;
+          return Leader.first;
+        }
+      }
+    }
+
+    std::string Fingerprint;
+    if (CompareFingerprints && computeTokenFingerprint(Clang, Fingerprint)){
+      std::lock_guard<std::mutex> Guard(Lock);
+      unsigned LeaderID = FingerprintLeaders.insert(std::make_pair(Fingerprint, CI_ID)).first->second;
+      if (LeaderID != CI_ID)
+        ++NumSkippedIdentical;
+      return LeaderID;
+    }
+    return CI_ID;
+  }
+
+  /// Start recording what the analyzed compiler instance \p Clang depends
+  /// on. Returns null if that is not compared.
+  std::shared_ptr<BruteClangVariantSensitivity> recordSensitivity(CompilerInstance &Clang) {
+    if (!WatchedMacros)
+      return nullptr;
+    auto Sensitivity = std::make_shared<BruteClangVariantSensitivity>(*WatchedMacros, Clang.getPreprocessorOpts());
+    Clang.addDependencyCollector(Sensitivity->createRecorder());
+    return Sensitivity;
+  }
+
+  /// Compare the variants still to come with the finished compiler instance
+  /// \p CI_ID too.
+  void addSensitivity(unsigned CI_ID, std::shared_ptr<const BruteClangVariantSensitivity> Sensitivity) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Sensitivities.push_back(std::make_pair(CI_ID, std::move(Sensitivity)));
+  }
+};
+
+std::atomic<unsigned> BruteClangEquivalentVariants::NumSkippedInsensitive{0};
+std::atomic<unsigned> BruteClangEquivalentVariants::NumSkippedIdentical{0};
+
+/// Finish \p Profile, of a variant dealt with as \p Outcome since \p Start,
+/// and write it to \p ProfileLog.
+static void writeProfile(BruteClangProfileLog &ProfileLog, BruteClangVariantProfile &Profile, BruteClangVariantProfile::OutcomeKind Outcome, const BruteClangPhaseTime &Start){
+  Profile.Outcome = Outcome;
+  Profile.Total = BruteClangPhaseTime::now();
+  Profile.Total -= Start;
+  ProfileLog.write(Profile);
+}
+
+/// A source file being analyzed, with the grouped diagnostics of its variants.
+struct BruteClangFile {
+  std::string Name;
+
+  /// False if the file is not in any file list.
+  bool Known = false;
+
+  /// How much there is to analyze in the file, to estimate the time of its
+  /// variants from (-brute-job-times). See BruteClangJobTimes::getFileCost.
+  double Cost = 0;
+
+  /// The variants to analyze the file for, and the ID of each variant's
+  /// compiler instance in DiagContainer.
+  std::vector<unsigned> VariantIDs, CI_IDs;
+
+  /// The variants of the file left out of its sample (-brute-sample), and
+  /// how many were sampled: those come first in VariantIDs.
+  VariantMask Unsampled;
+  unsigned NumSampled = 0;
+
+  /// The sample, as printed with the diagnostics.
+  std::string SampleDescription;
+
+  /// Whether the unsampled variants are to be analyzed if the sampled ones
+  /// disagree (-brute-sample-escalate), and whether they were.
+  bool EscalateSample = false;
+  bool Escalated = false;
+
+  /// Sampled variants that have not finished yet, if EscalateSample.
+  std::atomic<unsigned> SampledRemaining{0};
+
+  /// The command line of this file's compiler instances.
+  std::vector<const char *> Argv;
+
+  /// The leading includes to load precompiled (-brute-pch-cache).
+  std::vector<BruteClangPCHCache::IncludeDirective> PCHIncludes;
+
+  /// The variants analyzed so far (-brute-skip-identical,
+  /// -brute-skip-insensitive).
+  BruteClangEquivalentVariants Equivalents;
+
+  /// The declarations the plugins checked for the variants so far
+  /// (-brute-dedup-decls).
+  BruteClangCheckedDecls CheckedDecls;
+
+  CustomDiagContainer DiagContainer;
+
+  /// Variants that have not finished yet.
+  std::atomic<unsigned> Remaining{0};
+};
+
+/// The state shared by every compiler instance of a run, set up once in
+/// cc1_main.
+struct BruteClangRun {
+  const BruteClangManifest &Manifest;
+  /// Where the -I arguments of the variants go.
+  frontend::IncludeDirGroup Group;
+  BruteClangSharedFiles &SharedFiles;
+  BruteClangPCHCache *PCHCache;
+  BruteClangResultCache *ResultCache;
+  BruteClangProfileLog *ProfileLog;
+  /// Whether the instances see each other's results, to skip the variants
+  /// equivalent to an analyzed one (-brute-skip-identical,
+  /// -brute-skip-insensitive) and the declarations checked for another
+  /// variant (-brute-dedup-decls). Forked children do not.
+  bool ShareResults;
+  bool DedupDecls;
+  /// Where to find the builtin headers from.
+  const char *Argv0;
+  void *MainAddr;
+};
+
+/// Analyze \p Variant of \p File as compiler instance \p CI_ID.
+///
+/// \returns whether an instance ran, or the variant was replayed from the
+/// result cache or skipped as equivalent to another.
+BruteClangVariantProfile::OutcomeKind ExecuteCI(const BruteClangRun &Run,
+                                                BruteClangFile &File,
+                                                unsigned Variant,
+                                                unsigned CI_ID) {
+  const BruteClangManifest &Manifest = Run.Manifest;
+  CustomDiagContainer &DiagContainer = File.DiagContainer;
+  ArrayRef<const char *> Argv = File.Argv;
+  BruteClangProfileLog *ProfileLog = Run.ProfileLog;
+  BruteClangResultCache *ResultCache = Run.ResultCache;
+  BruteClangEquivalentVariants *Equivalents =
+      Run.ShareResults && File.Equivalents.isEnabled() ? &File.Equivalents
+                                                       : nullptr;
+  BruteClangCheckedDecls *CheckedDecls =
+      Run.ShareResults && Run.DedupDecls ? &File.CheckedDecls : nullptr;
+
+  std::shared_ptr<BruteClangVariantProfile> Profile;
+  BruteClangPhaseTime Start;
+  if (ProfileLog){
+    Start = BruteClangPhaseTime::now();
+    Profile = std::make_shared<BruteClangVariantProfile>();
+    Profile->FileName = Argv.back(); //the input file
+    Profile->VariantName = Manifest.getVariantName(Variant);
+  }
+
+  SmallVector<BruteClangVariantArg, 64> VariantArgs;
+  Manifest.getVariantArgs(Variant, VariantArgs);
+
+  //replay the diagnostics of an earlier run if nothing they were computed
+  //from has changed
+  std::string ResultKey;
+  if (ResultCache){
+    ResultKey = ResultCache->getKey(Argv, VariantArgs);
+    std::vector<CustomDiagContainer::RecordedDiagnostic> Cached;
+    if (ResultCache->lookup(ResultKey, Cached)){
+      for (const CustomDiagContainer::RecordedDiagnostic &Diag : Cached)
+        DiagContainer.AddDiagnostic(CI_ID, Diag.FileName, Diag.ColumnNumber, Diag.LineNumber, Diag.msg, Diag.DiagID);
+      if (Profile)
+        writeProfile(*ProfileLog, *Profile, BruteClangVariantProfile::Replayed, Start);
+      return BruteClangVariantProfile::Replayed;
+    }
+  }
+
   std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
   IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
 
@@ -221,55 +749,309 @@ void ExecuteCI(std::string platform, frontend::IncludeDirGroup Group, CustomDiag
   if (Clang->getHeaderSearchOpts().UseBuiltinIncludes &&
       Clang->getHeaderSearchOpts().ResourceDir.empty())
       Clang->getHeaderSearchOpts().ResourceDir =
-      CompilerInvocation::GetResourcesPath(Argv0, MainAddr);
-  
+      CompilerInvocation::GetResourcesPath(Run.Argv0, Run.MainAddr);
+
+  //the driver passes -disable-free, which leaks the AST, Sema and
+  //Preprocessor of every instance; a run has thousands of them
+  Clang->getFrontendOpts().DisableFree = false;
 
   Clang->createDiagnostics();
   
-  std::string input_string;
-  std::ifstream config;
-  current_CI.append(".config");
-  config.open(current_CI);
-
-  while (1){
-    config >> input_string;
-    if(input_string.front() == '-'){
-      input_string.erase(input_string.begin()); //remove '-'
-      if (input_string.front() == 'I'){ //handle includes
-        input_string.pop_back(); //remove single quote ['] at the back
-        input_string.erase(input_string.begin(), input_string.begin()+2); //remove I and single quote [']
-        Clang->getHeaderSearchOpts().AddPath(input_string, Group, false, true);
-      }
-      else if(input_string.front() == 'D'){ //handle macrodefs
-        input_string.erase(input_string.begin()); //remove D
-        //invokes new AssignMacroDef function
-        CompilerInvocation::AssignMacroDef(Clang->getInvocation() , llvm::StringRef(input_string));
-      }
+  //add the -I and -D arguments of this variant
+  for (const BruteClangVariantArg &Arg : VariantArgs){
+    if (Arg.Kind == BruteClangVariantArg::Include){ //handle includes
+      Clang->getHeaderSearchOpts().AddPath(Arg.Value, Run.Group, false, true);
     }
-    if (config.eof()){
-      break;
+    else if (Arg.Kind == BruteClangVariantArg::Define){ //handle macrodefs
+      //invokes new AssignMacroDef function
+      CompilerInvocation::AssignMacroDef(Clang->getInvocation(), Arg.Value);
     }
   }
-  // Set an error handler, so that any LLVM backend diagnostics go through our
-  // error handler.
-  llvm::install_fatal_error_handler(LLVMErrorHandler,
-                                static_cast<void*>(&Clang->getDiagnostics()));
+
+  //stat and read headers through the files shared with the other instances
+  Run.SharedFiles.setUp(*Clang);
+
+  //skip the variant if an analyzed variant reports what this one would
+  if (Equivalents && Success){
+    unsigned LeaderID = Equivalents->findLeader(*Clang, CI_ID);
+    if (LeaderID != CI_ID){
+      DiagContainer.AddEquivalentInstance(CI_ID, LeaderID);
+      if (Profile)
+        writeProfile(*ProfileLog, *Profile, BruteClangVariantProfile::Skipped, Start);
+      return BruteClangVariantProfile::Skipped;
+    }
+  }
+
+  //load the leading include block precompiled, reporting the diagnostics
+  //raised while it was parsed as this instance's own
+  std::shared_ptr<const BruteClangPCHCache::Entry> PCH;
+  if (Run.PCHCache && !File.PCHIncludes.empty() && Success &&
+      Clang->getPreprocessorOpts().ImplicitPCHInclude.empty() &&
+      Clang->getFrontendOpts().Inputs.size() == 1)
+    PCH = Run.PCHCache->getPCH(Clang->getInvocation(),
+                               Clang->getFrontendOpts().Inputs[0].getFile(),
+                               File.PCHIncludes);
+  if (PCH){
+    Clang->getPreprocessorOpts().ImplicitPCHInclude = PCH->PCHPath;
+    Clang->getPreprocessorOpts().DisablePCHValidation = true;
+    for (const CustomDiagContainer::RecordedDiagnostic &Diag : PCH->Diags)
+      DiagContainer.AddDiagnostic(CI_ID, Diag.FileName, Diag.ColumnNumber, Diag.LineNumber, Diag.msg, Diag.DiagID);
+  }
+
+  //record what the variant depends on, to compare the variants still to come
+  //with. The headers of a precompiled block are not preprocessed again, so
+  //nothing can be recorded for them.
+  std::shared_ptr<BruteClangVariantSensitivity> Sensitivity;
+  if (Equivalents && Success && !PCH)
+    Sensitivity = Equivalents->recordSensitivity(*Clang);
+
+  //collect every file the instance reads, to tell whether the result can be
+  //replayed by later runs
+  std::shared_ptr<BruteClangResultCache::FileCollector> ResultDeps;
+  if (ResultCache && Success){
+    ResultDeps = std::make_shared<BruteClangResultCache::FileCollector>();
+    Clang->addDependencyCollector(ResultDeps);
+    //the headers of a precompiled block are not searched for again
+    if (PCH){
+      for (const std::string &Path : PCH->AbsentPaths)
+        ResultDeps->addAbsentPath(Path);
+      if (PCH->UntrackedLookups)
+        ResultDeps->setUntrackedLookups();
+    }
+  }
+
+  // Route LLVM backend diagnostics raised on this thread through this
+  // instance's diagnostics. See LLVMErrorHandler.
+  CurrentThreadDiags = &Clang->getDiagnostics();
 
   DiagsBuffer->FlushDiagnostics(Clang->getDiagnostics());
 
   //setting up the diagnostic client to our custom one.
-  Clang->getDiagnostics().setClient(new CustomDiagConsumer(DiagContainer), true);
+  Clang->getDiagnostics().setClient(new CustomDiagConsumer(DiagContainer, CI_ID), true);
 
   //setting error limit to unlimited (0)
   Clang->getDiagnostics().setErrorLimit(0);
 
+  //have the plugins skip the declarations checked for another variant
+  std::shared_ptr<BruteClangDeclFilter> DeclFilter;
+  if (CheckedDecls){
+    DeclFilter = std::make_shared<BruteClangDeclFilter>(*CheckedDecls, CI_ID);
+    Clang->getFrontendOpts().DeclFilter = DeclFilter;
+  }
+
+  //time the phases of the frontend action
+  BruteClangPhaseTime FrontendStart;
+  if (Profile){
+    Clang->getFrontendOpts().VariantProfile = Profile;
+    Clang->getPreprocessorOpts().DirectiveTimer = Profile->Directives;
+    FrontendStart = BruteClangPhaseTime::now();
+  }
+
   // Execute the frontend actions.
   Success = ExecuteCompilerInvocation(Clang.get());
 
+  if (Profile){
+    Profile->Frontend = BruteClangPhaseTime::now();
+    Profile->Frontend -= FrontendStart;
+    Profile->recordMemory(*Clang);
+  }
+
+  if (Sensitivity && Sensitivity->isComplete())
+    Equivalents->addSensitivity(CI_ID, std::move(Sensitivity));
+
+  //report what the plugins reported for the declarations left to other
+  //variants; those variants are running or done, and never wait on this one
+  //before they are done with their own declarations
+  if (DeclFilter)
+    DeclFilter->finish(DiagContainer);
+
+  if (ResultDeps){
+    std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+    DiagContainer.GetDiagnostics(CI_ID, Diags);
+    ResultCache->store(ResultKey, *ResultDeps, Diags);
+  }
+
   // Our error handler depends on the Diagnostics object, which we're
-  // potentially about to delete. Uninstall the handler now so that any
-  // later errors use the default handling behavior instead.
-  llvm::remove_fatal_error_handler();
+  // potentially about to delete. Detach it from this thread now so that any
+  // later errors use the fallback behavior instead.
+  CurrentThreadDiags = nullptr;
+
+  if (Profile)
+    writeProfile(*ProfileLog, *Profile, BruteClangVariantProfile::Analyzed, Start);
+  return BruteClangVariantProfile::Analyzed;
+}
+
+/// Prints the grouped diagnostics of each file as soon as all its variants are
+/// done, keeping the order in which the files were given.
+class BruteClangResultPrinter {
+  ArrayRef<std::unique_ptr<BruteClangFile>> Files;
+  unsigned NextToPrint = 0;
+  std::mutex Lock;
+
+  /// Where to write the structured report too (-brute-diag-output), or null.
+  BruteClangDiagnosticWriter *Output;
+
+  /// Where to collect the diagnostics located in headers instead of printing
+  /// them with each file (-brute-dedup-headers), or null.
+  BruteClangHeaderDiagnostics *Headers;
+
+  const BruteClangManifest &Manifest;
+
+  void writeReport(BruteClangFile &File, BruteClangDiagnosticWriter &Writer) {
+    unsigned NumVariants = Manifest.getNumVariants();
+    VariantMask Analyzed(NumVariants);
+    for (unsigned V : File.VariantIDs)
+      Analyzed.set(V);
+    Writer.beginTranslationUnit(File.Name, Analyzed);
+    File.DiagContainer.VisitDiagnostics([&](StringRef FileName, unsigned LineNumber, unsigned ColumnNumber, unsigned DiagID, StringRef msg, const llvm::SmallBitVector &CI_Set) {
+      //the compiler instances of a file were registered in the order of
+      //its variants
+      VariantMask Variants(NumVariants);
+      for (int ID = CI_Set.find_first(); ID != -1; ID = CI_Set.find_next(ID))
+        Variants.set(File.VariantIDs[ID]);
+      BruteClangOutputDiagnostic Diag;
+      Diag.FileName = FileName;
+      Diag.LineNumber = LineNumber;
+      Diag.ColumnNumber = ColumnNumber;
+      Diag.DiagID = DiagID;
+      Diag.Message = msg;
+      Writer.writeDiagnostic(Diag, Variants);
+    });
+    Writer.endTranslationUnit();
+  }
+
+  void print(BruteClangFile &File) {
+    if (Output)
+      writeReport(File, *Output);
+    llvm::outs() << "Running on file " << File.Name << ":\n";
+    if (!File.Known){
+      llvm::outs().flush();
+      llvm::errs() << "Unknown file. Please ensure the file exists in one of the file lists.\n";
+      return;
+    }
+    if (!File.SampleDescription.empty()){
+      llvm::outs() << File.SampleDescription << "\n";
+      if (File.Escalated)
+        llvm::outs() << "The sampled variants disagree; analyzed the other "
+                     << File.VariantIDs.size() - File.NumSampled << " variants too.\n";
+      llvm::outs().flush();
+    }
+    if (Headers){
+      writeReport(File, *Headers);
+      unsigned NumInHeaders = File.DiagContainer.PrintDiagnostics(llvm::outs(), llvm::errs(), [&](StringRef FileName) {
+        return !BruteClangHeaderDiagnostics::isInHeader(File.Name, FileName);
+      });
+      if (NumInHeaders){
+        llvm::errs().flush();
+        llvm::outs() << NumInHeaders << " diagnostics in headers, printed at the end of the run.\n";
+      }
+    }
+    else
+      File.DiagContainer.PrintDiagnostics();
+    //tryting to separate current diagnostic info from the next execution
+    llvm::outs() << "------------------------------------------------------\n";
+    llvm::outs() << "\n";
+    llvm::outs().flush();
+  }
+
+public:
+  BruteClangResultPrinter(ArrayRef<std::unique_ptr<BruteClangFile>> Files, BruteClangDiagnosticWriter *Output, BruteClangHeaderDiagnostics *Headers, const BruteClangManifest &Manifest)
+      : Files(Files), Output(Output), Headers(Headers), Manifest(Manifest) {}
+
+  /// Print the diagnostics located in headers collected from every file,
+  /// each once, with the files it was reported for. Called once every file
+  /// was printed.
+  void printHeaderDiagnostics() {
+    if (!Headers)
+      return;
+    llvm::outs() << "Diagnostics in headers:\n";
+    if (Headers->getDiagnostics().empty())
+      llvm::outs() << "No errors reported!\n";
+    llvm::outs().flush();
+    for (const BruteClangHeaderDiagnostics::HeaderDiagnostic &HD : Headers->getDiagnostics()){
+      Manifest.describeVariants(HD.Variants, llvm::errs());
+      llvm::errs() << ":\n In file " << HD.Diag.FileName << ": Line " << HD.Diag.LineNumber << ": error: " << HD.Diag.Message << "\n";
+      llvm::errs() << " Reported for " << llvm::join(HD.TranslationUnits.begin(), HD.TranslationUnits.end(), ", ") << "\n";
+    }
+    llvm::errs().flush();
+    llvm::outs() << "------------------------------------------------------\n";
+    llvm::outs().flush();
+  }
+
+  /// Print every finished file not printed yet, up to the first unfinished
+  /// one.
+  void printFinished() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    while (NextToPrint != Files.size() && Files[NextToPrint]->Remaining == 0)
+      print(*Files[NextToPrint++]);
+  }
+};
+
+/// The files whose sampled variants disagreed, and the variants they
+/// analyzed in the end (-brute-sample-escalate).
+static std::atomic<unsigned> NumEscalatedFiles{0}, NumEscalatedVariants{0};
+
+/// Record that variant \p I of \p File finished. If it was the last sampled
+/// variant to finish and the sampled variants disagree, the variants left out
+/// of the sample are registered and handed to \p Run. Returns true once every
+/// variant of the file is done.
+static bool finishVariant(BruteClangFile &File, unsigned I, const BruteClangManifest &Manifest, const std::function<void(BruteClangFile &, unsigned)> &Run){
+  if (I < File.NumSampled && File.EscalateSample && --File.SampledRemaining == 0){
+    //no sampled variant runs any more, so nothing reads VariantIDs
+    if (!File.DiagContainer.InstancesAgree()){
+      unsigned First = File.VariantIDs.size();
+      for (int V = File.Unsampled.find_first(); V != -1; V = File.Unsampled.find_next(V)){
+        File.VariantIDs.push_back(V);
+        File.CI_IDs.push_back(File.DiagContainer.AddCompilerInstance(Manifest.getVariantName(V).str()));
+      }
+      File.Escalated = true;
+      File.Remaining += File.VariantIDs.size() - First;
+      ++NumEscalatedFiles;
+      NumEscalatedVariants += File.VariantIDs.size() - First;
+      for (unsigned J = First, E = File.VariantIDs.size(); J != E; ++J)
+        Run(File, J);
+    }
+    //the file could not be printed before the sample was checked
+    --File.Remaining;
+  }
+  return --File.Remaining == 0;
+}
+
+static const char ForkedResultMagic[4] = {'B', 'C', 'F', 'K'};
+
+/// Send how compiler instance \p CI_ID was dealt with and its diagnostics to
+/// the parent process.
+static void writeForkedResult(CustomDiagContainer &DiagContainer, unsigned CI_ID, BruteClangVariantProfile::OutcomeKind Outcome, llvm::raw_ostream &OS){
+  std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+  DiagContainer.GetDiagnostics(CI_ID, Diags);
+  BruteClangCacheWriter Writer(StringRef(ForkedResultMagic, sizeof(ForkedResultMagic)), 3);
+  Writer.write<uint8_t>(Outcome);
+  Writer.writeDiagnostics(Diags);
+  OS << Writer.getContents();
+  OS.flush();
+}
+
+/// Add the diagnostics a child process sent for compiler instance \p CI_ID
+/// of \p File, and report the instance if the child did not end normally.
+///
+/// \returns how the child dealt with the instance; a child that sent nothing
+/// ran it.
+static BruteClangVariantProfile::OutcomeKind readForkedResult(BruteClangFile &File, unsigned CI_ID, const BruteClangProcessPool::Result &R){
+  BruteClangCacheReader Reader(R.Output, StringRef(ForkedResultMagic, sizeof(ForkedResultMagic)), 3);
+  auto Outcome = static_cast<BruteClangVariantProfile::OutcomeKind>(Reader.read<uint8_t>());
+  std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+  Reader.readDiagnostics(Diags);
+  if (!Reader.hasFailed())
+    for (const CustomDiagContainer::RecordedDiagnostic &Diag : Diags)
+      File.DiagContainer.AddDiagnostic(CI_ID, Diag.FileName, Diag.ColumnNumber, Diag.LineNumber, Diag.msg, Diag.DiagID);
+
+  if (!R.Succeeded){
+    std::string Message = "analysis of this variant aborted: " + R.Failure;
+    if (Reader.hasFailed())
+      Message += "; its diagnostics are lost";
+    File.DiagContainer.AddDiagnostic(CI_ID, File.Name, 0, 0, Message);
+  }
+  return Reader.hasFailed() ? BruteClangVariantProfile::Analyzed : Outcome;
 }
 
 int cc1_main(ArrayRef<const char *> Argv, const char *Argv0, void *MainAddr) {
@@ -281,46 +1063,364 @@ int cc1_main(ArrayRef<const char *> Argv, const char *Argv0, void *MainAddr) {
   llvm::InitializeAllAsmPrinters();
   llvm::InitializeAllAsmParsers();
 
-  std::string inputString; //string buffer to store input from config files
-  frontend::IncludeDirGroup Group = frontend::Angled; //for -I command line arguments
+  BruteClangOptions BruteOpts;
+  SmallVector<const char *, 256> ForwardedArgv;
+  if (!ParseBruteClangArgs(Argv, BruteOpts, ForwardedArgv))
+    return 1;
+  Argv = ForwardedArgv;
 
-  CustomDiagContainer DiagContainer;
+  if (!BruteOpts.CompileManifestPath.empty())
+    return CompileManifest(BruteOpts.CompileManifestPath) ? 0 : 1;
 
-  std::string fileName = std::string(Argv.back()); //the last argument in the command line is the file name
-  llvm::outs() << "Running on file " << fileName << ":\n";
-  if (isInFileList("common_files.config", fileName)){
-    //execute for all platforms
-    ExecuteCI("amd64", Group, DiagContainer, Argv, Argv0, MainAddr);
-    ExecuteCI("i386", Group, DiagContainer, Argv, Argv0, MainAddr);
-    ExecuteCI("p", Group, DiagContainer, Argv, Argv0, MainAddr);
-    ExecuteCI("z", Group, DiagContainer, Argv, Argv0, MainAddr);
+  //the reports to merge are the inputs; parse the command line as cc1 does
+  //to tell them from the values of other options
+  if (!BruteOpts.MergeDiagnosticsPath.empty()){
+    std::unique_ptr<OptTable> OptTbl(driver::createDriverOptTable());
+    unsigned MissingArgIndex, MissingArgCount;
+    InputArgList Args = OptTbl->ParseArgs(Argv, MissingArgIndex, MissingArgCount, driver::options::CC1Option);
+    std::vector<std::string> Inputs = Args.getAllArgValues(driver::options::OPT_INPUT);
+    return MergeDiagnosticReports(Inputs, BruteOpts.MergeDiagnosticsPath, BruteOpts.DiagOutputFormat) ? 0 : 1;
   }
-  else if(isInFileList("x_files.config", fileName)){
-    //execute for just x family
-    ExecuteCI("amd64", Group, DiagContainer, Argv, Argv0, MainAddr);
-    ExecuteCI("i386", Group, DiagContainer, Argv, Argv0, MainAddr);
+
+  //file lists and variant arguments, either precompiled or read from the
+  //config files in the current directory
+  std::string Error;
+  std::unique_ptr<BruteClangManifest> Manifest;
+  if (!BruteOpts.ManifestPath.empty())
+    Manifest = BruteClangManifest::loadFile(BruteOpts.ManifestPath, Error);
+  else
+    Manifest = BruteClangManifest::createFromConfigs(*vfs::getRealFileSystem(), ".", Error);
+  if (!Manifest){
+    llvm::errs() << "error: " << Error << "\n";
+    return 1;
   }
-  else if(isInFileList("amd64_files.config", fileName)){
-    ExecuteCI("amd64", Group, DiagContainer, Argv, Argv0, MainAddr);
+
+  //one record per file and variant, appended as each one finishes
+  std::unique_ptr<BruteClangProfileLog> ProfileLog;
+  if (!BruteOpts.ProfilePath.empty()){
+    ProfileLog = BruteClangProfileLog::create(BruteOpts.ProfilePath, Error);
+    if (!ProfileLog){
+      llvm::errs() << "error: " << Error << "\n";
+      return 1;
+    }
+  }
+
+  //the structured report, written alongside the text as each file is done
+  std::unique_ptr<llvm::raw_fd_ostream> DiagOutputStream;
+  std::unique_ptr<BruteClangDiagnosticWriter> DiagOutput;
+  if (!BruteOpts.DiagOutputPath.empty()){
+    std::error_code EC;
+    DiagOutputStream.reset(new llvm::raw_fd_ostream(BruteOpts.DiagOutputPath, EC, llvm::sys::fs::F_None));
+    if (EC){
+      llvm::errs() << "error: unable to open '" << BruteOpts.DiagOutputPath << "': " << EC.message() << "\n";
+      return 1;
+    }
+    DiagOutput = BruteClangDiagnosticWriter::create(BruteOpts.DiagOutputFormat, *DiagOutputStream);
+    std::vector<StringRef> VariantNames;
+    for (unsigned V = 0, E = Manifest->getNumVariants(); V != E; ++V)
+      VariantNames.push_back(Manifest->getVariantName(V));
+    DiagOutput->beginRun(VariantNames);
+  }
+
+  //the files to analyze: every file of the batch list, each appended to the
+  //command line, or else the input file, which is the last argument.
+  std::vector<std::string> FileNames;
+  ArrayRef<const char *> CommonArgv = Argv;
+  if (!BruteOpts.BatchFileList.empty()){
+    if (!BruteClangManifest::readFileList(*vfs::getRealFileSystem(), BruteOpts.BatchFileList, FileNames, Error)){
+      llvm::errs() << "error: " << Error << "\n";
+      return 1;
+    }
   }
-  else if(isInFileList("i386_files.config", fileName)){
-    ExecuteCI("i386", Group, DiagContainer, Argv, Argv0, MainAddr);
+  else{
+    FileNames.push_back(Argv.back());
+    CommonArgv = Argv.drop_back();
   }
-  else if(isInFileList("p_files.config", fileName)){
-    ExecuteCI("p", Group, DiagContainer, Argv, Argv0, MainAddr);
+
+  //the macros some variant defines, which are all that can tell variants
+  //apart besides their include paths
+  llvm::StringSet<> WatchedMacros;
+  if (BruteOpts.SkipInsensitiveVariants){
+    SmallVector<BruteClangVariantArg, 64> VariantArgs;
+    for (unsigned V = 0, E = Manifest->getNumVariants(); V != E; ++V){
+      VariantArgs.clear();
+      Manifest->getVariantArgs(V, VariantArgs);
+      for (const BruteClangVariantArg &Arg : VariantArgs)
+        if (Arg.Kind == BruteClangVariantArg::Define)
+          WatchedMacros.insert(Arg.Value.substr(0, Arg.Value.find_first_of("=(")));
+    }
   }
-  else if(isInFileList("z_files.config", fileName)){
-    ExecuteCI("z", Group, DiagContainer, Argv, Argv0, MainAddr);
+
+  //register the compiler instances of every file up front, so diagnostics
+  //are grouped in this order however the instances are scheduled.
+  std::vector<std::unique_ptr<BruteClangFile>> Files;
+  unsigned NumJobs = 0, NumUnsampled = 0;
+  for (const std::string &FileName : FileNames){
+    Files.emplace_back(new BruteClangFile);
+    BruteClangFile &File = *Files.back();
+    File.Name = FileName;
+
+    VariantMask Variants;
+    File.Known = Manifest->lookupFile(FileName, Variants);
+    if (!File.Known)
+      continue;
+
+    //analyze a covering array of the variants only; the others may be
+    //escalated to later
+    if (BruteOpts.SampleStrength){
+      VariantMask Sample;
+      Manifest->sampleVariants(Variants, BruteOpts.SampleStrength, Sample);
+      File.Unsampled = Variants;
+      File.Unsampled.resize(Manifest->getNumVariants());
+      File.Unsampled.reset(Sample);
+      File.EscalateSample = BruteOpts.EscalateSamples && File.Unsampled.any();
+      NumUnsampled += File.Unsampled.count();
+
+      llvm::raw_string_ostream OS(File.SampleDescription);
+      OS << "Sampled " << Sample.count() << " of " << Variants.count()
+         << " variants (" << BruteOpts.SampleStrength << "-wise): ";
+      Manifest->describeVariants(Sample, OS);
+      OS.flush();
+      Variants = std::move(Sample);
+    }
+
+    for (int V = Variants.find_first(); V != -1; V = Variants.find_next(V)){
+      File.VariantIDs.push_back(V);
+      File.CI_IDs.push_back(File.DiagContainer.AddCompilerInstance(Manifest->getVariantName(V).str()));
+    }
+    //with axes, print the variants of a diagnostic as patterns over them,
+    //which stay short with hundreds of variants
+    if (!Manifest->getAxes().empty()){
+      const BruteClangManifest *M = Manifest.get();
+      BruteClangFile *FilePtr = &File;
+      File.DiagContainer.setInstanceSetPrinter([M, FilePtr](const llvm::SmallBitVector &CI_Set, llvm::raw_ostream &OS) {
+        VariantMask Variants(M->getNumVariants());
+        for (int ID = CI_Set.find_first(); ID != -1; ID = CI_Set.find_next(ID))
+          Variants.set(FilePtr->VariantIDs[ID]);
+        M->describeVariants(Variants, OS);
+      });
+    }
+    File.Argv.assign(CommonArgv.begin(), CommonArgv.end());
+    File.Argv.push_back(File.Name.c_str());
+    File.NumSampled = File.VariantIDs.size();
+    File.SampledRemaining = File.NumSampled;
+    //hold the file back until its sample was checked
+    File.Remaining = File.VariantIDs.size() + File.EscalateSample;
+    File.Equivalents.CompareFingerprints = BruteOpts.SkipIdenticalVariants;
+    if (BruteOpts.SkipInsensitiveVariants)
+      File.Equivalents.WatchedMacros = &WatchedMacros;
+    NumJobs += File.VariantIDs.size();
+  }
+
+  frontend::IncludeDirGroup Group = frontend::Angled; //for -I command line arguments
+
+  // Set an error handler, so that any LLVM backend diagnostics go through our
+  // error handler.
+  llvm::install_fatal_error_handler(LLVMErrorHandler);
+
+  BruteClangSharedFiles SharedFiles;
+
+  //find the include blocks worth precompiling: the leading includes each
+  //file shares with another one
+  std::unique_ptr<BruteClangPCHCache> PCHCache;
+  if (!BruteOpts.PCHCacheDir.empty()){
+    auto PCHOps = std::make_shared<PCHContainerOperations>();
+    PCHOps->registerWriter(llvm::make_unique<ObjectFilePCHContainerWriter>());
+    PCHOps->registerReader(llvm::make_unique<ObjectFilePCHContainerReader>());
+    PCHCache.reset(new BruteClangPCHCache(BruteOpts.PCHCacheDir, SharedFiles.getFileSystem(), PCHOps));
+
+    std::vector<std::vector<BruteClangPCHCache::IncludeDirective>> LeadingIncludes(Files.size());
+    for (unsigned I = 0, E = Files.size(); I != E; ++I){
+      if (!Files[I]->Known)
+        continue;
+      if (auto Buffer = SharedFiles.getFileSystem()->getBufferForFile(Files[I]->Name))
+        BruteClangPCHCache::getLeadingIncludes((*Buffer)->getBuffer(), LeadingIncludes[I]);
+    }
+    std::vector<unsigned> Lengths = BruteClangPCHCache::getBlockLengths(LeadingIncludes);
+    for (unsigned I = 0, E = Files.size(); I != E; ++I){
+      LeadingIncludes[I].resize(Lengths[I]);
+      Files[I]->PCHIncludes = std::move(LeadingIncludes[I]);
+    }
+  }
+
+  //results are only valid for the binary and plugins that computed them
+  std::unique_ptr<BruteClangResultCache> ResultCache;
+  if (!BruteOpts.ResultCacheDir.empty()){
+    std::string ToolHash;
+    std::string Executable = llvm::sys::fs::getMainExecutable(Argv0, MainAddr);
+    if (BruteClangResultCache::getToolHash(Executable, CommonArgv, ToolHash))
+      ResultCache.reset(new BruteClangResultCache(BruteOpts.ResultCacheDir, SharedFiles.getFileSystem(), ToolHash));
+    else
+      llvm::errs() << "warning: unable to read '" << Executable << "' or a plugin; not using the result cache\n";
+  }
+
+  if (BruteOpts.ForkVariants && !BruteClangProcessPool::isSupported()){
+    llvm::errs() << "warning: -brute-fork is not supported on this host; running the variants on threads\n";
+    BruteOpts.ForkVariants = false;
+  }
+
+  std::unique_ptr<BruteClangHeaderDiagnostics> HeaderDiags;
+  if (BruteOpts.DedupHeaderDiagnostics)
+    HeaderDiags.reset(new BruteClangHeaderDiagnostics());
+  BruteClangResultPrinter Printer(Files, DiagOutput.get(), HeaderDiags.get(), *Manifest);
+
+  //the jobs in the order they are started: file by file, or longest first
+  //by the times of earlier runs, so the big files do not start last and keep
+  //a few workers busy long after the others ran out of work
+  struct ScheduledJob {
+    double Estimate;
+    BruteClangFile *File;
+    unsigned I;
+  };
+  std::vector<ScheduledJob> Jobs;
+  for (std::unique_ptr<BruteClangFile> &FilePtr : Files)
+    for (unsigned I = 0, E = FilePtr->VariantIDs.size(); I != E; ++I)
+      Jobs.push_back(ScheduledJob{0, FilePtr.get(), I});
+
+  std::unique_ptr<BruteClangJobTimes> JobTimes;
+  std::mutex JobSecondsLock;
+  std::vector<double> JobSeconds;
+  if (!BruteOpts.JobTimesPath.empty()){
+    JobTimes.reset(new BruteClangJobTimes());
+    if (!JobTimes->load(BruteOpts.JobTimesPath, Error)){
+      llvm::errs() << "error: " << Error << "\n";
+      return 1;
+    }
+    for (std::unique_ptr<BruteClangFile> &File : Files)
+      if (File->Known)
+        if (auto Buffer = SharedFiles.getFileSystem()->getBufferForFile(File->Name))
+          File->Cost = BruteClangJobTimes::getFileCost((*Buffer)->getBuffer());
+    for (ScheduledJob &Job : Jobs)
+      Job.Estimate = JobTimes->estimate(Job.File->Name, Manifest->getVariantName(Job.File->VariantIDs[Job.I]), Job.File->Cost);
+    std::stable_sort(Jobs.begin(), Jobs.end(), [](const ScheduledJob &L, const ScheduledJob &R) {
+      return L.Estimate > R.Estimate;
+    });
+  }
+  //a variant replayed from the result cache or skipped as equivalent takes
+  //next to no time, which says nothing of how long analyzing it takes
+  auto RecordJobTime = [&](BruteClangFile &File, unsigned I, double Seconds, BruteClangVariantProfile::OutcomeKind Outcome) {
+    if (!JobTimes)
+      return;
+    if (Outcome == BruteClangVariantProfile::Analyzed)
+      JobTimes->record(File.Name, Manifest->getVariantName(File.VariantIDs[I]), File.Cost, Seconds);
+    std::lock_guard<std::mutex> Guard(JobSecondsLock);
+    JobSeconds.push_back(Seconds);
+  };
+
+  BruteClangRun Run{*Manifest,
+                    Group,
+                    SharedFiles,
+                    PCHCache.get(),
+                    ResultCache.get(),
+                    ProfileLog.get(),
+                    /*ShareResults=*/!BruteOpts.ForkVariants,
+                    BruteOpts.DedupDecls,
+                    Argv0,
+                    MainAddr};
+
+  unsigned NumWorkers;
+  double RunStart = BruteClangPhaseTime::now().Wall;
+  if (BruteOpts.ForkVariants){
+    //set up what every child needs once, here: the children inherit it
+    //copy-on-write
+    for (unsigned I = 0; I + 1 < CommonArgv.size(); ++I)
+      if (StringRef(CommonArgv[I]) == "-load")
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(CommonArgv[I + 1]);
+    for (std::unique_ptr<BruteClangFile> &File : Files)
+      if (File->Known)
+        SharedFiles.getFileSystem()->getBufferForFile(File->Name);
+
+    //children cannot tell each other which variants they analyzed, so no
+    //variant is skipped as equivalent to another, nor any declaration as
+    //checked for another variant
+    BruteClangProcessPool Pool(BruteOpts.VariantJobs);
+    NumWorkers = BruteOpts.VariantJobs;
+    std::function<void(BruteClangFile &, unsigned)> RunVariant = [&](BruteClangFile &File, unsigned I) {
+      BruteClangFile *FilePtr = &File;
+      Pool.async([&, FilePtr, I](llvm::raw_ostream &OS) {
+        BruteClangFile &File = *FilePtr;
+        //a fatal error ends the child in the middle of running the instance
+        BruteClangVariantProfile::OutcomeKind Outcome = BruteClangVariantProfile::Analyzed;
+        WriteForkedResult = [&] { writeForkedResult(File.DiagContainer, File.CI_IDs[I], Outcome, OS); };
+        Outcome = ExecuteCI(Run, File, File.VariantIDs[I], File.CI_IDs[I]);
+        WriteForkedResult();
+      }, [&, FilePtr, I](const BruteClangProcessPool::Result &R) {
+        RecordJobTime(*FilePtr, I, R.Seconds, readForkedResult(*FilePtr, FilePtr->CI_IDs[I], R));
+        if (finishVariant(*FilePtr, I, *Manifest, RunVariant))
+          Printer.printFinished();
+      });
+    };
+    for (const ScheduledJob &Job : Jobs)
+      RunVariant(*Job.File, Job.I);
+    Printer.printFinished();
+    Pool.wait();
   }
   else{
-    llvm::errs() << "Unknown file. Please ensure the file exists in one of the file lists.\n";
-    return 0;
+    BruteClangWorkPool Pool(std::max(1u, std::min(BruteOpts.VariantJobs, NumJobs + NumUnsampled)));
+    NumWorkers = Pool.getNumWorkers();
+    std::function<void(BruteClangFile &, unsigned)> RunVariant = [&](BruteClangFile &File, unsigned I) {
+      BruteClangFile *FilePtr = &File;
+      Pool.async([&, FilePtr, I] {
+        BruteClangFile &File = *FilePtr;
+        double Start = BruteClangPhaseTime::now().Wall;
+        BruteClangVariantProfile::OutcomeKind Outcome =
+            ExecuteCI(Run, File, File.VariantIDs[I], File.CI_IDs[I]);
+        RecordJobTime(File, I, BruteClangPhaseTime::now().Wall - Start, Outcome);
+        if (finishVariant(File, I, *Manifest, RunVariant))
+          Printer.printFinished();
+      });
+    };
+    for (const ScheduledJob &Job : Jobs)
+      RunVariant(*Job.File, Job.I);
+    //files without any variant to run are finished already
+    Printer.printFinished();
+    Pool.wait();
   }
 
-  DiagContainer.PrintDiagnostics();
-  //tryting to separate current diagnostic info from the next execution
-  llvm::outs() << "------------------------------------------------------\n";
-  llvm::outs() << "\n";
+  double Makespan = BruteClangPhaseTime::now().Wall - RunStart;
+
+  llvm::remove_fatal_error_handler();
+  Printer.printFinished();
+  Printer.printHeaderDiagnostics();
+  if (DiagOutput)
+    DiagOutput->endRun();
+
+  if (JobTimes){
+    if (!JobTimes->save(BruteOpts.JobTimesPath, Error))
+      llvm::errs() << "warning: " << Error << "; the job times of this run are lost\n";
+    double Ideal = BruteClangJobTimes::getIdealMakespan(JobSeconds, NumWorkers);
+    llvm::errs() << "\n*** BruteClang Schedule Stats:\n"
+                 << JobSeconds.size() << " jobs on " << NumWorkers << " workers took "
+                 << llvm::format("%.2f", Makespan) << "s; ideally "
+                 << llvm::format("%.2f", Ideal) << "s";
+    if (Ideal > 0)
+      llvm::errs() << " (" << llvm::format("%.1f", 100 * (Makespan - Ideal) / Ideal) << "% over)";
+    llvm::errs() << ".\n";
+  }
+
+  if (BruteOpts.PrintFileSystemStats){
+    SharedFiles.printStatistics(llvm::errs());
+    if (PCHCache)
+      PCHCache->printStatistics(llvm::errs());
+    if (ResultCache)
+      ResultCache->printStatistics(llvm::errs());
+    if (BruteOpts.SkipIdenticalVariants || BruteOpts.SkipInsensitiveVariants)
+      llvm::errs() << "\n*** BruteClang Variant Stats:\n"
+                   << BruteClangEquivalentVariants::NumSkippedInsensitive << " of " << NumJobs
+                   << " variants skipped before preprocessing, "
+                   << BruteClangEquivalentVariants::NumSkippedIdentical
+                   << " after preprocessing to the same tokens as another.\n";
+    if (BruteOpts.DedupDecls)
+      llvm::errs() << "\n*** BruteClang Declaration Stats:\n"
+                   << BruteClangCheckedDecls::NumChecked << " distinct declarations checked by the plugins, "
+                   << BruteClangCheckedDecls::NumShared << " more left to another variant that parsed them the same.\n";
+    if (BruteOpts.SampleStrength)
+      llvm::errs() << "\n*** BruteClang Sampling Stats:\n"
+                   << NumUnsampled << " of " << NumJobs + NumUnsampled
+                   << " variants left out of the samples, "
+                   << NumEscalatedVariants << " of them analyzed for the "
+                   << NumEscalatedFiles << " files whose sampled variants disagreed.\n";
+  }
 
   return 0;
-}
\ No newline at end of file
+}
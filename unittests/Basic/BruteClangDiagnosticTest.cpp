@@ -0,0 +1,280 @@
+//===- unittests/Basic/BruteClangDiagnosticTest.cpp - Variant grouping ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangDiagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/IdentifierTable.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/LexDiagnostic.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+static std::string print(CustomDiagContainer &Container) {
+  std::string Out, Err;
+  raw_string_ostream OutOS(Out), ErrOS(Err);
+  Container.PrintDiagnostics(OutOS, ErrOS);
+  return OutOS.str() + ErrOS.str();
+}
+
+TEST(BruteClangDiagnosticTest, noDiagnostics) {
+  CustomDiagContainer Container;
+  Container.AddCompilerInstance("amd64");
+  EXPECT_EQ("No errors reported!\n", print(Container));
+}
+
+// Diagnostics reported by several compiler instances are printed once, with
+// the instances listed in registration order.
+TEST(BruteClangDiagnosticTest, groupsAcrossInstances) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned I386 = Container.AddCompilerInstance("i386");
+  unsigned P = Container.AddCompilerInstance("p");
+
+  // Report out of registration order, as concurrent instances would.
+  Container.AddDiagnostic(P, "HashTab.hpp", 5, 81, "cast loses information");
+  Container.AddDiagnostic(I386, "HashTab.hpp", 5, 81, "cast loses information");
+  Container.AddDiagnostic(I386, "HashTab.hpp", 5, 202, "cast loses information");
+  Container.AddDiagnostic(AMD64, "HashTab.hpp", 5, 81, "cast loses information");
+
+  EXPECT_EQ(2u, Container.getNumDiagnostics());
+  EXPECT_EQ("amd64, i386, p:\n"
+            " In file HashTab.hpp: Line 81: error: cast loses information\n"
+            "i386:\n"
+            " In file HashTab.hpp: Line 202: error: cast loses information\n",
+            print(Container));
+}
+
+TEST(BruteClangDiagnosticTest, printFiltered) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  Container.AddDiagnostic(AMD64, "a.cpp", 1, 3, "in the file");
+  Container.AddDiagnostic(AMD64, "A.hpp", 1, 5, "in a header");
+
+  std::string Out;
+  raw_string_ostream OS(Out);
+  EXPECT_EQ(1u, Container.PrintDiagnostics(OS, OS, [](StringRef FileName) {
+    return FileName == "a.cpp";
+  }));
+  EXPECT_EQ("amd64:\n In file a.cpp: Line 3: error: in the file\n", OS.str());
+}
+
+TEST(BruteClangDiagnosticTest, keyIncludesFileAndColumn) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned Z = Container.AddCompilerInstance("z");
+
+  Container.AddDiagnostic(AMD64, "A.hpp", 3, 10, "msg");
+  Container.AddDiagnostic(Z, "B.hpp", 3, 10, "msg");
+  Container.AddDiagnostic(Z, "A.hpp", 4, 10, "msg");
+  Container.AddDiagnostic(Z, "A.hpp", 3, 10, "msg");
+
+  EXPECT_EQ(3u, Container.getNumDiagnostics());
+}
+
+TEST(BruteClangDiagnosticTest, instancesAgree) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned I386 = Container.AddCompilerInstance("i386");
+  EXPECT_TRUE(Container.InstancesAgree());
+
+  Container.AddDiagnostic(AMD64, "A.hpp", 1, 1, "msg");
+  EXPECT_FALSE(Container.InstancesAgree());
+  Container.AddDiagnostic(I386, "A.hpp", 1, 1, "msg");
+  EXPECT_TRUE(Container.InstancesAgree());
+
+  // An instance registered later has reported nothing yet.
+  unsigned Z = Container.AddCompilerInstance("z");
+  EXPECT_FALSE(Container.InstancesAgree());
+  Container.AddEquivalentInstance(Z, AMD64);
+  EXPECT_TRUE(Container.InstancesAgree());
+}
+
+// Diagnostics with different IDs are kept apart even if they read the same,
+// and are visited in the order they are printed in.
+TEST(BruteClangDiagnosticTest, visitDiagnostics) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned I386 = Container.AddCompilerInstance("i386");
+  Container.AddDiagnostic(I386, "A.hpp", 2, 1, "msg", 7);
+  Container.AddDiagnostic(AMD64, "A.hpp", 2, 1, "msg", 7);
+  Container.AddDiagnostic(AMD64, "A.hpp", 2, 1, "msg", 8);
+
+  std::vector<std::pair<unsigned, unsigned>> Visited;
+  Container.VisitDiagnostics([&](StringRef FileName, unsigned LineNumber,
+                                 unsigned ColumnNumber, unsigned DiagID,
+                                 StringRef msg, const SmallBitVector &CI_Set) {
+    EXPECT_EQ("A.hpp", FileName);
+    Visited.push_back(std::make_pair(DiagID, unsigned(CI_Set.count())));
+  });
+  ASSERT_EQ(2u, Visited.size());
+  EXPECT_EQ(std::make_pair(7u, 2u), Visited[0]);
+  EXPECT_EQ(std::make_pair(8u, 1u), Visited[1]);
+}
+
+// Diagnostics reported through CustomDiagConsumer are formatted and located
+// when they are grouped, and group with the same diagnostic reported
+// formatted already, as if replayed from a cache.
+TEST(BruteClangDiagnosticTest, capturedDiagnostics) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned I386 = Container.AddCompilerInstance("i386");
+  unsigned P = Container.AddCompilerInstance("p");
+
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr(FileMgrOpts);
+  DiagnosticsEngine Diags(new DiagnosticIDs(), new DiagnosticOptions);
+  SourceManager SourceMgr(Diags, FileMgr);
+  Diags.setSourceManager(&SourceMgr);
+  StringRef Text = "int x;\r\n  BAR\n";
+  const FileEntry *File = FileMgr.getVirtualFile("HashTab.hpp", Text.size(), 0);
+  SourceMgr.overrideFileContents(File, MemoryBuffer::getMemBuffer(Text));
+  FileID FID = SourceMgr.createFileID(File, SourceLocation(), SrcMgr::C_User);
+  SourceLocation Loc = SourceMgr.getLocForStartOfFile(FID).getLocWithOffset(10);
+
+  // Ignored by default; the container formats it all the same.
+  Diags.setSeverity(diag::warn_pp_undef_identifier, diag::Severity::Warning,
+                    SourceLocation());
+  LangOptions LangOpts;
+  IdentifierTable Idents(LangOpts);
+  for (unsigned ID : {AMD64, I386}) {
+    Diags.setClient(new CustomDiagConsumer(Container, ID), true);
+    Diags.Report(Loc, diag::warn_pp_undef_identifier) << &Idents.get("BAR");
+  }
+  Container.AddDiagnostic(P, "HashTab.hpp", 3, 2,
+                          "'BAR' is not defined, evaluates to 0",
+                          diag::warn_pp_undef_identifier);
+
+  unsigned Visited = 0;
+  Container.VisitDiagnostics([&](StringRef FileName, unsigned LineNumber,
+                                 unsigned ColumnNumber, unsigned DiagID,
+                                 StringRef msg, const SmallBitVector &CI_Set) {
+    ++Visited;
+    EXPECT_EQ(2u, LineNumber);
+    EXPECT_EQ(3u, ColumnNumber);
+    EXPECT_EQ(unsigned(diag::warn_pp_undef_identifier), DiagID);
+    EXPECT_EQ(3u, CI_Set.count());
+  });
+  EXPECT_EQ(1u, Visited);
+  EXPECT_EQ("amd64, i386, p:\n In file HashTab.hpp: Line 2: error: 'BAR' is "
+            "not defined, evaluates to 0\n",
+            print(Container));
+}
+
+// Diagnostics captured in one compiler instance and added for another are
+// formatted when they are grouped too, located as they were captured until
+// the container knows their file.
+TEST(BruteClangDiagnosticTest, capturedElsewhere) {
+  CustomDiagContainer Container;
+  unsigned X = Container.AddCompilerInstance("x");
+  unsigned P = Container.AddCompilerInstance("p");
+  unsigned Z = Container.AddCompilerInstance("z");
+
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr(FileMgrOpts);
+  DiagnosticsEngine Diags(new DiagnosticIDs(), new DiagnosticOptions);
+  SourceManager SourceMgr(Diags, FileMgr);
+  Diags.setSourceManager(&SourceMgr);
+  StringRef Text = "int x;\r\n  BAR\n";
+  const FileEntry *File = FileMgr.getVirtualFile("HashTab.hpp", Text.size(), 0);
+  SourceMgr.overrideFileContents(File, MemoryBuffer::getMemBuffer(Text));
+  FileID FID = SourceMgr.createFileID(File, SourceLocation(), SrcMgr::C_User);
+  SourceLocation Loc = SourceMgr.getLocForStartOfFile(FID).getLocWithOffset(10);
+  Diags.setSeverity(diag::warn_pp_undef_identifier, diag::Severity::Warning,
+                    SourceLocation());
+  LangOptions LangOpts;
+  IdentifierTable Idents(LangOpts);
+
+  class CapturingConsumer : public DiagnosticConsumer {
+  public:
+    CustomDiagContainer::CapturedDiagnostic Captured;
+    bool HasCaptured = false;
+
+    void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,
+                          const Diagnostic &Info) override {
+      HasCaptured = CustomDiagContainer::CaptureDiagnostic(Info, Captured);
+    }
+  } Capturing;
+  Diags.setClient(&Capturing, false);
+  Diags.Report(Loc, diag::warn_pp_undef_identifier) << &Idents.get("BAR");
+  ASSERT_TRUE(Capturing.HasCaptured);
+  EXPECT_EQ(2u, Capturing.Captured.LineNumber);
+  EXPECT_EQ(3u, Capturing.Captured.ColumnNumber);
+
+  Container.AddCapturedDiagnostic(X, Capturing.Captured);
+  Diags.setClient(new CustomDiagConsumer(Container, P), true);
+  Diags.Report(Loc, diag::warn_pp_undef_identifier) << &Idents.get("BAR");
+  Container.AddCapturedDiagnostic(Z, Capturing.Captured);
+
+  EXPECT_EQ(1u, Container.getNumDiagnostics());
+  EXPECT_EQ("x, p, z:\n In file HashTab.hpp: Line 2: error: 'BAR' is not "
+            "defined, evaluates to 0\n",
+            print(Container));
+}
+
+// Each distinct set of instances is rendered once, however many diagnostics
+// share it.
+TEST(BruteClangDiagnosticTest, instanceSetPrinter) {
+  CustomDiagContainer Container;
+  unsigned AMD64 = Container.AddCompilerInstance("amd64");
+  unsigned I386 = Container.AddCompilerInstance("i386");
+  unsigned Calls = 0;
+  Container.setInstanceSetPrinter(
+      [&](const SmallBitVector &CI_Set, raw_ostream &OS) {
+        ++Calls;
+        OS << (CI_Set.count() == 2 ? "x/*" : "amd64/*");
+      });
+
+  Container.AddDiagnostic(AMD64, "A.hpp", 1, 1, "first");
+  Container.AddDiagnostic(AMD64, "A.hpp", 1, 2, "second");
+  Container.AddDiagnostic(AMD64, "A.hpp", 1, 3, "third");
+  Container.AddDiagnostic(I386, "A.hpp", 1, 2, "second");
+
+  EXPECT_EQ("amd64/*:\n In file A.hpp: Line 1: error: first\n"
+            "x/*:\n In file A.hpp: Line 2: error: second\n"
+            "amd64/*:\n In file A.hpp: Line 3: error: third\n",
+            print(Container));
+  EXPECT_EQ(2u, Calls);
+}
+
+// Not run by default; use --gtest_also_run_disabled_tests to see how grouping
+// scales with the number of diagnostics when every variant reports all of them.
+TEST(BruteClangDiagnosticTest, DISABLED_scaling) {
+  const unsigned NumVariants = 64;
+  for (unsigned NumDiags : {1000u, 10000u, 100000u}) {
+    std::vector<std::string> Messages;
+    for (unsigned I = 0; I != NumDiags; ++I)
+      Messages.push_back("diagnostic message number " + std::to_string(I));
+
+    TimeRecord Start = TimeRecord::getCurrentTime(true);
+    CustomDiagContainer Container;
+    for (unsigned V = 0; V != NumVariants; ++V) {
+      unsigned ID = Container.AddCompilerInstance("v" + std::to_string(V));
+      for (unsigned I = 0; I != NumDiags; ++I)
+        Container.AddDiagnostic(ID, "HashTab.hpp", 1, I, Messages[I]);
+    }
+    EXPECT_EQ(NumDiags, Container.getNumDiagnostics());
+    TimeRecord End = TimeRecord::getCurrentTime(false);
+
+    errs() << NumDiags << " diagnostics x " << NumVariants << " variants: "
+           << format("%.3f", End.getWallTime() - Start.getWallTime())
+           << "s\n";
+  }
+}
+
+} // anonymous namespace
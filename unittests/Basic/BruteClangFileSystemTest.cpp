@@ -0,0 +1,116 @@
+//===- unittests/Basic/BruteClangFileSystemTest.cpp - Shared FS tests -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangFileSystem.h"
+#include "clang/Basic/FileManager.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+/// Counts the requests reaching the file system under the shared one.
+class CountingFileSystem : public vfs::FileSystem {
+  IntrusiveRefCntPtr<vfs::FileSystem> FS;
+
+public:
+  explicit CountingFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> FS)
+      : FS(std::move(FS)) {}
+
+  ErrorOr<vfs::Status> status(const Twine &Path) override {
+    ++NumStats;
+    return FS->status(Path);
+  }
+  ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const Twine &Path) override {
+    ++NumOpens;
+    return FS->openFileForRead(Path);
+  }
+  vfs::directory_iterator dir_begin(const Twine &Dir,
+                                    std::error_code &EC) override {
+    return FS->dir_begin(Dir, EC);
+  }
+  std::error_code setCurrentWorkingDirectory(const Twine &Path) override {
+    return FS->setCurrentWorkingDirectory(Path);
+  }
+  ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return FS->getCurrentWorkingDirectory();
+  }
+
+  unsigned NumStats = 0;
+  unsigned NumOpens = 0;
+};
+
+class BruteClangFileSystemTest : public ::testing::Test {
+protected:
+  BruteClangFileSystemTest()
+      : Files(new vfs::InMemoryFileSystem),
+        Counter(new CountingFileSystem(Files)),
+        FS(new BruteClangFileSystem(Counter)) {
+    Files->addFile("/src/a.h", 0, MemoryBuffer::getMemBuffer("int a;\n"));
+    Files->addFile("/src/x/b.h", 0, MemoryBuffer::getMemBuffer("int b;\n"));
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> Files;
+  IntrusiveRefCntPtr<CountingFileSystem> Counter;
+  IntrusiveRefCntPtr<BruteClangFileSystem> FS;
+};
+
+TEST_F(BruteClangFileSystemTest, statsOnce) {
+  for (unsigned I = 0; I != 3; ++I) {
+    auto Status = FS->status("/src/a.h");
+    ASSERT_TRUE(bool(Status));
+    EXPECT_EQ("/src/a.h", Status->getName());
+    EXPECT_FALSE(FS->status("/src/missing.h"));
+  }
+  EXPECT_EQ(2u, Counter->NumStats);
+
+  BruteClangFileSystem::Statistics Stats = FS->getStatistics();
+  EXPECT_EQ(6u, Stats.NumStatRequests);
+  EXPECT_EQ(2u, Stats.NumStatsForwarded);
+}
+
+TEST_F(BruteClangFileSystemTest, readsOnce) {
+  for (unsigned I = 0; I != 3; ++I) {
+    auto Buffer = FS->getBufferForFile("/src/x/b.h");
+    ASSERT_TRUE(bool(Buffer));
+    EXPECT_EQ("int b;\n", (*Buffer)->getBuffer());
+  }
+  EXPECT_EQ(1u, Counter->NumOpens);
+
+  BruteClangFileSystem::Statistics Stats = FS->getStatistics();
+  EXPECT_EQ(3u, Stats.NumReadRequests);
+  EXPECT_EQ(1u, Stats.NumReadsForwarded);
+}
+
+TEST_F(BruteClangFileSystemTest, directoriesOpenButDoNotRead) {
+  auto Dir = FS->openFileForRead("/src/x");
+  ASSERT_TRUE(bool(Dir));
+  auto Status = (*Dir)->status();
+  ASSERT_TRUE(bool(Status));
+  EXPECT_TRUE(Status->isDirectory());
+  EXPECT_FALSE((*Dir)->getBuffer("/src/x"));
+}
+
+TEST_F(BruteClangFileSystemTest, sharedBetweenFileManagers) {
+  // Two compiler instances in a row, each with its own FileManager.
+  for (unsigned I = 0; I != 2; ++I) {
+    FileManager FileMgr(FileSystemOptions(), FS);
+    const FileEntry *File = FileMgr.getFile("/src/a.h", /*OpenFile=*/true);
+    ASSERT_TRUE(File);
+    auto Buffer = FileMgr.getBufferForFile(File);
+    ASSERT_TRUE(bool(Buffer));
+    EXPECT_EQ("int a;\n", (*Buffer)->getBuffer());
+  }
+  EXPECT_EQ(1u, Counter->NumOpens);
+}
+
+} // anonymous namespace
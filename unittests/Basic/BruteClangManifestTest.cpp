@@ -0,0 +1,283 @@
+//===- unittests/Basic/BruteClangManifestTest.cpp - Manifest tests --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangManifest.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <set>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+class BruteClangManifestTest : public ::testing::Test {
+protected:
+  BruteClangManifestTest() : FS(new vfs::InMemoryFileSystem) {}
+
+  void addConfig(StringRef Name, StringRef Contents) {
+    FS->addFile("/configs/" + Name, 0, MemoryBuffer::getMemBufferCopy(Contents));
+  }
+
+  std::unique_ptr<BruteClangManifest> compile() {
+    std::string Error;
+    auto Manifest = BruteClangManifest::createFromConfigs(*FS, "/configs", Error);
+    EXPECT_TRUE(Manifest) << Error;
+    return Manifest;
+  }
+
+  static std::vector<unsigned> variants(const VariantMask &Mask) {
+    std::vector<unsigned> Result;
+    for (int V = Mask.find_first(); V != -1; V = Mask.find_next(V))
+      Result.push_back(V);
+    return Result;
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS;
+};
+
+TEST_F(BruteClangManifestTest, firstFileListWins) {
+  addConfig("common_files.config", "Common.cpp\nShared.cpp\n");
+  addConfig("x_files.config", "X.cpp Shared.cpp");
+  addConfig("z_files.config", "Z.cpp");
+  for (StringRef V : {"amd64", "i386", "p", "z"})
+    addConfig(V.str() + ".config", "");
+
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+  ASSERT_EQ(4u, Manifest->getNumVariants());
+  EXPECT_EQ("amd64", Manifest->getVariantName(0));
+  EXPECT_EQ("z", Manifest->getVariantName(3));
+
+  VariantMask Mask;
+  ASSERT_TRUE(Manifest->lookupFile("Common.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3}), variants(Mask));
+  ASSERT_TRUE(Manifest->lookupFile("Shared.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3}), variants(Mask));
+  ASSERT_TRUE(Manifest->lookupFile("X.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({0, 1}), variants(Mask));
+  ASSERT_TRUE(Manifest->lookupFile("Z.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({3}), variants(Mask));
+  EXPECT_FALSE(Manifest->lookupFile("Unknown.cpp", Mask));
+}
+
+TEST_F(BruteClangManifestTest, variantArgs) {
+  addConfig("i386_files.config", "A.cpp");
+  addConfig("i386.config", "-DTR_TARGET_X86\n-DTR_TARGET_32BIT\n"
+                           "-I'../../compiler/x/i386'\n-I../../compiler\n"
+                           "ignored\n");
+
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+
+  SmallVector<BruteClangVariantArg, 8> Args;
+  Manifest->getVariantArgs(1, Args);
+  ASSERT_EQ(4u, Args.size());
+  EXPECT_EQ(BruteClangVariantArg::Define, Args[0].Kind);
+  EXPECT_EQ("TR_TARGET_X86", Args[0].Value);
+  EXPECT_EQ("TR_TARGET_32BIT", Args[1].Value);
+  EXPECT_EQ(BruteClangVariantArg::Include, Args[2].Kind);
+  EXPECT_EQ("../../compiler/x/i386", Args[2].Value);
+  EXPECT_EQ("../../compiler", Args[3].Value);
+}
+
+TEST_F(BruteClangManifestTest, missingVariantConfig) {
+  addConfig("p_files.config", "P.cpp");
+
+  std::string Error;
+  EXPECT_FALSE(BruteClangManifest::createFromConfigs(*FS, "/configs", Error));
+  EXPECT_NE(std::string::npos, Error.find("p.config"));
+}
+
+TEST_F(BruteClangManifestTest, rejectsMalformedManifest) {
+  std::string Error;
+  EXPECT_FALSE(BruteClangManifest::create(
+      MemoryBuffer::getMemBufferCopy("BCMF garbage"), Error));
+  EXPECT_FALSE(Error.empty());
+}
+
+TEST_F(BruteClangManifestTest, variantsConfig) {
+  addConfig("variants.config",
+            "# Platforms by language.\n"
+            "axis platform amd64 i386 p z\n"
+            "axis lang c cpp\n"
+            "group platform x amd64 i386\n"
+            "variants * - (platform=z & lang=c)\n"
+            "args platform=x: -DTR_TARGET_X86 -I'../../compiler/x'\n"
+            "argfile lang=cpp: cpp.args\n"
+            "files *: common.list\n"
+            "files platform=p: p.list\n"
+            "files platform=x & lang=c: p.list\n");
+  addConfig("cpp.args", "-DCPP\n");
+  addConfig("common.list", "Common.cpp");
+  addConfig("p.list", "P.cpp");
+
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+  ASSERT_EQ(7u, Manifest->getNumVariants());
+  EXPECT_EQ("amd64/c", Manifest->getVariantName(0));
+  EXPECT_EQ("amd64/cpp", Manifest->getVariantName(1));
+  EXPECT_EQ("z/cpp", Manifest->getVariantName(6));
+  ASSERT_EQ(2u, Manifest->getAxes().size());
+  EXPECT_EQ(3u, Manifest->getAxisValue(6, 0));
+  EXPECT_EQ(1u, Manifest->getAxisValue(6, 1));
+
+  SmallVector<BruteClangVariantArg, 8> Args;
+  Manifest->getVariantArgs(1, Args);
+  ASSERT_EQ(3u, Args.size());
+  EXPECT_EQ("TR_TARGET_X86", Args[0].Value);
+  EXPECT_EQ("../../compiler/x", Args[1].Value);
+  EXPECT_EQ("CPP", Args[2].Value);
+
+  // File lists naming the same file add up.
+  VariantMask Mask;
+  ASSERT_TRUE(Manifest->lookupFile("Common.cpp", Mask));
+  EXPECT_EQ(7u, Mask.count());
+  ASSERT_TRUE(Manifest->lookupFile("P.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({0, 2, 4, 5}), variants(Mask));
+}
+
+TEST_F(BruteClangManifestTest, variantSets) {
+  addConfig("variants.config", "axis platform amd64 i386 p z\n"
+                               "axis lang c cpp\n"
+                               "group platform x amd64 i386\n");
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+
+  auto evaluate = [&](StringRef Expr) {
+    VariantMask Mask;
+    std::string Error;
+    EXPECT_TRUE(Manifest->evaluateVariantSet(Expr, Mask, Error)) << Error;
+    return variants(Mask);
+  };
+  EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3}), evaluate("platform=x"));
+  EXPECT_EQ(std::vector<unsigned>({1, 3, 5}),
+            evaluate("lang=cpp - platform=z"));
+  EXPECT_EQ(std::vector<unsigned>({0, 2, 4, 5}),
+            evaluate("lang=c & !platform=z | platform=p"));
+  EXPECT_EQ(std::vector<unsigned>({6, 7}),
+            evaluate("platform=z,amd64 - platform=x"));
+  EXPECT_EQ(std::vector<unsigned>({6, 7}), evaluate("!platform=x,p"));
+
+  VariantMask Mask;
+  std::string Error;
+  EXPECT_FALSE(Manifest->evaluateVariantSet("arch=x", Mask, Error));
+  EXPECT_EQ("unknown axis 'arch'", Error);
+  EXPECT_FALSE(Manifest->evaluateVariantSet("platform=x &", Mask, Error));
+  EXPECT_FALSE(Manifest->evaluateVariantSet("(lang=c", Mask, Error));
+}
+
+TEST_F(BruteClangManifestTest, describeVariants) {
+  addConfig("variants.config", "axis platform amd64 i386 p z\n"
+                               "axis lang c cpp\n"
+                               "axis debug on off\n"
+                               "group platform x amd64 i386\n");
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+
+  auto describe = [&](StringRef Expr) {
+    VariantMask Mask;
+    std::string Error, Description;
+    EXPECT_TRUE(Manifest->evaluateVariantSet(Expr, Mask, Error)) << Error;
+    raw_string_ostream OS(Description);
+    Manifest->describeVariants(Mask, OS);
+    return OS.str();
+  };
+  EXPECT_EQ("*", describe("*"));
+  EXPECT_EQ("x/*", describe("platform=x"));
+  EXPECT_EQ("x,p/cpp/*", describe("platform=x,p & lang=cpp"));
+  EXPECT_EQ("*/c/on", describe("lang=c & debug=on"));
+  EXPECT_EQ("x/* | z/c/off", describe("platform=x | platform=z & lang=c & "
+                                      "debug=off"));
+}
+
+TEST_F(BruteClangManifestTest, hundredsOfVariants) {
+  std::string Config = "axis platform amd64 i386 p z\n"
+                       "axis lang c cpp\n"
+                       "axis feature";
+  for (unsigned I = 0; I != 50; ++I)
+    Config += " f" + std::to_string(I);
+  Config += "\nfiles platform=z & feature=f49: z.list\n";
+  addConfig("variants.config", Config);
+  addConfig("z.list", "Z.cpp");
+
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+  ASSERT_EQ(400u, Manifest->getNumVariants());
+  EXPECT_EQ("z/cpp/f49", Manifest->getVariantName(399));
+
+  VariantMask Mask;
+  ASSERT_TRUE(Manifest->lookupFile("Z.cpp", Mask));
+  EXPECT_EQ(std::vector<unsigned>({349, 399}), variants(Mask));
+}
+
+TEST_F(BruteClangManifestTest, sampleVariants) {
+  addConfig("variants.config", "axis platform amd64 i386 p z\n"
+                               "axis lang c cpp\n"
+                               "axis debug on off\n");
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+
+  auto sample = [&](StringRef Expr, unsigned Strength) {
+    VariantMask Candidates, Sample;
+    std::string Error;
+    EXPECT_TRUE(Manifest->evaluateVariantSet(Expr, Candidates, Error)) << Error;
+    Manifest->sampleVariants(Candidates, Strength, Sample);
+    return variants(Sample);
+  };
+
+  // Every pair of values of two axes is had by one of the 8 variants.
+  std::vector<unsigned> Pairwise = sample("*", 2);
+  EXPECT_EQ(std::vector<unsigned>({0, 3, 5, 6, 8, 11, 12, 15}), Pairwise);
+  for (unsigned A = 0; A != 3; ++A) {
+    for (unsigned B = A + 1; B != 3; ++B) {
+      std::set<std::pair<unsigned, unsigned>> Pairs;
+      for (unsigned V : Pairwise)
+        Pairs.insert(std::make_pair(Manifest->getAxisValue(V, A),
+                                    Manifest->getAxisValue(V, B)));
+      EXPECT_EQ(Manifest->getAxes()[A].Values.size() *
+                    Manifest->getAxes()[B].Values.size(),
+                Pairs.size());
+    }
+  }
+
+  EXPECT_EQ(4u, sample("*", 1).size());
+  EXPECT_EQ(16u, sample("*", 3).size());
+
+  // Only candidates are picked, and only their combinations are covered.
+  EXPECT_EQ(std::vector<unsigned>({8, 9, 12, 13}),
+            sample("platform=p,z & lang=c", 2));
+  EXPECT_EQ(std::vector<unsigned>({2}), sample("lang=cpp & debug=on & "
+                                                "platform=amd64", 2));
+}
+
+TEST_F(BruteClangManifestTest, sampleWithoutAxes) {
+  addConfig("common_files.config", "Common.cpp");
+  for (StringRef V : {"amd64", "i386", "p", "z"})
+    addConfig(V.str() + ".config", "");
+
+  auto Manifest = compile();
+  ASSERT_TRUE(Manifest);
+  VariantMask Mask, Sample;
+  ASSERT_TRUE(Manifest->lookupFile("Common.cpp", Mask));
+  Manifest->sampleVariants(Mask, 2, Sample);
+  EXPECT_EQ(std::vector<unsigned>({0, 1, 2, 3}), variants(Sample));
+}
+
+TEST_F(BruteClangManifestTest, variantsConfigErrors) {
+  addConfig("variants.config", "axis platform amd64 i386\n"
+                               "\n"
+                               "files platform=p: p.list\n");
+  std::string Error;
+  EXPECT_FALSE(BruteClangManifest::createFromConfigs(*FS, "/configs", Error));
+  EXPECT_EQ("variants.config:3: unknown value 'p' of axis 'platform'", Error);
+}
+
+} // anonymous namespace
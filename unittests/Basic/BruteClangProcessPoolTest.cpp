@@ -0,0 +1,72 @@
+//===- unittests/Basic/BruteClangProcessPoolTest.cpp - Process pool tests -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangProcessPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <map>
+
+using namespace clang;
+
+namespace {
+
+TEST(BruteClangProcessPoolTest, collectsOutput) {
+  std::map<unsigned, std::string> Outputs;
+  {
+    BruteClangProcessPool Pool(3);
+    for (unsigned I = 0; I != 10; ++I)
+      Pool.async(
+          [I](llvm::raw_ostream &OS) {
+            OS << "job " << I << "\n" << std::string(10000, 'x');
+          },
+          [&Outputs, I](const BruteClangProcessPool::Result &R) {
+            EXPECT_TRUE(R.Succeeded);
+            Outputs[I] = R.Output;
+          });
+    Pool.wait();
+  }
+  ASSERT_EQ(10u, Outputs.size());
+  for (unsigned I = 0; I != 10; ++I)
+    EXPECT_EQ("job " + std::to_string(I) + "\n" + std::string(10000, 'x'),
+              Outputs[I]);
+}
+
+TEST(BruteClangProcessPoolTest, isolatesCrashes) {
+  if (!BruteClangProcessPool::isSupported())
+    return;
+
+  // Jobs run in children, so nothing they do reaches this process.
+  int State = 0;
+  std::vector<BruteClangProcessPool::Result> Results(3);
+  BruteClangProcessPool Pool(2);
+  Pool.async([&](llvm::raw_ostream &OS) { State = 1; OS << "before"; },
+             [&](const BruteClangProcessPool::Result &R) { Results[0] = R; });
+  Pool.async(
+      [](llvm::raw_ostream &OS) {
+        OS << "partial";
+        OS.flush();
+        abort();
+      },
+      [&](const BruteClangProcessPool::Result &R) { Results[1] = R; });
+  Pool.async([](llvm::raw_ostream &OS) { exit(3); },
+             [&](const BruteClangProcessPool::Result &R) { Results[2] = R; });
+  Pool.wait();
+
+  EXPECT_EQ(0, State);
+  EXPECT_TRUE(Results[0].Succeeded);
+  EXPECT_EQ("before", Results[0].Output);
+  EXPECT_FALSE(Results[1].Succeeded);
+  EXPECT_EQ("partial", Results[1].Output);
+  EXPECT_EQ(0u, Results[1].Failure.find("killed by signal"));
+  EXPECT_FALSE(Results[2].Succeeded);
+  EXPECT_EQ("exited with status 3", Results[2].Failure);
+}
+
+} // end anonymous namespace
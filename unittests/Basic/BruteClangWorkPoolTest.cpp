@@ -0,0 +1,68 @@
+//===- unittests/Basic/BruteClangWorkPoolTest.cpp - Work pool tests -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/BruteClangWorkPool.h"
+#include "llvm/Config/llvm-config.h"
+#include "gtest/gtest.h"
+#include <atomic>
+
+using namespace clang;
+
+namespace {
+
+TEST(BruteClangWorkPoolTest, singleWorkerRunsInOrderOnCaller) {
+  BruteClangWorkPool Pool(1);
+  std::vector<int> Order;
+  std::thread::id Caller = std::this_thread::get_id();
+  for (int I = 0; I != 10; ++I)
+    Pool.async([&, I] {
+      EXPECT_EQ(Caller, std::this_thread::get_id());
+      Order.push_back(I);
+    });
+  Pool.wait();
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), Order);
+}
+
+TEST(BruteClangWorkPoolTest, runsEveryJob) {
+  std::atomic<unsigned> Count(0);
+  {
+    BruteClangWorkPool Pool(4);
+    for (unsigned I = 0; I != 1000; ++I)
+      Pool.async([&] { ++Count; });
+    Pool.wait();
+    EXPECT_EQ(1000u, Count);
+
+    // The pool can be reused after wait().
+    Pool.async([&] { ++Count; });
+  }
+  EXPECT_EQ(1001u, Count);
+}
+
+#if LLVM_ENABLE_THREADS
+// Jobs queued behind a long job on one worker are stolen by idle workers.
+TEST(BruteClangWorkPoolTest, idleWorkersSteal) {
+  BruteClangWorkPool Pool(2);
+  std::atomic<bool> Release(false);
+  std::atomic<unsigned> Done(0);
+
+  // Round-robin puts jobs 0, 2, 4, ... on the first queue. Job 0 blocks
+  // until every other job has run, which can only happen by stealing.
+  Pool.async([&] {
+    while (Done != 9)
+      std::this_thread::yield();
+    Release = true;
+  });
+  for (unsigned I = 0; I != 9; ++I)
+    Pool.async([&] { ++Done; });
+  Pool.wait();
+  EXPECT_TRUE(Release);
+}
+#endif
+
+} // anonymous namespace
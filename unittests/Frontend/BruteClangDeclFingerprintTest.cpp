@@ -0,0 +1,215 @@
+//===- unittests/Frontend/BruteClangDeclFingerprintTest.cpp ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangDeclFingerprint.h"
+#include "BruteClangTestInvocation.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+
+using namespace clang;
+
+namespace {
+
+/// Reports every function definition it is handed, as a plugin would.
+class ReportingConsumer : public ASTConsumer {
+  std::vector<std::string> &Checked;
+
+public:
+  explicit ReportingConsumer(std::vector<std::string> &Checked)
+      : Checked(Checked) {}
+
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    for (Decl *D : DG) {
+      auto *Function = dyn_cast<FunctionDecl>(D);
+      if (!Function || !Function->doesThisDeclarationHaveABody())
+        continue;
+      Checked.push_back(Function->getName());
+      DiagnosticsEngine &Diags = Function->getASTContext().getDiagnostics();
+      unsigned DiagID =
+          Diags.getCustomDiagID(DiagnosticsEngine::Warning, "checked %0");
+      Diags.Report(Function->getLocation(), DiagID) << Function->getName();
+    }
+    return true;
+  }
+};
+
+class ReportingAction : public ASTFrontendAction {
+  BruteClangDeclFilter &Filter;
+  std::vector<std::string> &Checked;
+
+public:
+  ReportingAction(BruteClangDeclFilter &Filter,
+                  std::vector<std::string> &Checked)
+      : Filter(Filter), Checked(Checked) {}
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    return Filter.wrapConsumer(llvm::make_unique<ReportingConsumer>(Checked),
+                               "reporter");
+  }
+};
+
+/// Fingerprints every top-level declaration it is handed.
+class FingerprintingConsumer : public ASTConsumer {
+  std::vector<std::string> &Fingerprints;
+
+public:
+  explicit FingerprintingConsumer(std::vector<std::string> &Fingerprints)
+      : Fingerprints(Fingerprints) {}
+
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    for (Decl *D : DG) {
+      std::string Fingerprint;
+      EXPECT_TRUE(computeDeclFingerprint(D, Fingerprint));
+      Fingerprints.push_back(Fingerprint);
+    }
+    return true;
+  }
+};
+
+class FingerprintingAction : public ASTFrontendAction {
+  std::vector<std::string> &Fingerprints;
+
+public:
+  explicit FingerprintingAction(std::vector<std::string> &Fingerprints)
+      : Fingerprints(Fingerprints) {}
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    return llvm::make_unique<FingerprintingConsumer>(Fingerprints);
+  }
+};
+
+class BruteClangDeclFingerprintTest : public ::testing::Test {
+protected:
+  BruteClangDeclFingerprintTest()
+      : InMemoryFileSystem(new vfs::InMemoryFileSystem) {
+    addFile("/src/main.cpp",
+            "#ifdef BROKEN\n"
+            "#include \"missing.h\"\n"
+            "#endif\n"
+            "struct __attribute__((annotate(KIND))) Code { int Size; };\n"
+            "int width() { return WIDTH; }\n"
+            "int twice(int X) { return 2 * X; }\n"
+            "void reset(Code *C) { C->Size = 0; }\n");
+  }
+
+  void addFile(StringRef Path, StringRef Contents) {
+    InMemoryFileSystem->addFile(Path, 0,
+                                llvm::MemoryBuffer::getMemBufferCopy(Contents));
+  }
+
+  /// Create a compiler instance for the variant with -D \p Defines,
+  /// reporting to \p Client if not null.
+  std::unique_ptr<CompilerInstance>
+  createVariant(ArrayRef<StringRef> Defines,
+                DiagnosticConsumer *Client = nullptr) {
+    return createTestInstance(
+        createTestInvocation("/src/main.cpp", None, Defines),
+        InMemoryFileSystem, Client);
+  }
+
+  /// Analyze the variant with -D \p Defines in compiler instance \p CI_ID,
+  /// which is to succeed if \p Succeeds is set, returning the functions the
+  /// consumer was handed.
+  std::vector<std::string> runVariant(ArrayRef<StringRef> Defines,
+                                      unsigned CI_ID, bool Succeeds = true) {
+    auto Compiler =
+        createVariant(Defines, new CustomDiagConsumer(DiagContainer, CI_ID));
+    BruteClangDeclFilter Filter(Checked, CI_ID);
+    std::vector<std::string> Handed;
+    ReportingAction Action(Filter, Handed);
+    EXPECT_EQ(Succeeds, Compiler->ExecuteAction(Action));
+    Filter.finish(DiagContainer);
+    return Handed;
+  }
+
+  /// The messages of the diagnostics compiler instance \p CI_ID reported.
+  std::vector<std::string> getMessages(unsigned CI_ID) {
+    std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+    DiagContainer.GetDiagnostics(CI_ID, Diags);
+    std::vector<std::string> Messages;
+    for (const CustomDiagContainer::RecordedDiagnostic &Diag : Diags)
+      Messages.push_back(Diag.msg);
+    std::sort(Messages.begin(), Messages.end());
+    return Messages;
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> InMemoryFileSystem;
+  CustomDiagContainer DiagContainer;
+  BruteClangCheckedDecls Checked;
+};
+
+TEST_F(BruteClangDeclFingerprintTest, sharedDeclarations) {
+  unsigned Narrow = DiagContainer.AddCompilerInstance("narrow");
+  unsigned Wide = DiagContainer.AddCompilerInstance("wide");
+  unsigned Same = DiagContainer.AddCompilerInstance("same");
+
+  EXPECT_EQ(std::vector<std::string>({"width", "twice", "reset"}),
+            runVariant({"WIDTH=4", "KIND=\"x\""}, Narrow));
+  // Only width reads differently.
+  EXPECT_EQ(std::vector<std::string>({"width"}),
+            runVariant({"WIDTH=8", "KIND=\"x\""}, Wide));
+  // The annotation of Code is part of its fingerprint, and reset is not
+  // compared through the definition of the class it uses.
+  EXPECT_EQ(std::vector<std::string>(),
+            runVariant({"WIDTH=4", "KIND=\"y\""}, Same));
+
+  std::vector<std::string> All = {"checked reset", "checked twice",
+                                  "checked width"};
+  EXPECT_EQ(All, getMessages(Narrow));
+  EXPECT_EQ(All, getMessages(Wide));
+  EXPECT_EQ(All, getMessages(Same));
+}
+
+TEST_F(BruteClangDeclFingerprintTest, fatalErrorsNotShared) {
+  unsigned Broken = DiagContainer.AddCompilerInstance("broken");
+  unsigned Fixed = DiagContainer.AddCompilerInstance("fixed");
+  unsigned Same = DiagContainer.AddCompilerInstance("same");
+
+  // Nothing is reported after the missing include, so the functions the
+  // broken variant checks are checked again for the next one, which shares
+  // them with the last.
+  std::vector<std::string> Functions = {"width", "twice", "reset"};
+  EXPECT_EQ(Functions,
+            runVariant({"BROKEN", "WIDTH=4", "KIND=\"x\""}, Broken, false));
+  EXPECT_EQ(Functions, runVariant({"WIDTH=4", "KIND=\"x\""}, Fixed));
+  EXPECT_EQ(std::vector<std::string>(),
+            runVariant({"WIDTH=4", "KIND=\"x\""}, Same));
+
+  EXPECT_EQ(std::vector<std::string>({"'missing.h' file not found"}),
+            getMessages(Broken));
+  std::vector<std::string> All = {"checked reset", "checked twice",
+                                  "checked width"};
+  EXPECT_EQ(All, getMessages(Fixed));
+  EXPECT_EQ(All, getMessages(Same));
+}
+
+TEST_F(BruteClangDeclFingerprintTest, fingerprints) {
+  std::vector<std::string> First, Second;
+  for (std::vector<std::string> *Fingerprints : {&First, &Second}) {
+    FingerprintingAction Action(*Fingerprints);
+    ASSERT_TRUE(
+        createVariant({"WIDTH=4", "KIND=\"x\""})->ExecuteAction(Action));
+  }
+
+  // The same text parses to the same fingerprints in another ASTContext, and
+  // declarations elsewhere in it differ.
+  ASSERT_EQ(4u, First.size());
+  EXPECT_EQ(First, Second);
+  EXPECT_NE(First[1], First[2]);
+}
+
+} // anonymous namespace
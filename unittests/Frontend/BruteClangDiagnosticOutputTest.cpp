@@ -0,0 +1,163 @@
+//===- unittests/Frontend/BruteClangDiagnosticOutputTest.cpp --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangDiagnosticOutput.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+static VariantMask makeMask(unsigned Size, std::initializer_list<unsigned> Set) {
+  VariantMask Mask(Size);
+  for (unsigned V : Set)
+    Mask.set(V);
+  return Mask;
+}
+
+/// Write a report of one translation unit with two diagnostics, for the
+/// variants \p Names.
+static std::string writeReport(BruteClangDiagnosticWriter::OutputFormat Format,
+                               ArrayRef<StringRef> Names, StringRef TU,
+                               StringRef Message) {
+  std::string Report;
+  llvm::raw_string_ostream OS(Report);
+  auto Writer = BruteClangDiagnosticWriter::create(Format, OS);
+  Writer->beginRun(Names);
+  Writer->beginTranslationUnit(TU, makeMask(Names.size(), {0, 1}));
+  BruteClangOutputDiagnostic Diag;
+  Diag.FileName = "HashTab.hpp";
+  Diag.LineNumber = 81;
+  Diag.ColumnNumber = 5;
+  Diag.DiagID = 42;
+  Diag.Message = "cast loses information";
+  Writer->writeDiagnostic(Diag, makeMask(Names.size(), {0}));
+  Diag.LineNumber = 202;
+  Diag.Message = Message;
+  Writer->writeDiagnostic(Diag, makeMask(Names.size(), {1}));
+  Writer->endTranslationUnit();
+  Writer->endRun();
+  return OS.str();
+}
+
+TEST(BruteClangDiagnosticOutputTest, jsonLines) {
+  StringRef Names[] = {"amd64", "i386"};
+  EXPECT_EQ(
+      "{\"kind\": \"run\", \"version\": 1, \"variants\": [\"amd64\", "
+      "\"i386\"]}\n"
+      "{\"kind\": \"tu\", \"name\": \"a.cpp\", \"variants\": \"3\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"a.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 81, \"column\": 5, \"id\": 42, \"message\": "
+      "\"cast loses information\", \"variants\": \"1\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"a.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 202, \"column\": 5, \"id\": 42, "
+      "\"message\": \"\\\"quoted\\\"\\u000a\", \"variants\": \"2\"}\n",
+      writeReport(BruteClangDiagnosticWriter::JSONLines, Names, "a.cpp",
+                  "\"quoted\"\n"));
+}
+
+// Both formats read back to the same report.
+TEST(BruteClangDiagnosticOutputTest, roundTrip) {
+  StringRef Names[] = {"amd64", "i386"};
+  std::string Expected = writeReport(BruteClangDiagnosticWriter::JSONLines,
+                                     Names, "a.cpp", "\"quoted\"\n");
+  for (auto Format : {BruteClangDiagnosticWriter::JSONLines,
+                      BruteClangDiagnosticWriter::Bitstream}) {
+    std::string Report = writeReport(Format, Names, "a.cpp", "\"quoted\"\n");
+    std::string Replayed, Error;
+    llvm::raw_string_ostream OS(Replayed);
+    auto Writer = BruteClangDiagnosticWriter::create(
+        BruteClangDiagnosticWriter::JSONLines, OS);
+    ASSERT_TRUE(BruteClangDiagnosticWriter::read(Report, *Writer, Error))
+        << Error;
+    EXPECT_EQ(Expected, OS.str());
+  }
+
+  std::string Error;
+  BruteClangDiagnosticMerger Merger;
+  EXPECT_FALSE(BruteClangDiagnosticWriter::read("{\"kind\": \"run\"}\n",
+                                                Merger, Error));
+  EXPECT_EQ("line 1: malformed run", Error);
+}
+
+// Shards over different variants merge by variant name, and a diagnostic
+// both report is reported once, by the variants of both.
+TEST(BruteClangDiagnosticOutputTest, merge) {
+  StringRef ShardNames[] = {"amd64", "i386"};
+  StringRef OtherNames[] = {"p", "amd64"};
+  std::string Shard = writeReport(BruteClangDiagnosticWriter::Bitstream,
+                                  ShardNames, "a.cpp", "first");
+  std::string Other = writeReport(BruteClangDiagnosticWriter::JSONLines,
+                                  OtherNames, "a.cpp", "second");
+  std::string Third = writeReport(BruteClangDiagnosticWriter::JSONLines,
+                                  OtherNames, "b.cpp", "third");
+
+  BruteClangDiagnosticMerger Merger;
+  std::string Error;
+  ASSERT_TRUE(BruteClangDiagnosticWriter::read(Shard, Merger, Error));
+  ASSERT_TRUE(BruteClangDiagnosticWriter::read(Other + Third, Merger, Error));
+
+  std::string Merged;
+  llvm::raw_string_ostream OS(Merged);
+  Merger.emit(*BruteClangDiagnosticWriter::create(
+      BruteClangDiagnosticWriter::JSONLines, OS));
+  EXPECT_EQ(
+      "{\"kind\": \"run\", \"version\": 1, \"variants\": [\"amd64\", "
+      "\"i386\", \"p\"]}\n"
+      "{\"kind\": \"tu\", \"name\": \"a.cpp\", \"variants\": \"7\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"a.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 81, \"column\": 5, \"id\": 42, \"message\": "
+      "\"cast loses information\", \"variants\": \"5\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"a.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 202, \"column\": 5, \"id\": 42, "
+      "\"message\": \"first\", \"variants\": \"2\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"a.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 202, \"column\": 5, \"id\": 42, "
+      "\"message\": \"second\", \"variants\": \"1\"}\n"
+      "{\"kind\": \"tu\", \"name\": \"b.cpp\", \"variants\": \"5\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"b.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 81, \"column\": 5, \"id\": 42, \"message\": "
+      "\"cast loses information\", \"variants\": \"4\"}\n"
+      "{\"kind\": \"diagnostic\", \"tu\": \"b.cpp\", \"file\": "
+      "\"HashTab.hpp\", \"line\": 202, \"column\": 5, \"id\": 42, "
+      "\"message\": \"third\", \"variants\": \"1\"}\n",
+      OS.str());
+}
+
+// A header diagnostic is kept once over the translation units reporting it;
+// those located in the translation unit itself are left out.
+TEST(BruteClangDiagnosticOutputTest, headerDiagnostics) {
+  BruteClangHeaderDiagnostics Headers;
+  BruteClangOutputDiagnostic Diag;
+  Diag.FileName = "HashTab.hpp";
+  Diag.LineNumber = 81;
+  Diag.Message = "cast loses information";
+  BruteClangOutputDiagnostic Local = Diag;
+  Local.FileName = "a.cpp";
+
+  Headers.beginTranslationUnit("a.cpp", makeMask(3, {0, 1, 2}));
+  Headers.writeDiagnostic(Diag, makeMask(3, {1}));
+  Headers.writeDiagnostic(Local, makeMask(3, {0}));
+  Headers.endTranslationUnit();
+  Headers.beginTranslationUnit("b.cpp", makeMask(3, {0, 1, 2}));
+  Headers.writeDiagnostic(Diag, makeMask(3, {2}));
+  Headers.endTranslationUnit();
+
+  ASSERT_EQ(1u, Headers.getDiagnostics().size());
+  const BruteClangHeaderDiagnostics::HeaderDiagnostic &HD =
+      Headers.getDiagnostics()[0];
+  EXPECT_EQ("HashTab.hpp", HD.Diag.FileName);
+  EXPECT_TRUE(HD.Variants == makeMask(3, {1, 2}));
+  ASSERT_EQ(2u, HD.TranslationUnits.size());
+  EXPECT_EQ("a.cpp", HD.TranslationUnits[0]);
+  EXPECT_EQ("b.cpp", HD.TranslationUnits[1]);
+}
+
+} // anonymous namespace
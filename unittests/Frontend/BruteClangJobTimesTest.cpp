@@ -0,0 +1,62 @@
+//===- unittests/Frontend/BruteClangJobTimesTest.cpp ----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangJobTimes.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+// Untimed jobs are estimated from the other variants of their file, and
+// otherwise from the cost of their file.
+TEST(BruteClangJobTimesTest, estimate) {
+  BruteClangJobTimes Times;
+  EXPECT_EQ(100, Times.estimate("a.cpp", "amd64", 100));
+
+  Times.record("a.cpp", "amd64", 1000, 4);
+  Times.record("a.cpp", "i386", 1000, 2);
+  Times.record("a.cpp", "i386", 1000, 6);
+  EXPECT_EQ(4, Times.estimate("a.cpp", "amd64", 1000));
+  EXPECT_EQ(5, Times.estimate("a.cpp", "p", 1000));
+  // 10 seconds for 2000 units of cost.
+  EXPECT_EQ(2.5, Times.estimate("b.cpp", "amd64", 500));
+}
+
+TEST(BruteClangJobTimesTest, saveAndLoad) {
+  SmallString<128> Path;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("job-times-test", "txt", Path));
+  llvm::sys::fs::remove(Path);
+
+  std::string Error;
+  BruteClangJobTimes Times;
+  ASSERT_TRUE(Times.load(Path, Error)) << Error;
+  Times.record("dir/a b.cpp", "amd64", 1000, 1.5);
+  ASSERT_TRUE(Times.save(Path, Error)) << Error;
+
+  BruteClangJobTimes Loaded;
+  ASSERT_TRUE(Loaded.load(Path, Error)) << Error;
+  EXPECT_EQ(1.5, Loaded.estimate("dir/a b.cpp", "amd64", 0));
+  EXPECT_EQ(0.75, Loaded.estimate("c.cpp", "amd64", 500));
+  llvm::sys::fs::remove(Path);
+}
+
+TEST(BruteClangJobTimesTest, fileCostAndMakespan) {
+  EXPECT_EQ(2 * 16384 + 39.0,
+            BruteClangJobTimes::getFileCost("#include \"a.h\"\n"
+                                            "  #  include <b>\n"
+                                            "int x;\n"));
+  EXPECT_EQ(5, BruteClangJobTimes::getIdealMakespan({5, 1, 1}, 2));
+  EXPECT_EQ(4, BruteClangJobTimes::getIdealMakespan({3, 3, 2}, 2));
+}
+
+} // anonymous namespace
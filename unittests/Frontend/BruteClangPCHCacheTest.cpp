@@ -0,0 +1,223 @@
+//===- unittests/Frontend/BruteClangPCHCacheTest.cpp ----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangPCHCache.h"
+#include "BruteClangTestInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+typedef std::vector<BruteClangPCHCache::IncludeDirective> IncludeBlock;
+
+IncludeBlock getLeadingIncludes(StringRef Source) {
+  IncludeBlock Includes;
+  BruteClangPCHCache::getLeadingIncludes(Source, Includes);
+  return Includes;
+}
+
+TEST(BruteClangPCHCacheTest, leadingIncludes) {
+  IncludeBlock Includes = getLeadingIncludes(
+      "// License header\n"
+      "/* More comments */\n"
+      "#include \"env/FrontEnd.hpp\"\n"
+      "  #  include <stdint.h>  // trailing comment\n"
+      "#include <sys/types.h>\n"
+      "#include \"il/Node.hpp\"\n"
+      "#define X 1\n"
+      "#include \"Late.hpp\"\n");
+  ASSERT_EQ(4u, Includes.size());
+  EXPECT_EQ("#include \"env/FrontEnd.hpp\"", Includes[0].Text);
+  EXPECT_EQ("env/FrontEnd.hpp", Includes[0].Name);
+  EXPECT_FALSE(Includes[0].IsAngled);
+  EXPECT_EQ("#  include <stdint.h>", Includes[1].Text);
+  EXPECT_EQ("stdint.h", Includes[1].Name);
+  EXPECT_TRUE(Includes[1].IsAngled);
+  EXPECT_EQ("sys/types.h", Includes[2].Name);
+  EXPECT_EQ("il/Node.hpp", Includes[3].Name);
+
+  // Conditionals, computed includes and code end the block.
+  EXPECT_EQ(1u, getLeadingIncludes("#include <a.h>\n"
+                                   "#ifdef X\n"
+                                   "#include <b.h>\n"
+                                   "#endif\n")
+                    .size());
+  EXPECT_EQ(0u, getLeadingIncludes("#include HEADER\n").size());
+  EXPECT_EQ(0u, getLeadingIncludes("int x;\n#include <a.h>\n").size());
+  EXPECT_EQ(0u, getLeadingIncludes("#include <a.h> int x;\n").size());
+}
+
+TEST(BruteClangPCHCacheTest, blockLengths) {
+  std::vector<IncludeBlock> Blocks = {
+      getLeadingIncludes("#include <a.h>\n#include <b.h>\n#include <c.h>\n"),
+      getLeadingIncludes("#include <x.h>\n#include <y.h>\n"),
+      getLeadingIncludes("#include <a.h>\n#include <b.h>\n#include <d.h>\n"),
+      getLeadingIncludes("#include <a.h>\n#include <e.h>\n"),
+      getLeadingIncludes(""),
+  };
+  std::vector<unsigned> Lengths = BruteClangPCHCache::getBlockLengths(Blocks);
+  ASSERT_EQ(5u, Lengths.size());
+  // a, b shared with the third unit.
+  EXPECT_EQ(2u, Lengths[0]);
+  // Shares nothing, so the whole block.
+  EXPECT_EQ(2u, Lengths[1]);
+  EXPECT_EQ(2u, Lengths[2]);
+  // a shared with the first and third units.
+  EXPECT_EQ(1u, Lengths[3]);
+  EXPECT_EQ(0u, Lengths[4]);
+}
+
+
+// Builds the include blocks of files in a temporary directory, which is made
+// the current one so the files can be named relative to it, as BruteClang's
+// inputs usually are.
+class BruteClangPCHCacheBuildTest : public ::testing::Test {
+protected:
+  SmallString<128> Root, SavedDir, CacheDir;
+
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("pch-cache-test", Root));
+    ASSERT_FALSE(llvm::sys::fs::current_path(SavedDir));
+    ASSERT_FALSE(llvm::sys::fs::set_current_path(Root));
+    CacheDir = Root;
+    llvm::sys::path::append(CacheDir, "cache");
+
+    writeFile("src/main.cpp", "#include \"Local.hpp\"\n"
+                              "#include <Common.hpp>\n"
+                              "int main();\n");
+    writeFile("src/Local.hpp", "#ifndef LOCAL\n"
+                               "#define LOCAL\n"
+                               "#warning local header\n"
+                               "#endif\n");
+    writeFile("other/main.cpp", "#include \"Local.hpp\"\n"
+                                "#include <Common.hpp>\n");
+    writeFile("other/Local.hpp", "#ifndef OTHER_LOCAL\n"
+                                 "#define OTHER_LOCAL\n"
+                                 "#warning other local header\n"
+                                 "#endif\n");
+    writeFile("inc/Common.hpp", "#ifndef COMMON\n"
+                                "#define COMMON\n"
+                                "int common();\n"
+                                "#endif\n");
+  }
+
+  void TearDown() override {
+    llvm::sys::fs::set_current_path(SavedDir);
+    llvm::sys::fs::remove_directories(Root);
+  }
+
+  static void writeFile(StringRef Path, StringRef Contents) {
+    llvm::sys::fs::create_directories(llvm::sys::path::parent_path(Path));
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << Contents;
+  }
+
+  static std::shared_ptr<CompilerInvocation>
+  createInvocation(StringRef MainFile) {
+    return createTestInvocation(MainFile, {"inc"});
+  }
+
+  /// Get the precompiled leading includes of \p MainFile from a cache as a
+  /// new run would.
+  std::shared_ptr<const BruteClangPCHCache::Entry> getPCH(StringRef MainFile) {
+    auto Buffer = llvm::MemoryBuffer::getFile(MainFile);
+    if (!Buffer)
+      return nullptr;
+    IncludeBlock Includes;
+    BruteClangPCHCache::getLeadingIncludes((*Buffer)->getBuffer(), Includes);
+    BruteClangPCHCache Cache(CacheDir, vfs::getRealFileSystem(),
+                             std::make_shared<PCHContainerOperations>());
+    return Cache.getPCH(*createInvocation(MainFile), MainFile, Includes);
+  }
+
+  /// Get the diagnostics of \p MainFile compiled without a PCH.
+  static std::vector<CustomDiagContainer::RecordedDiagnostic>
+  getDiagnostics(StringRef MainFile) {
+    CustomDiagContainer DiagContainer;
+    unsigned CI_ID = DiagContainer.AddCompilerInstance("plain");
+    auto Clang =
+        createTestInstance(createInvocation(MainFile), nullptr,
+                           new CustomDiagConsumer(DiagContainer, CI_ID));
+    SyntaxOnlyAction Action;
+    EXPECT_TRUE(Clang->ExecuteAction(Action));
+    std::vector<CustomDiagContainer::RecordedDiagnostic> Diags;
+    DiagContainer.GetDiagnostics(CI_ID, Diags);
+    return Diags;
+  }
+};
+
+TEST_F(BruteClangPCHCacheBuildTest, buildKeepsHeaderNames) {
+  auto PCH = getPCH("src/main.cpp");
+  ASSERT_TRUE(PCH);
+  EXPECT_TRUE(llvm::sys::fs::exists(PCH->PCHPath));
+
+  // The diagnostics of the block are located as without the PCH, so they
+  // are grouped with those of the variants not using it.
+  auto Diags = getDiagnostics("src/main.cpp");
+  ASSERT_EQ(1u, Diags.size());
+  EXPECT_EQ("src/Local.hpp", Diags[0].FileName);
+  ASSERT_EQ(1u, PCH->Diags.size());
+  EXPECT_EQ(Diags[0].FileName, PCH->Diags[0].FileName);
+  EXPECT_EQ(Diags[0].msg, PCH->Diags[0].msg);
+  EXPECT_EQ(Diags[0].LineNumber, PCH->Diags[0].LineNumber);
+}
+
+TEST_F(BruteClangPCHCacheBuildTest, quotedIncludesOfOtherDirectories) {
+  // The same block includes another Local.hpp next to another main file.
+  auto PCH = getPCH("src/main.cpp");
+  auto OtherPCH = getPCH("other/main.cpp");
+  ASSERT_TRUE(PCH);
+  ASSERT_TRUE(OtherPCH);
+  EXPECT_NE(PCH->PCHPath, OtherPCH->PCHPath);
+  ASSERT_EQ(1u, OtherPCH->Diags.size());
+  EXPECT_EQ("other/Local.hpp", OtherPCH->Diags[0].FileName);
+}
+
+TEST_F(BruteClangPCHCacheBuildTest, loadUnchanged) {
+  auto Built = getPCH("src/main.cpp");
+  ASSERT_TRUE(Built);
+
+  // A later run loads the PCH with the diagnostics of its build.
+  auto Loaded = getPCH("src/main.cpp");
+  ASSERT_TRUE(Loaded);
+  EXPECT_EQ(Built->PCHPath, Loaded->PCHPath);
+  ASSERT_EQ(1u, Loaded->Diags.size());
+  EXPECT_EQ("src/Local.hpp", Loaded->Diags[0].FileName);
+  EXPECT_EQ(Built->Diags[0].msg, Loaded->Diags[0].msg);
+}
+
+TEST_F(BruteClangPCHCacheBuildTest, invalidatedByHeaderChange) {
+  auto Built = getPCH("src/main.cpp");
+  ASSERT_TRUE(Built);
+
+  writeFile("inc/Common.hpp", "#ifndef COMMON\n"
+                              "#define COMMON\n"
+                              "int common(int);\n"
+                              "#endif\n");
+  auto Rebuilt = getPCH("src/main.cpp");
+  ASSERT_TRUE(Rebuilt);
+  EXPECT_NE(Built->PCHPath, Rebuilt->PCHPath);
+  EXPECT_TRUE(llvm::sys::fs::exists(Rebuilt->PCHPath));
+}
+
+TEST_F(BruteClangPCHCacheBuildTest, unguardedHeaderNotPrecompiled) {
+  writeFile("src/Local.hpp", "int local();\n");
+  EXPECT_FALSE(getPCH("src/main.cpp"));
+}
+
+} // anonymous namespace
@@ -0,0 +1,180 @@
+//===- unittests/Frontend/BruteClangResultCacheTest.cpp -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangResultCache.h"
+#include "BruteClangTestInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+typedef std::vector<CustomDiagContainer::RecordedDiagnostic> DiagList;
+
+class BruteClangResultCacheTest : public ::testing::Test {
+protected:
+  SmallString<128> CacheDir;
+
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("result-cache-test", CacheDir));
+  }
+
+  void TearDown() override {
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator I(CacheDir, EC), E; I != E && !EC;
+         I.increment(EC))
+      llvm::sys::fs::remove(I->path());
+    llvm::sys::fs::remove(CacheDir);
+  }
+
+  /// Create the files of a run, the header with \p HeaderText.
+  static IntrusiveRefCntPtr<vfs::InMemoryFileSystem>
+  createFiles(StringRef HeaderText, time_t ModTime) {
+    IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(new vfs::InMemoryFileSystem);
+    FS->addFile("/src/main.cpp", ModTime,
+                llvm::MemoryBuffer::getMemBuffer("#include \"main.hpp\"\n"));
+    FS->addFile("/src/main.hpp", ModTime,
+                llvm::MemoryBuffer::getMemBuffer(HeaderText));
+    return FS;
+  }
+
+  static BruteClangResultCache::FileCollector collectFiles() {
+    BruteClangResultCache::FileCollector Deps;
+    for (StringRef File : {"/src/main.cpp", "/src/main.hpp"})
+      Deps.maybeAddDependency(File, false, false, false, false);
+    return Deps;
+  }
+
+  static DiagList getDiags() {
+    CustomDiagContainer::RecordedDiagnostic Diag = {"/src/main.hpp",
+                                                    "unused variable 'x'", 3,
+                                                    5};
+    return DiagList(1, Diag);
+  }
+};
+
+TEST_F(BruteClangResultCacheTest, keys) {
+  BruteClangResultCache Cache(CacheDir, createFiles("", 0), "tools");
+  const char *Argv[] = {"-fsyntax-only", "/src/main.cpp"};
+  BruteClangVariantArg PowerArgs[] = {{BruteClangVariantArg::Define, "POWER"}};
+  BruteClangVariantArg X86Args[] = {{BruteClangVariantArg::Define, "X86"}};
+  EXPECT_EQ(Cache.getKey(Argv, PowerArgs), Cache.getKey(Argv, PowerArgs));
+  EXPECT_NE(Cache.getKey(Argv, PowerArgs), Cache.getKey(Argv, X86Args));
+  EXPECT_NE(Cache.getKey(Argv, PowerArgs),
+            Cache.getKey(makeArrayRef(Argv).drop_back(), PowerArgs));
+
+  BruteClangResultCache Rebuilt(CacheDir, createFiles("", 0), "new tools");
+  EXPECT_NE(Cache.getKey(Argv, PowerArgs), Rebuilt.getKey(Argv, PowerArgs));
+}
+
+TEST_F(BruteClangResultCacheTest, replayUnchanged) {
+  {
+    BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 0), "tools");
+    DiagList Diags;
+    EXPECT_FALSE(Cache.lookup("key", Diags));
+    Cache.store("key", collectFiles(), getDiags());
+  }
+
+  // A later run with touched but unchanged files.
+  BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 100), "tools");
+  DiagList Diags;
+  ASSERT_TRUE(Cache.lookup("key", Diags));
+  ASSERT_EQ(1u, Diags.size());
+  EXPECT_EQ("/src/main.hpp", Diags[0].FileName);
+  EXPECT_EQ("unused variable 'x'", Diags[0].msg);
+  EXPECT_EQ(3u, Diags[0].LineNumber);
+  EXPECT_EQ(5u, Diags[0].ColumnNumber);
+}
+
+TEST_F(BruteClangResultCacheTest, invalidatedByChange) {
+  {
+    BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 0), "tools");
+    Cache.store("key", collectFiles(), getDiags());
+  }
+
+  // Same size, different contents.
+  BruteClangResultCache Cache(CacheDir, createFiles("int y;\n", 0), "tools");
+  DiagList Diags;
+  EXPECT_FALSE(Cache.lookup("key", Diags));
+  EXPECT_TRUE(Diags.empty());
+}
+
+TEST_F(BruteClangResultCacheTest, invalidatedByShadowingHeader) {
+  {
+    BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 0), "tools");
+    BruteClangResultCache::FileCollector Deps = collectFiles();
+    Deps.addAbsentPath("/inc/main.hpp");
+    Cache.store("key", Deps, getDiags());
+  }
+
+  {
+    BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 0), "tools");
+    DiagList Diags;
+    EXPECT_TRUE(Cache.lookup("key", Diags));
+  }
+
+  // A header found ahead of the one the diagnostics were computed from.
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS = createFiles("int x;\n", 0);
+  FS->addFile("/inc/main.hpp", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  BruteClangResultCache Cache(CacheDir, FS, "tools");
+  DiagList Diags;
+  EXPECT_FALSE(Cache.lookup("key", Diags));
+}
+
+TEST_F(BruteClangResultCacheTest, collectsHeaderSearches) {
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(new vfs::InMemoryFileSystem);
+  auto AddFile = [&](StringRef Path, StringRef Contents) {
+    FS->addFile(Path, 0, llvm::MemoryBuffer::getMemBufferCopy(Contents));
+  };
+  AddFile("/src/main.cpp", "#include \"Local.hpp\"\n"
+                           "#include \"Common.hpp\"\n"
+                           "#include <Wrap.hpp>\n"
+                           "#if __has_include(<None.hpp>)\n"
+                           "#endif\n");
+  AddFile("/src/Local.hpp", "");
+  AddFile("/a/Wrap.hpp", "#include_next <Wrap.hpp>\n");
+  AddFile("/c/Wrap.hpp", "");
+  AddFile("/c/Common.hpp", "");
+  AddFile("/b/Unrelated.hpp", "");
+
+  auto Compiler = createTestInstance(
+      createTestInvocation("/src/main.cpp", {"/a", "/b", "/c"}), FS);
+  auto Deps = std::make_shared<BruteClangResultCache::FileCollector>();
+  Compiler->addDependencyCollector(Deps);
+  SyntaxOnlyAction Action;
+  ASSERT_TRUE(Compiler->ExecuteAction(Action));
+
+  EXPECT_FALSE(Deps->hasMissingFiles());
+  EXPECT_FALSE(Deps->hasUntrackedLookups());
+  std::vector<std::string> Expected = {
+      // "Common.hpp", from the includer's directory on.
+      "/src/Common.hpp", "/a/Common.hpp", "/b/Common.hpp",
+      // The #include_next of /a/Wrap.hpp.
+      "/b/Wrap.hpp",
+      // __has_include(<None.hpp>), which found nothing.
+      "/a/None.hpp", "/b/None.hpp", "/c/None.hpp"};
+  EXPECT_EQ(Expected, Deps->getAbsentPaths().vec());
+}
+
+TEST_F(BruteClangResultCacheTest, missingFilesNotStored) {
+  BruteClangResultCache Cache(CacheDir, createFiles("int x;\n", 0), "tools");
+  BruteClangResultCache::FileCollector Deps = collectFiles();
+  Deps.maybeAddDependency("Missing.hpp", false, false, false, true);
+  Cache.store("key", Deps, getDiags());
+  DiagList Diags;
+  EXPECT_FALSE(Cache.lookup("key", Diags));
+}
+
+} // end anonymous namespace
@@ -0,0 +1,67 @@
+//===- unittests/Frontend/BruteClangTestInvocation.h ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  Provides the compiler invocations and instances the BruteClang frontend
+//  tests analyze their variants with.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_UNITTESTS_FRONTEND_BRUTECLANGTESTINVOCATION_H
+#define LLVM_CLANG_UNITTESTS_FRONTEND_BRUTECLANGTESTINVOCATION_H
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+
+namespace clang {
+
+/// Create the invocation of a variant parsing the C++ file \p MainFile for
+/// x86_64 Linux, with an -I for each of \p Dirs and a -D for each of
+/// \p Defines. The builtin and standard include directories are left out, so
+/// that only the files of the test are found.
+inline std::shared_ptr<CompilerInvocation>
+createTestInvocation(StringRef MainFile, ArrayRef<StringRef> Dirs = None,
+                     ArrayRef<StringRef> Defines = None) {
+  auto Invocation = std::make_shared<CompilerInvocation>();
+  Invocation->getFrontendOpts().Inputs.push_back(
+      FrontendInputFile(MainFile, InputKind::CXX));
+  Invocation->getFrontendOpts().ProgramAction = frontend::ParseSyntaxOnly;
+  Invocation->getTargetOpts().Triple = "x86_64-unknown-linux-gnu";
+  HeaderSearchOptions &HSOpts = Invocation->getHeaderSearchOpts();
+  HSOpts.UseBuiltinIncludes = false;
+  HSOpts.UseStandardSystemIncludes = false;
+  HSOpts.UseStandardCXXIncludes = false;
+  for (StringRef Dir : Dirs)
+    HSOpts.AddPath(Dir, frontend::Angled, false, true);
+  for (StringRef Define : Defines)
+    Invocation->getPreprocessorOpts().addMacroDef(Define);
+  return Invocation;
+}
+
+/// Create a compiler instance running \p Invocation, reporting to \p Client
+/// if not null and reading the files of \p FS if not null.
+inline std::unique_ptr<CompilerInstance>
+createTestInstance(std::shared_ptr<CompilerInvocation> Invocation,
+                   IntrusiveRefCntPtr<vfs::FileSystem> FS = nullptr,
+                   DiagnosticConsumer *Client = nullptr) {
+  std::unique_ptr<CompilerInstance> Compiler(new CompilerInstance);
+  Compiler->setInvocation(std::move(Invocation));
+  Compiler->createDiagnostics(Client);
+  if (FS)
+    Compiler->setFileManager(new FileManager(FileSystemOptions(), FS));
+  return Compiler;
+}
+
+} // end namespace clang
+
+#endif // LLVM_CLANG_UNITTESTS_FRONTEND_BRUTECLANGTESTINVOCATION_H
@@ -0,0 +1,55 @@
+//===- unittests/Frontend/BruteClangTokenFingerprintTest.cpp --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangTokenFingerprint.h"
+#include "BruteClangTestInvocation.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+/// Fingerprint \p Source preprocessed with -D \p Define.
+std::string getFingerprint(StringRef Source, StringRef Define) {
+  auto Invocation = createTestInvocation("test.cc", None, {Define});
+  Invocation->getPreprocessorOpts().addRemappedFile(
+      "test.cc", llvm::MemoryBuffer::getMemBufferCopy(Source).release());
+  auto Compiler = createTestInstance(std::move(Invocation));
+
+  std::string Fingerprint;
+  EXPECT_TRUE(computeTokenFingerprint(*Compiler, Fingerprint));
+  return Fingerprint;
+}
+
+TEST(BruteClangTokenFingerprintTest, untestedMacros) {
+  StringRef Source = "#ifdef TR_TARGET_X86\n"
+                     "#define WIDTH 4\n"
+                     "#else\n"
+                     "#define WIDTH 4\n"
+                     "#endif\n"
+                     "int x = WIDTH;\n";
+  EXPECT_EQ(getFingerprint(Source, "TR_HOST_X86"),
+            getFingerprint(Source, "TR_HOST_POWER"));
+  // Same tokens, but spelled on different lines.
+  EXPECT_NE(getFingerprint(Source, "TR_HOST_X86"),
+            getFingerprint(Source, "TR_TARGET_X86"));
+}
+
+TEST(BruteClangTokenFingerprintTest, testedMacros) {
+  StringRef Source = "#ifdef TR_TARGET_X86\n"
+                     "int x;\n"
+                     "#endif\n";
+  EXPECT_NE(getFingerprint(Source, "TR_TARGET_X86"),
+            getFingerprint(Source, "TR_TARGET_POWER"));
+  EXPECT_NE(getFingerprint("int x = VALUE;\n", "VALUE=1"),
+            getFingerprint("int x = VALUE;\n", "VALUE=2"));
+}
+
+} // anonymous namespace
@@ -0,0 +1,78 @@
+//===- unittests/Frontend/BruteClangVariantProfileTest.cpp ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangVariantProfile.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+TEST(BruteClangVariantProfileTest, phaseTimerNests) {
+  BruteClangPhaseTimer Timer;
+  {
+    BruteClangPhaseRegion Outer(&Timer);
+    BruteClangPhaseRegion Inner(&Timer);
+  }
+  BruteClangPhaseRegion None(nullptr);
+  EXPECT_EQ(1u, Timer.getCount());
+  EXPECT_LE(0, Timer.getTotal().Wall);
+}
+
+TEST(BruteClangVariantProfileTest, recordsPhases) {
+  auto Invocation = std::make_shared<CompilerInvocation>();
+  Invocation->getPreprocessorOpts().addRemappedFile(
+      "test.cc", llvm::MemoryBuffer::getMemBufferCopy(
+                     "#ifdef TR_TARGET_X86\n"
+                     "int x;\n"
+                     "#endif\n"
+                     "#define WIDTH 4\n"
+                     "int y = WIDTH;\n")
+                     .release());
+  Invocation->getFrontendOpts().Inputs.push_back(
+      FrontendInputFile("test.cc", InputKind::CXX));
+  Invocation->getFrontendOpts().ProgramAction = frontend::ParseSyntaxOnly;
+  Invocation->getTargetOpts().Triple = "x86_64-unknown-linux-gnu";
+
+  auto Profile = std::make_shared<BruteClangVariantProfile>();
+  Profile->FileName = "dir/\"test\".cc";
+  Profile->VariantName = "amd64";
+  Invocation->getFrontendOpts().VariantProfile = Profile;
+  Invocation->getPreprocessorOpts().DirectiveTimer = Profile->Directives;
+
+  CompilerInstance Compiler;
+  Compiler.setInvocation(std::move(Invocation));
+  Compiler.createDiagnostics();
+  SyntaxOnlyAction Action;
+  ASSERT_TRUE(Compiler.ExecuteAction(Action));
+  Profile->recordMemory(Compiler);
+
+  // #ifdef, #endif and #define, plus those of the predefines.
+  EXPECT_LE(3u, Profile->Directives->getCount());
+  EXPECT_LT(0u, Profile->ASTBytes);
+  EXPECT_LT(0u, Profile->PreprocessorBytes);
+
+  std::string JSON;
+  llvm::raw_string_ostream OS(JSON);
+  Profile->writeJSON(OS);
+  OS.flush();
+  EXPECT_EQ(0u, JSON.find("{\"file\": \"dir/\\\"test\\\".cc\", "
+                          "\"variant\": \"amd64\", \"outcome\": \"analyzed\""));
+  EXPECT_NE(std::string::npos, JSON.find("\"consumers\": {\"main action\": {"));
+  EXPECT_NE(std::string::npos, JSON.find("\"parse_sema\": {\"wall\": "));
+  EXPECT_EQ(std::string::npos, JSON.find('\n'));
+}
+
+} // anonymous namespace
@@ -0,0 +1,135 @@
+//===- unittests/Frontend/BruteClangVariantSensitivityTest.cpp ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/BruteClangVariantSensitivity.h"
+#include "BruteClangTestInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+class BruteClangVariantSensitivityTest : public ::testing::Test {
+protected:
+  BruteClangVariantSensitivityTest()
+      : InMemoryFileSystem(new vfs::InMemoryFileSystem) {
+    for (const char *Name : {"TR_HOST_POWER", "TR_HOST_X86", "TR_DEBUG"})
+      WatchedMacros.insert(Name);
+    addFile("/src/main.cpp", "#include \"Target.hpp\"\n"
+                             "#ifdef TR_HOST_X86\n"
+                             "int x;\n"
+                             "#endif\n"
+                             "int y = WIDTH;\n");
+    addFile("/p/Target.hpp", "#define WIDTH 4\n");
+    addFile("/x/Target.hpp", "#define WIDTH 8\n");
+  }
+
+  void addFile(StringRef Path, StringRef Contents) {
+    InMemoryFileSystem->addFile(Path, 0,
+                                llvm::MemoryBuffer::getMemBufferCopy(Contents));
+  }
+
+  /// Create the compiler instance of a variant of /src/main.cpp with -I
+  /// \p Dir and -D \p Defines.
+  std::unique_ptr<CompilerInstance>
+  createVariant(StringRef Dir, ArrayRef<StringRef> Defines) {
+    return createVariant("/src/main.cpp", {Dir}, Defines);
+  }
+
+  /// Create the compiler instance of a variant of \p MainFile with an -I for
+  /// each of \p Dirs and -D \p Defines.
+  std::unique_ptr<CompilerInstance>
+  createVariant(StringRef MainFile, ArrayRef<StringRef> Dirs,
+                ArrayRef<StringRef> Defines) {
+    return createTestInstance(createTestInvocation(MainFile, Dirs, Defines),
+                              InMemoryFileSystem);
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> InMemoryFileSystem;
+  llvm::StringSet<> WatchedMacros;
+};
+
+TEST_F(BruteClangVariantSensitivityTest, equivalentVariants) {
+  auto Recorded = createVariant("/p", {"TR_HOST_POWER"});
+  BruteClangVariantSensitivity Sensitivity(WatchedMacros,
+                                           Recorded->getPreprocessorOpts());
+  Recorded->addDependencyCollector(Sensitivity.createRecorder());
+  SyntaxOnlyAction Action;
+  ASSERT_TRUE(Recorded->ExecuteAction(Action));
+  ASSERT_TRUE(Sensitivity.isComplete());
+  EXPECT_EQ(1u, Sensitivity.getNumQueriedMacros());
+  EXPECT_EQ(1u, Sensitivity.getNumIncludeLookups());
+
+  // Macros the file never mentions do not matter.
+  EXPECT_TRUE(
+      Sensitivity.matches(*createVariant("/p", {"TR_HOST_POWER", "TR_DEBUG"})));
+  EXPECT_TRUE(Sensitivity.matches(*createVariant("/p", {"TR_HOST_POWER=2"})));
+  // Target.hpp found elsewhere.
+  EXPECT_FALSE(Sensitivity.matches(*createVariant("/x", {"TR_HOST_POWER"})));
+  // TR_HOST_X86 is tested.
+  EXPECT_FALSE(Sensitivity.matches(*createVariant("/p", {"TR_HOST_X86"})));
+}
+
+// An #include_next is replayed from the directory after the one the
+// including header was found in, whatever precedes that directory.
+TEST_F(BruteClangVariantSensitivityTest, includeNext) {
+  addFile("/src/next.cpp", "#include <Wrap.hpp>\n"
+                           "int y = WIDTH;\n");
+  addFile("/p/Wrap.hpp", "#include_next <Wrap.hpp>\n");
+  addFile("/common/Wrap.hpp", "#define WIDTH 4\n");
+  addFile("/shadow/Wrap.hpp", "#define WIDTH 8\n");
+  addFile("/empty/Unrelated.hpp", "");
+
+  auto Recorded = createVariant("/src/next.cpp", {"/p", "/common"}, {});
+  BruteClangVariantSensitivity Sensitivity(WatchedMacros,
+                                           Recorded->getPreprocessorOpts());
+  Recorded->addDependencyCollector(Sensitivity.createRecorder());
+  SyntaxOnlyAction Action;
+  ASSERT_TRUE(Recorded->ExecuteAction(Action));
+  ASSERT_TRUE(Sensitivity.isComplete());
+  EXPECT_EQ(2u, Sensitivity.getNumIncludeLookups());
+
+  EXPECT_TRUE(Sensitivity.matches(
+      *createVariant("/src/next.cpp", {"/p", "/common"}, {"TR_DEBUG"})));
+  // A directory without Wrap.hpp between the two changes nothing.
+  EXPECT_TRUE(Sensitivity.matches(
+      *createVariant("/src/next.cpp", {"/p", "/empty", "/common"}, {})));
+  // The #include_next finds another Wrap.hpp first.
+  EXPECT_FALSE(Sensitivity.matches(
+      *createVariant("/src/next.cpp", {"/p", "/shadow", "/common"}, {})));
+  // The #include_next finds nothing.
+  EXPECT_FALSE(
+      Sensitivity.matches(*createVariant("/src/next.cpp", {"/p"}, {})));
+  // The #include finds the end of the chain straight away.
+  EXPECT_FALSE(Sensitivity.matches(
+      *createVariant("/src/next.cpp", {"/common", "/p"}, {})));
+}
+
+// Lookups made by __has_include are not seen by the recorder, so a unit
+// using it is never considered equivalent to another variant.
+TEST_F(BruteClangVariantSensitivityTest, hasInclude) {
+  addFile("/src/has.cpp", "#if __has_include(<Target.hpp>)\n"
+                          "#include <Target.hpp>\n"
+                          "#else\n"
+                          "#define WIDTH 2\n"
+                          "#endif\n"
+                          "int y = WIDTH;\n");
+
+  auto Recorded = createVariant("/src/has.cpp", {"/p"}, {});
+  BruteClangVariantSensitivity Sensitivity(WatchedMacros,
+                                           Recorded->getPreprocessorOpts());
+  Recorded->addDependencyCollector(Sensitivity.createRecorder());
+  SyntaxOnlyAction Action;
+  ASSERT_TRUE(Recorded->ExecuteAction(Action));
+  EXPECT_FALSE(Sensitivity.isComplete());
+}
+
+} // anonymous namespace
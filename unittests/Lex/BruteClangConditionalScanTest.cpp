@@ -0,0 +1,183 @@
+//===- unittests/Lex/BruteClangConditionalScanTest.cpp --------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/BruteClangConditionalScan.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/MemoryBufferCache.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/ModuleLoader.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+TEST(BruteClangConditionalScanTest, blockEnds) {
+  StringRef Source = "#if A\n"
+                     "#ifdef B\n"
+                     "#else\n"
+                     "#endif\n"
+                     "#elif C\n"
+                     "  # else\n"
+                     "#endif\n";
+  LangOptions LangOpts;
+  auto Blocks = BruteClangConditionalScan::scan(Source, LangOpts);
+
+  // #if A ends at #elif C, which ends at # else, which ends at the last
+  // #endif. The nested blocks end at their own #else and #endif.
+  EXPECT_EQ(5u, Blocks->size());
+  EXPECT_EQ(Source.find("#elif"), Blocks->getEnd(Source.find("if A")));
+  EXPECT_EQ(Source.find("#else"), Blocks->getEnd(Source.find("ifdef")));
+  EXPECT_EQ(Source.find("#endif"), Blocks->getEnd(Source.find("else")));
+  EXPECT_EQ(Source.find("# else"), Blocks->getEnd(Source.find("elif")));
+  EXPECT_EQ(Source.rfind("#endif"),
+            Blocks->getEnd(Source.find("# else") + 2));
+  EXPECT_EQ(0u, Blocks->getEnd(0));
+}
+
+TEST(BruteClangConditionalScanTest, directivesHiddenFromScan) {
+  LangOptions LangOpts;
+  // Neither of these starts a line.
+  auto Blocks = BruteClangConditionalScan::scan("#if A\n"
+                                                "/* comment\n"
+                                                "#endif */ x #endif\n"
+                                                "#define S \"\\\n"
+                                                "#endif\"\n"
+                                                "#endif\n",
+                                                LangOpts);
+  EXPECT_EQ(1u, Blocks->size());
+
+  // The preprocessor diagnoses an #else after #else while skipping.
+  EXPECT_EQ(0u, BruteClangConditionalScan::scan("#if A\n"
+                                                "#if B\n"
+                                                "#else\n"
+                                                "#else\n"
+                                                "#endif\n"
+                                                "#endif\n",
+                                                LangOpts)
+                    ->size());
+
+  // An active #include lexes <a/*b> as a header name, a skipped one as the
+  // start of a comment.
+  EXPECT_EQ(0u, BruteClangConditionalScan::scan("#if A\n"
+                                                "#include <a/*b>\n"
+                                                "#endif\n",
+                                                LangOpts)
+                    ->size());
+}
+
+class BruteClangConditionalSkipTest : public ::testing::Test {
+protected:
+  BruteClangConditionalSkipTest()
+      : InMemoryFileSystem(new vfs::InMemoryFileSystem),
+        FileMgr(FileSystemOptions(), InMemoryFileSystem),
+        DiagID(new DiagnosticIDs()),
+        Diags(DiagID, new DiagnosticOptions, new IgnoringDiagConsumer()),
+        TargetOpts(new TargetOptions),
+        Scan(std::make_shared<BruteClangConditionalScan>()) {
+    TargetOpts->Triple = "x86_64-unknown-linux-gnu";
+    Target = TargetInfo::CreateTargetInfo(Diags, TargetOpts);
+  }
+
+  void addFile(StringRef Path, StringRef Contents) {
+    InMemoryFileSystem->addFile(Path, 0,
+                                llvm::MemoryBuffer::getMemBufferCopy(Contents));
+  }
+
+  /// Preprocess \p Path as a variant with the \p Predefines, sharing the
+  /// conditional blocks found by Scan if \p UseScan is set, and return the
+  /// spelling of each token.
+  std::vector<std::string> preprocess(StringRef Path, StringRef Predefines,
+                                      bool UseScan) {
+    SourceManager SourceMgr(Diags, FileMgr);
+    SourceMgr.setMainFileID(SourceMgr.createFileID(
+        FileMgr.getFile(Path), SourceLocation(), SrcMgr::C_User));
+
+    auto PPOpts = std::make_shared<PreprocessorOptions>();
+    if (UseScan)
+      PPOpts->ConditionalScan = Scan;
+    TrivialModuleLoader ModLoader;
+    MemoryBufferCache PCMCache;
+    HeaderSearch HeaderInfo(std::make_shared<HeaderSearchOptions>(),
+                            SourceMgr, Diags, LangOpts, Target.get());
+    Preprocessor PP(PPOpts, Diags, LangOpts, SourceMgr, PCMCache, HeaderInfo,
+                    ModLoader, /*IILookup =*/nullptr,
+                    /*OwnsHeaderSearch =*/false);
+    PP.Initialize(*Target);
+    PP.setPredefines(Predefines);
+    PP.EnterMainSourceFile();
+
+    std::vector<std::string> Spellings;
+    Token Tok;
+    for (PP.Lex(Tok); Tok.isNot(tok::eof); PP.Lex(Tok))
+      Spellings.push_back(PP.getSpelling(Tok));
+    return Spellings;
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> InMemoryFileSystem;
+  FileManager FileMgr;
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID;
+  DiagnosticsEngine Diags;
+  LangOptions LangOpts;
+  std::shared_ptr<TargetOptions> TargetOpts;
+  IntrusiveRefCntPtr<TargetInfo> Target;
+  std::shared_ptr<BruteClangConditionalScan> Scan;
+};
+
+TEST_F(BruteClangConditionalSkipTest, variantsJumpOverSkippedBlocks) {
+  std::string Body;
+  for (unsigned I = 0; I != 100; ++I)
+    Body += "int filler" + std::to_string(I) + ";\n";
+  addFile("/src/Target.cpp", "#if defined(X86)\n"
+                             "int x86;\n" +
+                                 Body +
+                                 "#ifdef NESTED\n"
+                                 "int nested;\n"
+                                 "#else\n"
+                                 "#endif\n"
+                                 "#elif defined(P)\n"
+                                 "int p;\n" +
+                                 Body +
+                                 "#else\n"
+                                 "int other;\n"
+                                 "#endif\n"
+                                 "int common;\n");
+
+  const char *Variants[] = {"#define X86 1\n", "#define P 1\n", ""};
+  for (const char *Predefines : Variants)
+    EXPECT_EQ(preprocess("/src/Target.cpp", Predefines, false),
+              preprocess("/src/Target.cpp", Predefines, true));
+
+  std::vector<std::string> P =
+      preprocess("/src/Target.cpp", Variants[1], true);
+  ASSERT_EQ(306u, P.size());
+  EXPECT_EQ("p", P[1]);
+  EXPECT_EQ("common", P[304]);
+
+  // The file is scanned once for all variants. X86 jumps over the nested
+  // #ifdef and the #elif and #else blocks, P (twice) over the #if and #else
+  // blocks, and the last variant over the #if and #elif blocks. Together they
+  // leave out five copies of the filler.
+  BruteClangConditionalScan::Statistics Stats = Scan->getStatistics();
+  EXPECT_EQ(1u, Stats.NumFilesScanned);
+  EXPECT_EQ(9u, Stats.NumJumps);
+  EXPECT_LT(5 * Body.size(), Stats.NumBytesSkipped);
+}
+
+} // end anonymous namespace
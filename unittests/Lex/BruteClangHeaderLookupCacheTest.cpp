@@ -0,0 +1,135 @@
+//===- unittests/Lex/BruteClangHeaderLookupCacheTest.cpp ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/BruteClangHeaderLookupCache.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+
+namespace {
+
+TEST(BruteClangHeaderLookupCacheTest, sharedSuffixes) {
+  BruteClangHeaderLookupCache Cache;
+  auto *Common = Cache.getSuffix("common", nullptr);
+  auto *Compiler = Cache.getSuffix("compiler", Common);
+  auto *X = Cache.getSuffix("x", Compiler);
+  auto *P = Cache.getSuffix("p", Compiler);
+
+  EXPECT_EQ(Compiler, Cache.getSuffix("compiler", Common));
+  EXPECT_NE(X, P);
+  EXPECT_EQ(3u, X->getLength());
+
+  // x, compiler, common: found in common.
+  std::vector<const BruteClangHeaderLookupCache::Suffix *> SearchList = {
+      X, Compiler, Common};
+  Cache.record(SearchList, 0, 2, "Util.hpp");
+
+  unsigned DirsToSkip;
+  ASSERT_TRUE(Cache.lookup(Compiler, "Util.hpp", DirsToSkip));
+  EXPECT_EQ(1u, DirsToSkip);
+  // Nothing is known about p itself.
+  EXPECT_FALSE(Cache.lookup(P, "Util.hpp", DirsToSkip));
+
+  // Found nowhere.
+  Cache.record(SearchList, 1, 3, "Missing.hpp");
+  ASSERT_TRUE(Cache.lookup(Compiler, "Missing.hpp", DirsToSkip));
+  EXPECT_EQ(2u, DirsToSkip);
+  EXPECT_FALSE(Cache.lookup(X, "Missing.hpp", DirsToSkip));
+}
+
+class BruteClangHeaderSearchTest : public ::testing::Test {
+protected:
+  BruteClangHeaderSearchTest()
+      : InMemoryFileSystem(new vfs::InMemoryFileSystem),
+        FileMgr(FileSystemOptions(), InMemoryFileSystem),
+        DiagID(new DiagnosticIDs()),
+        Diags(DiagID, new DiagnosticOptions, new IgnoringDiagConsumer()),
+        SourceMgr(Diags, FileMgr), TargetOpts(new TargetOptions),
+        Cache(std::make_shared<BruteClangHeaderLookupCache>()) {
+    TargetOpts->Triple = "x86_64-unknown-linux-gnu";
+    Target = TargetInfo::CreateTargetInfo(Diags, TargetOpts);
+  }
+
+  void addFile(StringRef Path) {
+    InMemoryFileSystem->addFile(Path, 0, llvm::MemoryBuffer::getMemBuffer(""));
+  }
+
+  /// Create the header search of a variant with -I \p Dirs.
+  std::unique_ptr<HeaderSearch> createVariant(ArrayRef<StringRef> Dirs) {
+    auto HSOpts = std::make_shared<HeaderSearchOptions>();
+    HSOpts->SharedLookupCache = Cache;
+    std::unique_ptr<HeaderSearch> HS(
+        new HeaderSearch(HSOpts, SourceMgr, Diags, LangOpts, Target.get()));
+    std::vector<DirectoryLookup> SearchDirs;
+    for (StringRef Dir : Dirs)
+      SearchDirs.push_back(DirectoryLookup(FileMgr.getDirectory(Dir),
+                                           SrcMgr::C_User, false));
+    HS->SetSearchPaths(SearchDirs, 0, SearchDirs.size(), false);
+    return HS;
+  }
+
+  StringRef lookup(HeaderSearch &HS, StringRef Filename) {
+    const DirectoryLookup *CurDir;
+    const FileEntry *FE = HS.LookupFile(Filename, SourceLocation(), true,
+                                        nullptr, CurDir, None, nullptr,
+                                        nullptr, nullptr, nullptr, nullptr);
+    return FE ? FE->getName() : "";
+  }
+
+  IntrusiveRefCntPtr<vfs::InMemoryFileSystem> InMemoryFileSystem;
+  FileManager FileMgr;
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID;
+  DiagnosticsEngine Diags;
+  SourceManager SourceMgr;
+  LangOptions LangOpts;
+  std::shared_ptr<TargetOptions> TargetOpts;
+  IntrusiveRefCntPtr<TargetInfo> Target;
+  std::shared_ptr<BruteClangHeaderLookupCache> Cache;
+};
+
+TEST_F(BruteClangHeaderSearchTest, leadingDirectoriesStillSearched) {
+  addFile("/omr/x/i386/Other.hpp");
+  addFile("/omr/z/Other.hpp");
+  addFile("/omr/x/Target.hpp");
+  addFile("/omr/p/Target.hpp");
+  addFile("/omr/compiler/Target.hpp");
+  addFile("/omr/compiler/Compiler.hpp");
+  addFile("/omr/Util.hpp");
+
+  auto I386 = createVariant({"/omr/x/i386", "/omr/x", "/omr/compiler", "/omr"});
+  auto P = createVariant({"/omr/p", "/omr/compiler", "/omr"});
+  auto Z = createVariant({"/omr/z", "/omr/compiler", "/omr"});
+
+  EXPECT_EQ("/omr/x/Target.hpp", lookup(*I386, "Target.hpp"));
+  EXPECT_EQ("/omr/compiler/Compiler.hpp", lookup(*I386, "Compiler.hpp"));
+  EXPECT_EQ("/omr/Util.hpp", lookup(*I386, "Util.hpp"));
+  EXPECT_EQ("", lookup(*I386, "Missing.hpp"));
+
+  // The shared tail of the search list was searched by the i386 variant
+  // already, but p's own directory must still take precedence.
+  EXPECT_EQ("/omr/p/Target.hpp", lookup(*P, "Target.hpp"));
+  EXPECT_EQ("/omr/compiler/Compiler.hpp", lookup(*P, "Compiler.hpp"));
+  EXPECT_EQ("/omr/Util.hpp", lookup(*P, "Util.hpp"));
+  EXPECT_EQ("", lookup(*P, "Missing.hpp"));
+
+  EXPECT_EQ("/omr/compiler/Target.hpp", lookup(*Z, "Target.hpp"));
+  EXPECT_EQ("/omr/Util.hpp", lookup(*Z, "Util.hpp"));
+}
+
+} // anonymous namespace
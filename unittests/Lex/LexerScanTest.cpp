@@ -0,0 +1,127 @@
+//===- unittests/Lex/LexerScanTest.cpp ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/LexerScan.h"
+#include "clang/Basic/CharInfo.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+typedef const char *(*ScanFunction)(const char *, const char *);
+
+struct ScanKind {
+  const char *Name;
+  ScanFunction Scan;
+  bool (*ContinuesRun)(unsigned char);
+  /// A character continuing the run, to fill the buffers with.
+  char Fill;
+};
+
+bool continuesLineComment(unsigned char C) {
+  return C != '\0' && C != '\n' && C != '\r';
+}
+
+bool continuesStringLiteral(unsigned char C) {
+  return continuesLineComment(C) && C != '"' && C != '\\' && C != '?';
+}
+
+const ScanKind Kinds[] = {
+    {"identifier", scanIdentifierBody,
+     [](unsigned char C) { return isIdentifierBody(C); }, 'a'},
+    {"whitespace", scanHorizontalWhitespace,
+     [](unsigned char C) { return isHorizontalWhitespace(C); }, ' '},
+    {"line comment", scanLineCommentBody, continuesLineComment, 'x'},
+    {"string literal", scanStringLiteralBody, continuesStringLiteral, 'x'},
+    {"number", scanNumberBody,
+     [](unsigned char C) { return isPreprocessingNumberBody(C); }, '1'},
+};
+
+/// The levels the host supports, widest last.
+std::vector<LexerScanLevel> getSupportedLevels() {
+  std::vector<LexerScanLevel> Levels;
+  for (int L = 0; L <= static_cast<int>(getHostLexerScanLevel()); ++L)
+    Levels.push_back(static_cast<LexerScanLevel>(L));
+  return Levels;
+}
+
+class LexerScanTest : public ::testing::Test {
+protected:
+  LexerScanTest() : SavedLevel(getLexerScanLevel()) {}
+  ~LexerScanTest() override { setLexerScanLevel(SavedLevel); }
+
+  LexerScanLevel SavedLevel;
+};
+
+// Every byte value, placed at every position of runs crossing the widths of
+// the vectors, ends each kind of run exactly when the scalar predicate says
+// so.
+TEST_F(LexerScanTest, StopsAtFirstCharacterEndingRun) {
+  for (LexerScanLevel Level : getSupportedLevels()) {
+    setLexerScanLevel(Level);
+    for (const ScanKind &Kind : Kinds) {
+      for (unsigned C = 0; C != 256; ++C) {
+        bool Continues = Kind.ContinuesRun(static_cast<unsigned char>(C));
+        for (unsigned Pos = 0; Pos != 140; ++Pos) {
+          std::string Buffer(150, Kind.Fill);
+          Buffer[Pos] = static_cast<char>(C);
+          const char *Begin = Buffer.data();
+          const char *End = Begin + Buffer.size();
+          const char *Expected = Continues ? End : Begin + Pos;
+          ASSERT_EQ(Expected, Kind.Scan(Begin, End))
+              << Kind.Name << ", level " << static_cast<int>(Level)
+              << ", character " << C << " at " << Pos;
+        }
+      }
+    }
+  }
+}
+
+// Runs reaching the end of the range stop there, from every start and for
+// every length, however many characters of the run follow it.
+TEST_F(LexerScanTest, StopsAtEndOfRange) {
+  for (LexerScanLevel Level : getSupportedLevels()) {
+    setLexerScanLevel(Level);
+    for (const ScanKind &Kind : Kinds) {
+      std::string Buffer(200, Kind.Fill);
+      const char *Begin = Buffer.data();
+      for (unsigned Start = 0; Start != 70; ++Start)
+        for (unsigned Length = 0; Length != 130; ++Length)
+          ASSERT_EQ(Begin + Start + Length,
+                    Kind.Scan(Begin + Start, Begin + Start + Length))
+              << Kind.Name << ", level " << static_cast<int>(Level)
+              << ", from " << Start << " for " << Length;
+    }
+  }
+}
+
+TEST_F(LexerScanTest, StopsAtNullTerminator) {
+  std::string Source = "identifier_body_longer_than_sixteen_bytes";
+  for (LexerScanLevel Level : getSupportedLevels()) {
+    setLexerScanLevel(Level);
+    const char *Begin = Source.c_str();
+    const char *End = Begin + Source.size();
+    EXPECT_EQ(End, scanIdentifierBody(Begin, End));
+    EXPECT_EQ(End, scanLineCommentBody(Begin, End));
+    EXPECT_EQ(End, scanStringLiteralBody(Begin, End));
+    EXPECT_EQ(Begin, scanHorizontalWhitespace(Begin, End));
+  }
+}
+
+TEST_F(LexerScanTest, SetLevelIsUsed) {
+  for (LexerScanLevel Level : getSupportedLevels()) {
+    setLexerScanLevel(Level);
+    EXPECT_EQ(Level, getLexerScanLevel());
+  }
+}
+
+} // anonymous namespace
@@ -18,6 +18,7 @@
 #include "clang/Basic/TargetOptions.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/LexerScan.h"
 #include "clang/Lex/MacroArgs.h"
 #include "clang/Lex/MacroInfo.h"
 #include "clang/Lex/ModuleLoader.h"
@@ -420,4 +421,31 @@ TEST_F(LexerTest, DontOverallocateStringifyArgs) {
 #endif
 }
 
+// Tokens longer than the vectors the lexer scans with lex alike at every
+// level, including where an escaped newline interrupts a run.
+TEST_F(LexerTest, LongRunsLexAtEveryScanLevel) {
+  std::string Identifier(70, 'i');
+  std::string Source = Identifier + "    \t          \t                  " +
+                       "\"" + std::string(40, 's') + "\\\"" +
+                       std::string(30, 's') + "\" 1234567890123456789.5e+10" +
+                       "  // " + std::string(80, 'c') + "\\\n" +
+                       std::string(20, 'c') + "\n" + Identifier + "\\\n" +
+                       Identifier + "\n";
+  std::vector<tok::TokenKind> ExpectedTokens = {
+      tok::identifier, tok::string_literal, tok::numeric_constant,
+      tok::identifier};
+
+  LexerScanLevel SavedLevel = getLexerScanLevel();
+  for (int L = 0; L <= static_cast<int>(getHostLexerScanLevel()); ++L) {
+    setLexerScanLevel(static_cast<LexerScanLevel>(L));
+    std::vector<Token> toks = CheckLex(Source, ExpectedTokens);
+    ASSERT_EQ(4U, toks.size());
+    EXPECT_EQ(70U, toks[0].getLength());
+    EXPECT_EQ(74U, toks[1].getLength());
+    EXPECT_EQ(25U, toks[2].getLength());
+    EXPECT_EQ(142U, toks[3].getLength());
+  }
+  setLexerScanLevel(SavedLevel);
+}
+
 } // anonymous namespace